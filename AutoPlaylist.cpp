@@ -21,80 +21,466 @@
 #include <vector>
 #include <algorithm>
 #include <locale>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include <dirent.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
 
-#include "utils/RegExp.h"
 #include "AutoPlaylist.h"
 
 using namespace std;
 
-void AutoPlaylist::readPlaylist(string &filename)
+// Enough for the demuxer to probe the container and find its streams
+#define PREFETCH_BYTES (2 * 1024 * 1024)
+
+// sorted, for binary_search
+static const char *video_extensions[] = {
+	"3g2", "3gp", "amv", "asf", "avi", "dmg", "drc", "f4a", "f4b", "f4p", "f4v",
+	"flv", "iso", "m2ts", "m2v", "m4p", "m4v", "mkv", "mov", "mp2", "mp4", "mpe",
+	"mpeg", "mpg", "mpv", "mts", "mxf", "nsv", "ogg", "ogv", "qt", "rm", "rmvb",
+	"roq", "svi", "ts", "vob", "webm", "wmv", "yuv"
+};
+
+AutoPlaylist::AutoPlaylist()
+{
+	// In English and most other European langauges, this should sort by lower case without
+	// regard to diacritics
+	try {
+		loc = locale("");
+	} catch(runtime_error &) {
+		loc = locale::classic();
+	}
+}
+
+AutoPlaylist::~AutoPlaylist()
+{
+	if(m_prefetch.Running())
+		m_prefetch.StopThread();
+
+	updateCache();
+	reset();
+}
+
+void AutoPlaylist::reset()
 {
-	// reset object
 	playlist_pos = -1;
 	playlist.clear();
+	keys.clear();
 	dirname.clear();
+	current.clear();
+	current_key.clear();
+	current_removed = false;
+	changed = false;
 
-    int pos = filename.find_last_of('/');
-    dirname = filename.substr(0, pos+1); // including trailing slash
-    string basename = filename.substr(pos+1);
+	if(inotify_fd != -1) {
+		close(inotify_fd);
+		inotify_fd = -1;
+	}
+}
 
-	DIR *dir;
-	struct dirent *ent;
-	if ((dir = opendir(dirname.c_str())) == NULL) {
+void AutoPlaylist::readPlaylist(string &filename)
+{
+	reset();
+
+	int pos = filename.find_last_of('/');
+	dirname = filename.substr(0, pos+1); // including trailing slash
+	current = filename.substr(pos+1);
+
+	// Quit if file being played doesn't have one of the above filename extensions
+	if(!hasVideoExtension(current)) {
+		puts("Disabling playlist as filename extension not recognised");
+		reset();
+		return;
+	}
+
+	// watch first, so changes made while the directory is read aren't missed
+	watchDirectory();
+
+	struct stat st;
+	if(stat(dirname.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
 		puts("Failed to open directory for reading");
+		reset();
 		return;
 	}
+	dir_mtime = st.st_mtim;
 
-	// re for filename match
-	CRegExp fnameext_match = CRegExp(true);
-	fnameext_match.RegComp("\\.(3g2|3gp|amv|asf|avi|drc|f4a|f4b|f4p|f4v|flv|"
-		"m2ts|m2v|m4p|m4v|mkv|mov|mp2|mp4|mpe|mpeg|mpg|mpv|mts|mxf|nsv|ogg|"
-		"ogv|qt|rm|rmvb|roq|svi|ts|vob|webm|wmv|yuv|iso|dmg)$");
+	if(loadCache() && findCurrent())
+		return;
 
-	// Quit if file being played doesn't have one of the above filename extensions
-	if(fnameext_match.RegFind(basename, 0) == -1) {
-		puts("Disabling playlist as filename extension not recognised");
+	if(!scanDirectory()) {
+		puts("Failed to open directory for reading");
+		reset();
+		return;
+	}
+
+	if(!findCurrent()) {
+		// strange error
+		puts("Weird error");
+		reset();
+		return;
+	}
+
+	saveCache();
+}
+
+bool AutoPlaylist::ChangeFile(int delta, string &filename)
+{
+	if(playlist_pos < 0)
+		return false;
+
+	applyChanges();
+
+	// if the file has been removed playlist_pos is already on the next one
+	int npos = playlist_pos + delta;
+	if(current_removed && delta > 0)
+		npos--;
+
+	if(npos < 0 || npos >= (int)playlist.size())
+		return false;
+
+	playlist_pos = npos;
+	current = playlist[playlist_pos];
+	current_key = keys.empty() ? string() : keys[playlist_pos];
+	current_removed = false;
+
+	filename = dirname + current;
+	return true;
+}
+
+void AutoPlaylist::prefetchNext()
+{
+	if(playlist_pos < 0)
+		return;
+
+	applyChanges();
+
+	int next = current_removed ? playlist_pos : playlist_pos + 1;
+	if(next >= (int)playlist.size())
 		return;
+
+	if(m_prefetch.Running())
+		m_prefetch.StopThread();
+
+	m_prefetch.filename = dirname + playlist[next];
+	m_prefetch.Create();
+}
+
+void AutoPlaylist::PrefetchThread::Process()
+{
+	// only use the disk when playback isn't waiting on it
+	struct sched_param param = {0};
+	pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+
+	int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd == -1)
+		return;
+
+	posix_fadvise(fd, 0, PREFETCH_BYTES, POSIX_FADV_WILLNEED);
+
+	// network filesystems don't all act on the advice, so read it as well
+	char buf[64 * 1024];
+	for(int done = 0; done < PREFETCH_BYTES && !m_bStop; ) {
+		ssize_t n = read(fd, buf, sizeof(buf));
+		if(n <= 0) break;
+		done += n;
 	}
 
+	close(fd);
+}
+
+bool AutoPlaylist::scanDirectory()
+{
+	playlist.clear();
+	keys.clear();
+
+	DIR *dir;
+	struct dirent *ent;
+	if ((dir = opendir(dirname.c_str())) == NULL)
+		return false;
+
+	vector<pair<string, string> > entries;
 	while ((ent = readdir(dir)) != NULL) {
-		if(ent->d_type != 4 && ent->d_name[0] != '.' &&
-				fnameext_match.RegFind(ent->d_name, 0) > -1) {
+		if(ent->d_type != DT_DIR && ent->d_name[0] != '.' && hasVideoExtension(ent->d_name))
+			entries.emplace_back(collationKey(ent->d_name), ent->d_name);
+	}
+	closedir(dir);
+
+	// comparing keys is a plain string compare, the locale is only used
+	// once per name to make them
+	sort(entries.begin(), entries.end());
+
+	playlist.reserve(entries.size());
+	keys.reserve(entries.size());
+	for(auto &e : entries) {
+		keys.push_back(move(e.first));
+		playlist.push_back(move(e.second));
+	}
+
+	if(!current.empty())
+		current_key = collationKey(current);
+
+	return true;
+}
+
+bool AutoPlaylist::findCurrent()
+{
+	// a plain search doesn't need keys, which a cached listing hasn't got
+	auto it = find(playlist.begin(), playlist.end(), current);
+	if(it == playlist.end())
+		return false;
+
+	playlist_pos = it - playlist.begin();
+	current_removed = false;
+	return true;
+}
+
+// Format: "<mtime seconds> <mtime nanoseconds> <locale>", the directory,
+// then the names in order, one per line
+bool AutoPlaylist::loadCache()
+{
+	playlist.clear();
+	keys.clear();
+
+	ifstream s(cacheFile());
+	if(!s.is_open()) return false;
+
+	string line, dir, locale_name;
+	long long sec, nsec;
+	if(!getline(s, line)) return false;
+
+	istringstream is(line);
+	if(!(is >> sec >> nsec) || is.get() != ' ' || !getline(is, locale_name))
+		return false;
+
+	if(sec != dir_mtime.tv_sec || nsec != dir_mtime.tv_nsec || locale_name != loc.name())
+		return false;
+
+	if(!getline(s, dir) || dir != dirname)
+		return false;
 
-			playlist.push_back(ent->d_name);
+	while(getline(s, line)) {
+		// a torn write has no newline
+		if(s.eof()) {
+			playlist.clear();
+			return false;
 		}
+		playlist.push_back(line);
 	}
 
-	// In English and most other European langauges, this should sort by lower case without
-	// regard to diacritics
-	const locale loc = locale("");
-	sort(playlist.begin(), playlist.end(), loc);
+	return true;
+}
 
-	// search for file we started with
-	for(uint i = 0; i < playlist.size(); i++) {
-		if(playlist[i] == basename) {
-			playlist_pos = i;
+void AutoPlaylist::saveCache()
+{
+	if(dirname.find('\n') != string::npos)
+		return;
+	for(const string &name : playlist)
+		if(name.find('\n') != string::npos)
 			return;
+
+	string filename = cacheFile();
+	string tmp = filename + ".tmp";
+
+	ofstream s(tmp, ios::trunc);
+	if(!s.is_open()) return;
+
+	s << (long long)dir_mtime.tv_sec << ' ' << (long long)dir_mtime.tv_nsec << ' '
+		<< loc.name() << '\n' << dirname << '\n';
+	for(const string &name : playlist)
+		s << name << '\n';
+	s.close();
+
+	if(s.fail() || rename(tmp.c_str(), filename.c_str()) != 0)
+		remove(tmp.c_str());
+
+	changed = false;
+}
+
+void AutoPlaylist::updateCache()
+{
+	if(inotify_fd == -1 || playlist_pos < 0)
+		return;
+
+	// Any change made before the stat is already queued. One made after it
+	// is applied too, but leaves the cached mtime behind so the directory
+	// is read again next time.
+	struct stat st;
+	if(stat(dirname.c_str(), &st) != 0)
+		return;
+
+	applyChanges();
+
+	if(changed && inotify_fd != -1) {
+		dir_mtime = st.st_mtim;
+		saveCache();
+	}
+}
+
+void AutoPlaylist::watchDirectory()
+{
+	inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(inotify_fd == -1)
+		return;
+
+	if(inotify_add_watch(inotify_fd, dirname.c_str(),
+			IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR) == -1) {
+		close(inotify_fd);
+		inotify_fd = -1;
+	}
+}
+
+void AutoPlaylist::applyChanges()
+{
+	if(inotify_fd == -1)
+		return;
+
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	bool overflow = false;
+	bool gone = false;
+	ssize_t len;
+
+	while((len = read(inotify_fd, buf, sizeof(buf))) > 0) {
+		for(char *p = buf; p < buf + len; ) {
+			const struct inotify_event *ev = (const struct inotify_event *)p;
+			p += sizeof(struct inotify_event) + ev->len;
+
+			if(ev->mask & IN_Q_OVERFLOW)
+				overflow = true;
+			if(ev->mask & IN_IGNORED)
+				gone = true;
+
+			if(ev->len == 0 || (ev->mask & IN_ISDIR))
+				continue;
+
+			string name(ev->name);
+			if(name[0] == '.' || !hasVideoExtension(name))
+				continue;
+
+			if(ev->mask & (IN_CREATE | IN_MOVED_TO))
+				addFile(name);
+			else if(ev->mask & (IN_DELETE | IN_MOVED_FROM))
+				removeFile(name);
 		}
 	}
 
-	// strange error
-	puts("Weird error");
-	playlist.clear();
+	// events were dropped, so start again from the directory itself
+	if(overflow && !gone && scanDirectory()) {
+		changed = true;
+		playlist_pos = lowerBound(current_key, current);
+		current_removed = playlist_pos == (int)playlist.size() || playlist[playlist_pos] != current;
+	}
+
+	// the directory has been removed or unmounted, keep what we have
+	if(gone) {
+		close(inotify_fd);
+		inotify_fd = -1;
+	}
 }
 
-bool AutoPlaylist::ChangeFile(int delta, string &filename)
+void AutoPlaylist::addFile(const string &name)
 {
-	int npos = playlist_pos + delta;
-	int last_index = playlist.size() - 1;
+	makeKeys();
+
+	string key = collationKey(name);
+	int i = lowerBound(key, name);
+	if(i < (int)playlist.size() && playlist[i] == name)
+		return;
+
+	bool before = beforeCurrent(key, name);
+
+	playlist.insert(playlist.begin() + i, name);
+	keys.insert(keys.begin() + i, move(key));
+	changed = true;
+
+	if(current_removed && name == current)
+		current_removed = false;
+	else if(before)
+		playlist_pos++;
+}
+
+void AutoPlaylist::removeFile(const string &name)
+{
+	makeKeys();
+
+	int i = lowerBound(collationKey(name), name);
+	if(i == (int)playlist.size() || playlist[i] != name)
+		return;
+
+	playlist.erase(playlist.begin() + i);
+	keys.erase(keys.begin() + i);
+	changed = true;
+
+	if(i < playlist_pos)
+		playlist_pos--;
+	else if(i == playlist_pos && !current_removed)
+		current_removed = true;
+}
+
+// Index of the first entry which doesn't sort before key and name
+int AutoPlaylist::lowerBound(const string &key, const string &name)
+{
+	int lo = 0, hi = playlist.size();
+	while(lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		int c = keys[mid].compare(key);
+		if(c < 0 || (c == 0 && playlist[mid] < name))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+bool AutoPlaylist::beforeCurrent(const string &key, const string &name)
+{
+	int c = key.compare(current_key);
+	return c < 0 || (c == 0 && name < current);
+}
+
+void AutoPlaylist::makeKeys()
+{
+	if(keys.size() != playlist.size()) {
+		keys.clear();
+		keys.reserve(playlist.size());
+		for(const string &name : playlist)
+			keys.push_back(collationKey(name));
+	}
 
-	if(npos < 0 || npos > last_index)
+	if(current_key.empty())
+		current_key = collationKey(current);
+}
+
+string AutoPlaylist::collationKey(const string &name)
+{
+	const collate<char> &coll = use_facet<collate<char> >(loc);
+	return coll.transform(name.data(), name.data() + name.size());
+}
+
+bool AutoPlaylist::hasVideoExtension(const string &name)
+{
+	size_t dot = name.find_last_of('.');
+	if(dot == string::npos || name.size() - dot - 1 > 4)
 		return false;
 
-	playlist_pos = npos;
+	string ext = name.substr(dot + 1);
+	for(char &c : ext)
+		c = tolower((unsigned char)c);
 
-	filename = dirname + playlist[playlist_pos];
-	return true;
+	return binary_search(begin(video_extensions), end(video_extensions), ext.c_str(),
+		[](const char *a, const char *b) { return strcmp(a, b) < 0; });
+}
+
+string AutoPlaylist::cacheFile()
+{
+	return string(getenv("HOME")) + "/.omxplayer_playlist_cache";
 }
@@ -20,17 +20,72 @@
 
 #include <string>
 #include <vector>
+#include <locale>
+#include <time.h>
+
+#include "OMXThread.h"
 
 using namespace std;
 
+// The video files in the directory of the file being played, in collation
+// order. The sorted listing is kept in ~/.omxplayer_playlist_cache along
+// with the directory's mtime, so starting another file from an unchanged
+// directory doesn't read and sort it again. While playing, changes to the
+// directory are picked up through inotify and applied to the sorted list
+// one entry at a time, and the cache is brought up to date on exit.
 class AutoPlaylist
 {
 public:
+	AutoPlaylist();
+	~AutoPlaylist();
+
 	void readPlaylist(string &indexfilepath);
 	bool ChangeFile(int delta, string &filename);
 
+	// Reads the start of the next file in the background, so opening it
+	// doesn't have to wait for the disk or network share
+	void prefetchNext();
+
 private:
+	class PrefetchThread : public OMXThread
+	{
+	public:
+		void Process() override;
+		string filename;
+	};
+
+	void reset();
+	bool scanDirectory();
+	bool loadCache();
+	void saveCache();
+	void updateCache();
+	void watchDirectory();
+	void applyChanges();
+	void addFile(const string &name);
+	void removeFile(const string &name);
+	bool findCurrent();
+	int lowerBound(const string &key, const string &name);
+	bool beforeCurrent(const string &key, const string &name);
+	void makeKeys();
+	string collationKey(const string &name);
+	static bool hasVideoExtension(const string &name);
+	static string cacheFile();
+
+	// playlist[i] sorts by keys[i], which are only made once an entry has
+	// to be looked up or inserted
 	vector<string> playlist;
+	vector<string> keys;
 	int playlist_pos = -1;
 	string dirname;
+	// the file last returned, which may have been removed since. If so
+	// playlist_pos is where it would be inserted.
+	string current;
+	string current_key;
+	bool current_removed = false;
+	// the list has changed since the cache was written
+	bool changed = false;
+	struct timespec dir_mtime;
+	locale loc;
+	int inotify_fd = -1;
+	PrefetchThread m_prefetch;
 };
@@ -0,0 +1,406 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <fstream>
+
+#include "ClockSync.h"
+#include "KeyConfig.h"
+#include "utils/log.h"
+#include "utils/Strprintf.h"
+
+#define SYNC_MAGIC 0x53584d4f // "OMXS"
+#define SYNC_PORT "4242"
+
+// the leader's user pause, and its clock waiting for data
+#define SYNC_PAUSED  1
+#define SYNC_STOPPED 2
+
+// SYNC_NORMAL_SPEED
+#define SYNC_NORMAL_SPEED 1000
+
+// How often the leader sends its clock
+#define SYNC_INTERVAL 100000
+// Followers play on by themselves when the leader has been quiet this long
+#define SYNC_TIMEOUT 1000000
+// Offsets beyond this are seeked away rather than slewed
+#define SYNC_SEEK_OFFSET 1000000
+// Offsets aren't acted on this long after a seek
+#define SYNC_SETTLE 2000000
+// How often followers log their offsets
+#define SYNC_REPORT_INTERVAL 10000000
+
+ClockSync::ClockSync()
+: m_fd(-1), m_leader(false), m_host(0),
+  m_seq(0), m_last_sent(0), m_last_flags(0),
+  m_have_last(false), m_last_received(0), m_settle_until(0), m_speed(SYNC_NORMAL_SPEED),
+  m_seek_lead(0), m_seeked(false), m_pending(KeyConfig::ACTION_BLANK), m_seeks(0)
+{
+  memset(&m_addr, 0, sizeof(m_addr));
+  memset(&m_last, 0, sizeof(m_last));
+}
+
+ClockSync::~ClockSync()
+{
+  Close();
+}
+
+bool ClockSync::Resolve(const std::string &address, struct sockaddr_in &addr)
+{
+  std::string host = address, port = SYNC_PORT;
+  size_t colon = address.rfind(':');
+  if (colon != std::string::npos)
+  {
+    host = address.substr(0, colon);
+    port = address.substr(colon + 1);
+  }
+
+  struct addrinfo hints, *res;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  int err = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+  if (err != 0)
+  {
+    CLog::Log(LOGERROR, "ClockSync: %s: %s", address.c_str(), gai_strerror(err));
+    return false;
+  }
+
+  memcpy(&addr, res->ai_addr, sizeof(addr));
+  freeaddrinfo(res);
+  return true;
+}
+
+// Monotonic times can only be compared between processes of one boot
+uint64_t ClockSync::HostId()
+{
+  std::string id;
+  std::ifstream s("/proc/sys/kernel/random/boot_id");
+  getline(s, id);
+
+  uint64_t hash = 14695981039346656037ULL;
+  for (char c : id)
+    hash = (hash ^ (unsigned char)c) * 1099511628211ULL;
+  return hash;
+}
+
+int64_t ClockSync::RealTime()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// The clock of OMXClock::GetAbsoluteClock()
+int64_t ClockSync::MonotonicTime()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+bool ClockSync::Lead(const std::string &address)
+{
+  Close();
+  if (!Resolve(address, m_addr))
+    return false;
+
+  m_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (m_fd == -1)
+  {
+    CLog::Log(LOGERROR, "ClockSync: socket(): %s", strerror(errno));
+    return false;
+  }
+
+  // followers are on the local network, or on this host
+  int ttl = 1, yes = 1;
+  setsockopt(m_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+  setsockopt(m_fd, IPPROTO_IP, IP_MULTICAST_LOOP, &yes, sizeof(yes));
+  setsockopt(m_fd, SOL_SOCKET, SO_BROADCAST, &yes, sizeof(yes));
+
+  m_leader = true;
+  m_host = HostId();
+  return true;
+}
+
+bool ClockSync::Follow(const std::string &address)
+{
+  Close();
+  if (!Resolve(address, m_addr))
+    return false;
+
+  m_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (m_fd == -1)
+  {
+    CLog::Log(LOGERROR, "ClockSync: socket(): %s", strerror(errno));
+    return false;
+  }
+
+  // several followers can share a host
+  int yes = 1;
+  setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+  struct sockaddr_in any = m_addr;
+  any.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(m_fd, (struct sockaddr *)&any, sizeof(any)) != 0)
+  {
+    CLog::Log(LOGERROR, "ClockSync: bind(): %s", strerror(errno));
+    Close();
+    return false;
+  }
+
+  if (IN_MULTICAST(ntohl(m_addr.sin_addr.s_addr)))
+  {
+    struct ip_mreq mreq;
+    mreq.imr_multiaddr = m_addr.sin_addr;
+    mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (setsockopt(m_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) != 0)
+    {
+      CLog::Log(LOGERROR, "ClockSync: IP_ADD_MEMBERSHIP: %s", strerror(errno));
+      Close();
+      return false;
+    }
+  }
+
+  m_leader = false;
+  m_host = HostId();
+  return true;
+}
+
+void ClockSync::Close()
+{
+  if (m_fd != -1)
+  {
+    close(m_fd);
+    m_fd = -1;
+  }
+  m_have_last = false;
+  m_pending = KeyConfig::ACTION_BLANK;
+}
+
+int ClockSync::Update(Clock *clock, bool paused, int64_t &arg)
+{
+  m_pending = KeyConfig::ACTION_BLANK;
+  if (m_fd == -1 || !clock)
+    return KeyConfig::ACTION_BLANK;
+
+  if (m_leader)
+  {
+    Send(clock, paused);
+    return KeyConfig::ACTION_BLANK;
+  }
+
+  if (Receive())
+  {
+    m_pending = Adjust(clock, paused, arg);
+    return m_pending;
+  }
+
+  // the leader went away, so play on at normal speed
+  if (m_have_last && MonotonicTime() - m_last_received > SYNC_TIMEOUT)
+  {
+    CLog::Log(LOGWARNING, "ClockSync: lost the leader");
+    SetSpeed(clock, SYNC_NORMAL_SPEED);
+    m_have_last = false;
+  }
+  return KeyConfig::ACTION_BLANK;
+}
+
+void ClockSync::Send(Clock *clock, bool paused)
+{
+  uint32_t flags = (paused ? SYNC_PAUSED : 0) | (clock->Waiting() ? SYNC_STOPPED : 0);
+  int64_t now = MonotonicTime();
+
+  // a pause is passed on straight away
+  if (now - m_last_sent < SYNC_INTERVAL && flags == m_last_flags)
+    return;
+
+  Packet p;
+  memset(&p, 0, sizeof(p));
+  p.magic      = SYNC_MAGIC;
+  p.seq        = m_seq++;
+  p.host       = m_host;
+  p.media_time = clock->MediaTime();
+  p.monotonic  = MonotonicTime();
+  p.realtime   = RealTime();
+  p.speed      = clock->Speed();
+  p.flags      = flags;
+
+  if (sendto(m_fd, &p, sizeof(p), MSG_DONTWAIT, (struct sockaddr *)&m_addr, sizeof(m_addr)) < 0)
+    CLog::Log(LOGDEBUG, "ClockSync: sendto(): %s", strerror(errno));
+
+  m_last_sent = now;
+  m_last_flags = flags;
+}
+
+bool ClockSync::Receive()
+{
+  // only the latest clock of the leader matters
+  bool received = false;
+  Packet p;
+  while (recv(m_fd, &p, sizeof(p), 0) == sizeof(p))
+  {
+    if (p.magic != SYNC_MAGIC)
+      continue;
+    m_last = p;
+    received = true;
+  }
+
+  if (received)
+  {
+    m_have_last = true;
+    m_last_received = MonotonicTime();
+  }
+  return received;
+}
+
+int ClockSync::Adjust(Clock *clock, bool paused, int64_t &arg)
+{
+  bool leader_paused = m_last.flags & SYNC_PAUSED;
+  if (leader_paused != paused)
+    return leader_paused ? KeyConfig::ACTION_PAUSE : KeyConfig::ACTION_PLAY;
+
+  int64_t now = MonotonicTime();
+  int speed = clock->Speed();
+
+  // nothing to compare while either clock waits for data, and a speed set
+  // on this player by hand isn't fought
+  if (paused || m_last.media_time == 0 || clock->Waiting() || now < m_settle_until ||
+      (speed != m_speed && speed != SYNC_NORMAL_SPEED))
+    return KeyConfig::ACTION_BLANK;
+
+  int64_t media_time = clock->MediaTime();
+  int64_t since = m_last.host == m_host ? MonotonicTime() - m_last.monotonic
+                                        : RealTime() - m_last.realtime;
+  int64_t leader = m_last.media_time;
+  if (!(m_last.flags & SYNC_STOPPED))
+    leader += since * m_last.speed / SYNC_NORMAL_SPEED;
+
+  // positive when this player is ahead
+  int64_t offset = media_time - leader;
+
+  if (llabs(offset) >= SYNC_SEEK_OFFSET)
+  {
+    CLog::Log(LOGINFO, "ClockSync: %.3f s off the leader, seeking", offset * 1e-6);
+    arg = leader + m_seek_lead;
+    return KeyConfig::ACTION_SEEK_ABSOLUTE;
+  }
+
+  // a seek lands behind by the time it takes to refill the buffers
+  if (m_seeked)
+  {
+    m_seek_lead = std::min(std::max(m_seek_lead - offset, (int64_t)0), (int64_t)SYNC_SEEK_OFFSET / 2);
+    m_seeked = false;
+  }
+
+  m_total.Add(offset);
+  m_recent.Add(offset);
+  if (m_recent.samples == SYNC_REPORT_INTERVAL / SYNC_INTERVAL)
+  {
+    CLog::Log(LOGINFO, "ClockSync: %s", m_recent.Summary(m_seeks).c_str());
+    m_recent.Reset();
+  }
+
+  // as with --live, in steps so the audio isn't resampled more than needed
+  int64_t off = llabs(offset);
+  int step = 0;
+  if (off >= 100000)
+    step = 50;
+  else if (off >= 10000)
+    step = 10;
+  else if (off >= 1000)
+    step = 1;
+  SetSpeed(clock, SYNC_NORMAL_SPEED + (offset > 0 ? -step : step));
+  return KeyConfig::ACTION_BLANK;
+}
+
+void ClockSync::Taken(Clock *clock)
+{
+  if (m_pending == KeyConfig::ACTION_BLANK)
+    return;
+
+  if (m_pending == KeyConfig::ACTION_SEEK_ABSOLUTE)
+  {
+    m_seeks++;
+    m_seeked = true;
+    m_settle_until = MonotonicTime() + SYNC_SETTLE;
+  }
+  SetSpeed(clock, SYNC_NORMAL_SPEED);
+  m_pending = KeyConfig::ACTION_BLANK;
+}
+
+void ClockSync::SetSpeed(Clock *clock, int speed)
+{
+  if (speed == m_speed && speed == clock->Speed())
+    return;
+
+  clock->SetSpeed(speed);
+  m_speed = speed;
+}
+
+void ClockSync::Offsets::Reset()
+{
+  samples = 0;
+  sum = 0;
+  sum_squares = 0;
+  max = 0;
+  memset(histogram, 0, sizeof(histogram));
+}
+
+void ClockSync::Offsets::Add(int64_t offset)
+{
+  int64_t off = llabs(offset);
+  samples++;
+  sum += offset;
+  sum_squares += (double)offset * offset;
+  if (off > max)
+    max = off;
+  histogram[std::min(off / 1000, (int64_t)HISTOGRAM_SIZE - 1)]++;
+}
+
+std::string ClockSync::Offsets::Summary(int64_t seeks)
+{
+  if (samples == 0)
+    return strprintf("no offsets measured, %lld seeks", (long long)seeks);
+
+  // the offset in whole milliseconds that n of the samples are within
+  auto percentile = [&](int64_t n) {
+    int64_t count = 0;
+    for (int i = 0; i < HISTOGRAM_SIZE; i++)
+      if ((count += histogram[i]) >= n)
+        return i + 1;
+    return HISTOGRAM_SIZE;
+  };
+
+  double mean = sum / samples;
+  double stddev = sqrt(std::max(sum_squares / samples - mean * mean, 0.0));
+  return strprintf("%lld offsets, mean %.2f ms, stddev %.2f ms, 50%% within %d ms, 95%% within %d ms, max %.2f ms, %lld seeks",
+                   (long long)samples, mean * 1e-3, stddev * 1e-3,
+                   percentile((samples + 1) / 2), percentile((samples * 95 + 99) / 100),
+                   max * 1e-3, (long long)seeks);
+}
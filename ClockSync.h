@@ -0,0 +1,133 @@
+#pragma once
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <stdint.h>
+#include <netinet/in.h>
+#include <string>
+
+// Keeps several players in step. The leader sends its media time with the
+// time it was read at to a UDP address, usually a multicast group, and the
+// followers slew the speed of their clock until their media time matches,
+// as --live does to hold the latency. Followers pause and resume with the
+// leader and seek when they're too far off to catch up.
+//
+// The media time is stamped with both the monotonic and the real time.
+// Followers on the leader's host use the monotonic time; elsewhere the
+// real time is used, so those hosts' clocks have to be kept in step with
+// NTP or PTP.
+class ClockSync
+{
+public:
+  struct Packet
+  {
+    uint32_t magic;
+    uint32_t seq;
+    uint64_t host;        // hash of the boot id
+    int64_t  media_time;  // microseconds
+    int64_t  monotonic;   // CLOCK_MONOTONIC in microseconds when media_time was read
+    int64_t  realtime;    // CLOCK_REALTIME in microseconds at the same time
+    int32_t  speed;       // 1000 is normal speed
+    uint32_t flags;
+  };
+
+  // What's used of the player's clock, so the sync can be run without one
+  class Clock
+  {
+  public:
+    virtual ~Clock() {}
+    virtual int64_t MediaTime() = 0;
+    virtual int Speed() = 0;    // 1000 is normal speed
+    virtual bool Waiting() = 0; // stopped until there's data
+    virtual void SetSpeed(int speed) = 0;
+  };
+
+  ClockSync();
+  ~ClockSync();
+
+  // address is host:port
+  bool Lead(const std::string &address);
+  bool Follow(const std::string &address);
+  void Close();
+  bool IsOpen() { return m_fd != -1; }
+
+  // Called on each check of the main loop. The leader sends its clock, a
+  // follower adjusts its own and returns the KeyConfig action the player
+  // has to take to keep up, with the position to seek to in arg.
+  int Update(Clock *clock, bool paused, int64_t &arg);
+  // Called when the action returned by Update is taken. A key or D-Bus
+  // command in the same pass goes first, and the action is asked for
+  // again on the next pass.
+  void Taken(Clock *clock);
+
+  // A summary of the offsets from the leader seen so far
+  std::string Stats() { return m_total.Summary(m_seeks); }
+  bool IsFollower() { return m_fd != -1 && !m_leader; }
+
+private:
+  // |offset| histogram in milliseconds, the last bucket holds the rest
+  struct Offsets
+  {
+    static const int HISTOGRAM_SIZE = 1001;
+    int64_t  samples;
+    double   sum;
+    double   sum_squares;
+    int64_t  max;
+    uint32_t histogram[HISTOGRAM_SIZE];
+
+    Offsets() { Reset(); }
+    void Reset();
+    void Add(int64_t offset);
+    std::string Summary(int64_t seeks);
+  };
+
+  static bool Resolve(const std::string &address, struct sockaddr_in &addr);
+  static uint64_t HostId();
+  static int64_t RealTime();
+  static int64_t MonotonicTime();
+
+  void Send(Clock *clock, bool paused);
+  bool Receive();
+  int Adjust(Clock *clock, bool paused, int64_t &arg);
+  void SetSpeed(Clock *clock, int speed);
+
+  int                m_fd;
+  bool               m_leader;
+  struct sockaddr_in m_addr;
+  uint64_t           m_host;
+
+  // leader
+  uint32_t m_seq;
+  int64_t  m_last_sent;
+  uint32_t m_last_flags;
+
+  // follower
+  Packet   m_last;
+  bool     m_have_last;
+  int64_t  m_last_received;
+  int64_t  m_settle_until;
+  int      m_speed;
+  // how far ahead of the leader to seek, learnt from where seeks land
+  int64_t  m_seek_lead;
+  bool     m_seeked;
+  // the action last returned, until it's taken
+  int      m_pending;
+
+  Offsets  m_total;
+  Offsets  m_recent;
+  int64_t  m_seeks;
+};
@@ -0,0 +1,216 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ControlSocket.h"
+#include "OMXClock.h"
+#include "OMXPlayerAudio.h"
+#include "utils/log.h"
+
+// Commands beyond this are answered with CONTROL_BUSY rather than queued
+#define MAX_QUEUED_COMMANDS 64
+// How often the thread looks for StopThread()
+#define POLL_TIMEOUT_MS 100
+
+ControlSocket::ControlSocket()
+: m_fd(-1), m_clock(NULL), m_audio(NULL), m_pending(0)
+{
+}
+
+ControlSocket::~ControlSocket()
+{
+  Close();
+}
+
+bool ControlSocket::Address(const std::string &path, struct sockaddr_un &addr, socklen_t &len)
+{
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(addr.sun_path))
+    return false;
+
+  // abstract names start with a NUL and aren't terminated
+  if (path[0] == '@')
+  {
+    memcpy(addr.sun_path + 1, path.data() + 1, path.size() - 1);
+    len = offsetof(struct sockaddr_un, sun_path) + path.size();
+  }
+  else
+  {
+    memcpy(addr.sun_path, path.data(), path.size());
+    len = sizeof(addr);
+  }
+  return true;
+}
+
+bool ControlSocket::Open(const std::string &path, OMXClock *clock, OMXPlayerAudio *audio)
+{
+  Close();
+
+  struct sockaddr_un addr;
+  socklen_t len;
+  if (!Address(path, addr, len))
+  {
+    CLog::Log(LOGERROR, "ControlSocket: invalid socket name '%s'", path.c_str());
+    return false;
+  }
+
+  m_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (m_fd == -1)
+  {
+    CLog::Log(LOGERROR, "ControlSocket: socket(): %s", strerror(errno));
+    return false;
+  }
+
+  // a socket file left behind by a player that didn't exit cleanly
+  if (path[0] != '@')
+    unlink(path.c_str());
+
+  if (bind(m_fd, (struct sockaddr *)&addr, len) != 0)
+  {
+    CLog::Log(LOGERROR, "ControlSocket: bind('%s'): %s", path.c_str(), strerror(errno));
+    close(m_fd);
+    m_fd = -1;
+    return false;
+  }
+
+  m_path  = path;
+  m_clock = clock;
+  m_audio = audio;
+  Create();
+  return true;
+}
+
+void ControlSocket::Close()
+{
+  if (Running())
+    StopThread();
+
+  if (m_fd != -1)
+  {
+    close(m_fd);
+    m_fd = -1;
+    if (m_path[0] != '@')
+      unlink(m_path.c_str());
+  }
+
+  m_queue.clear();
+  m_pending = 0;
+}
+
+void ControlSocket::Process()
+{
+  while (!m_bStop)
+  {
+    struct pollfd pfd = { m_fd, POLLIN, 0 };
+    if (poll(&pfd, 1, POLL_TIMEOUT_MS) <= 0)
+      continue;
+
+    // answer everything that has arrived before waiting again
+    for (;;)
+    {
+      Command command;
+      command.from_len = sizeof(command.from);
+      ssize_t n = recvfrom(m_fd, &command.request, sizeof(command.request), MSG_DONTWAIT | MSG_TRUNC,
+                           (struct sockaddr *)&command.from, &command.from_len);
+      if (n < 0)
+        break;
+
+      if (n != sizeof(command.request))
+      {
+        // the id can still be returned if it was sent
+        ControlRequest bad = {};
+        if (n >= (ssize_t)sizeof(bad.id))
+          bad.id = command.request.id;
+        Send(bad, CONTROL_BAD_REQUEST, command.from, command.from_len);
+        continue;
+      }
+
+      if (command.request.command == CONTROL_STATUS)
+      {
+        Send(command.request, CONTROL_OK, command.from, command.from_len);
+        continue;
+      }
+
+      if (command.request.command > CONTROL_SET_VOLUME)
+      {
+        Send(command.request, CONTROL_UNKNOWN_COMMAND, command.from, command.from_len);
+        continue;
+      }
+
+      bool queued = false;
+      Lock();
+      if (m_queue.size() < MAX_QUEUED_COMMANDS)
+      {
+        m_queue.push_back(command);
+        m_pending++;
+        queued = true;
+      }
+      UnLock();
+
+      if (!queued)
+        Send(command.request, CONTROL_BUSY, command.from, command.from_len);
+    }
+  }
+}
+
+bool ControlSocket::Pop(Command &command)
+{
+  if (m_pending == 0)
+    return false;
+
+  Lock();
+  command = m_queue.front();
+  m_queue.pop_front();
+  m_pending--;
+  UnLock();
+  return true;
+}
+
+void ControlSocket::Reply(const Command &command, int status)
+{
+  Send(command.request, status, command.from, command.from_len);
+}
+
+void ControlSocket::Send(const ControlRequest &request, int status, const struct sockaddr_un &to, socklen_t to_len)
+{
+  // an unbound client has nowhere to be answered
+  if (to_len <= offsetof(struct sockaddr_un, sun_path))
+    return;
+
+  ControlReply reply = {};
+  reply.id     = request.id;
+  reply.status = status;
+  if (m_clock)
+  {
+    reply.media_time = m_clock->OMXMediaTime();
+    reply.clock_time = OMXClock::GetAbsoluteClock();
+    reply.speed      = m_clock->OMXPlaySpeed();
+    if (m_clock->OMXIsPaused())
+      reply.flags |= CONTROL_PAUSED;
+  }
+  if (m_audio)
+    reply.volume = m_audio->GetVolume();
+
+  if (sendto(m_fd, &reply, sizeof(reply), MSG_DONTWAIT | MSG_NOSIGNAL, (const struct sockaddr *)&to, to_len) < 0)
+    CLog::Log(LOGDEBUG, "ControlSocket: sendto(): %s", strerror(errno));
+}
@@ -0,0 +1,123 @@
+#pragma once
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <atomic>
+#include <deque>
+#include <string>
+
+#include "OMXThread.h"
+
+class OMXClock;
+class OMXPlayerAudio;
+
+// A binary control protocol over a UNIX datagram socket, for clients that
+// poll the media time or drive the player more often than D-Bus allows.
+// Each request is one ControlRequest datagram, answered with one
+// ControlReply datagram sent back to the address of the client, so the
+// client has to bind its socket (an autobound abstract address will do).
+// Fields are in the byte order of the player.
+enum ControlCommand
+{
+  CONTROL_STATUS       = 0,  // only the state in the reply
+  CONTROL_PLAY         = 1,
+  CONTROL_PAUSE        = 2,
+  CONTROL_PLAYPAUSE    = 3,
+  CONTROL_STOP         = 4,
+  CONTROL_SEEK         = 5,  // arg: offset in microseconds
+  CONTROL_SET_POSITION = 6,  // arg: position in microseconds
+  CONTROL_SET_RATE     = 7,  // value: 1.0 is normal speed
+  CONTROL_SET_VOLUME   = 8,  // value: linear volume
+};
+
+enum ControlStatus
+{
+  CONTROL_OK              = 0,
+  CONTROL_UNKNOWN_COMMAND = -1,
+  CONTROL_BAD_REQUEST     = -2,
+  CONTROL_BUSY            = -3,
+};
+
+#define CONTROL_PAUSED 1
+
+struct ControlRequest
+{
+  uint32_t id;       // returned in the reply
+  uint32_t command;  // ControlCommand
+  int64_t  arg;
+  double   value;
+};
+
+// The state is read when the request is taken, so for commands it's the
+// state they were applied to
+struct ControlReply
+{
+  uint32_t id;
+  int32_t  status;      // ControlStatus
+  uint32_t flags;       // CONTROL_PAUSED
+  int32_t  speed;       // 1000 is normal speed
+  int64_t  media_time;  // microseconds
+  int64_t  clock_time;  // OMXClock::GetAbsoluteClock() when media_time was read
+  double   volume;
+};
+
+static_assert(sizeof(ControlRequest) == 24, "ControlRequest is part of the protocol");
+static_assert(sizeof(ControlReply) == 40, "ControlReply is part of the protocol");
+
+// Serves the control socket. STATUS requests are answered on the socket's
+// thread straight away; commands are queued for the main loop, which
+// takes them through OMXControl::getEvent() and acts on them as it does
+// on the D-Bus calls.
+class ControlSocket : public OMXThread
+{
+public:
+  struct Command
+  {
+    ControlRequest request;
+    struct sockaddr_un from;
+    socklen_t from_len;
+  };
+
+  ControlSocket();
+  ~ControlSocket();
+
+  // path is a file name, or an abstract socket name after a '@'
+  bool Open(const std::string &path, OMXClock *clock, OMXPlayerAudio *audio);
+  void Close();
+  bool IsOpen() { return m_fd != -1; }
+
+  // Whether commands are waiting for the main loop
+  bool Pending() { return m_pending > 0; }
+  bool Pop(Command &command);
+  void Reply(const Command &command, int status);
+
+  void Process() override;
+
+private:
+  static bool Address(const std::string &path, struct sockaddr_un &addr, socklen_t &len);
+  void Send(const ControlRequest &request, int status, const struct sockaddr_un &to, socklen_t to_len);
+
+  int              m_fd;
+  std::string      m_path;
+  OMXClock        *m_clock;
+  OMXPlayerAudio  *m_audio;
+  std::deque<Command> m_queue;
+  std::atomic<int> m_pending;
+};
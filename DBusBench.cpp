@@ -0,0 +1,271 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+// Polls the properties of a running omxplayer over D-Bus as fast as it
+// answers and reports the calls per second and the round trip times. With
+// --socket the player's state is polled over its control socket instead,
+// for comparison.
+//
+//   dbus-bench.bin [options] [property...]
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <dbus/dbus.h>
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "ControlSocket.h"
+
+using namespace std;
+
+namespace {
+  const char* PLAYER_INTERFACE = "org.mpris.MediaPlayer2.Player";
+
+  void PrintUsage() {
+    printf("Usage: dbus-bench.bin [options] [property...]\n"
+           "    --dest name       D-Bus name of the player (default: org.mpris.MediaPlayer2.omxplayer)\n"
+           "    --calls n         Number of Get calls to make (default: 1000)\n"
+           "    --pipeline n      Calls in flight at once (default: 1)\n"
+           "    --socket path     Poll the status over the control socket at path instead\n"
+           "Properties of the Player interface are polled in turn\n"
+           "(default: Position Duration PlaybackStatus).\n");
+  }
+
+  void PrintTimes(const char* name, vector<double>& us) {
+    if (us.empty()) return;
+
+    sort(us.begin(), us.end());
+    double total = 0;
+    for (double t : us) total += t;
+
+    printf("  %-8s mean %8.1f us  median %8.1f us  95%% %8.1f us  max %8.1f us\n",
+           name,
+           total / us.size(),
+           us[us.size() / 2],
+           us[us.size() * 95 / 100],
+           us.back());
+  }
+
+  double Elapsed(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+  }
+
+  struct Call {
+    DBusPendingCall* pending;
+    chrono::steady_clock::time_point start;
+  };
+
+  bool SocketAddress(const string& path, sockaddr_un& addr, socklen_t& len) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) return false;
+
+    memcpy(addr.sun_path, path.data(), path.size());
+    if (path[0] == '@') {
+      addr.sun_path[0] = '\0';
+      len = offsetof(sockaddr_un, sun_path) + path.size();
+    } else {
+      len = sizeof(addr);
+    }
+    return true;
+  }
+
+  // Sends CONTROL_STATUS requests, keeping up to pipeline of them
+  // unanswered, and matches the replies by id
+  int BenchSocket(const string& path, int calls, int pipeline) {
+    sockaddr_un addr;
+    socklen_t len;
+    if (!SocketAddress(path, addr, len)) {
+      fprintf(stderr, "Invalid socket name: %s\n", path.c_str());
+      return 1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    // the player answers to the address we're bound to, so autobind one
+    sa_family_t family = AF_UNIX;
+    if (fd == -1 || bind(fd, (sockaddr*)&family, sizeof(family)) != 0 ||
+        connect(fd, (sockaddr*)&addr, len) != 0) {
+      fprintf(stderr, "Unable to connect to %s: %s\n", path.c_str(), strerror(errno));
+      return 1;
+    }
+
+    vector<double> round_trip_us;
+    round_trip_us.reserve(calls);
+    vector<chrono::steady_clock::time_point> start(calls);
+    int sent = 0, received = 0, failed = 0;
+
+    auto bench_start = chrono::steady_clock::now();
+    while (received < calls) {
+      while (sent < calls && sent - received < pipeline) {
+        ControlRequest request = {};
+        request.id = sent;
+        request.command = CONTROL_STATUS;
+        start[sent] = chrono::steady_clock::now();
+        if (send(fd, &request, sizeof(request), 0) != sizeof(request)) {
+          fprintf(stderr, "Unable to send request: %s\n", strerror(errno));
+          return 1;
+        }
+        sent++;
+      }
+
+      pollfd pfd = { fd, POLLIN, 0 };
+      if (poll(&pfd, 1, 5000) <= 0) {
+        fprintf(stderr, "No reply\n");
+        return 1;
+      }
+
+      ControlReply reply;
+      if (recv(fd, &reply, sizeof(reply), 0) != sizeof(reply) || reply.id >= (uint32_t)sent) {
+        failed++;
+        continue;
+      }
+      round_trip_us.push_back(Elapsed(start[reply.id]));
+      if (reply.status != CONTROL_OK && failed++ == 0)
+        fprintf(stderr, "Request failed: %d\n", reply.status);
+      received++;
+    }
+    double total_s = Elapsed(bench_start) / 1000000;
+
+    printf("%s: %d calls (%d failed) in %.2f s, %.1f calls/s with %d in flight\n",
+           path.c_str(), calls, failed, total_s, calls / total_s, pipeline);
+    PrintTimes("call", round_trip_us);
+
+    close(fd);
+    return failed ? 1 : 0;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  string dest = "org.mpris.MediaPlayer2.omxplayer";
+  string socket_path;
+  int calls = 1000;
+  int pipeline = 1;
+
+  const int dest_opt     = 0x100;
+  const int calls_opt    = 0x101;
+  const int pipeline_opt = 0x102;
+  const int socket_opt   = 0x103;
+
+  struct option longopts[] = {
+    { "dest",         required_argument,  NULL,          dest_opt },
+    { "calls",        required_argument,  NULL,          calls_opt },
+    { "pipeline",     required_argument,  NULL,          pipeline_opt },
+    { "socket",       required_argument,  NULL,          socket_opt },
+    { "help",         no_argument,        NULL,          'h' },
+    { 0, 0, 0, 0 }
+  };
+
+  int c;
+  while ((c = getopt_long(argc, argv, "h", longopts, NULL)) != -1) {
+    switch (c) {
+      case dest_opt:
+        dest = optarg;
+        break;
+      case calls_opt:
+        calls = max(atoi(optarg), 1);
+        break;
+      case pipeline_opt:
+        pipeline = max(atoi(optarg), 1);
+        break;
+      case socket_opt:
+        socket_path = optarg;
+        break;
+      default:
+        PrintUsage();
+        return c == 'h' ? 0 : 1;
+    }
+  }
+
+  if (!socket_path.empty())
+    return BenchSocket(socket_path, calls, pipeline);
+
+  vector<string> properties(argv + optind, argv + argc);
+  if (properties.empty())
+    properties = { "Position", "Duration", "PlaybackStatus" };
+
+  DBusError error;
+  dbus_error_init(&error);
+  DBusConnection* bus = dbus_bus_get_private(DBUS_BUS_SESSION, &error);
+  if (!bus) {
+    fprintf(stderr, "Unable to connect to the session bus: %s\n", error.message);
+    dbus_error_free(&error);
+    return 1;
+  }
+  dbus_connection_set_exit_on_disconnect(bus, FALSE);
+
+  vector<double> round_trip_us;
+  round_trip_us.reserve(calls);
+  deque<Call> in_flight;
+  int sent = 0, failed = 0;
+
+  auto bench_start = chrono::steady_clock::now();
+  while (sent < calls || !in_flight.empty()) {
+    while (sent < calls && (int)in_flight.size() < pipeline) {
+      DBusMessage* m = dbus_message_new_method_call(dest.c_str(), "/org/mpris/MediaPlayer2",
+                                                    DBUS_INTERFACE_PROPERTIES, "Get");
+      const char* property = properties[sent % properties.size()].c_str();
+      dbus_message_append_args(m, DBUS_TYPE_STRING, &PLAYER_INTERFACE,
+                               DBUS_TYPE_STRING, &property, DBUS_TYPE_INVALID);
+
+      Call call;
+      call.start = chrono::steady_clock::now();
+      if (!dbus_connection_send_with_reply(bus, m, &call.pending, 5000) || !call.pending) {
+        fprintf(stderr, "Unable to send message\n");
+        return 1;
+      }
+      dbus_message_unref(m);
+      in_flight.push_back(call);
+      sent++;
+    }
+
+    Call call = in_flight.front();
+    in_flight.pop_front();
+    dbus_pending_call_block(call.pending);
+    round_trip_us.push_back(Elapsed(call.start));
+
+    DBusMessage* reply = dbus_pending_call_steal_reply(call.pending);
+    if (!reply || dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR) {
+      if (failed++ == 0)
+        fprintf(stderr, "Call failed: %s\n",
+                reply ? dbus_message_get_error_name(reply) : "no reply");
+    }
+    if (reply)
+      dbus_message_unref(reply);
+    dbus_pending_call_unref(call.pending);
+  }
+  double total_s = Elapsed(bench_start) / 1000000;
+
+  printf("%s: %d calls (%d failed) in %.2f s, %.1f calls/s with %d in flight\n",
+         dest.c_str(), calls, failed, total_s, calls / total_s, pipeline);
+  PrintTimes("call", round_trip_us);
+
+  dbus_connection_close(bus);
+  dbus_connection_unref(bus);
+  return failed ? 1 : 0;
+}
@@ -109,6 +109,9 @@ DispmanxLayer::DispmanxLayer(int bytesperpixel, Rectangle dest_rect, Dimension s
 		&vc_image_ptr);
 	assert(m_resource != 0);
 
+	// the resource's contents are undefined, clear it with the first upload
+	m_dirty_height = src_image.height;
+
 	// set palette is necessary
 	if(imagetype == VC_IMAGE_8BPP) {
 		int palette[256]; // ARGB 256
@@ -166,26 +169,53 @@ void DispmanxLayer::showElement()
 
 void DispmanxLayer::clearImage()
 {
-	int size = m_image_pitch * m_bmpRect.height;
-	void *blank = (void *)malloc(size);
-	memset(blank, 0, size);
+	setImageData(NULL, 0, 0, false);
+}
 
-	setImageData(blank, false);
+// write whole rows of image data, image_data points to the first row
+void DispmanxLayer::writeRows(void *image_data, int y, int height)
+{
+	VC_RECT_T rect;
+	vc_dispmanx_rect_set(&rect, 0, y, m_bmpRect.width, height);
 
-	free(blank);
+	// Dispmanx ignores rect.x and reads from src_address + y * pitch, so
+	// pass the address where row 0 would be. The palette param is ignored.
+	unsigned char *src_address = (unsigned char *)image_data - y * m_image_pitch;
+	int result = vc_dispmanx_resource_write_data(m_resource,
+		VC_IMAGE_MIN, m_image_pitch, src_address, &rect);
+
+	assert(result == 0);
 }
 
+void DispmanxLayer::clearRows(int y, int height)
+{
+	size_t size = m_image_pitch * height;
+	if(m_blank.size() < size)
+		m_blank.resize(size, 0);
+
+	writeRows(m_blank.data(), y, height);
+}
 
 // copy image data to screen and make the element visible
 void DispmanxLayer::setImageData(void *image_data, bool show)
 {
-	// the palette param is ignored
-	int result = vc_dispmanx_resource_write_data(m_resource,
-		VC_IMAGE_MIN, m_image_pitch, image_data, &(m_bmpRect));
+	setImageData(image_data, 0, m_bmpRect.height, show);
+}
 
-	assert(result == 0);
+// Only rows y to y + height are uploaded, anything drawn outside them
+// last time is cleared
+void DispmanxLayer::setImageData(void *image_data, int y, int height, bool show)
+{
+	if(m_dirty_height > 0 && (m_dirty_y < y || m_dirty_y + m_dirty_height > y + height))
+		clearRows(m_dirty_y, m_dirty_height);
+
+	if(height > 0)
+		writeRows(image_data, y, height);
 
-	result = vc_dispmanx_element_change_source(m_update, m_element, m_resource);
+	m_dirty_y = y;
+	m_dirty_height = height;
+
+	int result = vc_dispmanx_element_change_source(m_update, m_element, m_resource);
 
 	assert(result == 0);
 
@@ -218,3 +248,24 @@ DispmanxLayer::~DispmanxLayer()
 	result = vc_dispmanx_resource_delete(m_resource);
 	assert(result == 0);
 }
+
+DispmanxDisplay::DispmanxDisplay(int display_num, int layer)
+{
+	DispmanxLayer::openDisplay(display_num, layer);
+}
+
+DispmanxDisplay::~DispmanxDisplay()
+{
+	DispmanxLayer::closeDisplay();
+}
+
+Dimension DispmanxDisplay::getScreenDimensions()
+{
+	return DispmanxLayer::getScreenDimensions();
+}
+
+SubtitleLayer *DispmanxDisplay::createLayer(int bytesperpixel, Rectangle dest_rect,
+	Dimension src_image)
+{
+	return new DispmanxLayer(bytesperpixel, dest_rect, src_image);
+}
@@ -29,21 +29,24 @@
 //
 
 #include <bcm_host.h>
+#include <vector>
 
 #include "utils/simple_geometry.h"
+#include "SubtitleLayer.h"
 
-class DispmanxLayer
+class DispmanxLayer : public SubtitleLayer
 {
 public:
 	DispmanxLayer(int bytesperpixel, Rectangle dest_rect, Dimension src_image = {-1, -1});
 	~DispmanxLayer();
 
-	void hideElement();
-	void clearImage();
-	void setImageData(void *image_data, bool show = true);
+	void hideElement() override;
+	void clearImage() override;
+	void setImageData(void *image_data, bool show = true) override;
+	void setImageData(void *image_data, int y, int height, bool show = true) override;
 
-	const int& getSourceWidth();
-	const int& getSourceHeight();
+	const int& getSourceWidth() override;
+	const int& getSourceHeight() override;
 
 	static void openDisplay(int display_num, int layer);
 	static Dimension getScreenDimensions();
@@ -52,6 +55,8 @@ public:
 private:
 	void changeImageLayer(int new_layer);
 	void showElement();
+	void writeRows(void *image_data, int y, int height);
+	void clearRows(int y, int height);
 
 	VC_RECT_T m_bmpRect;
 	int m_image_pitch;
@@ -61,6 +66,25 @@ private:
 
 	bool m_element_is_hidden = true;
 
+	// the rows of the resource which currently hold image data
+	int m_dirty_y = 0;
+	int m_dirty_height = 0;
+
+	// zeroed rows used for clearing
+	std::vector<unsigned char> m_blank;
+
 	static int s_layer;
 	static DISPMANX_DISPLAY_HANDLE_T s_display;
 };
+
+// Opens the display on construction and closes it on destruction
+class DispmanxDisplay : public SubtitleDisplay
+{
+public:
+	DispmanxDisplay(int display_num, int layer);
+	~DispmanxDisplay();
+
+	Dimension getScreenDimensions() override;
+	SubtitleLayer *createLayer(int bytesperpixel, Rectangle dest_rect,
+		Dimension src_image = {-1, -1}) override;
+};
@@ -42,6 +42,8 @@ CFile::CFile()
   m_flags = 0;
   m_iLength = 0;
   m_bPipe = false;
+  m_pipe = NULL;
+  m_pipeSize = 0;
 }
 
 //*********************************************************************************************
@@ -49,6 +51,7 @@ CFile::~CFile()
 {
   if(m_pFile && !m_bPipe)
     fclose(m_pFile);
+  delete m_pipe;
 }
 
 //*********************************************************************************************
@@ -61,6 +64,11 @@ bool CFile::Open(const CStdString& strFileName, unsigned int flags)
     m_bPipe = true;
     m_pFile = stdin;
     m_iLength = 0;
+    if (m_pipeSize)
+    {
+      m_pipe = new PipeReader();
+      return m_pipe->Open(fileno(stdin), m_pipeSize);
+    }
     return true;
   }
   m_pFile = fopen64(strFileName.c_str(), "r");
@@ -103,6 +111,9 @@ unsigned int CFile::Read(void *lpBuf, int64_t uiBufSize)
   if(!m_pFile)
     return 0;
 
+  if (m_pipe)
+    return m_pipe->Read((uint8_t *)lpBuf, uiBufSize);
+
   ret = fread(lpBuf, 1, uiBufSize, m_pFile);
 
   return ret;
@@ -114,6 +125,12 @@ void CFile::Close()
   if(m_pFile && !m_bPipe)
     fclose(m_pFile);
   m_pFile = NULL;
+  if (m_pipe)
+  {
+    m_pipe->Close();
+    delete m_pipe;
+    m_pipe = NULL;
+  }
 }
 
 //*********************************************************************************************
@@ -122,6 +139,10 @@ int64_t CFile::Seek(int64_t iFilePosition, int iWhence)
   if (!m_pFile)
     return -1;
 
+  // only back into what the pipe reader still has, or forward
+  if (m_pipe)
+    return m_pipe->Seek(iFilePosition, iWhence);
+
   return fseeko64(m_pFile, iFilePosition, iWhence);;
 }
 
@@ -137,6 +158,9 @@ int64_t CFile::GetPosition()
   if (!m_pFile)
     return -1;
 
+  if (m_pipe)
+    return m_pipe->GetPosition();
+
   return ftello64(m_pFile);
 }
 
@@ -168,8 +192,20 @@ bool CFile::IsEOF()
   if (!m_pFile)
     return false;
 
+  if (m_pipe)
+    return m_pipe->IsEOF();
+
   if (m_bPipe)
     return false;
 
   return feof(m_pFile) != 0;
 }
+
+bool CFile::GetPipeStats(PipeReader::PipeStats &stats)
+{
+  if (!m_pipe)
+    return false;
+
+  stats = m_pipe->GetPipeStats();
+  return true;
+}
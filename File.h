@@ -29,6 +29,8 @@
 #pragma once
 #endif // _MSC_VER > 1000
 
+#include "PipeReader.h"
+
 #define FFMPEG_FILE_BUFFER_SIZE   32768
 
 namespace XFILE
@@ -74,11 +76,17 @@ public:
   int GetChunkSize() { return 6144 /*FFMPEG_FILE_BUFFER_SIZE*/; };
   int IoControl(EIoControl request, void* param);
   bool IsEOF();
+  // pipe: is read through a PipeReader with a ring of size bytes if it's
+  // opened after this, or straight from stdin for 0
+  void SetPipeBuffer(size_t size) { m_pipeSize = size; }
+  bool GetPipeStats(PipeReader::PipeStats &stats);
 private:
   unsigned int m_flags;
   FILE  *m_pFile;
   int64_t m_iLength;
   bool m_bPipe;
+  PipeReader *m_pipe;
+  size_t m_pipeSize;
 };
 
 };
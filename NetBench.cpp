@@ -0,0 +1,994 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+// Reads a generated stream through NetworkCache from an HTTP server run
+// in this process, which can be made slow, stall or drop connections.
+// Every byte read is checked, and the read times and cache counters are
+// reported at the end. With --hls the server has a playlist of segments
+// instead, which are read through SegmentPrefetcher the way the hls
+// demuxer opens them, reloading the playlist as it goes, and the waits at
+// segment boundaries are reported. --dash makes it a manifest of
+// $Number$.m4s segments, and --bare serves playlists at urls without an
+// extension.
+// With --timeshift the server has a live transport stream that's recorded
+// through TimeshiftBuffer, paused, rewound and caught up with. With
+// --pipe the stream is written into a pipe instead and read through
+// PipeReader by a reader that stalls now and then, reporting how long the
+// writer was held up.
+//
+//   net-bench.bin [options]
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "NetworkCache.h"
+#include "PipeReader.h"
+#include "SegmentPrefetcher.h"
+#include "TimeshiftBuffer.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+};
+
+using namespace std;
+
+namespace {
+  void PrintUsage() {
+    printf("Usage: net-bench.bin [options]\n"
+           "    --size n          Length of the stream in MB (default: 64)\n"
+           "    --cache n         Size of the cache in MB (default: 8)\n"
+           "    --spill path      Spill file for the cache\n"
+           "    --timeout s       Time a connection may stall before it's opened again (default: 1)\n"
+           "    --latency ms      Delay before the server answers a request (default: 0)\n"
+           "    --rate n          Server rate in kB/s per connection (default: unlimited)\n"
+           "    --drop-every n    Server drops each connection after n kB (default: never)\n"
+           "    --stall-every n   Server stalls each connection after every n kB (default: never)\n"
+           "    --stall ms        Length of a stall (default: 2000)\n"
+           "    --consume n       Rate the stream is read at in kB/s (default: unlimited)\n"
+           "    --seek-every n    Seek to a random position after every n kB read (default: never)\n"
+           "    --seed n          Seed for the seek positions (default: 1)\n"
+           "    --hls n           Serve a playlist of n segments and read those instead\n"
+           "    --segment n       Size of a segment in kB (default: 1024)\n"
+           "    --prefetch n      Segments fetched ahead (default: 3)\n"
+           "    --dash            With --hls, serve a DASH manifest of seg-$Number$.m4s segments\n"
+           "    --bare            With --hls, serve the playlists at urls without an extension\n"
+           "    --timeshift path  Record a live stream into a ring file at path, the size of the cache\n"
+           "    --play s          Time played before pausing it (default: 5)\n"
+           "    --pause s         Time it's paused for (default: 10)\n"
+           "    --rewind s        Time rewound by after the pause (default: 5)\n"
+           "    --discontinuity s The live stream's PCR jumps an hour ahead every s seconds (default: never)\n"
+           "    --pipe            Write the stream into a pipe at the rate and read it through a ring\n"
+           "                      the size of the cache, stalling as the server would\n"
+           "    --direct          With --pipe, read the pipe directly instead\n");
+  }
+
+  // The byte at each offset of the stream
+  uint8_t Pattern(int64_t pos) {
+    return (uint8_t)(pos ^ (pos >> 8) ^ (pos >> 16) ^ (pos >> 24));
+  }
+
+  double Elapsed(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+  }
+
+  void PrintTimes(const char* name, vector<double>& us) {
+    if (us.empty()) return;
+
+    sort(us.begin(), us.end());
+    double total = 0;
+    for (double t : us) total += t;
+
+    printf("  %-8s mean %8.1f us  median %8.1f us  99%% %8.1f us  max %8.1f us\n",
+           name,
+           total / us.size(),
+           us[us.size() / 2],
+           us[us.size() * 99 / 100],
+           us.back());
+  }
+
+  // The live stream is a transport stream of packets that each have the
+  // PCR for when they're sent and then the pattern. A packet a millisecond
+  // unless there's a rate. With discontinuities the PCR jumps ahead by
+  // PCR_JUMP every jump_every packets.
+  const int PACKET_SIZE = 188;
+  const int64_t PCR_JUMP = 3600LL * 90000;
+
+  int PacketsPerSecond(int rate) {
+    return rate ? max(rate / PACKET_SIZE, 1) : 1000;
+  }
+
+  int64_t LivePcr(int64_t k, int pps, int64_t jump_every) {
+    return k * 90000 / pps + (jump_every ? k / jump_every * PCR_JUMP : 0);
+  }
+
+  // The time since the stream started of a PCR, in 90 kHz units
+  int64_t LiveTime(int64_t pcr, int pps, int64_t jump_every) {
+    if (jump_every)
+      pcr -= pcr / (PCR_JUMP + jump_every * 90000 / pps) * PCR_JUMP;
+    return pcr;
+  }
+
+  void LivePacket(int64_t k, int pps, int64_t jump_every, uint8_t* p) {
+    int64_t pcr = LivePcr(k, pps, jump_every);
+    p[0] = 0x47;
+    p[1] = 0x41;                 // pid 0x100
+    p[2] = 0x00;
+    p[3] = 0x20 | (k & 15);      // adaptation field only
+    p[4] = PACKET_SIZE - 5;
+    p[5] = 0x10;                 // with a PCR
+    p[6] = pcr >> 25;
+    p[7] = pcr >> 17;
+    p[8] = pcr >> 9;
+    p[9] = pcr >> 1;
+    p[10] = ((pcr & 1) << 7) | 0x7e;
+    p[11] = 0;
+    for (int i = 12; i < PACKET_SIZE; i++)
+      p[i] = Pattern(k * PACKET_SIZE + i);
+  }
+
+  struct ServerConfig {
+    chrono::steady_clock::time_point epoch;
+    int64_t length;
+    int latency_ms;
+    int rate;           // bytes per second, 0 for unlimited
+    int64_t drop_every;
+    int64_t stall_every;
+    int stall_ms;
+    int segments;
+    int64_t segment_size;
+    int discontinuity_s;  // seconds between PCR jumps of the live stream, 0 for none
+    bool dash;          // with segments, a manifest of seg-$Number$.m4s
+    bool bare;          // playlists at urls without an extension
+  };
+
+  // The segments the server has with --hls, the first of a DASH manifest
+  // being number 1
+  string SegmentName(const ServerConfig& config, int i) {
+    char name[32];
+    if (config.dash)
+      snprintf(name, sizeof(name), "seg-%d.m4s", i + 1);
+    else
+      snprintf(name, sizeof(name), "seg%d.ts", i);
+    return name;
+  }
+
+  // The url path of the master playlist or manifest, and of the media
+  // playlist it lists
+  string TopPath(const ServerConfig& config) {
+    if (config.dash)
+      return config.bare ? "/manifest" : "/manifest.mpd";
+    return config.bare ? "/master" : "/master.m3u8";
+  }
+
+  string MediaPath(const ServerConfig& config) {
+    return config.bare ? "/media" : "/media.m3u8";
+  }
+
+  // The playlists the server has with --hls
+  string TopPlaylist(const ServerConfig& config) {
+    if (config.dash) {
+      char manifest[512];
+      snprintf(manifest, sizeof(manifest),
+               "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+               "<MPD xmlns=\"urn:mpeg:dash:schema:mpd:2011\" type=\"static\" minBufferTime=\"PT2S\"\n"
+               "     mediaPresentationDuration=\"PT%dS\" profiles=\"urn:mpeg:dash:profile:isoff-live:2011\">\n"
+               "  <Period>\n"
+               "    <AdaptationSet mimeType=\"video/mp4\">\n"
+               "      <SegmentTemplate media=\"seg-$Number$.m4s\" startNumber=\"1\" duration=\"2\" timescale=\"1\"/>\n"
+               "      <Representation id=\"0\" bandwidth=\"4000000\"/>\n"
+               "    </AdaptationSet>\n"
+               "  </Period>\n"
+               "</MPD>\n", config.segments * 2);
+      return manifest;
+    }
+    return "#EXTM3U\n#EXT-X-STREAM-INF:BANDWIDTH=4000000\n" + MediaPath(config).substr(1) + "\n";
+  }
+
+  string Playlist(const ServerConfig& config) {
+    string playlist = "#EXTM3U\n#EXT-X-VERSION:3\n#EXT-X-TARGETDURATION:2\n#EXT-X-MEDIA-SEQUENCE:0\n";
+    for (int i = 0; i < config.segments; i++)
+      playlist += "#EXTINF:2.0,\n" + SegmentName(config, i) + "\n";
+    return playlist + "#EXT-X-ENDLIST\n";
+  }
+
+  // Sends the live stream from now on until the connection drops
+  void ServeLive(int fd, const ServerConfig& config, atomic<unsigned>* drops, atomic<unsigned>* stalls) {
+    const char* header = "HTTP/1.1 200 OK\r\nContent-Type: video/mp2t\r\nConnection: close\r\n\r\n";
+    if (send(fd, header, strlen(header), MSG_NOSIGNAL) < 0) {
+      close(fd);
+      return;
+    }
+
+    int pps = PacketsPerSecond(config.rate);
+    int64_t jump_every = (int64_t)config.discontinuity_s * pps;
+    int64_t k = (int64_t)(Elapsed(config.epoch) * pps / 1000000);
+    int64_t sent = 0, next_stall = config.stall_every;
+    uint8_t buf[PACKET_SIZE * 16];
+    for (;;) {
+      if (config.drop_every && sent >= config.drop_every) {
+        (*drops)++;
+        break;
+      }
+      if (next_stall && sent >= next_stall) {
+        (*stalls)++;
+        this_thread::sleep_for(chrono::milliseconds(config.stall_ms));
+        next_stall += config.stall_every;
+      }
+
+      // each packet is sent when it's due
+      this_thread::sleep_until(config.epoch + chrono::microseconds((k + 16) * 1000000 / pps));
+      for (int i = 0; i < 16; i++)
+        LivePacket(k + i, pps, jump_every, buf + i * PACKET_SIZE);
+      ssize_t n = send(fd, buf, sizeof(buf), MSG_NOSIGNAL);
+      if (n != (ssize_t)sizeof(buf)) break;
+      sent += n;
+      k += 16;
+    }
+    close(fd);
+  }
+
+  // Answers one GET, honouring "Range: bytes=n-". The stream, and each
+  // segment, is a part of the pattern.
+  void Serve(int fd, ServerConfig config, atomic<unsigned>* drops, atomic<unsigned>* stalls,
+             atomic<unsigned>* playlists) {
+    string request;
+    char buf[4096];
+    while (request.find("\r\n\r\n") == string::npos) {
+      ssize_t n = recv(fd, buf, sizeof(buf), 0);
+      if (n <= 0) {
+        close(fd);
+        return;
+      }
+      request.append(buf, n);
+    }
+
+    if (request.compare(0, 10, "GET /live ") == 0) {
+      this_thread::sleep_for(chrono::milliseconds(config.latency_ms));
+      ServeLive(fd, config, drops, stalls);
+      return;
+    }
+
+    // where in the pattern, unless it's a playlist
+    int64_t base = 0, length = config.length;
+    string body;
+    string path = request.substr(4, request.find(' ', 4) - 4);
+    int segment, end = 0;
+    if (config.segments && (path == TopPath(config) || (!config.dash && path == MediaPath(config)))) {
+      body = path == TopPath(config) ? TopPlaylist(config) : Playlist(config);
+      length = body.size();
+      (*playlists)++;
+    } else if (sscanf(path.c_str(), config.dash ? "/seg-%d.m4s%n" : "/seg%d.ts%n", &segment, &end) == 1 &&
+               end == (int)path.size()) {
+      if (config.dash) segment--;
+      base = segment * config.segment_size;
+      length = segment >= 0 && segment < config.segments ? config.segment_size : 0;
+    } else if (request.compare(0, 12, "GET /stream ") != 0) {
+      length = 0;
+    }
+
+    int64_t start = 0;
+    size_t range = request.find("\nRange: bytes=");
+    if (range == string::npos) range = request.find("\nrange: bytes=");
+    if (range != string::npos) start = strtoll(request.c_str() + range + 14, NULL, 10);
+
+    this_thread::sleep_for(chrono::milliseconds(config.latency_ms));
+
+    if (!length) {
+      const char* reply = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+      send(fd, reply, strlen(reply), MSG_NOSIGNAL);
+      close(fd);
+      return;
+    }
+
+    if (start >= length) {
+      const char* reply = "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+      send(fd, reply, strlen(reply), MSG_NOSIGNAL);
+      close(fd);
+      return;
+    }
+
+    char header[256];
+    if (range != string::npos) {
+      snprintf(header, sizeof(header),
+               "HTTP/1.1 206 Partial Content\r\nContent-Length: %lld\r\nContent-Range: bytes %lld-%lld/%lld\r\n"
+               "Accept-Ranges: bytes\r\nConnection: close\r\n\r\n",
+               (long long)(length - start), (long long)start, (long long)length - 1, (long long)length);
+    } else {
+      snprintf(header, sizeof(header),
+               "HTTP/1.1 200 OK\r\nContent-Length: %lld\r\nAccept-Ranges: bytes\r\nConnection: close\r\n\r\n",
+               (long long)length);
+    }
+    if (send(fd, header, strlen(header), MSG_NOSIGNAL) < 0) {
+      close(fd);
+      return;
+    }
+
+    auto begin = chrono::steady_clock::now();
+    int64_t sent = 0, next_stall = config.stall_every;
+    while (start + sent < length) {
+      if (config.drop_every && sent >= config.drop_every) {
+        (*drops)++;
+        break;
+      }
+      if (next_stall && sent >= next_stall) {
+        (*stalls)++;
+        this_thread::sleep_for(chrono::milliseconds(config.stall_ms));
+        next_stall += config.stall_every;
+      }
+
+      int len = (int)min((int64_t)sizeof(buf), length - start - sent);
+      for (int i = 0; i < len; i++)
+        buf[i] = body.empty() ? Pattern(base + start + sent + i) : body[start + sent + i];
+      ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+      if (n <= 0) break;
+      sent += n;
+
+      if (config.rate) {
+        auto due = begin + chrono::microseconds(sent * 1000000 / config.rate);
+        this_thread::sleep_until(due);
+      }
+    }
+    close(fd);
+  }
+
+  struct Server {
+    int fd;
+    int port;
+    ServerConfig config;
+    atomic<unsigned> requests{0};
+    atomic<unsigned> drops{0};
+    atomic<unsigned> stalls{0};
+    atomic<unsigned> playlists{0};
+
+    bool Start() {
+      fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      sockaddr_in addr = {};
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      socklen_t len = sizeof(addr);
+      if (fd == -1 || bind(fd, (sockaddr*)&addr, len) != 0 || listen(fd, 16) != 0 ||
+          getsockname(fd, (sockaddr*)&addr, &len) != 0) {
+        fprintf(stderr, "Unable to listen: %s\n", strerror(errno));
+        return false;
+      }
+      port = ntohs(addr.sin_port);
+      thread([this] { Accept(); }).detach();
+      return true;
+    }
+
+    void Accept() {
+      for (;;) {
+        int client = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+        if (client == -1) {
+          if (errno == EINTR) continue;
+          return;
+        }
+        requests++;
+        thread(Serve, client, config, &drops, &stalls, &playlists).detach();
+      }
+    }
+  };
+
+  // Reads all of what io_open gives for url, returning false if it can't
+  // be opened
+  bool ReadAll(AVFormatContext* s, const string& url, string& data) {
+    AVIOContext* pb = NULL;
+    if (s->io_open(s, &pb, url.c_str(), AVIO_FLAG_READ, NULL) < 0)
+      return false;
+    data.clear();
+    char buf[4096];
+    int n;
+    while ((n = avio_read(pb, (unsigned char*)buf, sizeof(buf))) > 0)
+      data.append(buf, n);
+    s->io_close(s, pb);
+    return true;
+  }
+
+  // Opens the playlist and then each segment in turn through the
+  // prefetcher, as the hls and dash demuxers would, timing the wait for the
+  // first bytes of each segment. An HLS media playlist is loaded again
+  // before each segment, the way a live one is, and each load has to reach
+  // the server.
+  int BenchHls(Server& server, int prefetch, size_t cache_size, float timeout, int64_t consume) {
+    const ServerConfig& config = server.config;
+    char base[64];
+    snprintf(base, sizeof(base), "http://127.0.0.1:%d", server.port);
+    string top = base + TopPath(config), media = base + MediaPath(config);
+    const char* url = top.c_str();
+    AVIOInterruptCB int_cb = { NULL, NULL };
+
+    SegmentPrefetcher prefetcher;
+    AVIOContext* playlist = prefetcher.Open(url, NULL, prefetch, cache_size, timeout, int_cb);
+    if (!playlist) {
+      fprintf(stderr, "Unable to open %s\n", url);
+      return 1;
+    }
+    AVFormatContext* s = avformat_alloc_context();
+    prefetcher.Attach(s);
+
+    vector<double> first_byte_us;
+    vector<uint8_t> buf(32 << 10);
+    int64_t read = 0, mismatches = 0;
+    unsigned loads = 1;
+    string text;
+
+    auto bench_start = chrono::steady_clock::now();
+    for (int i = 0; i < config.segments; i++) {
+      if (!config.dash) {
+        if (!ReadAll(s, media, text) || text != Playlist(config)) {
+          fprintf(stderr, "Unable to load %s\n", media.c_str());
+          return 1;
+        }
+        loads++;
+      }
+
+      string segment = base + string("/") + SegmentName(config, i);
+      const char* segment_url = segment.c_str();
+
+      auto start = chrono::steady_clock::now();
+      AVIOContext* pb = NULL;
+      int ret = s->io_open(s, &pb, segment_url, AVIO_FLAG_READ, NULL);
+      if (ret < 0) {
+        fprintf(stderr, "Unable to open %s (%d)\n", segment_url, ret);
+        return 1;
+      }
+
+      int64_t pos = 0;
+      int n;
+      while ((n = avio_read(pb, buf.data(), buf.size())) > 0) {
+        if (pos == 0) first_byte_us.push_back(Elapsed(start));
+        for (int j = 0; j < n; j++)
+          if (buf[j] != Pattern(i * config.segment_size + pos + j)) mismatches++;
+        pos += n;
+        read += n;
+
+        // playback takes as long as the segment lasts, which is when the
+        // ones after it are fetched
+        if (consume)
+          this_thread::sleep_until(bench_start + chrono::microseconds(read * 1000000 / consume));
+      }
+      s->io_close(s, pb);
+
+      if (pos != config.segment_size) {
+        fprintf(stderr, "%s ended at %lld of %lld (%d)\n", segment_url, (long long)pos,
+                (long long)config.segment_size, n);
+        mismatches++;
+      }
+    }
+    double total_s = Elapsed(bench_start) / 1000000;
+
+    SegmentPrefetcher::PrefetchStats stats = prefetcher.GetPrefetchStats();
+    av_freep(&playlist->buffer);
+    avio_context_free(&playlist);
+    prefetcher.Close();
+    avformat_free_context(s);
+
+    printf("%s: %d segments, %lld kB in %.2f s, %.1f MB/s, %d ahead, %lld bytes wrong\n", url,
+           config.segments, (long long)(read >> 10), total_s, read / total_s / (1 << 20), prefetch,
+           (long long)mismatches);
+    PrintTimes("boundary", first_byte_us);
+    printf("  prefetch %u opened, %u already fetched, %u waits for %.0f ms\n",
+           stats.opened, stats.ready, stats.waits, stats.wait_ms);
+    printf("           %lld kB fetched, %u failed, %u evicted unused\n",
+           (long long)(stats.fetched >> 10), stats.failed, stats.evicted);
+    printf("  server   %u requests, %u dropped, %u stalls, %u of %u playlist loads\n",
+           server.requests.load(), server.drops.load(), server.stalls.load(),
+           server.playlists.load(), loads);
+
+    return mismatches || server.playlists != loads ? 1 : 0;
+  }
+
+  // Writes the stream into a pipe at the server's rate and reads it back
+  // through a PipeReader, or directly, stalling every so often as a busy
+  // decoder would. The writer's time blocked on the pipe is what a capture
+  // tool would lose.
+  int BenchPipe(const ServerConfig& config, size_t size, bool direct, int64_t consume) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+      fprintf(stderr, "Unable to create a pipe: %s\n", strerror(errno));
+      return 1;
+    }
+
+    vector<double> write_us;
+    thread writer([&]() {
+      vector<uint8_t> buf(64 << 10);
+      auto begin = chrono::steady_clock::now();
+      int64_t sent = 0;
+      while (sent < config.length) {
+        int len = (int)min((int64_t)buf.size(), config.length - sent);
+        for (int i = 0; i < len; i++)
+          buf[i] = Pattern(sent + i);
+        auto start = chrono::steady_clock::now();
+        for (int done = 0; done < len; ) {
+          ssize_t n = write(fds[1], buf.data() + done, len - done);
+          if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            close(fds[1]);
+            return;
+          }
+          done += n;
+        }
+        write_us.push_back(Elapsed(start));
+        sent += len;
+
+        if (config.rate)
+          this_thread::sleep_until(begin + chrono::microseconds(sent * 1000000 / config.rate));
+      }
+      close(fds[1]);
+    });
+
+    PipeReader reader;
+    if (!direct) reader.Open(fds[0], size);
+
+    vector<double> read_us;
+    vector<uint8_t> buf(32 << 10);
+    int64_t pos = 0, mismatches = 0, next_stall = config.stall_every;
+    unsigned stalls = 0;
+
+    auto bench_start = chrono::steady_clock::now();
+    for (;;) {
+      if (next_stall && pos >= next_stall) {
+        stalls++;
+        this_thread::sleep_for(chrono::milliseconds(config.stall_ms));
+        next_stall += config.stall_every;
+      }
+
+      auto start = chrono::steady_clock::now();
+      int n = direct ? (int)read(fds[0], buf.data(), buf.size()) : reader.Read(buf.data(), buf.size());
+      read_us.push_back(Elapsed(start));
+      if (n < 0) {
+        fprintf(stderr, "Read at %lld failed (%d)\n", (long long)pos, n);
+        return 1;
+      }
+      if (n == 0) break;
+
+      for (int i = 0; i < n; i++)
+        if (buf[i] != Pattern(pos + i)) mismatches++;
+      pos += n;
+
+      if (consume)
+        this_thread::sleep_until(bench_start + chrono::microseconds(pos * 1000000 / consume));
+    }
+    double total_s = Elapsed(bench_start) / 1000000;
+    writer.join();
+
+    PipeReader::PipeStats stats = reader.GetPipeStats();
+    reader.Close();
+    close(fds[0]);
+
+    if (pos != config.length) {
+      fprintf(stderr, "Pipe ended at %lld of %lld\n", (long long)pos, (long long)config.length);
+      mismatches++;
+    }
+
+    double blocked_ms = 0;
+    unsigned held_up = 0;
+    for (double t : write_us) {
+      blocked_ms += t / 1000;
+      if (t >= 10000) held_up++;
+    }
+
+    printf("pipe%s: %lld kB in %.2f s, %.1f MB/s, %u reader stalls, %lld bytes wrong\n",
+           direct ? " read directly" : "", (long long)(pos >> 10), total_s, pos / total_s / (1 << 20),
+           stalls, (long long)mismatches);
+    PrintTimes("write", write_us);
+    PrintTimes("read", read_us);
+    printf("  writer   blocked %.0f ms in all, %u writes held up 10 ms or more\n", blocked_ms, held_up);
+    if (!direct) {
+      printf("  reader   %d kB pipe, %lld kB ring, %lld kB waiting at most\n", stats.pipe_size >> 10,
+             (long long)(size >> 10), (long long)(stats.peak >> 10));
+      printf("           pipe full %u times, ring full %u times, %u waits for %.0f ms\n",
+             stats.pipe_full, stats.ring_full, stats.stalls, stats.stall_ms);
+    }
+
+    return mismatches ? 1 : 0;
+  }
+
+  // Checks the packets of the live stream as they're read, and keeps the
+  // first PCR since a seek and the last one
+  struct LiveChecker {
+    int pps;
+    int64_t jump_every;
+    vector<uint8_t> pending;
+    int64_t packets = 0, bad = 0, resyncs = 0, first_pcr = -1, last_pcr = -1;
+
+    void Reset() {
+      pending.clear();
+      first_pcr = -1;
+    }
+
+    void Check(const uint8_t* data, int size) {
+      pending.insert(pending.end(), data, data + size);
+      size_t at = 0;
+      while (pending.size() - at >= (size_t)PACKET_SIZE) {
+        const uint8_t* p = &pending[at];
+        if (p[0] != 0x47) {
+          // only where a connection dropped
+          while (at < pending.size() && pending[at] != 0x47) at++;
+          resyncs++;
+          continue;
+        }
+        int64_t pcr = ((int64_t)p[6] << 25) | (p[7] << 17) | (p[8] << 9) | (p[9] << 1) | (p[10] >> 7);
+        int64_t k = (LiveTime(pcr, pps, jump_every) * pps + 89999) / 90000;
+        bool ok = p[1] == 0x41 && p[5] == 0x10;
+        for (int i = 12; ok && i < PACKET_SIZE; i++)
+          ok = p[i] == Pattern(k * PACKET_SIZE + i);
+        if (ok) {
+          packets++;
+          if (first_pcr == -1) first_pcr = pcr;
+          last_pcr = pcr;
+          at += PACKET_SIZE;
+        } else {
+          bad++;
+          at++;
+        }
+      }
+      pending.erase(pending.begin(), pending.begin() + at);
+    }
+  };
+
+  // Plays the live stream through a TimeshiftBuffer at its own pace, pauses
+  // it, rewinds and then reads as fast as it can until it's live again
+  int BenchTimeshift(Server& server, const string& path, size_t size, float timeout,
+                     int play_s, int pause_s, int rewind_s) {
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/live", server.port);
+    AVIOInterruptCB int_cb = { NULL, NULL };
+
+    TimeshiftBuffer timeshift;
+    if (!timeshift.Open(url, NULL, path, size, timeout, int_cb)) {
+      fprintf(stderr, "Unable to open %s\n", url);
+      return 1;
+    }
+
+    LiveChecker checker;
+    checker.pps = PacketsPerSecond(server.config.rate);
+    checker.jump_every = (int64_t)server.config.discontinuity_s * checker.pps;
+    vector<uint8_t> buf(32 << 10);
+    vector<double> read_us;
+    int64_t read = 0;
+
+    auto read_some = [&]() {
+      auto start = chrono::steady_clock::now();
+      int n = timeshift.Read(buf.data(), buf.size());
+      read_us.push_back(Elapsed(start));
+      if (n > 0) {
+        checker.Check(buf.data(), n);
+        read += n;
+      }
+      return n;
+    };
+
+    auto bench_start = chrono::steady_clock::now();
+    while (Elapsed(bench_start) < play_s * 1000000.0)
+      if (read_some() < 0) return 1;
+    bool live_before = !timeshift.IsBehindLive();
+
+    this_thread::sleep_for(chrono::seconds(pause_s));
+    TimeshiftBuffer::TimeshiftStats paused = timeshift.GetTimeshiftStats();
+    bool behind_after_pause = timeshift.IsBehindLive();
+    // resuming, from where the ring starts if it went past
+    int64_t before_pause = checker.last_pcr;
+    checker.Reset();
+    if (read_some() < 0) return 1;
+
+    // where playback was, less the rewind, on the clock of where it was as
+    // the player's would be. How far off it lands is measured in the time
+    // since the stream started, which carries on over the discontinuities.
+    int64_t target = before_pause * 100 / 9 - (int64_t)rewind_s * 1000000;
+    int64_t target_time = LiveTime(before_pause, checker.pps, checker.jump_every) * 100 / 9 - (int64_t)rewind_s * 1000000;
+    int64_t pts = target, pos = 0;
+    double seek_ms = 0;
+    if (timeshift.TimeToPosition(pts, pos) && timeshift.Seek(pos, SEEK_SET) == pos) {
+      checker.Reset();
+      while (checker.first_pcr == -1)
+        if (read_some() < 0) return 1;
+      seek_ms = (LiveTime(checker.first_pcr, checker.pps, checker.jump_every) * 100 / 9 - target_time) / 1000.0;
+    } else {
+      fprintf(stderr, "Rewind to %.1f s failed\n", target / 1000000.0);
+    }
+
+    auto catch_up_start = chrono::steady_clock::now();
+    int64_t catch_up_read = read;
+    while (timeshift.IsBehindLive())
+      if (read_some() < 0) return 1;
+    double catch_up_s = Elapsed(catch_up_start) / 1000000;
+    catch_up_read = read - catch_up_read;
+
+    TimeshiftBuffer::TimeshiftStats stats = timeshift.GetTimeshiftStats();
+    timeshift.Close();
+
+    printf("%s: %lld kB read, %lld packets, %lld bad, %lld resyncs\n", url, (long long)(read >> 10),
+           (long long)checker.packets, (long long)checker.bad, (long long)checker.resyncs);
+    PrintTimes("read", read_us);
+    printf("  live     %s after playing, %s after a %d s pause with %lld kB to catch up\n",
+           live_before ? "live" : "behind", behind_after_pause ? "behind" : "live", pause_s,
+           (long long)(paused.behind >> 10));
+    printf("  rewind   %d s landed %.0f ms from the target, caught up in %.2f s at %.1f MB/s\n", rewind_s,
+           seek_ms, catch_up_s, catch_up_s > 0 ? catch_up_read / catch_up_s / (1 << 20) : 0.0);
+    printf("  ring     %lld MB, %lld kB received, %lld kB written at %.1f MB/s\n", (long long)(stats.size >> 20),
+           (long long)(stats.received >> 10), (long long)(stats.written >> 10),
+           stats.write_ms > 0 ? stats.written * 1000.0 / stats.write_ms / (1 << 20) : 0.0);
+    printf("           %u overruns, %u times lapped, %u reconnects\n", stats.overruns, stats.lapped, stats.reconnects);
+    printf("  server   %u requests, %u dropped, %u stalls\n",
+           server.requests.load(), server.drops.load(), server.stalls.load());
+
+    return checker.bad || !checker.packets ? 1 : 0;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  Server server;
+  server.config.epoch = chrono::steady_clock::now();
+  server.config.length = 64 << 20;
+  server.config.latency_ms = 0;
+  server.config.rate = 0;
+  server.config.drop_every = 0;
+  server.config.stall_every = 0;
+  server.config.stall_ms = 2000;
+  server.config.segments = 0;
+  server.config.segment_size = 1 << 20;
+  server.config.discontinuity_s = 0;
+  server.config.dash = false;
+  server.config.bare = false;
+  size_t cache_size = 8 << 20;
+  string spill;
+  float timeout = 1;
+  int64_t consume = 0;
+  int64_t seek_every = 0;
+  unsigned seed = 1;
+  int prefetch = 3;
+  string timeshift;
+  int play_s = 5;
+  int pause_s = 10;
+  int rewind_s = 5;
+  bool pipe_input = false;
+  bool direct = false;
+
+  const int size_opt        = 0x100;
+  const int cache_opt       = 0x101;
+  const int spill_opt       = 0x102;
+  const int timeout_opt     = 0x103;
+  const int latency_opt     = 0x104;
+  const int rate_opt        = 0x105;
+  const int drop_every_opt  = 0x106;
+  const int stall_every_opt = 0x107;
+  const int stall_opt       = 0x108;
+  const int consume_opt     = 0x109;
+  const int seek_every_opt  = 0x10a;
+  const int seed_opt        = 0x10b;
+  const int hls_opt         = 0x10c;
+  const int segment_opt     = 0x10d;
+  const int prefetch_opt    = 0x10e;
+  const int timeshift_opt   = 0x10f;
+  const int play_opt        = 0x110;
+  const int pause_opt       = 0x111;
+  const int rewind_opt      = 0x112;
+  const int pipe_opt        = 0x113;
+  const int direct_opt      = 0x114;
+  const int discontinuity_opt = 0x115;
+  const int dash_opt        = 0x116;
+  const int bare_opt        = 0x117;
+
+  struct option longopts[] = {
+    { "size",         required_argument,  NULL,          size_opt },
+    { "cache",        required_argument,  NULL,          cache_opt },
+    { "spill",        required_argument,  NULL,          spill_opt },
+    { "timeout",      required_argument,  NULL,          timeout_opt },
+    { "latency",      required_argument,  NULL,          latency_opt },
+    { "rate",         required_argument,  NULL,          rate_opt },
+    { "drop-every",   required_argument,  NULL,          drop_every_opt },
+    { "stall-every",  required_argument,  NULL,          stall_every_opt },
+    { "stall",        required_argument,  NULL,          stall_opt },
+    { "consume",      required_argument,  NULL,          consume_opt },
+    { "seek-every",   required_argument,  NULL,          seek_every_opt },
+    { "seed",         required_argument,  NULL,          seed_opt },
+    { "hls",          required_argument,  NULL,          hls_opt },
+    { "segment",      required_argument,  NULL,          segment_opt },
+    { "prefetch",     required_argument,  NULL,          prefetch_opt },
+    { "timeshift",    required_argument,  NULL,          timeshift_opt },
+    { "play",         required_argument,  NULL,          play_opt },
+    { "pause",        required_argument,  NULL,          pause_opt },
+    { "rewind",       required_argument,  NULL,          rewind_opt },
+    { "pipe",         no_argument,        NULL,          pipe_opt },
+    { "direct",       no_argument,        NULL,          direct_opt },
+    { "discontinuity", required_argument, NULL,          discontinuity_opt },
+    { "dash",         no_argument,        NULL,          dash_opt },
+    { "bare",         no_argument,        NULL,          bare_opt },
+    { "help",         no_argument,        NULL,          'h' },
+    { 0, 0, 0, 0 }
+  };
+
+  int c;
+  while ((c = getopt_long(argc, argv, "h", longopts, NULL)) != -1) {
+    switch (c) {
+      case size_opt:
+        server.config.length = max((int64_t)(atof(optarg) * (1 << 20)), (int64_t)1);
+        break;
+      case cache_opt:
+        cache_size = max((size_t)(atof(optarg) * (1 << 20)), (size_t)(256 << 10));
+        break;
+      case spill_opt:
+        spill = optarg;
+        break;
+      case timeout_opt:
+        timeout = atof(optarg);
+        break;
+      case latency_opt:
+        server.config.latency_ms = atoi(optarg);
+        break;
+      case rate_opt:
+        server.config.rate = atoi(optarg) << 10;
+        break;
+      case drop_every_opt:
+        server.config.drop_every = (int64_t)atoi(optarg) << 10;
+        break;
+      case stall_every_opt:
+        server.config.stall_every = (int64_t)atoi(optarg) << 10;
+        break;
+      case stall_opt:
+        server.config.stall_ms = atoi(optarg);
+        break;
+      case consume_opt:
+        consume = (int64_t)atoi(optarg) << 10;
+        break;
+      case seek_every_opt:
+        seek_every = (int64_t)atoi(optarg) << 10;
+        break;
+      case seed_opt:
+        seed = strtoul(optarg, NULL, 0);
+        break;
+      case hls_opt:
+        server.config.segments = max(atoi(optarg), 0);
+        break;
+      case segment_opt:
+        server.config.segment_size = max((int64_t)atoi(optarg) << 10, (int64_t)1024);
+        break;
+      case prefetch_opt:
+        prefetch = max(atoi(optarg), 0);
+        break;
+      case timeshift_opt:
+        timeshift = optarg;
+        break;
+      case play_opt:
+        play_s = max(atoi(optarg), 0);
+        break;
+      case pause_opt:
+        pause_s = max(atoi(optarg), 0);
+        break;
+      case rewind_opt:
+        rewind_s = max(atoi(optarg), 0);
+        break;
+      case pipe_opt:
+        pipe_input = true;
+        break;
+      case direct_opt:
+        direct = true;
+        break;
+      case discontinuity_opt:
+        server.config.discontinuity_s = max(atoi(optarg), 0);
+        break;
+      case dash_opt:
+        server.config.dash = true;
+        break;
+      case bare_opt:
+        server.config.bare = true;
+        break;
+      default:
+        PrintUsage();
+        return c == 'h' ? 0 : 1;
+    }
+  }
+
+  if (pipe_input)
+    return BenchPipe(server.config, cache_size, direct, consume);
+
+  if (!server.Start()) return 1;
+  avformat_network_init();
+
+  if (server.config.segments)
+    return BenchHls(server, prefetch, cache_size, timeout, consume);
+  if (!timeshift.empty())
+    return BenchTimeshift(server, timeshift, cache_size, timeout, play_s, pause_s, rewind_s);
+
+  char url[64];
+  snprintf(url, sizeof(url), "http://127.0.0.1:%d/stream", server.port);
+  AVIOInterruptCB int_cb = { NULL, NULL };
+
+  NetworkCache cache;
+  auto open_start = chrono::steady_clock::now();
+  if (!cache.Open(url, NULL, false, cache_size, spill, timeout, int_cb)) {
+    fprintf(stderr, "Unable to open %s\n", url);
+    return 1;
+  }
+  double open_us = Elapsed(open_start);
+
+  int64_t length = server.config.length;
+  mt19937 rng(seed);
+  vector<double> read_us;
+  vector<uint8_t> buf(32 << 10);
+  int64_t pos = 0, read = 0, next_seek = seek_every, mismatches = 0;
+  unsigned seeks = 0;
+
+  auto bench_start = chrono::steady_clock::now();
+  for (;;) {
+    if (seek_every && read >= next_seek) {
+      pos = uniform_int_distribution<int64_t>(0, length - 1)(rng);
+      if (cache.Seek(pos, SEEK_SET) != pos) {
+        fprintf(stderr, "Seek to %lld failed\n", (long long)pos);
+        return 1;
+      }
+      seeks++;
+      next_seek += seek_every;
+    }
+
+    auto start = chrono::steady_clock::now();
+    int n = cache.Read(buf.data(), buf.size());
+    read_us.push_back(Elapsed(start));
+    if (n < 0) {
+      fprintf(stderr, "Read at %lld failed (%d)\n", (long long)pos, n);
+      return 1;
+    }
+    if (n == 0) break;
+
+    for (int i = 0; i < n; i++)
+      if (buf[i] != Pattern(pos + i)) mismatches++;
+    pos += n;
+    read += n;
+
+    // a reader that only keeps up with playback leaves the fetch time to fill the cache
+    if (consume)
+      this_thread::sleep_until(bench_start + chrono::microseconds(read * 1000000 / consume));
+  }
+  double total_s = Elapsed(bench_start) / 1000000;
+
+  if (pos != length) {
+    fprintf(stderr, "Stream ended at %lld of %lld\n", (long long)pos, (long long)length);
+    mismatches++;
+  }
+
+  NetworkCache::CacheStats stats = cache.GetCacheStats();
+  cache.Close();
+
+  printf("%s: %lld kB in %.2f s, %.1f MB/s, %u seeks, %lld bytes wrong\n", url,
+         (long long)(read >> 10), total_s, read / total_s / (1 << 20), seeks, (long long)mismatches);
+  printf("  open     %8.1f us\n", open_us);
+  PrintTimes("read", read_us);
+  printf("  cache    %lld kB fetched, %lld kB from memory, %lld kB from disk\n",
+         (long long)(stats.fetched >> 10), (long long)(stats.from_memory >> 10), (long long)(stats.from_disk >> 10));
+  printf("           %u refetches, %u reconnects, %u stalls for %.0f ms\n",
+         stats.refetches, stats.reconnects, stats.stalls, stats.stall_ms);
+  printf("  server   %u requests, %u dropped, %u stalls\n",
+         server.requests.load(), server.drops.load(), server.stalls.load());
+
+  return mismatches ? 1 : 0;
+}
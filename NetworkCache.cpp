@@ -0,0 +1,443 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "NetworkCache.h"
+#include "utils/log.h"
+
+// Bytes asked of the protocol at a time
+#define FETCH_SIZE           (64 * 1024)
+// The part of the ring kept behind the read position is 1/KEEP_BEHIND
+#define KEEP_BEHIND          4
+// Reads this far ahead of the fetch wait for it rather than starting over
+#define READ_AHEAD_WAIT      (1024 * 1024)
+// How often a waiting read checks the interrupt callback
+#define WAIT_MS              100
+#define RECONNECT_MIN_MS     100
+#define RECONNECT_MAX_MS     2000
+
+NetworkCache::NetworkCache()
+: m_options(NULL), m_http(false), m_live(false), m_seekable(false), m_length(-1),
+  m_io(NULL), m_size(0), m_start(0), m_end(0), m_pos(0), m_eof(false), m_seek_to(-1),
+  m_spill_fd(-1)
+{
+  m_interrupt.callback = NULL;
+  m_interrupt.opaque = NULL;
+  memset(&m_stats, 0, sizeof(m_stats));
+}
+
+NetworkCache::~NetworkCache()
+{
+  Close();
+}
+
+bool NetworkCache::Open(const std::string &url, AVDictionary *options, bool live, size_t size,
+                        const std::string &spill_file, float timeout, const AVIOInterruptCB &int_cb)
+{
+  Close();
+
+  m_url       = url;
+  m_http      = url.compare(0, 7, "http://") == 0 || url.compare(0, 8, "https://") == 0;
+  m_live      = live;
+  m_seekable  = false;
+  m_interrupt = int_cb;
+  av_dict_copy(&m_options, options, 0);
+  // a stalled connection is dropped and opened again after this
+  if (timeout > 0)
+    av_dict_set_int(&m_options, "rw_timeout", (int64_t)(timeout * 1e6), AV_DICT_DONT_OVERWRITE);
+
+  if (!Connect(0, int_cb))
+  {
+    av_dict_free(&m_options);
+    return false;
+  }
+
+  m_length   = avio_size(m_io);
+  if (m_length < 0)
+    m_length = -1;
+  m_seekable = !live && (m_io->seekable & AVIO_SEEKABLE_NORMAL);
+
+  m_ring.reset(new uint8_t[size]);
+  m_size    = size;
+  m_start   = 0;
+  m_end     = 0;
+  m_pos     = 0;
+  m_eof     = false;
+  m_seek_to = -1;
+  memset(&m_stats, 0, sizeof(m_stats));
+
+  // only what can be read again at the same offset is worth keeping
+  if (!spill_file.empty() && m_seekable && m_length > 0)
+  {
+    m_spill_fd = open(spill_file.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (m_spill_fd == -1)
+      CLog::Log(LOGWARNING, "NetworkCache: unable to open %s: %s", spill_file.c_str(), strerror(errno));
+    else
+      unlink(spill_file.c_str());
+  }
+
+  CLog::Log(LOGDEBUG, "NetworkCache: %s, %lld bytes%s, %lld kB ring%s", m_url.c_str(),
+            (long long)m_length, m_seekable ? "" : " not seekable", (long long)(m_size >> 10),
+            m_spill_fd != -1 ? " and spill file" : "");
+
+  Create();
+  return true;
+}
+
+void NetworkCache::Close()
+{
+  if (Running())
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_bStop = true;
+    }
+    m_cond.notify_all();
+    StopThread();
+  }
+
+  if (m_ring)
+  {
+    CacheStats stats = GetCacheStats();
+    CLog::Log(LOGDEBUG, "NetworkCache: %lld kB fetched, %lld kB read from memory and %lld kB from disk, "
+              "%u refetches, %u reconnects, %u stalls for %.0f ms", (long long)(stats.fetched >> 10),
+              (long long)(stats.from_memory >> 10), (long long)(stats.from_disk >> 10),
+              stats.refetches, stats.reconnects, stats.stalls, stats.stall_ms);
+  }
+
+  Disconnect();
+
+  if (m_spill_fd != -1)
+  {
+    close(m_spill_fd);
+    m_spill_fd = -1;
+  }
+  m_spilled.clear();
+  m_ring.reset();
+  m_size = 0;
+  av_dict_free(&m_options);
+}
+
+NetworkCache::CacheStats NetworkCache::GetCacheStats()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+int NetworkCache::Interrupted(void *opaque)
+{
+  NetworkCache *cache = (NetworkCache *)opaque;
+  return cache->m_bStop || cache->m_seek_to != -1;
+}
+
+bool NetworkCache::Connect(int64_t offset, const AVIOInterruptCB &int_cb)
+{
+  AVDictionary *options = NULL;
+  av_dict_copy(&options, m_options, 0);
+
+  // http asks for the range straight away, other protocols seek once open
+  bool resume = offset > 0 && m_seekable;
+  if (resume && m_http)
+    av_dict_set_int(&options, "offset", offset, 0);
+
+  AVIOContext *io = NULL;
+  int ret = avio_open2(&io, m_url.c_str(), AVIO_FLAG_READ, &int_cb, &options);
+  av_dict_free(&options);
+  if (ret < 0)
+  {
+    // not worth a mention if a seek or Close() cut it short
+    if (ret != AVERROR_EXIT)
+      CLog::Log(LOGERROR, "NetworkCache: unable to open %s at %lld (%d)", m_url.c_str(), (long long)offset, ret);
+    return false;
+  }
+
+  if (resume && !m_http && avio_seek(io, offset, SEEK_SET) != offset)
+  {
+    CLog::Log(LOGERROR, "NetworkCache: unable to seek %s to %lld", m_url.c_str(), (long long)offset);
+    avio_closep(&io);
+    return false;
+  }
+
+  m_io = io;
+  return true;
+}
+
+void NetworkCache::Disconnect()
+{
+  if (m_io)
+    avio_closep(&m_io);
+}
+
+// Empties the ring and has the fetch thread start again at offset.
+// Called with m_mutex held.
+void NetworkCache::Restart(int64_t offset)
+{
+  m_start   = offset;
+  m_end     = offset;
+  m_eof     = false;
+  m_seek_to = offset;
+  m_stats.refetches++;
+  m_cond.notify_all();
+}
+
+bool NetworkCache::Spilled(int64_t pos, int64_t &end)
+{
+  if (m_spill_fd == -1)
+    return false;
+
+  std::map<int64_t, int64_t>::iterator it = m_spilled.upper_bound(pos);
+  if (it == m_spilled.begin())
+    return false;
+  --it;
+  if (pos >= it->second)
+    return false;
+  end = it->second;
+  return true;
+}
+
+void NetworkCache::AddSpilled(int64_t start, int64_t end)
+{
+  std::map<int64_t, int64_t>::iterator it = m_spilled.upper_bound(start);
+  if (it != m_spilled.begin())
+  {
+    std::map<int64_t, int64_t>::iterator prev = it;
+    --prev;
+    if (prev->second >= start)
+    {
+      start = prev->first;
+      end = std::max(end, prev->second);
+      m_spilled.erase(prev);
+    }
+  }
+  while (it != m_spilled.end() && it->first <= end)
+  {
+    end = std::max(end, it->second);
+    it = m_spilled.erase(it);
+  }
+  m_spilled[start] = end;
+}
+
+void NetworkCache::Process()
+{
+  const AVIOInterruptCB int_cb = { Interrupted, this };
+  int backoff_ms = 0;
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_bStop)
+  {
+    int64_t seek_to = m_seek_to;
+    if (seek_to != -1)
+    {
+      m_seek_to = -1;
+      lock.unlock();
+      // a read that was interrupted leaves its error on the context
+      if (!m_io || m_io->error || avio_seek(m_io, seek_to, SEEK_SET) != seek_to)
+      {
+        // if this fails too, connecting is retried below
+        Disconnect();
+        Connect(seek_to, int_cb);
+      }
+      lock.lock();
+      continue;
+    }
+
+    if (!m_io)
+    {
+      if (backoff_ms)
+      {
+        m_cond.wait_for(lock, std::chrono::milliseconds(backoff_ms));
+        if (m_bStop || m_seek_to != -1)
+          continue;
+      }
+      int64_t offset = m_end;
+      lock.unlock();
+      bool ok = Connect(offset, int_cb);
+      lock.lock();
+      if (ok)
+        backoff_ms = 0;
+      else if (m_seek_to == -1)
+        backoff_ms = backoff_ms ? std::min(backoff_ms * 2, RECONNECT_MAX_MS) : RECONNECT_MIN_MS;
+      continue;
+    }
+
+    int64_t room = m_size - m_size / KEEP_BEHIND - (m_end - m_pos);
+    if (m_eof || room <= 0)
+    {
+      m_cond.wait(lock);
+      continue;
+    }
+
+    int64_t offset = m_end;
+    int64_t at = offset % m_size;
+    int len = (int)std::min(std::min(room, m_size - at), (int64_t)FETCH_SIZE);
+    m_start = std::max(m_start, offset + len - m_size);
+    lock.unlock();
+
+    int n = avio_read(m_io, m_ring.get() + at, len);
+    bool spilled = n > 0 && m_spill_fd != -1 && pwrite(m_spill_fd, m_ring.get() + at, n, offset) == n;
+
+    lock.lock();
+    if (n > 0)
+    {
+      m_stats.fetched += n;
+      if (spilled)
+        AddSpilled(offset, offset + n);
+      // unless the reader has moved on
+      if (m_seek_to == -1)
+      {
+        m_end += n;
+        m_cond.notify_all();
+      }
+      continue;
+    }
+
+    if (m_bStop || m_seek_to != -1)
+      continue;
+
+    // a live stream that ends has dropped, as has anything shorter than its length
+    if ((n == 0 || n == AVERROR_EOF) && !m_live && (m_length < 0 || m_end >= m_length))
+    {
+      m_eof = true;
+      m_cond.notify_all();
+      continue;
+    }
+
+    CLog::Log(LOGWARNING, "NetworkCache: %s at %lld, reconnecting",
+              n == 0 || n == AVERROR_EOF ? "connection closed" : "read failed", (long long)m_end);
+    m_stats.reconnects++;
+    lock.unlock();
+    Disconnect();
+    lock.lock();
+  }
+}
+
+int NetworkCache::Read(uint8_t *buf, int size)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  std::chrono::steady_clock::time_point stall_start;
+  bool stalled = false;
+  int ret;
+
+  for (;;)
+  {
+    int64_t pos = m_pos;
+    if (pos >= m_start && pos < m_end)
+    {
+      ret = (int)std::min((int64_t)size, m_end - pos);
+      int64_t at = pos % m_size;
+      int first = (int)std::min((int64_t)ret, m_size - at);
+      memcpy(buf, m_ring.get() + at, first);
+      memcpy(buf + first, m_ring.get(), ret - first);
+      m_stats.from_memory += ret;
+      break;
+    }
+
+    int64_t end;
+    if (Spilled(pos, end))
+    {
+      lock.unlock();
+      ret = pread(m_spill_fd, buf, std::min((int64_t)size, end - pos), pos);
+      lock.lock();
+      if (ret > 0)
+      {
+        m_stats.from_disk += ret;
+        break;
+      }
+    }
+
+    if ((m_length >= 0 && pos >= m_length) || (m_eof && pos >= m_end))
+    {
+      ret = 0;
+      break;
+    }
+
+    // a little way ahead is quicker to wait for than a new request
+    if (m_seekable && (pos < m_start || pos >= m_end + READ_AHEAD_WAIT))
+      Restart(pos);
+
+    if (m_interrupt.callback && m_interrupt.callback(m_interrupt.opaque))
+    {
+      ret = AVERROR_EXIT;
+      break;
+    }
+
+    if (!stalled)
+    {
+      stalled = true;
+      stall_start = std::chrono::steady_clock::now();
+      m_stats.stalls++;
+    }
+    m_cond.wait_for(lock, std::chrono::milliseconds(WAIT_MS));
+  }
+
+  if (stalled)
+    m_stats.stall_ms += std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - stall_start).count();
+
+  if (ret > 0)
+  {
+    m_pos += ret;
+    m_cond.notify_all();
+  }
+  return ret;
+}
+
+int64_t NetworkCache::Seek(int64_t offset, int whence)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  if (whence == AVSEEK_SIZE)
+    return m_length;
+
+  int64_t pos;
+  switch (whence & ~AVSEEK_FORCE)
+  {
+    case SEEK_SET: pos = offset; break;
+    case SEEK_CUR: pos = m_pos + offset; break;
+    case SEEK_END: pos = m_length < 0 ? -1 : m_length + offset; break;
+    default:       pos = -1; break;
+  }
+
+  // a stream that can't seek can only skip forward or back into the ring
+  if (pos < 0 || (!m_seekable && pos < m_start))
+    return -1;
+
+  // After a seek into the spill file the fetch carries on from the end of
+  // the part that's there, unless it's already getting there
+  int64_t end;
+  if (m_seekable && (pos < m_start || pos > m_end) && Spilled(pos, end) &&
+      (m_end < pos || m_end > end) && (m_length < 0 || end < m_length))
+    Restart(end);
+
+  m_pos = pos;
+  m_cond.notify_all();
+  return pos;
+}
+
+bool NetworkCache::IsEOF()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return (m_length >= 0 && m_pos >= m_length) || (m_eof && m_pos >= m_end);
+}
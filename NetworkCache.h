@@ -0,0 +1,117 @@
+#pragma once
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+extern "C" {
+#include <libavformat/avio.h>
+#include <libavutil/dict.h>
+};
+
+#include "OMXThread.h"
+
+// Reads an http(s) or ftp stream ahead of the demuxer, so that TCP stalls
+// and server hiccups are taken up here rather than reaching the decoders.
+// A thread fetches the stream through ffmpeg's own protocols into a ring
+// in memory, which also keeps a quarter of its size behind the read
+// position for short seeks back. With a spill file everything fetched is
+// written to disk as well, and any part seen before is read from there.
+//
+// A seek outside what's cached restarts the fetch at the new offset, which
+// for http is a range request. A connection that drops, or stalls for the
+// timeout, is opened again where it left off.
+class NetworkCache : public OMXThread
+{
+public:
+  struct CacheStats
+  {
+    int64_t      fetched;      // bytes
+    int64_t      from_memory;  // bytes
+    int64_t      from_disk;    // bytes
+    unsigned int refetches;    // seeks outside the cache
+    unsigned int reconnects;
+    unsigned int stalls;       // reads that had to wait for the fetch
+    double       stall_ms;
+  };
+
+  NetworkCache();
+  ~NetworkCache();
+
+  // options go to the protocol on each connect. size is the size of the
+  // ring in bytes, spill_file may be empty. Reads give up waiting when
+  // int_cb says so.
+  bool Open(const std::string &url, AVDictionary *options, bool live, size_t size,
+            const std::string &spill_file, float timeout, const AVIOInterruptCB &int_cb);
+  void Close();
+
+  // Returns 0 only at the end of the stream
+  int Read(uint8_t *buf, int size);
+  int64_t Seek(int64_t offset, int whence);
+  // -1 if the server didn't say
+  int64_t GetLength() { return m_length; }
+  bool IsSeekable() { return m_seekable; }
+  bool IsEOF();
+  CacheStats GetCacheStats();
+
+  void Process() override;
+
+private:
+  static int Interrupted(void *opaque);
+  bool Connect(int64_t offset, const AVIOInterruptCB &int_cb);
+  void Disconnect();
+  void Restart(int64_t offset);
+  bool Spilled(int64_t pos, int64_t &end);
+  void AddSpilled(int64_t start, int64_t end);
+
+  std::string     m_url;
+  AVDictionary   *m_options;
+  AVIOInterruptCB m_interrupt;
+  bool            m_http;
+  bool            m_live;
+  bool            m_seekable;
+  int64_t         m_length;
+
+  // only used by the fetch thread once it's running
+  AVIOContext    *m_io;
+
+  // The ring holds [m_start, m_end) of the stream, byte n at n % m_size.
+  // The fetch thread writes after m_end with the lock released, having
+  // moved m_start past what it will overwrite.
+  std::unique_ptr<uint8_t[]> m_ring;
+  int64_t         m_size;
+  int64_t         m_start;
+  int64_t         m_end;
+  int64_t         m_pos;
+  bool            m_eof;
+  // where the fetch thread has to start again, or -1
+  std::atomic<int64_t> m_seek_to;
+
+  // ranges of the stream in the spill file, start to end
+  int             m_spill_fd;
+  std::map<int64_t, int64_t> m_spilled;
+
+  CacheStats      m_stats;
+  std::mutex      m_mutex;
+  std::condition_variable m_cond;
+};
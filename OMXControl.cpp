@@ -5,9 +5,12 @@
 #include <string.h>
 #include <dbus/dbus.h>
 
+#include <algorithm>
+#include <cmath>
 #include <string>
 #include <sstream>
 #include <utility>
+#include <vector>
 
 #include "utils/log.h"
 #include "OMXControl.h"
@@ -53,9 +56,110 @@ void deprecatedMessage()
   CLog::Log(LOGWARNING, "DBus property access through direct method is deprecated. Use Get/Set methods instead.");
 }
 
+//Property values are appended to the reply of Get, or to a variant for
+//GetAll and PropertiesChanged
+void append_boolean(DBusMessageIter *iter, dbus_bool_t b)
+{
+  dbus_message_iter_append_basic(iter, DBUS_TYPE_BOOLEAN, &b);
+}
+
+void append_int64(DBusMessageIter *iter, dbus_int64_t i)
+{
+  dbus_message_iter_append_basic(iter, DBUS_TYPE_INT64, &i);
+}
+
+void append_double(DBusMessageIter *iter, double d)
+{
+  dbus_message_iter_append_basic(iter, DBUS_TYPE_DOUBLE, &d);
+}
+
+void append_string(DBusMessageIter *iter, const char *text)
+{
+  dbus_message_iter_append_basic(iter, DBUS_TYPE_STRING, &text);
+}
+
+void append_string_array(DBusMessageIter *iter, const char *array[], int size)
+{
+  DBusMessageIter array_cont;
+  dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, DBUS_TYPE_STRING_AS_STRING, &array_cont);
+  for (int i = 0; i < size; i++)
+    dbus_message_iter_append_basic(&array_cont, DBUS_TYPE_STRING, &array[i]);
+  dbus_message_iter_close_container(iter, &array_cont);
+}
+
 
 #define CLASSNAME "OMXControl"
 
+#define MAX_MESSAGES_PER_EVENT 64
+
+// microseconds between Position updates while playing
+#define POSITION_INTERVAL 1000000
+// a position this far from where playback should have got to is a seek,
+// it's more than playback can drift between two updates
+#define POSITION_JUMP 2000000
+
+namespace
+{
+  // The entries of a handler table sorted by interface and name. A call
+  // without an interface matches the first entry with its name, as it did
+  // with dbus_message_is_method_call.
+  template<class Entry>
+  class DispatchIndex
+  {
+  public:
+    template<size_t N>
+    explicit DispatchIndex(const Entry (&table)[N])
+    : m_table(table), m_size(N)
+    {
+      for (size_t i = 0; i < N; i++)
+        m_sorted.push_back(&table[i]);
+      std::sort(m_sorted.begin(), m_sorted.end(), [](const Entry *a, const Entry *b)
+      {
+        return compare(a->interface, a->name, b->interface, b->name) < 0;
+      });
+    }
+
+    const Entry *find(const char *interface, const char *name) const
+    {
+      if (!name)
+        return NULL;
+
+      if (!interface)
+      {
+        for (size_t i = 0; i < m_size; i++)
+          if (strcmp(m_table[i].name, name) == 0)
+            return &m_table[i];
+        return NULL;
+      }
+
+      size_t lo = 0, hi = m_sorted.size();
+      while (lo < hi)
+      {
+        size_t mid = lo + (hi - lo) / 2;
+        int c = compare(m_sorted[mid]->interface, m_sorted[mid]->name, interface, name);
+        if (c == 0)
+          return m_sorted[mid];
+        if (c < 0)
+          lo = mid + 1;
+        else
+          hi = mid;
+      }
+      return NULL;
+    }
+
+  private:
+    static int compare(const char *interface1, const char *name1, const char *interface2, const char *name2)
+    {
+      int c = strcmp(interface1, interface2);
+      return c ? c : strcmp(name1, name2);
+    }
+
+    const Entry *m_table;
+    size_t m_size;
+    std::vector<const Entry *> m_sorted;
+  };
+}
+
 OMXControlResult::OMXControlResult( int newKey ) {
   key = newKey;
 }
@@ -187,286 +291,841 @@ void OMXControl::dbus_disconnect()
     }
 }
 
+bool OMXControl::openSocket(const std::string& path)
+{
+  return control_socket.Open(path, clock, audio);
+}
+
+void OMXControl::closeSocket()
+{
+  control_socket.Close();
+}
+
 OMXControlResult OMXControl::getEvent()
 {
+  ControlSocket::Command command;
+  while (control_socket.Pop(command))
+  {
+    OMXControlResult result = handle_command(command);
+    if (result.getKey() != KeyConfig::ACTION_BLANK)
+      return result;
+  }
+
   if (!bus)
     return KeyConfig::ACTION_BLANK;
 
   dispatch();
-  DBusMessage *m = dbus_connection_pop_message(bus);
+  update_properties();
 
-  if (m == NULL)
-    return KeyConfig::ACTION_BLANK;
+  // Calls which don't need the player to do anything are all answered
+  // now, so clients polling properties aren't held to one call per pass
+  // of the main loop
+  for (int i = 0; i < MAX_MESSAGES_PER_EVENT; i++)
+  {
+    DBusMessage *m = dbus_connection_pop_message(bus);
+
+    if (m == NULL)
+      break;
 
-  CLog::Log(LOGDEBUG, "Popped message member: %s interface: %s type: %d path: %s", dbus_message_get_member(m), dbus_message_get_interface(m), dbus_message_get_type(m), dbus_message_get_path(m) );
-  OMXControlResult result = handle_event(m);
-  dbus_message_unref(m);
+    CLog::Log(LOGDEBUG, "Popped message member: %s interface: %s type: %d path: %s", dbus_message_get_member(m), dbus_message_get_interface(m), dbus_message_get_type(m), dbus_message_get_path(m) );
+    OMXControlResult result = handle_event(m);
+    dbus_message_unref(m);
+
+    if (result.getKey() != KeyConfig::ACTION_BLANK)
+      return result;
+  }
 
-  return result;
+  return KeyConfig::ACTION_BLANK;
 }
 
-OMXControlResult OMXControl::handle_event(DBusMessage *m)
+// In the order dbus_message_is_method_call was tried, which decides the
+// handler of a call without an interface
+const OMXControl::MethodHandler OMXControl::method_handlers[] =
 {
   //----------------------------DBus root interface-----------------------------
-  //Methods:
-  if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_ROOT, "Quit"))
-  {
-    dbus_respond_ok(m);//Note: No reply according to MPRIS2 specs
-    return KeyConfig::ACTION_EXIT;
-  }
-  else if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_ROOT, "Raise"))
-  {
-    //Does nothing
-    return KeyConfig::ACTION_BLANK;
-  }
-  //Properties Get method:
-  //TODO: implement GetAll
-  else if (dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "Get"))
-  {
-    DBusError error;
-    dbus_error_init(&error);
-
-    //Retrieve interface and property name
-    const char *interface, *property;
-    dbus_message_get_args(m, &error, DBUS_TYPE_STRING, &interface, DBUS_TYPE_STRING, &property, DBUS_TYPE_INVALID);
-    //Root interface:
-    if (strcmp(interface, OMXPLAYER_DBUS_INTERFACE_ROOT)==0)
+  { OMXPLAYER_DBUS_INTERFACE_ROOT, "Quit", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
     {
-      if (strcmp(property, "CanRaise")==0)
-      {
-        dbus_respond_boolean(m, 0);
-        return KeyConfig::ACTION_BLANK;
-      }
-      else if (strcmp(property, "CanQuit")==0)
-      {
-        dbus_respond_boolean(m, 1);
-        return KeyConfig::ACTION_BLANK;
-      }
-      else if (strcmp(property, "CanSetFullscreen")==0)
-      {
-        dbus_respond_boolean(m, 0);
-        return KeyConfig::ACTION_BLANK;
-      }
-      else if (strcmp(property, "Fullscreen")==0) //Fullscreen is read/write in theory not read only, but read only at the moment so...
-      {
-        dbus_respond_boolean(m, 1);
+      c.dbus_respond_ok(m);//Note: No reply according to MPRIS2 specs
+      return KeyConfig::ACTION_EXIT;
+    } },
+  { OMXPLAYER_DBUS_INTERFACE_ROOT, "Raise", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      //Does nothing
+      return KeyConfig::ACTION_BLANK;
+    } },
+  //Properties methods:
+  { DBUS_INTERFACE_PROPERTIES, "Get", [](OMXControl &c, DBusMessage *m) { return c.get_property(m); } },
+  { DBUS_INTERFACE_PROPERTIES, "Set", [](OMXControl &c, DBusMessage *m) { return c.set_property(m); } },
+  { DBUS_INTERFACE_PROPERTIES, "GetAll", [](OMXControl &c, DBusMessage *m) { return c.get_all_properties(m); } },
+  //----------------------------------------------------------------------------
+
+
+  //-------------------------DEPRECATED PROPERTIES METHODS----------------------
+  { DBUS_INTERFACE_PROPERTIES, "CanQuit", [](OMXControl &c, DBusMessage *m) { return c.deprecated_boolean(m, 1); } },
+  { DBUS_INTERFACE_PROPERTIES, "Fullscreen", [](OMXControl &c, DBusMessage *m) { return c.deprecated_boolean(m, 1); } },
+  { DBUS_INTERFACE_PROPERTIES, "CanSetFullscreen", [](OMXControl &c, DBusMessage *m) { return c.deprecated_boolean(m, 0); } },
+  { DBUS_INTERFACE_PROPERTIES, "CanRaise", [](OMXControl &c, DBusMessage *m) { return c.deprecated_boolean(m, 0); } },
+  { DBUS_INTERFACE_PROPERTIES, "HasTrackList", [](OMXControl &c, DBusMessage *m) { return c.deprecated_boolean(m, 0); } },
+  { DBUS_INTERFACE_PROPERTIES, "Identity", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      c.dbus_respond_string(m, "OMXPlayer");
+      deprecatedMessage();
+      return KeyConfig::ACTION_BLANK;
+    } },
+  { DBUS_INTERFACE_PROPERTIES, "SupportedUriSchemes", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      const char *UriSchemes[] = {"file", "http", "rtsp", "rtmp"};
+      c.dbus_respond_array(m, UriSchemes, 2); // Array is of length 2
+      deprecatedMessage();
+      return KeyConfig::ACTION_BLANK;
+    } },
+  { DBUS_INTERFACE_PROPERTIES, "SupportedMimeTypes", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      const char *MimeTypes[] = {}; // Needs supplying
+      c.dbus_respond_array(m, MimeTypes, 0);
+      deprecatedMessage();
+      return KeyConfig::ACTION_BLANK;
+    } },
+  { DBUS_INTERFACE_PROPERTIES, "CanGoNext", [](OMXControl &c, DBusMessage *m) { return c.deprecated_boolean(m, 0); } },
+  { DBUS_INTERFACE_PROPERTIES, "CanGoPrevious", [](OMXControl &c, DBusMessage *m) { return c.deprecated_boolean(m, 0); } },
+  { DBUS_INTERFACE_PROPERTIES, "CanSeek", [](OMXControl &c, DBusMessage *m) { return c.deprecated_boolean(m, c.reader->CanSeek()); } },
+  { DBUS_INTERFACE_PROPERTIES, "CanControl", [](OMXControl &c, DBusMessage *m) { return c.deprecated_boolean(m, 1); } },
+  { DBUS_INTERFACE_PROPERTIES, "CanPlay", [](OMXControl &c, DBusMessage *m) { return c.deprecated_boolean(m, 1); } },
+  { DBUS_INTERFACE_PROPERTIES, "CanPause", [](OMXControl &c, DBusMessage *m) { return c.deprecated_boolean(m, 1); } },
+  { DBUS_INTERFACE_PROPERTIES, "PlaybackStatus", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      c.dbus_respond_string(m, c.clock->OMXIsPaused() ? "Paused" : "Playing");
+      deprecatedMessage();
+      return KeyConfig::ACTION_BLANK;
+    } },
+  { DBUS_INTERFACE_PROPERTIES, "GetSource", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      c.dbus_respond_string(m, c.reader->getFilename().c_str());
+      deprecatedMessage();
+      return KeyConfig::ACTION_BLANK;
+    } },
+  { DBUS_INTERFACE_PROPERTIES, "Volume", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      DBusError error;
+      dbus_error_init(&error);
+
+      double volume;
+      dbus_message_get_args(m, &error, DBUS_TYPE_DOUBLE, &volume, DBUS_TYPE_INVALID);
+
+      if (dbus_error_is_set(&error))
+      { // i.e. Get current volume
+        dbus_error_free(&error);
+        c.dbus_respond_double(m, c.audio->GetVolume());
+        deprecatedMessage();
         return KeyConfig::ACTION_BLANK;
       }
-      else if (strcmp(property, "HasTrackList")==0)
+      else
       {
-        dbus_respond_boolean(m, 0);
+        //Min value is 0
+        if(volume<.0)
+        {
+          volume=.0;
+        }
+        c.audio->SetVolume(volume);
+        c.dbus_respond_double(m, volume);
+        deprecatedMessage();
         return KeyConfig::ACTION_BLANK;
       }
-      else if (strcmp(property, "Identity")==0)
+    } },
+  { DBUS_INTERFACE_PROPERTIES, "Mute", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      c.audio->SetMute(true);
+      c.dbus_respond_ok(m);
+      deprecatedMessage();
+      return KeyConfig::ACTION_BLANK;
+    } },
+  { DBUS_INTERFACE_PROPERTIES, "Unmute", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      c.audio->SetMute(false);
+      c.dbus_respond_ok(m);
+      deprecatedMessage();
+      return KeyConfig::ACTION_BLANK;
+    } },
+  { DBUS_INTERFACE_PROPERTIES, "Position", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      // Returns the current position in microseconds
+      c.dbus_respond_int64(m, c.clock->OMXMediaTime());
+      deprecatedMessage();
+      return KeyConfig::ACTION_BLANK;
+    } },
+  { DBUS_INTERFACE_PROPERTIES, "Aspect", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      // Returns aspect ratio
+      c.dbus_respond_double(m, c.reader->GetAspectRatio());
+      deprecatedMessage();
+      return KeyConfig::ACTION_BLANK;
+    } },
+  { DBUS_INTERFACE_PROPERTIES, "VideoStreamCount", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      // Returns number of video streams
+      c.dbus_respond_int64(m, c.reader->VideoStreamCount());
+      deprecatedMessage();
+      return KeyConfig::ACTION_BLANK;
+    } },
+  { DBUS_INTERFACE_PROPERTIES, "ResWidth", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      // Returns width of video
+      c.dbus_respond_int64(m, c.reader->GetWidth());
+      deprecatedMessage();
+      return KeyConfig::ACTION_BLANK;
+    } },
+  { DBUS_INTERFACE_PROPERTIES, "ResHeight", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      // Returns height of video
+      c.dbus_respond_int64(m, c.reader->GetHeight());
+      deprecatedMessage();
+      return KeyConfig::ACTION_BLANK;
+    } },
+  { DBUS_INTERFACE_PROPERTIES, "Duration", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      // Returns the duration in microseconds
+      c.dbus_respond_int64(m, c.reader->GetStreamLengthMicro());
+      deprecatedMessage();
+      return KeyConfig::ACTION_BLANK;
+    } },
+  { DBUS_INTERFACE_PROPERTIES, "MinimumRate", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      c.dbus_respond_double(m, 0.0);
+      deprecatedMessage();
+      return KeyConfig::ACTION_BLANK;
+    } },
+  { DBUS_INTERFACE_PROPERTIES, "MaximumRate", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      //TODO: to be made consistent
+      c.dbus_respond_double(m, 10.125);
+      deprecatedMessage();
+      return KeyConfig::ACTION_BLANK;
+    } },
+  //----------------------------------------------------------------------------
+
+
+  //--------------------------Player interface methods--------------------------
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "GetSource", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      c.dbus_respond_string(m, c.reader->getFilename().c_str());
+      return KeyConfig::ACTION_BLANK;
+    } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "Next", [](OMXControl &c, DBusMessage *m) { return c.respond_action(m, KeyConfig::ACTION_NEXT_CHAPTER); } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "Previous", [](OMXControl &c, DBusMessage *m) { return c.respond_action(m, KeyConfig::ACTION_PREVIOUS_CHAPTER); } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "Pause", [](OMXControl &c, DBusMessage *m) { return c.respond_action(m, KeyConfig::ACTION_PAUSE); } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "Play", [](OMXControl &c, DBusMessage *m) { return c.respond_action(m, KeyConfig::ACTION_PLAY); } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "PlayPause", [](OMXControl &c, DBusMessage *m) { return c.respond_action(m, KeyConfig::ACTION_PLAYPAUSE); } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "Stop", [](OMXControl &c, DBusMessage *m) { return c.respond_action(m, KeyConfig::ACTION_EXIT); } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "Seek", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      DBusError error;
+      dbus_error_init(&error);
+
+      int64_t offset;
+      dbus_message_get_args(m, &error, DBUS_TYPE_INT64, &offset, DBUS_TYPE_INVALID);
+
+      // Make sure a value is sent for seeking
+      if (dbus_error_is_set(&error))
       {
-        dbus_respond_string(m, "OMXPlayer");
+        CLog::Log(LOGWARNING, "Seek D-Bus Error: %s", error.message );
+        dbus_error_free(&error);
+        c.dbus_respond_ok(m);
         return KeyConfig::ACTION_BLANK;
       }
-      else if (strcmp(property, "SupportedUriSchemes")==0) //TODO: Update ?
+      else
       {
-        const char *UriSchemes[] = {"file", "http", "rtsp", "rtmp"};
-        dbus_respond_array(m, UriSchemes, 4); // Array is of length 4
-        return KeyConfig::ACTION_BLANK;
+        c.dbus_respond_int64(m, offset);
+        return OMXControlResult(KeyConfig::ACTION_SEEK_RELATIVE, offset);
       }
-      else if (strcmp(property, "SupportedMimeTypes")==0) //Vinc: TODO: Minimal list of supported types based on ffmpeg minimal support ?
+    } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "SetPosition", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      DBusError error;
+      dbus_error_init(&error);
+
+      int64_t position;
+      const char *oPath; // ignoring path right now because we don't have a playlist
+      dbus_message_get_args(m, &error, DBUS_TYPE_OBJECT_PATH, &oPath, DBUS_TYPE_INT64, &position, DBUS_TYPE_INVALID);
+
+      // Make sure a value is sent for setting position
+      if (dbus_error_is_set(&error))
       {
-        const char *MimeTypes[] = {}; // Needs supplying
-        dbus_respond_array(m, MimeTypes, 0);
+        CLog::Log(LOGWARNING, "SetPosition D-Bus Error: %s", error.message );
+        dbus_error_free(&error);
+        c.dbus_respond_ok(m);
         return KeyConfig::ACTION_BLANK;
       }
-      //Wrong property
       else
       {
-        //Error
-        CLog::Log(LOGWARNING, "Unhandled dbus property message, member: %s interface: %s type: %d path: %s property: %s", dbus_message_get_member(m), dbus_message_get_interface(m), dbus_message_get_type(m), dbus_message_get_path(m), property );
-        dbus_respond_error(m, DBUS_ERROR_UNKNOWN_PROPERTY, "Unknown property");
-        return KeyConfig::ACTION_BLANK;
+        c.dbus_respond_int64(m, position);
+        return OMXControlResult(KeyConfig::ACTION_SEEK_ABSOLUTE, position);
       }
-    }
-    //Player interface:
-    else if (strcmp(interface, OMXPLAYER_DBUS_INTERFACE_PLAYER)==0)
+    } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "SetAlpha", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
     {
-      //MPRIS2 properties:
-      if (strcmp(property, "CanGoNext")==0)
+      DBusError error;
+      dbus_error_init(&error);
+
+      int64_t alpha;
+      const char *oPath; // ignoring path right now because we don't have a playlist
+      dbus_message_get_args(m, &error, DBUS_TYPE_OBJECT_PATH, &oPath, DBUS_TYPE_INT64, &alpha, DBUS_TYPE_INVALID);
+
+      // Make sure a value is sent for setting alpha
+      if (dbus_error_is_set(&error))
       {
-        dbus_respond_boolean(m, 0);
+        CLog::Log(LOGWARNING, "SetAlpha D-Bus Error: %s", error.message );
+        dbus_error_free(&error);
+        c.dbus_respond_ok(m);
         return KeyConfig::ACTION_BLANK;
       }
-      else if (strcmp(property, "CanGoPrevious")==0)
+      else
       {
-        dbus_respond_boolean(m, 0);
-        return KeyConfig::ACTION_BLANK;
+        c.dbus_respond_int64(m, alpha);
+        return OMXControlResult(KeyConfig::ACTION_SET_ALPHA, alpha);
       }
-      else if (strcmp(property, "CanSeek")==0)
+    } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "SetLayer", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      DBusError error;
+      dbus_error_init(&error);
+
+      int64_t layer;
+      dbus_message_get_args(m, &error, DBUS_TYPE_INT64, &layer, DBUS_TYPE_INVALID);
+
+      // Make sure a value is sent for setting layer
+      if (dbus_error_is_set(&error))
       {
-        dbus_respond_boolean(m, reader->CanSeek());
+        CLog::Log(LOGWARNING, "SetLayer D-Bus Error: %s", error.message );
+        dbus_error_free(&error);
+        c.dbus_respond_ok(m);
         return KeyConfig::ACTION_BLANK;
       }
-      else if (strcmp(property, "CanControl")==0)
+      else
       {
-        dbus_respond_boolean(m, 1);
-        return KeyConfig::ACTION_BLANK;
+        c.dbus_respond_int64(m, layer);
+        return OMXControlResult(KeyConfig::ACTION_SET_LAYER, layer);
       }
-      else if (strcmp(property, "CanPlay")==0)
+    } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "SetAspectMode", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      DBusError error;
+      dbus_error_init(&error);
+
+      const char *aspectMode;
+      const char *oPath; // ignoring path right now because we don't have a playlist
+      dbus_message_get_args(m, &error, DBUS_TYPE_OBJECT_PATH, &oPath, DBUS_TYPE_STRING, &aspectMode, DBUS_TYPE_INVALID);
+
+      // Make sure a value is sent for setting aspect mode
+      if (dbus_error_is_set(&error))
       {
-        dbus_respond_boolean(m, 1);
+        CLog::Log(LOGWARNING, "SetAspectMode D-Bus Error: %s", error.message );
+        dbus_error_free(&error);
+        c.dbus_respond_ok(m);
         return KeyConfig::ACTION_BLANK;
       }
-      else if (strcmp(property, "CanPause")==0)
+      else
       {
-        dbus_respond_boolean(m, 1);
-        return KeyConfig::ACTION_BLANK;
+        c.dbus_respond_string(m, aspectMode);
+        return OMXControlResult(KeyConfig::ACTION_SET_ASPECT_MODE, aspectMode);
       }
-      else if (strcmp(property, "Position")==0)
+    } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "Mute", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      c.audio->SetMute(true);
+      c.dbus_respond_ok(m);
+      return KeyConfig::ACTION_BLANK;
+    } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "Unmute", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      c.audio->SetMute(false);
+      c.dbus_respond_ok(m);
+      return KeyConfig::ACTION_BLANK;
+    } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "ListSubtitles", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      c.respond_stream_list(m, OMXSTREAM_SUBTITLE, c.reader->SubtitleStreamCount(), c.subtitles->GetActiveStream());
+      return KeyConfig::ACTION_BLANK;
+    } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "HideVideo", [](OMXControl &c, DBusMessage *m) { return c.respond_action(m, KeyConfig::ACTION_HIDE_VIDEO); } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "UnHideVideo", [](OMXControl &c, DBusMessage *m) { return c.respond_action(m, KeyConfig::ACTION_UNHIDE_VIDEO); } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "ListAudio", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      c.respond_stream_list(m, OMXSTREAM_AUDIO, c.reader->AudioStreamCount(), c.reader->GetAudioIndex());
+      return KeyConfig::ACTION_BLANK;
+    } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "ListVideo", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      c.respond_stream_list(m, OMXSTREAM_VIDEO, c.reader->VideoStreamCount(), c.reader->GetVideoIndex());
+      return KeyConfig::ACTION_BLANK;
+    } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "SelectSubtitle", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      DBusError error;
+      dbus_error_init(&error);
+
+      int index;
+      dbus_message_get_args(m, &error, DBUS_TYPE_INT32, &index, DBUS_TYPE_INVALID);
+
+      if (dbus_error_is_set(&error))
       {
-        // Returns the current position in microseconds
-        int64_t pos = clock->OMXMediaTime();
-        dbus_respond_int64(m, pos);
-        return KeyConfig::ACTION_BLANK;
+        dbus_error_free(&error);
+        c.dbus_respond_boolean(m, 0);
       }
-      else if (strcmp(property, "PlaybackStatus")==0)
+      else
       {
-        const char *status;
-        if (clock->OMXIsPaused())
+        if (c.reader->SetActiveStream(OMXSTREAM_SUBTITLE, index))
         {
-          status = "Paused";
+          c.subtitles->SetActiveStream(c.reader->GetSubtitleIndex());
+          c.dbus_respond_boolean(m, 1);
         }
-        else
-        {
-          status = "Playing";
+        else {
+          c.dbus_respond_boolean(m, 0);
         }
-        dbus_respond_string(m, status);
-        return KeyConfig::ACTION_BLANK;
       }
-      else if (strcmp(property, "MinimumRate")==0)
+      return KeyConfig::ACTION_BLANK;
+    } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "SelectAudio", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      DBusError error;
+      dbus_error_init(&error);
+
+      int index;
+      dbus_message_get_args(m, &error, DBUS_TYPE_INT32, &index, DBUS_TYPE_INVALID);
+
+      if (dbus_error_is_set(&error))
       {
-        dbus_respond_double(m, (MIN_RATE)/1000.);
-        return KeyConfig::ACTION_BLANK;
+        dbus_error_free(&error);
+        c.dbus_respond_boolean(m, 0);
+      }
+      else
+      {
+        c.dbus_respond_boolean(m, c.reader->SetActiveStream(OMXSTREAM_AUDIO, index));
       }
-      else if (strcmp(property, "MaximumRate")==0)
+      return KeyConfig::ACTION_BLANK;
+    } },
+  // TODO: SelectVideo ???
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "ShowSubtitles", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      c.subtitles->SetVisible(true);
+      c.dbus_respond_ok(m);
+      return KeyConfig::ACTION_SHOW_SUBTITLES;
+    } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "HideSubtitles", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      c.subtitles->SetVisible(false);
+      c.dbus_respond_ok(m);
+      return KeyConfig::ACTION_HIDE_SUBTITLES;
+    } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "OpenUri", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      DBusError error;
+      dbus_error_init(&error);
+
+      const char *file;
+      dbus_message_get_args(m, &error, DBUS_TYPE_STRING, &file, DBUS_TYPE_INVALID);
+
+      if (dbus_error_is_set(&error))
       {
-        dbus_respond_double(m, (MAX_RATE)/1000.);
+        CLog::Log(LOGWARNING, "Change file D-Bus Error: %s", error.message );
+        dbus_error_free(&error);
+        c.dbus_respond_ok(m);
         return KeyConfig::ACTION_BLANK;
       }
-      else if (strcmp(property, "Rate")==0)
+      else
       {
-        //return current playing rate
-        dbus_respond_double(m, (double)clock->OMXPlaySpeed()/1000.);
-        return KeyConfig::ACTION_BLANK;
+        c.dbus_respond_string(m, file);
+        return OMXControlResult(KeyConfig::ACTION_CHANGE_FILE, file);
       }
-      else if (strcmp(property, "Volume")==0)
+    } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "Action", [](OMXControl &c, DBusMessage *m) -> OMXControlResult
+    {
+      DBusError error;
+      dbus_error_init(&error);
+
+      int action;
+      dbus_message_get_args(m, &error, DBUS_TYPE_INT32, &action, DBUS_TYPE_INVALID);
+
+      if (dbus_error_is_set(&error))
       {
-        //return current volume
-        dbus_respond_double(m, audio->GetVolume());
+        dbus_error_free(&error);
+        c.dbus_respond_ok(m);
         return KeyConfig::ACTION_BLANK;
       }
-      else if (strcmp(property, "Metadata")==0)
+      else
       {
-        DBusMessage *reply;
-        reply = dbus_message_new_method_return(m);
-        if(reply)
-        {
-          //Create iterator: Array of dict entries, composed of string (key)) and variant (value)
-          DBusMessageIter array_cont, dict_cont, dict_entry_cont, var;
-          dbus_message_iter_init_append(reply, &array_cont);
-          dbus_message_iter_open_container(&array_cont, DBUS_TYPE_ARRAY, "{sv}", &dict_cont);
-            //First dict entry: URI
-            const char *key1 = "xesam:url";
-            char uri[PATH_MAX+7];
-            ToURI(reader->getFilename(), uri);
-            const char *value1=uri;
-            dbus_message_iter_open_container(&dict_cont, DBUS_TYPE_DICT_ENTRY, NULL, &dict_entry_cont);
-              dbus_message_iter_append_basic(&dict_entry_cont, DBUS_TYPE_STRING, &key1);
-              dbus_message_iter_open_container(&dict_entry_cont, DBUS_TYPE_VARIANT, DBUS_TYPE_STRING_AS_STRING, &var);
-              dbus_message_iter_append_basic(&var, DBUS_TYPE_STRING, &value1);
-              dbus_message_iter_close_container(&dict_entry_cont, &var);
-            dbus_message_iter_close_container(&dict_cont, &dict_entry_cont);
-            //Second dict entry: duration in us
-            const char *key2 = "mpris:length";
-            dbus_int64_t value2 = reader->GetStreamLengthMicro();
-            dbus_message_iter_open_container(&dict_cont, DBUS_TYPE_DICT_ENTRY, NULL, &dict_entry_cont);
-              dbus_message_iter_append_basic(&dict_entry_cont, DBUS_TYPE_STRING, &key2);
-              dbus_message_iter_open_container(&dict_entry_cont, DBUS_TYPE_VARIANT, DBUS_TYPE_INT64_AS_STRING, &var);
-              dbus_message_iter_append_basic(&var, DBUS_TYPE_INT64, &value2);
-              dbus_message_iter_close_container(&dict_entry_cont, &var);
-            dbus_message_iter_close_container(&dict_cont, &dict_entry_cont);
-          dbus_message_iter_close_container(&array_cont, &dict_cont);
-          //Send message
-          dbus_connection_send(bus, reply, NULL);
-          dbus_message_unref(reply);
-        }
-        return KeyConfig::ACTION_BLANK;
+        c.dbus_respond_ok(m);
+        return action; // Directly return enum
       }
+    } },
+  //----------------------------------------------------------------------------
+};
 
-      //Non-MPRIS2 properties:
-      else if (strcmp(property, "Aspect")==0)
+const OMXControl::PropertyGetter OMXControl::property_getters[] =
+{
+  //Root interface:
+  { OMXPLAYER_DBUS_INTERFACE_ROOT, "CanRaise", "b", [](OMXControl &c, DBusMessageIter *v) { append_boolean(v, 0); } },
+  { OMXPLAYER_DBUS_INTERFACE_ROOT, "CanQuit", "b", [](OMXControl &c, DBusMessageIter *v) { append_boolean(v, 1); } },
+  { OMXPLAYER_DBUS_INTERFACE_ROOT, "CanSetFullscreen", "b", [](OMXControl &c, DBusMessageIter *v) { append_boolean(v, 0); } },
+  //Fullscreen is read/write in theory not read only, but read only at the moment so...
+  { OMXPLAYER_DBUS_INTERFACE_ROOT, "Fullscreen", "b", [](OMXControl &c, DBusMessageIter *v) { append_boolean(v, 1); } },
+  { OMXPLAYER_DBUS_INTERFACE_ROOT, "HasTrackList", "b", [](OMXControl &c, DBusMessageIter *v) { append_boolean(v, 0); } },
+  { OMXPLAYER_DBUS_INTERFACE_ROOT, "Identity", "s", [](OMXControl &c, DBusMessageIter *v) { append_string(v, "OMXPlayer"); } },
+  { OMXPLAYER_DBUS_INTERFACE_ROOT, "SupportedUriSchemes", "as", [](OMXControl &c, DBusMessageIter *v) //TODO: Update ?
+    {
+      const char *UriSchemes[] = {"file", "http", "rtsp", "rtmp"};
+      append_string_array(v, UriSchemes, 4); // Array is of length 4
+    } },
+  { OMXPLAYER_DBUS_INTERFACE_ROOT, "SupportedMimeTypes", "as", [](OMXControl &c, DBusMessageIter *v) //Vinc: TODO: Minimal list of supported types based on ffmpeg minimal support ?
+    {
+      const char *MimeTypes[] = {}; // Needs supplying
+      append_string_array(v, MimeTypes, 0);
+    } },
+  //Player interface, MPRIS2 properties:
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "CanGoNext", "b", [](OMXControl &c, DBusMessageIter *v) { append_boolean(v, 0); } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "CanGoPrevious", "b", [](OMXControl &c, DBusMessageIter *v) { append_boolean(v, 0); } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "CanSeek", "b", [](OMXControl &c, DBusMessageIter *v) { append_boolean(v, c.reader->CanSeek()); } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "CanControl", "b", [](OMXControl &c, DBusMessageIter *v) { append_boolean(v, 1); } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "CanPlay", "b", [](OMXControl &c, DBusMessageIter *v) { append_boolean(v, 1); } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "CanPause", "b", [](OMXControl &c, DBusMessageIter *v) { append_boolean(v, 1); } },
+  // Returns the current position in microseconds
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "Position", "x", [](OMXControl &c, DBusMessageIter *v) { append_int64(v, c.clock->OMXMediaTime()); } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "PlaybackStatus", "s", [](OMXControl &c, DBusMessageIter *v)
+    {
+      append_string(v, c.clock->OMXIsPaused() ? "Paused" : "Playing");
+    } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "MinimumRate", "d", [](OMXControl &c, DBusMessageIter *v) { append_double(v, (MIN_RATE)/1000.); } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "MaximumRate", "d", [](OMXControl &c, DBusMessageIter *v) { append_double(v, (MAX_RATE)/1000.); } },
+  //return current playing rate
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "Rate", "d", [](OMXControl &c, DBusMessageIter *v) { append_double(v, (double)c.clock->OMXPlaySpeed()/1000.); } },
+  //return current volume
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "Volume", "d", [](OMXControl &c, DBusMessageIter *v) { append_double(v, c.audio->GetVolume()); } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "Metadata", "a{sv}", [](OMXControl &c, DBusMessageIter *v)
+    {
+      //Create iterator: Array of dict entries, composed of string (key)) and variant (value)
+      DBusMessageIter dict_cont, dict_entry_cont, var;
+      dbus_message_iter_open_container(v, DBUS_TYPE_ARRAY, "{sv}", &dict_cont);
+        //First dict entry: URI
+        const char *key1 = "xesam:url";
+        char uri[PATH_MAX+7];
+        ToURI(c.reader->getFilename(), uri);
+        const char *value1=uri;
+        dbus_message_iter_open_container(&dict_cont, DBUS_TYPE_DICT_ENTRY, NULL, &dict_entry_cont);
+          dbus_message_iter_append_basic(&dict_entry_cont, DBUS_TYPE_STRING, &key1);
+          dbus_message_iter_open_container(&dict_entry_cont, DBUS_TYPE_VARIANT, DBUS_TYPE_STRING_AS_STRING, &var);
+          dbus_message_iter_append_basic(&var, DBUS_TYPE_STRING, &value1);
+          dbus_message_iter_close_container(&dict_entry_cont, &var);
+        dbus_message_iter_close_container(&dict_cont, &dict_entry_cont);
+        //Second dict entry: duration in us
+        const char *key2 = "mpris:length";
+        dbus_int64_t value2 = c.reader->GetStreamLengthMicro();
+        dbus_message_iter_open_container(&dict_cont, DBUS_TYPE_DICT_ENTRY, NULL, &dict_entry_cont);
+          dbus_message_iter_append_basic(&dict_entry_cont, DBUS_TYPE_STRING, &key2);
+          dbus_message_iter_open_container(&dict_entry_cont, DBUS_TYPE_VARIANT, DBUS_TYPE_INT64_AS_STRING, &var);
+          dbus_message_iter_append_basic(&var, DBUS_TYPE_INT64, &value2);
+          dbus_message_iter_close_container(&dict_entry_cont, &var);
+        dbus_message_iter_close_container(&dict_cont, &dict_entry_cont);
+      dbus_message_iter_close_container(v, &dict_cont);
+    } },
+  //Player interface, non-MPRIS2 properties:
+  // Returns aspect ratio
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "Aspect", "d", [](OMXControl &c, DBusMessageIter *v) { append_double(v, c.reader->GetAspectRatio()); } },
+  // Returns number of video streams
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "VideoStreamCount", "x", [](OMXControl &c, DBusMessageIter *v) { append_int64(v, c.reader->VideoStreamCount()); } },
+  // Returns width of video
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "ResWidth", "x", [](OMXControl &c, DBusMessageIter *v) { append_int64(v, c.reader->GetWidth()); } },
+  // Returns height of video
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "ResHeight", "x", [](OMXControl &c, DBusMessageIter *v) { append_int64(v, c.reader->GetHeight()); } },
+  // Returns the duration in microseconds
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "Duration", "x", [](OMXControl &c, DBusMessageIter *v) { append_int64(v, c.reader->GetStreamLengthMicro()); } },
+};
+
+const OMXControl::PropertySetter OMXControl::property_setters[] =
+{
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "Volume", [](OMXControl &c, DBusMessage *m, double volume) -> OMXControlResult
+    {
+      //Min value is 0
+      if(volume<.0)
       {
-        // Returns aspect ratio
-        double ratio = reader->GetAspectRatio();
-        dbus_respond_double(m, ratio);
-        return KeyConfig::ACTION_BLANK;
+        volume=.0;
       }
-      else if (strcmp(property, "VideoStreamCount")==0)
+      c.audio->SetVolume(volume);
+      c.dbus_respond_double(m, volume);
+      return KeyConfig::ACTION_BLANK;
+    } },
+  { OMXPLAYER_DBUS_INTERFACE_PLAYER, "Rate", [](OMXControl &c, DBusMessage *m, double rate) -> OMXControlResult
+    {
+      if(rate>MAX_RATE/1000.)
       {
-        // Returns number of video streams
-        int64_t vcount = reader->VideoStreamCount();
-        dbus_respond_int64(m, vcount);
-        return KeyConfig::ACTION_BLANK;
+        rate=MAX_RATE/1000.;
       }
-      else if (strcmp(property, "ResWidth")==0)
+      if(rate<MIN_RATE/1000.)
       {
-        // Returns width of video
-        int64_t width = reader->GetWidth();
-        dbus_respond_int64(m, width);
-        return KeyConfig::ACTION_BLANK;
+        //Set to Pause according to MPRIS2 specs (no actual change of playing rate)
+        c.dbus_respond_double(m, (double)c.clock->OMXPlaySpeed()/1000.);
+        return KeyConfig::ACTION_PAUSE;
       }
-      else if (strcmp(property, "ResHeight")==0)
+      int iSpeed=(int)(rate*1000.);
+      if(!c.clock)
       {
-        // Returns height of video
-        int64_t height = reader->GetHeight();
-        dbus_respond_int64(m, height);
+        c.dbus_respond_double(m, .0);//What value ????
         return KeyConfig::ACTION_BLANK;
       }
-      else if (strcmp(property,  "Duration")==0)
+      //Can't do trickplay here so limit max speed
+      if(iSpeed > MAX_RATE)
+        iSpeed=MAX_RATE;
+      c.dbus_respond_double(m, iSpeed/1000.);//Reply before applying to be faster
+      c.clock->OMXSetSpeed(iSpeed, false, true);
+      return KeyConfig::ACTION_PLAY;
+    } },
+};
+
+OMXControlResult OMXControl::handle_event(DBusMessage *m)
+{
+  static const DispatchIndex<MethodHandler> methods(method_handlers);
+
+  if (dbus_message_get_type(m) == DBUS_MESSAGE_TYPE_METHOD_CALL)
+  {
+    const MethodHandler *handler = methods.find(dbus_message_get_interface(m), dbus_message_get_member(m));
+    if (handler)
+      return handler->handle(*this, m);
+  }
+
+  CLog::Log(LOGWARNING, "Unhandled dbus message, member: %s interface: %s type: %d path: %s", dbus_message_get_member(m), dbus_message_get_interface(m), dbus_message_get_type(m), dbus_message_get_path(m) );
+  if (dbus_message_get_type(m) == DBUS_MESSAGE_TYPE_METHOD_CALL)
+    dbus_respond_error(m, DBUS_ERROR_UNKNOWN_METHOD, "Unknown method");
+
+  return KeyConfig::ACTION_BLANK;
+}
+
+const OMXControl::PropertyGetter *OMXControl::find_getter(const char *interface, const char *property)
+{
+  static const DispatchIndex<PropertyGetter> getters(property_getters);
+  return getters.find(interface, property);
+}
+
+// Commands of the control socket, acted on as the D-Bus calls doing the
+// same are
+OMXControlResult OMXControl::handle_command(const ControlSocket::Command &command)
+{
+  const ControlRequest &request = command.request;
+
+  switch (request.command)
+  {
+    case CONTROL_PLAY:
+      control_socket.Reply(command, CONTROL_OK);
+      return KeyConfig::ACTION_PLAY;
+    case CONTROL_PAUSE:
+      control_socket.Reply(command, CONTROL_OK);
+      return KeyConfig::ACTION_PAUSE;
+    case CONTROL_PLAYPAUSE:
+      control_socket.Reply(command, CONTROL_OK);
+      return KeyConfig::ACTION_PLAYPAUSE;
+    case CONTROL_STOP:
+      control_socket.Reply(command, CONTROL_OK);
+      return KeyConfig::ACTION_EXIT;
+    case CONTROL_SEEK:
+      control_socket.Reply(command, CONTROL_OK);
+      return OMXControlResult(KeyConfig::ACTION_SEEK_RELATIVE, request.arg);
+    case CONTROL_SET_POSITION:
+      control_socket.Reply(command, CONTROL_OK);
+      return OMXControlResult(KeyConfig::ACTION_SEEK_ABSOLUTE, request.arg);
+    case CONTROL_SET_RATE:
+    {
+      if (!std::isfinite(request.value))
       {
-        // Returns the duration in microseconds
-        int64_t dur = reader->GetStreamLengthMicro();
-        dbus_respond_int64(m, dur);
+        control_socket.Reply(command, CONTROL_BAD_REQUEST);
         return KeyConfig::ACTION_BLANK;
       }
-      //Wrong property
-      else
+      control_socket.Reply(command, CONTROL_OK);
+      //As with Rate, too slow pauses and trickplay isn't possible
+      if (request.value < MIN_RATE/1000.)
+        return KeyConfig::ACTION_PAUSE;
+      clock->OMXSetSpeed((int)(std::min(request.value, MAX_RATE/1000.)*1000.), false, true);
+      return KeyConfig::ACTION_PLAY;
+    }
+    case CONTROL_SET_VOLUME:
+      if (!std::isfinite(request.value))
       {
-        //Error
-        CLog::Log(LOGWARNING, "Unhandled dbus property message, member: %s interface: %s type: %d path: %s  property: %s", dbus_message_get_member(m), dbus_message_get_interface(m), dbus_message_get_type(m), dbus_message_get_path(m), property );
-        dbus_respond_error(m, DBUS_ERROR_UNKNOWN_PROPERTY, "Unknown property");
+        control_socket.Reply(command, CONTROL_BAD_REQUEST);
         return KeyConfig::ACTION_BLANK;
       }
-    }
-    //Wrong interface:
-    else
-    {
-        //Error
-        CLog::Log(LOGWARNING, "Unhandled dbus message, member: %s interface: %s type: %d path: %s", dbus_message_get_member(m), dbus_message_get_interface(m), dbus_message_get_type(m), dbus_message_get_path(m) );
-        dbus_respond_error(m, DBUS_ERROR_UNKNOWN_INTERFACE, "Unknown interface");
-        return KeyConfig::ACTION_BLANK;
-    }
+      control_socket.Reply(command, CONTROL_OK);
+      audio->SetVolume(std::max(request.value, .0));
+      return KeyConfig::ACTION_BLANK;
+    default:
+      control_socket.Reply(command, CONTROL_UNKNOWN_COMMAND);
+      return KeyConfig::ACTION_BLANK;
   }
-  //Properties Set method:
-  //TODO: implement signal generation on some property changes
-  else if (dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "Set"))
-  {
-    DBusError error;
-    dbus_error_init(&error);
+}
 
-    //Retrieve interface, property name and value
-    //Message has the form message[STRING:interface STRING:property DOUBLE:value] or message[STRING:interface STRING:property VARIANT[DOUBLE:value]]
-    const char *interface, *property;
-    double new_property_value;
+//Properties Get method:
+OMXControlResult OMXControl::get_property(DBusMessage *m)
+{
+  DBusError error;
+  dbus_error_init(&error);
+
+  //Retrieve interface and property name
+  const char *interface, *property;
+  if (!dbus_message_get_args(m, &error, DBUS_TYPE_STRING, &interface, DBUS_TYPE_STRING, &property, DBUS_TYPE_INVALID))
+  {
+    CLog::Log(LOGWARNING, "Unhandled dbus message, member: %s interface: %s type: %d path: %s", dbus_message_get_member(m), dbus_message_get_interface(m), dbus_message_get_type(m), dbus_message_get_path(m) );
+    dbus_error_free(&error);
+    dbus_respond_error(m, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
+    return KeyConfig::ACTION_BLANK;
+  }
+
+  const PropertyGetter *getter = find_getter(interface, property);
+  if (!getter)
+  {
+    respond_unknown_property(m, interface, property);
+    return KeyConfig::ACTION_BLANK;
+  }
+
+  //The value is sent as it is rather than in a variant, as it always has been
+  DBusMessage *reply = dbus_message_new_method_return(m);
+  if (reply)
+  {
     DBusMessageIter args;
-    dbus_message_iter_init(m, &args);
-    if(dbus_message_iter_has_next(&args))
+    dbus_message_iter_init_append(reply, &args);
+    getter->get(*this, &args);
+    dbus_connection_send(bus, reply, NULL);
+    dbus_message_unref(reply);
+  }
+  return KeyConfig::ACTION_BLANK;
+}
+
+//Properties GetAll method:
+OMXControlResult OMXControl::get_all_properties(DBusMessage *m)
+{
+  DBusError error;
+  dbus_error_init(&error);
+
+  const char *interface;
+  if (!dbus_message_get_args(m, &error, DBUS_TYPE_STRING, &interface, DBUS_TYPE_INVALID))
+  {
+    CLog::Log(LOGWARNING, "Unhandled dbus message, member: %s interface: %s type: %d path: %s", dbus_message_get_member(m), dbus_message_get_interface(m), dbus_message_get_type(m), dbus_message_get_path(m) );
+    dbus_error_free(&error);
+    dbus_respond_error(m, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
+    return KeyConfig::ACTION_BLANK;
+  }
+
+  if (strcmp(interface, OMXPLAYER_DBUS_INTERFACE_ROOT)!=0 && strcmp(interface, OMXPLAYER_DBUS_INTERFACE_PLAYER)!=0)
+  {
+    CLog::Log(LOGWARNING, "Unhandled dbus message, member: %s interface: %s type: %d path: %s", dbus_message_get_member(m), dbus_message_get_interface(m), dbus_message_get_type(m), dbus_message_get_path(m) );
+    dbus_respond_error(m, DBUS_ERROR_UNKNOWN_INTERFACE, "Unknown interface");
+    return KeyConfig::ACTION_BLANK;
+  }
+
+  DBusMessage *reply = dbus_message_new_method_return(m);
+  if (reply)
+  {
+    DBusMessageIter args, dict;
+    dbus_message_iter_init_append(reply, &args);
+    dbus_message_iter_open_container(&args, DBUS_TYPE_ARRAY, "{sv}", &dict);
+    for (const PropertyGetter &getter : property_getters)
     {
+      if (strcmp(getter.interface, interface)==0)
+        append_property(&dict, getter);
+    }
+    dbus_message_iter_close_container(&args, &dict);
+    dbus_connection_send(bus, reply, NULL);
+    dbus_message_unref(reply);
+  }
+  return KeyConfig::ACTION_BLANK;
+}
+
+// Appends a name and value dict entry
+void OMXControl::append_property(DBusMessageIter *dict, const PropertyGetter &getter)
+{
+  DBusMessageIter entry, value;
+  dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY, NULL, &entry);
+  dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &getter.name);
+  dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT, getter.signature, &value);
+  getter.get(*this, &value);
+  dbus_message_iter_close_container(&entry, &value);
+  dbus_message_iter_close_container(dict, &entry);
+}
+
+// Sends PropertiesChanged for the properties of the player which have
+// changed since the last call. Position changes all the time, so it's
+// only sent every POSITION_INTERVAL while playing, and straight away
+// with a Seeked signal when it jumps.
+void OMXControl::update_properties()
+{
+  int64_t now = OMXClock::GetAbsoluteClock();
+  PlayerState state;
+  state.paused = clock->OMXIsPaused();
+  state.speed = clock->OMXPlaySpeed();
+  state.volume = audio->GetVolume();
+  state.url = reader->getFilename();
+  state.length = reader->GetStreamLengthMicro();
+  state.position = clock->OMXMediaTime();
+  state.position_time = now;
+
+  if (!notified.valid)
+  {
+    state.valid = true;
+    notified = state;
+    return;
+  }
+
+  std::vector<const char *> changed;
+  if (state.paused != notified.paused)
+    changed.push_back("PlaybackStatus");
+  if (state.speed != notified.speed)
+    changed.push_back("Rate");
+  if (state.volume != notified.volume)
+    changed.push_back("Volume");
+
+  bool new_track = state.url != notified.url || state.length != notified.length;
+  if (new_track)
+  {
+    changed.push_back("Metadata");
+    changed.push_back("Duration");
+  }
+
+  // where playback would be had it carried on since the last update
+  int64_t expected = notified.position;
+  if (!notified.paused)
+    expected += (now - notified.position_time) * notified.speed / DVD_PLAYSPEED_NORMAL;
+  bool seeked = !new_track && llabs(state.position - expected) > POSITION_JUMP;
+
+  if (seeked || !changed.empty() || (!state.paused && now - notified.position_time >= POSITION_INTERVAL))
+  {
+    changed.push_back("Position");
+  }
+  else
+  {
+    // keep extrapolating from the last update
+    state.position = notified.position;
+    state.position_time = notified.position_time;
+  }
+
+  state.valid = true;
+  notified = state;
+
+  if (seeked)
+    dbus_signal_seeked(state.position);
+  if (!changed.empty())
+    dbus_signal_properties_changed(OMXPLAYER_DBUS_INTERFACE_PLAYER, changed);
+}
+
+//Properties Set method:
+OMXControlResult OMXControl::set_property(DBusMessage *m)
+{
+  static const DispatchIndex<PropertySetter> setters(property_setters);
+
+  DBusError error;
+  dbus_error_init(&error);
+
+  //Retrieve interface, property name and value
+  //Message has the form message[STRING:interface STRING:property DOUBLE:value] or message[STRING:interface STRING:property VARIANT[DOUBLE:value]]
+  const char *interface = NULL, *property = NULL;
+  double new_property_value = 0;
+  DBusMessageIter args;
+  dbus_message_iter_init(m, &args);
+  if(dbus_message_iter_has_next(&args))
+  {
 		//The interface name
 		if( DBUS_TYPE_STRING == dbus_message_iter_get_arg_type(&args) ) 
 			dbus_message_iter_get_basic (&args, &interface);
@@ -515,616 +1174,120 @@ OMXControlResult OMXControl::handle_event(DBusMessage *m)
 			}
 		}
 	}
-    if ( dbus_error_is_set(&error) )
-    {
-        CLog::Log(LOGWARNING, "Unhandled dbus message, member: %s interface: %s type: %d path: %s", dbus_message_get_member(m), dbus_message_get_interface(m), dbus_message_get_type(m), dbus_message_get_path(m) );
-        dbus_error_free(&error);
-        dbus_respond_error(m, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
-        return KeyConfig::ACTION_BLANK;
-    }
-    //Player interface:
-    if (strcmp(interface, OMXPLAYER_DBUS_INTERFACE_PLAYER)==0)
-    {
-      if (strcmp(property, "Volume")==0)
-      {
-        double volume=new_property_value;
-        //Min value is 0
-        if(volume<.0)
-        {
-          volume=.0;
-        }
-        audio->SetVolume(volume);
-        dbus_respond_double(m, volume);
-        return KeyConfig::ACTION_BLANK;
-      }
-      else if (strcmp(property, "Rate")==0)
-      {
-        double rate=new_property_value;
-        if(rate>MAX_RATE/1000.)
-        {
-          rate=MAX_RATE/1000.;
-        }
-        if(rate<MIN_RATE/1000.)
-        {
-          //Set to Pause according to MPRIS2 specs (no actual change of playing rate)
-          dbus_respond_double(m, (double)clock->OMXPlaySpeed()/1000.);
-          return KeyConfig::ACTION_PAUSE;
-        }
-        int iSpeed=(int)(rate*1000.);
-        if(!clock)
-        {
-          dbus_respond_double(m, .0);//What value ????
-          return KeyConfig::ACTION_BLANK;
-        }
-        //Can't do trickplay here so limit max speed
-        if(iSpeed > MAX_RATE)
-          iSpeed=MAX_RATE;
-        dbus_respond_double(m, iSpeed/1000.);//Reply before applying to be faster
-        clock->OMXSetSpeed(iSpeed, false, true);
-        return KeyConfig::ACTION_PLAY;
-      }
-      //Wrong property
-      else
-      {
-        //Error
-        CLog::Log(LOGWARNING, "Unhandled dbus property message, member: %s interface: %s type: %d path: %s  property: %s", dbus_message_get_member(m), dbus_message_get_interface(m), dbus_message_get_type(m), dbus_message_get_path(m), property );
-        dbus_respond_error(m, DBUS_ERROR_UNKNOWN_PROPERTY, "Unknown property");
-        return KeyConfig::ACTION_BLANK;
-      }
-    }
-    //Wrong interface:
-    else
-    {
-        //Error
-        CLog::Log(LOGWARNING, "Unhandled dbus message, member: %s interface: %s type: %d path: %s", dbus_message_get_member(m), dbus_message_get_interface(m), dbus_message_get_type(m), dbus_message_get_path(m) );
-        dbus_respond_error(m, DBUS_ERROR_UNKNOWN_INTERFACE, "Unknown interface");
-        return KeyConfig::ACTION_BLANK;
-    }
-  }
-  //----------------------------------------------------------------------------
-
-
-  //-------------------------DEPRECATED PROPERTIES METHODS----------------------
-  else if (dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "CanQuit")
-      || dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "Fullscreen"))
-  {
-    dbus_respond_boolean(m, 1);
-    deprecatedMessage();
-    return KeyConfig::ACTION_BLANK;
-  }
-  else if (dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "CanSetFullscreen")
-      || dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "CanRaise")
-      || dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "HasTrackList"))
-  {
-    dbus_respond_boolean(m, 0);
-    deprecatedMessage();
-    return KeyConfig::ACTION_BLANK;
-  }
-  else if (dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "Identity"))
-  {
-    dbus_respond_string(m, "OMXPlayer");
-    deprecatedMessage();
-    return KeyConfig::ACTION_BLANK;
-  }
-  else if (dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "SupportedUriSchemes"))
+  if ( dbus_error_is_set(&error) || !interface || !property )
   {
-    const char *UriSchemes[] = {"file", "http", "rtsp", "rtmp"};
-    dbus_respond_array(m, UriSchemes, 2); // Array is of length 2
-    deprecatedMessage();
-    return KeyConfig::ACTION_BLANK;
-  }
-  else if (dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "SupportedMimeTypes"))
-  {
-    const char *MimeTypes[] = {}; // Needs supplying
-    dbus_respond_array(m, MimeTypes, 0);
-    deprecatedMessage();
-    return KeyConfig::ACTION_BLANK;
-  }
-  else if (dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "CanGoNext")
-        || dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "CanGoPrevious"))
-  {
-    dbus_respond_boolean(m, 0);
-    deprecatedMessage();
-    return KeyConfig::ACTION_BLANK;
-  }
-  else if (dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "CanSeek"))
-  {
-    dbus_respond_boolean(m, reader->CanSeek());
-    deprecatedMessage();
-    return KeyConfig::ACTION_BLANK;
-  }
-  else if (dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "CanControl")
-        || dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "CanPlay")
-        || dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "CanPause"))
-  {
-    dbus_respond_boolean(m, 1);
-    deprecatedMessage();
-    return KeyConfig::ACTION_BLANK;
-  }
-  else if (dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "PlaybackStatus"))
-  {
-    const char *status;
-    if (clock->OMXIsPaused())
-    {
-      status = "Paused";
-    }
-    else
-    {
-      status = "Playing";
-    }
-
-    dbus_respond_string(m, status);
-    deprecatedMessage();
-    return KeyConfig::ACTION_BLANK;
-  }
-  else if (dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "GetSource"))
-  {
-    dbus_respond_string(m, reader->getFilename().c_str());
-    deprecatedMessage();
-    return KeyConfig::ACTION_BLANK;
-  }
-  else if (dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "Volume"))
-  {
-    DBusError error;
-    dbus_error_init(&error);
-
-    double volume;
-    dbus_message_get_args(m, &error, DBUS_TYPE_DOUBLE, &volume, DBUS_TYPE_INVALID);
-
-    if (dbus_error_is_set(&error))
-    { // i.e. Get current volume
+      CLog::Log(LOGWARNING, "Unhandled dbus message, member: %s interface: %s type: %d path: %s", dbus_message_get_member(m), dbus_message_get_interface(m), dbus_message_get_type(m), dbus_message_get_path(m) );
       dbus_error_free(&error);
-      dbus_respond_double(m, audio->GetVolume());
-      deprecatedMessage();
+      dbus_respond_error(m, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
       return KeyConfig::ACTION_BLANK;
-    }
-    else
-    {
-      //Min value is 0
-      if(volume<.0)
-      {
-        volume=.0;
-      }
-      audio->SetVolume(volume);
-      dbus_respond_double(m, volume);
-      deprecatedMessage();
-      return KeyConfig::ACTION_BLANK;
-    }
-  }
-  else if (dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "Mute"))
-  {
-    audio->SetMute(true);
-    dbus_respond_ok(m);
-    deprecatedMessage();
-    return KeyConfig::ACTION_BLANK;
-  }
-  else if (dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "Unmute"))
-  {
-    audio->SetMute(false);
-    dbus_respond_ok(m);
-    deprecatedMessage();
-    return KeyConfig::ACTION_BLANK;
   }
-  else if (dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "Position"))
-  {
-    // Returns the current position in microseconds
-    int64_t pos = clock->OMXMediaTime();
-    dbus_respond_int64(m, pos);
-    deprecatedMessage();
-    return KeyConfig::ACTION_BLANK;
-  }
-  else if (dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "Aspect"))
-  {
-    // Returns aspect ratio
-    double ratio = reader->GetAspectRatio();
-    dbus_respond_double(m, ratio);
-    deprecatedMessage();
-    return KeyConfig::ACTION_BLANK;
-  }
-  else if (dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "VideoStreamCount"))
-  {
-    // Returns number of video streams
-    int64_t vcount = reader->VideoStreamCount();
-    dbus_respond_int64(m, vcount);
-    deprecatedMessage();
-    return KeyConfig::ACTION_BLANK;
-  }
-  else if (dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "ResWidth"))
-  {
-    // Returns width of video
-    int64_t width = reader->GetWidth();
-    dbus_respond_int64(m, width);
-    deprecatedMessage();
-    return KeyConfig::ACTION_BLANK;
-  }
-  else if (dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "ResHeight"))
-  {
-    // Returns height of video
-    int64_t height = reader->GetHeight();
-    dbus_respond_int64(m, height);
-    deprecatedMessage();
-    return KeyConfig::ACTION_BLANK;
-  }
-  else if (dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "Duration"))
-  {
-    // Returns the duration in microseconds
-    int64_t dur = reader->GetStreamLengthMicro();
-    dbus_respond_int64(m, dur);
-    deprecatedMessage();
-    return KeyConfig::ACTION_BLANK;
-  }
-  else if (dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "MinimumRate"))
-  {
-    dbus_respond_double(m, 0.0);
-    deprecatedMessage();
-    return KeyConfig::ACTION_BLANK;
-  }
-  else if (dbus_message_is_method_call(m, DBUS_INTERFACE_PROPERTIES, "MaximumRate"))
-  {
-    //TODO: to be made consistent
-    dbus_respond_double(m, 10.125);
-    deprecatedMessage();
-    return KeyConfig::ACTION_BLANK;
-  }
-  //----------------------------------------------------------------------------
 
+  const PropertySetter *setter = setters.find(interface, property);
+  if (setter)
+    return setter->set(*this, m, new_property_value);
 
-  //--------------------------Player interface methods--------------------------
-  else if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_PLAYER, "GetSource"))
-  {
-    dbus_respond_string(m, reader->getFilename().c_str());
-    return KeyConfig::ACTION_BLANK;
-  }
-  else if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_PLAYER, "Next"))
-  {
-    dbus_respond_ok(m);
-    return KeyConfig::ACTION_NEXT_CHAPTER;
-  }
-  else if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_PLAYER, "Previous"))
-  {
-    dbus_respond_ok(m);
-    return KeyConfig::ACTION_PREVIOUS_CHAPTER;
-  }
-  else if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_PLAYER, "Pause"))
-  {
-    dbus_respond_ok(m);
-    return KeyConfig::ACTION_PAUSE;
-  }
-  else if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_PLAYER, "Play"))
-  {
-    dbus_respond_ok(m);
-    return KeyConfig::ACTION_PLAY;
-  }
-  else if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_PLAYER, "PlayPause"))
-  {
-    dbus_respond_ok(m);
-    return KeyConfig::ACTION_PLAYPAUSE;
-  }
-  else if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_PLAYER, "Stop"))
-  {
-    dbus_respond_ok(m);
-    return KeyConfig::ACTION_EXIT;
-  }
-  else if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_PLAYER, "Seek"))
-  {
-    DBusError error;
-    dbus_error_init(&error);
-
-    int64_t offset;
-    dbus_message_get_args(m, &error, DBUS_TYPE_INT64, &offset, DBUS_TYPE_INVALID);
+  respond_unknown_property(m, interface, property);
+  return KeyConfig::ACTION_BLANK;
+}
 
-    // Make sure a value is sent for seeking
-    if (dbus_error_is_set(&error))
-    {
-       CLog::Log(LOGWARNING, "Seek D-Bus Error: %s", error.message );
-       dbus_error_free(&error);
-       dbus_respond_ok(m);
-       return KeyConfig::ACTION_BLANK;
-    }
-    else
-    {
-       dbus_respond_int64(m, offset);
-       return OMXControlResult(KeyConfig::ACTION_SEEK_RELATIVE, offset);
-    }
-  }
-  else if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_PLAYER, "SetPosition"))
+void OMXControl::respond_unknown_property(DBusMessage *m, const char *interface, const char *property)
+{
+  //Wrong property
+  if (strcmp(interface, OMXPLAYER_DBUS_INTERFACE_ROOT)==0 || strcmp(interface, OMXPLAYER_DBUS_INTERFACE_PLAYER)==0)
   {
-    DBusError error;
-    dbus_error_init(&error);
-
-    int64_t position;
-    const char *oPath; // ignoring path right now because we don't have a playlist
-    dbus_message_get_args(m, &error, DBUS_TYPE_OBJECT_PATH, &oPath, DBUS_TYPE_INT64, &position, DBUS_TYPE_INVALID);
-
-    // Make sure a value is sent for setting position
-    if (dbus_error_is_set(&error))
-    {
-      CLog::Log(LOGWARNING, "SetPosition D-Bus Error: %s", error.message );
-      dbus_error_free(&error);
-      dbus_respond_ok(m);
-      return KeyConfig::ACTION_BLANK;
-    }
-    else
-    {
-      dbus_respond_int64(m, position);
-      return OMXControlResult(KeyConfig::ACTION_SEEK_ABSOLUTE, position);
-    }
+    CLog::Log(LOGWARNING, "Unhandled dbus property message, member: %s interface: %s type: %d path: %s property: %s", dbus_message_get_member(m), dbus_message_get_interface(m), dbus_message_get_type(m), dbus_message_get_path(m), property );
+    dbus_respond_error(m, DBUS_ERROR_UNKNOWN_PROPERTY, "Unknown property");
   }
-  else if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_PLAYER, "SetAlpha"))
+  //Wrong interface:
+  else
   {
-    DBusError error;
-    dbus_error_init(&error);
-
-    int64_t alpha;
-    const char *oPath; // ignoring path right now because we don't have a playlist
-    dbus_message_get_args(m, &error, DBUS_TYPE_OBJECT_PATH, &oPath, DBUS_TYPE_INT64, &alpha, DBUS_TYPE_INVALID);
-
-    // Make sure a value is sent for setting alpha
-    if (dbus_error_is_set(&error))
-    {
-      CLog::Log(LOGWARNING, "SetAlpha D-Bus Error: %s", error.message );
-      dbus_error_free(&error);
-      dbus_respond_ok(m);
-      return KeyConfig::ACTION_BLANK;
-    }
-    else
-    {
-      dbus_respond_int64(m, alpha);
-      return OMXControlResult(KeyConfig::ACTION_SET_ALPHA, alpha);
-    }
+    CLog::Log(LOGWARNING, "Unhandled dbus message, member: %s interface: %s type: %d path: %s", dbus_message_get_member(m), dbus_message_get_interface(m), dbus_message_get_type(m), dbus_message_get_path(m) );
+    dbus_respond_error(m, DBUS_ERROR_UNKNOWN_INTERFACE, "Unknown interface");
   }
-  else if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_PLAYER, "SetLayer"))
-  {
-    DBusError error;
-    dbus_error_init(&error);
+}
 
-    int64_t layer;
-    dbus_message_get_args(m, &error, DBUS_TYPE_INT64, &layer, DBUS_TYPE_INVALID);
+OMXControlResult OMXControl::deprecated_boolean(DBusMessage *m, int b)
+{
+  dbus_respond_boolean(m, b);
+  deprecatedMessage();
+  return KeyConfig::ACTION_BLANK;
+}
 
-    // Make sure a value is sent for setting layer
-    if (dbus_error_is_set(&error))
-    {
-      CLog::Log(LOGWARNING, "SetLayer D-Bus Error: %s", error.message );
-      dbus_error_free(&error);
-      dbus_respond_ok(m);
-      return KeyConfig::ACTION_BLANK;
-    }
-    else
-    {
-      dbus_respond_int64(m, layer);
-      return OMXControlResult(KeyConfig::ACTION_SET_LAYER, layer);
-    }
-  }
-  else if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_PLAYER, "SetAspectMode"))
-  {
-    DBusError error;
-    dbus_error_init(&error);
+OMXControlResult OMXControl::respond_action(DBusMessage *m, int action)
+{
+  dbus_respond_ok(m);
+  return action;
+}
 
-    const char *aspectMode;
-    const char *oPath; // ignoring path right now because we don't have a playlist
-    dbus_message_get_args(m, &error, DBUS_TYPE_OBJECT_PATH, &oPath, DBUS_TYPE_STRING, &aspectMode, DBUS_TYPE_INVALID);
+void OMXControl::respond_stream_list(DBusMessage *m, OMXStreamType type, int count, int active)
+{
+  char** values = new char*[count];
 
-    // Make sure a value is sent for setting aspect mode
-    if (dbus_error_is_set(&error))
-    {
-      CLog::Log(LOGWARNING, "SetAspectMode D-Bus Error: %s", error.message );
-      dbus_error_free(&error);
-      dbus_respond_ok(m);
-      return KeyConfig::ACTION_BLANK;
-    }
-    else
-    {
-      dbus_respond_string(m, aspectMode);
-      return OMXControlResult(KeyConfig::ACTION_SET_ASPECT_MODE, aspectMode);
-    }
-  }
-  else if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_PLAYER, "Mute"))
+  for (int i=0; i < count; i++)
   {
-    audio->SetMute(true);
-    dbus_respond_ok(m);
-    return KeyConfig::ACTION_BLANK;
+     asprintf(&values[i], "%d:%s:%s:%s:%s", i,
+                                            reader->GetStreamLanguage(type, i).c_str(),
+                                            reader->GetStreamName(type, i).c_str(),
+                                            reader->GetCodecName(type, i).c_str(),
+                                            (active == i) ? "active" : "");
   }
-  else if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_PLAYER, "Unmute"))
-  {
-    audio->SetMute(false);
-    dbus_respond_ok(m);
-    return KeyConfig::ACTION_BLANK;
-  }
-  else if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_PLAYER, "ListSubtitles"))
-  {
-    int count = reader->SubtitleStreamCount();
-    char** values = new char*[count];
 
-    for (int i=0; i < count; i++)
-    {
-       asprintf(&values[i], "%d:%s:%s:%s:%s", i,
-                                              reader->GetStreamLanguage(OMXSTREAM_SUBTITLE, i).c_str(),
-                                              reader->GetStreamName(OMXSTREAM_SUBTITLE, i).c_str(),
-                                              reader->GetCodecName(OMXSTREAM_SUBTITLE, i).c_str(),
-                                              ((int)subtitles->GetActiveStream() == i) ? "active" : "");
-    }
-
-    dbus_respond_array(m, (const char**)values, count);
-
-    // Cleanup
-    for (int i=0; i < count; i++)
-    {
-      delete[] values[i];
-    }
+  dbus_respond_array(m, (const char**)values, count);
 
-    return KeyConfig::ACTION_BLANK;
-  }
-  else if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_PLAYER, "HideVideo"))
-  {
-    dbus_respond_ok(m);
-    return KeyConfig::ACTION_HIDE_VIDEO;
-  }
-  else if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_PLAYER, "UnHideVideo"))
-  {
-    dbus_respond_ok(m);
-    return KeyConfig::ACTION_UNHIDE_VIDEO;
-  }
-  else if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_PLAYER, "ListAudio"))
+  // Cleanup
+  for (int i=0; i < count; i++)
   {
-    int count = reader->AudioStreamCount();
-    char** values = new char*[count];
-
-    for (int i=0; i < count; i++)
-    {
-       asprintf(&values[i], "%d:%s:%s:%s:%s", i,
-                                              reader->GetStreamLanguage(OMXSTREAM_AUDIO, i).c_str(),
-                                              reader->GetStreamName(OMXSTREAM_AUDIO, i).c_str(),
-                                              reader->GetCodecName(OMXSTREAM_AUDIO, i).c_str(),
-                                              (reader->GetAudioIndex() == i) ? "active" : "");
-    }
-
-    dbus_respond_array(m, (const char**)values, count);
-
-    // Cleanup
-    for (int i=0; i < count; i++)
-    {
-      delete[] values[i];
-    }
-
-    return KeyConfig::ACTION_BLANK;
+    free(values[i]);
   }
-  else if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_PLAYER, "ListVideo"))
-  {
-    int count = reader->VideoStreamCount();
-    char** values = new char*[count];
+  delete[] values;
+}
 
-    for (int i=0; i < count; i++)
-    {
-       asprintf(&values[i], "%d:%s:%s:%s:%s", i,
-                                              reader->GetStreamLanguage(OMXSTREAM_VIDEO, i).c_str(),
-                                              reader->GetStreamName(OMXSTREAM_VIDEO, i).c_str(),
-                                              reader->GetCodecName(OMXSTREAM_VIDEO, i).c_str(),
-                                              (reader->GetVideoIndex() == i) ? "active" : "");
-    }
+void OMXControl::dbus_signal_properties_changed(const char *interface, const std::vector<const char *> &names)
+{
+  DBusMessage *signal;
 
-    dbus_respond_array(m, (const char**)values, count);
+  signal = dbus_message_new_signal(OMXPLAYER_DBUS_PATH_SERVER, DBUS_INTERFACE_PROPERTIES, "PropertiesChanged");
 
-    // Cleanup
-    for (int i=0; i < count; i++)
-    {
-      delete[] values[i];
-    }
-
-    return KeyConfig::ACTION_BLANK;
-  }
-  else if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_PLAYER, "SelectSubtitle"))
+  if (!signal)
   {
-    DBusError error;
-    dbus_error_init(&error);
-
-    int index;
-    dbus_message_get_args(m, &error, DBUS_TYPE_INT32, &index, DBUS_TYPE_INVALID);
-
-    if (dbus_error_is_set(&error))
-    {
-      dbus_error_free(&error);
-      dbus_respond_boolean(m, 0);
-    }
-    else
-    {
-      if (reader->SetActiveStream(OMXSTREAM_SUBTITLE, index))
-      {
-        subtitles->SetActiveStream(reader->GetSubtitleIndex());
-        dbus_respond_boolean(m, 1);
-      }
-      else {
-        dbus_respond_boolean(m, 0);
-      }
-    }
-    return KeyConfig::ACTION_BLANK;
+    CLog::Log(LOGWARNING, "Failed to allocate message");
+    return;
   }
-  else if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_PLAYER, "SelectAudio"))
-  {
-    DBusError error;
-    dbus_error_init(&error);
-
-    int index;
-    dbus_message_get_args(m, &error, DBUS_TYPE_INT32, &index, DBUS_TYPE_INVALID);
 
-    if (dbus_error_is_set(&error))
-    {
-      dbus_error_free(&error);
-      dbus_respond_boolean(m, 0);
-    }
-    else
-    {
-      if (reader->SetActiveStream(OMXSTREAM_AUDIO, index))
-      {
-        dbus_respond_boolean(m, 1);
-      }
-      else {
-        dbus_respond_boolean(m, 0);
-      }
-    }
-    return KeyConfig::ACTION_BLANK;
-  }
-  // TODO: SelectVideo ???
-  else if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_PLAYER, "ShowSubtitles"))
-  {
-    subtitles->SetVisible(true);
-    dbus_respond_ok(m);
-    return KeyConfig::ACTION_SHOW_SUBTITLES;
-  }
-  else if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_PLAYER, "HideSubtitles"))
+  DBusMessageIter args, dict, invalidated;
+  dbus_message_iter_init_append(signal, &args);
+  dbus_message_iter_append_basic(&args, DBUS_TYPE_STRING, &interface);
+  dbus_message_iter_open_container(&args, DBUS_TYPE_ARRAY, "{sv}", &dict);
+  for (const char *name : names)
   {
-    subtitles->SetVisible(false);
-    dbus_respond_ok(m);
-    return KeyConfig::ACTION_HIDE_SUBTITLES;
+    const PropertyGetter *getter = find_getter(interface, name);
+    if (getter)
+      append_property(&dict, *getter);
   }
-  else if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_PLAYER, "OpenUri"))
-  {
-    DBusError error;
-    dbus_error_init(&error);
+  dbus_message_iter_close_container(&args, &dict);
+  dbus_message_iter_open_container(&args, DBUS_TYPE_ARRAY, DBUS_TYPE_STRING_AS_STRING, &invalidated);
+  dbus_message_iter_close_container(&args, &invalidated);
 
-    const char *file;
-    dbus_message_get_args(m, &error, DBUS_TYPE_STRING, &file, DBUS_TYPE_INVALID);
+  dbus_connection_send(bus, signal, NULL);
+  dbus_message_unref(signal);
+}
 
-    if (dbus_error_is_set(&error))
-    {
-      CLog::Log(LOGWARNING, "Change file D-Bus Error: %s", error.message );
-      dbus_error_free(&error);
-      dbus_respond_ok(m);
-      return KeyConfig::ACTION_BLANK;
-    }
-    else
-    {
-      dbus_respond_string(m, file);
-      return OMXControlResult(KeyConfig::ACTION_CHANGE_FILE, file);
-    }
-  }
-  else if (dbus_message_is_method_call(m, OMXPLAYER_DBUS_INTERFACE_PLAYER, "Action"))
-  {
-    DBusError error;
-    dbus_error_init(&error);
+void OMXControl::dbus_signal_seeked(int64_t position)
+{
+  DBusMessage *signal;
 
-    int action;
-    dbus_message_get_args(m, &error, DBUS_TYPE_INT32, &action, DBUS_TYPE_INVALID);
+  signal = dbus_message_new_signal(OMXPLAYER_DBUS_PATH_SERVER, OMXPLAYER_DBUS_INTERFACE_PLAYER, "Seeked");
 
-    if (dbus_error_is_set(&error))
-    {
-      dbus_error_free(&error);
-      dbus_respond_ok(m);
-      return KeyConfig::ACTION_BLANK;
-    }
-    else
-    {
-      dbus_respond_ok(m);
-      return action; // Directly return enum
-    }
-  }
-  //----------------------------------------------------------------------------
-  else {
-    CLog::Log(LOGWARNING, "Unhandled dbus message, member: %s interface: %s type: %d path: %s", dbus_message_get_member(m), dbus_message_get_interface(m), dbus_message_get_type(m), dbus_message_get_path(m) );
-    if (dbus_message_get_type(m) == DBUS_MESSAGE_TYPE_METHOD_CALL)
-      dbus_respond_error(m, DBUS_ERROR_UNKNOWN_METHOD, "Unknown method");
+  if (!signal)
+  {
+    CLog::Log(LOGWARNING, "Failed to allocate message");
+    return;
   }
 
-  return KeyConfig::ACTION_BLANK;
+  dbus_int64_t pos = position;
+  dbus_message_append_args(signal, DBUS_TYPE_INT64, &pos, DBUS_TYPE_INVALID);
+  dbus_connection_send(bus, signal, NULL);
+  dbus_message_unref(signal);
 }
 
 DBusHandlerResult OMXControl::dbus_respond_error(DBusMessage *m, const char *name, const char *msg)
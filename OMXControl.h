@@ -3,9 +3,12 @@
 #define OMXPLAYER_DBUS_INTERFACE_PLAYER "org.mpris.MediaPlayer2.Player"
 
 #include <dbus/dbus.h>
+#include <string>
+#include <vector>
 #include "OMXClock.h"
 #include "OMXPlayerAudio.h"
 #include "OMXPlayerSubtitles.h"
+#include "ControlSocket.h"
 
 
 #define MIN_RATE (1)
@@ -34,16 +37,29 @@ protected:
   OMXPlayerAudio     *audio;
   OMXReader          *reader;
   OMXPlayerSubtitles *subtitles;
+  ControlSocket       control_socket;
 public:
   OMXControl();
   ~OMXControl();
   int init(OMXClock *m_av_clock, OMXPlayerAudio *m_player_audio, OMXPlayerSubtitles *m_player_subtitles, OMXReader *m_omx_reader, std::string& dbus_name);
+  bool openSocket(const std::string& path);
+  void closeSocket();
+  // Whether the control socket has commands for getEvent()
+  bool pending() { return control_socket.Pending(); }
   OMXControlResult getEvent();
   void dispatch();
 private:
   int dbus_connect(std::string& dbus_name);
   void dbus_disconnect();
   OMXControlResult handle_event(DBusMessage *m);
+  OMXControlResult handle_command(const ControlSocket::Command &command);
+  OMXControlResult get_property(DBusMessage *m);
+  OMXControlResult set_property(DBusMessage *m);
+  OMXControlResult get_all_properties(DBusMessage *m);
+  void respond_unknown_property(DBusMessage *m, const char *interface, const char *property);
+  OMXControlResult deprecated_boolean(DBusMessage *m, int b);
+  OMXControlResult respond_action(DBusMessage *m, int action);
+  void respond_stream_list(DBusMessage *m, OMXStreamType type, int count, int active);
   DBusHandlerResult dbus_respond_error(DBusMessage *m, const char *name, const char *msg);
   DBusHandlerResult dbus_respond_ok(DBusMessage *m);
   DBusHandlerResult dbus_respond_int64(DBusMessage *m, int64_t i);
@@ -51,4 +67,49 @@ private:
   DBusHandlerResult dbus_respond_boolean(DBusMessage *m, int b);
   DBusHandlerResult dbus_respond_string(DBusMessage *m, const char *text);
   DBusHandlerResult dbus_respond_array(DBusMessage *m, const char *array[], int size);
+  void dbus_signal_properties_changed(const char *interface, const std::vector<const char *> &names);
+  void dbus_signal_seeked(int64_t position);
+
+  // Handlers of method calls and properties, looked up by interface and
+  // name through a sorted index rather than compared one by one
+  struct MethodHandler
+  {
+    const char *interface;
+    const char *name;
+    OMXControlResult (*handle)(OMXControl &c, DBusMessage *m);
+  };
+  struct PropertyGetter
+  {
+    const char *interface;
+    const char *name;
+    const char *signature;
+    void (*get)(OMXControl &c, DBusMessageIter *value);
+  };
+  struct PropertySetter
+  {
+    const char *interface;
+    const char *name;
+    OMXControlResult (*set)(OMXControl &c, DBusMessage *m, double value);
+  };
+  static const MethodHandler method_handlers[];
+  static const PropertyGetter property_getters[];
+  static const PropertySetter property_setters[];
+
+  static const PropertyGetter *find_getter(const char *interface, const char *property);
+  void append_property(DBusMessageIter *dict, const PropertyGetter &getter);
+  void update_properties();
+
+  // The player as last sent with PropertiesChanged
+  struct PlayerState
+  {
+    bool valid = false;
+    bool paused;
+    int speed;
+    double volume;
+    std::string url;
+    int64_t length;
+    int64_t position;
+    int64_t position_time;
+  };
+  PlayerState notified;
 };
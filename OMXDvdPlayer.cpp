@@ -20,16 +20,26 @@
  */
 
 #include <string.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <vector>
 #include <dvdread/dvd_reader.h>
 #include <dvdread/ifo_read.h>
 
 #include "OMXReader.h"
 #include "OMXDvdPlayer.h"
+#include "utils/log.h"
 
 bool OMXDvdPlayer::Open(const std::string &filename)
 {
-	static int audio_id[7] = {0x80, 0, 0xC0, 0xC0, 0xA0, 0, 0x88};
 	device_path = filename;
+	auto start = std::chrono::steady_clock::now();
 
 	// Open DVD device or file
 	dvd_device = DVDOpen(device_path.c_str());
@@ -38,9 +48,31 @@ bool OMXDvdPlayer::Open(const std::string &filename)
 		return false;
 	}
 
-	// Get device name and checksum
+	// Get device name
 	read_title_name();
-	read_disc_checksum();
+
+	// A disc we've seen before doesn't need its IFO files read again
+	read_disc_identity();
+	bool cached = load_meta_cache();
+	if(cached) {
+		puts("Loaded DVD meta data from cache");
+	} else {
+		read_disc_checksum();
+		if(!read_meta_data())
+			return false;
+
+		save_meta_cache();
+	}
+
+	CLog::Log(LOGINFO, "OMXDvdPlayer: %s meta data in %lld ms", cached ? "loaded cached" : "read",
+		(long long)std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - start).count());
+	return true;
+}
+
+bool OMXDvdPlayer::read_meta_data()
+{
+	static int audio_id[7] = {0x80, 0, 0xC0, 0xC0, 0xA0, 0, 0x88};
 
 	// Open dvd meta data header
 	ifo_handle_t *ifo_zero, **ifo;
@@ -50,16 +82,35 @@ bool OMXDvdPlayer::Open(const std::string &filename)
 		return false;
 	}
 
-	ifo = new ifo_handle_t*[ifo_zero->vts_atrt->nr_of_vtss + 1];
-	//ifo = (ifo_handle_t **)malloc((ifo_zero->vts_atrt->nr_of_vtss + 1) * sizeof(ifo_handle_t *));
-	for (int i=1; i <= ifo_zero->vts_atrt->nr_of_vtss; i++) {
-		ifo[i] = ifoOpen(dvd_device, i);
-		if ( !ifo[i] && i == 0 ) {
-			fprintf( stderr, "Can't open ifo %d!\n", i);
-			return false;
+	int vts_count = ifo_zero->vts_atrt->nr_of_vtss;
+	ifo = new ifo_handle_t*[vts_count + 1]();
+
+	// Title set IFOs of images and directories are opened in parallel,
+	// which hides the latency of network shares. A libdvdread reader can't
+	// be shared between threads, so each extra thread opens the disc
+	// itself. A drive has one head, so there's nothing to gain there.
+	ifo_handles = ifo;
+	ifo_count = vts_count;
+	ifo_next = 1;
+
+	std::vector<dvd_reader_t *> readers;
+	std::vector<std::unique_ptr<IfoThread> > threads;
+	struct stat st;
+	if (stat(device_path.c_str(), &st) == 0 && !S_ISBLK(st.st_mode)) {
+		for (int i = 1; i < IFO_THREADS && i < vts_count; i++) {
+			dvd_reader_t *reader = DVDOpen(device_path.c_str());
+			if (!reader) break;
+
+			readers.push_back(reader);
+			threads.emplace_back(new IfoThread(this, reader));
+			threads.back()->Create();
 		}
 	}
 
+	open_title_sets(dvd_device);
+	for (auto &thread : threads)
+		thread->StopThread();
+
 	// loop through title sets
 	title_count = ifo_zero->tt_srpt->nr_of_srpts;
 	titles = new title_info[title_count];
@@ -67,7 +118,8 @@ bool OMXDvdPlayer::Open(const std::string &filename)
 		int title_set_nr = ifo_zero->tt_srpt->title[j].title_set_nr;
 		int vts_ttn = ifo_zero->tt_srpt->title[j].vts_ttn;
 
-		if (!ifo[title_set_nr]->vtsi_mat) {
+		if (title_set_nr < 1 || title_set_nr > vts_count ||
+				!ifo[title_set_nr] || !ifo[title_set_nr]->vtsi_mat) {
 			h--;
 			title_count--;
 			continue;
@@ -75,7 +127,8 @@ bool OMXDvdPlayer::Open(const std::string &filename)
 
 		pgcit_t    *vts_pgcit  = ifo[title_set_nr]->vts_pgcit;
 		vtsi_mat_t *vtsi_mat   = ifo[title_set_nr]->vtsi_mat;
-		pgc_t      *pgc        = vts_pgcit->pgci_srp[ifo[title_set_nr]->vts_ptt_srpt->title[vts_ttn - 1].ptt[0].pgcn - 1].pgc;
+		int         pgcn       = ifo[title_set_nr]->vts_ptt_srpt->title[vts_ttn - 1].ptt[0].pgcn;
+		pgc_t      *pgc        = vts_pgcit->pgci_srp[pgcn - 1].pgc;
 
 		if(pgc->cell_playback == NULL || pgc->program_map == NULL) {
 			h--;
@@ -113,6 +166,38 @@ bool OMXDvdPlayer::Open(const std::string &filename)
 		}
 		titles[h].last_sector = last_sector;
 
+		// Time map
+		// every cell starts on a VOBU, and the VTS time map has the VOBU
+		// at every tmu seconds
+		std::vector<title_info::time_entry> time_map;
+		int cell_time = 0;
+		for (int i = 0; i < cell_count; i++) {
+			int sector = pgc->cell_playback[i].first_sector;
+			if(sector > last_sector) break;
+
+			time_map.push_back({cell_time, sector});
+			cell_time += dvdtime2msec(&pgc->cell_playback[i].playback_time);
+		}
+
+		vts_tmapt_t *tmapt = ifo[title_set_nr]->vts_tmapt;
+		if (tmapt && pgcn <= tmapt->nr_of_tmaps && tmapt->tmap[pgcn - 1].tmu > 0) {
+			vts_tmap_t *tmap = &tmapt->tmap[pgcn - 1];
+			for (int i = 0; i < tmap->nr_of_entries; i++) {
+				// the top bit marks a discontinuity
+				int sector = tmap->map_ent[i] & 0x7fffffff;
+				if(sector > last_sector) break;
+
+				time_map.push_back({(i + 1) * tmap->tmu * 1000, sector});
+			}
+		}
+
+		std::stable_sort(time_map.begin(), time_map.end(),
+			[](const title_info::time_entry &a, const title_info::time_entry &b) { return a.ms < b.ms; });
+
+		titles[h].time_map_count = time_map.size();
+		titles[h].time_map = new title_info::time_entry[time_map.size()];
+		std::copy(time_map.begin(), time_map.end(), titles[h].time_map);
+
 		// Chapters
 		titles[h].chapters = new int[titles[h].chapter_count];
 
@@ -169,15 +254,25 @@ bool OMXDvdPlayer::Open(const std::string &filename)
 		}
 	}
 
-	// close dvd meta data filehandles
-	for (int i=1; i <= ifo_zero->vts_atrt->nr_of_vtss; i++) ifoClose(ifo[i]);
-	delete ifo;
+	// close dvd meta data filehandles, then the readers they came from
+	for (int i=1; i <= vts_count; i++) if (ifo[i]) ifoClose(ifo[i]);
+	delete[] ifo;
 	ifoClose(ifo_zero);
+	for (dvd_reader_t *reader : readers) DVDClose(reader);
+	ifo_handles = NULL;
 	m_allocated = true;
 	puts("Finished parsing DVD meta data");
 	return true;
 }
 
+// Opens title set IFOs until there are none left, on any number of
+// threads each with its own reader
+void OMXDvdPlayer::open_title_sets(dvd_reader_t *reader)
+{
+	for (int i = ifo_next++; i <= ifo_count; i = ifo_next++)
+		ifo_handles[i] = ifoOpen(reader, i);
+}
+
 bool OMXDvdPlayer::ChangeTrack(int delta, int &t)
 {
 	int ct;
@@ -198,6 +293,8 @@ bool OMXDvdPlayer::OpenTrack(int ct)
 {
 	if(m_open && titles[ct].vts != titles[current_track].vts)
 		CloseTrack();
+	else if(m_open)
+		log_cache_stats();
 
 	if(ct < 0 || ct > title_count - 1)
 		return false;
@@ -207,6 +304,7 @@ bool OMXDvdPlayer::OpenTrack(int ct)
 
 	// seek to beginning to track
 	pos = 0;
+	pos_byte_offset = 0;
 	pos_locked = false;
 
 	// blocks for this track
@@ -220,6 +318,32 @@ bool OMXDvdPlayer::OpenTrack(int ct)
 			puts("Error on DVDOpenFile");
 			return false;
 		}
+
+		file_blocks = DVDFileSize(dvd_track);
+
+		// titles loaded from the cache must fit in the title set
+		if(meta_cached && titles[current_track].last_sector >= file_blocks) {
+			puts("DVD meta data cache is out of date");
+			DVDCloseFile(dvd_track);
+
+			int vts = titles[current_track].vts;
+			int first_sector = titles[current_track].first_sector;
+			int length = titles[current_track].length;
+			if(!reload_meta_data())
+				return false;
+
+			// the title table is compacted differently, so the same title
+			// may have another number now
+			for(ct = 0; ct < title_count; ct++)
+				if(titles[ct].vts == vts && titles[ct].first_sector == first_sector
+						&& titles[ct].length == length)
+					return OpenTrack(ct);
+
+			puts("DVD title not found after reading the meta data again");
+			return false;
+		}
+
+		start_read_ahead();
 	}
 
 	m_open = true;
@@ -233,32 +357,247 @@ int OMXDvdPlayer::Read(unsigned char *lpBuf, int64_t uiBufSize)
 
 	// capture pos in cpos to avoid it changing midway through read
 	int cpos = pos;
+	int offset = pos_byte_offset;
 	pos_locked = false;
 
-	// read in block in whole numbers
-	int blocks_to_read = uiBufSize / 2048;
+	int64_t remaining = (int64_t)(total_blocks - cpos) * 2048 - offset;
+	if(uiBufSize > remaining)
+		uiBufSize = remaining;
 
-	if(cpos + blocks_to_read > total_blocks) {
-		blocks_to_read = total_blocks - cpos;
+	if(uiBufSize < 1)
+		return 0;
 
-		if(blocks_to_read < 1)
-			return 0;
+	// copy out of the cache from any byte offset, a chunk at a time
+	int sector = titles[current_track].first_sector + cpos;
+	int64_t done = 0;
+	std::unique_lock<std::mutex> lock(cache_lock);
+	while(done < uiBufSize) {
+		cache_chunk *c = get_chunk(sector, lock);
+		if(!c) {
+			if(done == 0)
+				return -1;
+			break;
+		}
+
+		int64_t from = (int64_t)(sector - c->first) * 2048 + offset;
+		int64_t n = std::min((int64_t)c->blocks * 2048 - from, uiBufSize - done);
+		memcpy(lpBuf + done, c->data + from, n);
+		done += n;
+
+		sector = c->first + (from + n) / 2048;
+		offset = (from + n) % 2048;
+	}
+	lock.unlock();
+
+	// keep the chunks after this one coming
+	int ahead = sector - sector % CHUNK_BLOCKS + CHUNK_BLOCKS;
+	if(ahead != read_ahead_from && read_ahead_thread.Running()) {
+		read_ahead_from = ahead;
+		read_ahead_mailbox.clear();
+		read_ahead_mailbox.send(ReadAheadMessage::ReadAhead{ahead});
 	}
 
-	int read_blocks;
-	if(pos_byte_offset > 0) {
-		unsigned char *buffer;
-		buffer = (unsigned char *)malloc(uiBufSize);
-		read_blocks = DVDReadBlocks(dvd_track, titles[current_track].first_sector + cpos, blocks_to_read, buffer);
-		memcpy(lpBuf, buffer + pos_byte_offset, (read_blocks * 2048) - pos_byte_offset);
-		pos_byte_offset = 0;
-		free(buffer);
+	if(!pos_locked) {
+		pos = sector - titles[current_track].first_sector;
+		pos_byte_offset = offset;
+	}
+	return done;
+}
+
+// Returns the chunk holding sector, or NULL if it couldn't be read.
+// Called with cache_lock held.
+OMXDvdPlayer::cache_chunk *OMXDvdPlayer::get_chunk(int sector, std::unique_lock<std::mutex> &lock)
+{
+	cache_chunk *c = find_chunk(sector);
+	if(c && !c->filling) {
+		cache_stats.hits++;
+		c->last_used = ++cache_clock;
+		return c;
+	}
+
+	cache_stats.misses++;
+	auto start = std::chrono::steady_clock::now();
+
+	// read ahead gives way until this read is done
+	io_waiting++;
+	for(;;) {
+		c = find_chunk(sector);
+		if(c && c->filling) {
+			// it's being read ahead already, up to the next piece
+			cache_cond.wait(lock);
+			continue;
+		}
+		if(!c && fill_chunk(sector, lock, false))
+			c = find_chunk(sector);
+		break;
+	}
+	io_waiting--;
+
+	cache_stats.stall_ms += std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+
+	if(c)
+		c->last_used = ++cache_clock;
+	return c;
+}
+
+OMXDvdPlayer::cache_chunk *OMXDvdPlayer::find_chunk(int sector)
+{
+	for(cache_chunk &c : cache)
+		if(c.first != -1 && sector >= c.first && sector < c.first + c.blocks)
+			return &c;
+	return NULL;
+}
+
+// Reads the aligned chunk holding sector into the least recently used
+// slot. The cache is unlocked while the disc is read, with the slot
+// marked as filling so nobody else uses it. Reading ahead stops early if
+// playback has to read, keeping what was read so far, and only returns
+// true if the whole chunk was read.
+bool OMXDvdPlayer::fill_chunk(int sector, std::unique_lock<std::mutex> &lock, bool ahead)
+{
+	int first = sector - sector % CHUNK_BLOCKS;
+	int blocks = file_blocks - first;
+	if(blocks > CHUNK_BLOCKS)
+		blocks = CHUNK_BLOCKS;
+	else if(blocks < 1)
+		return false;
+
+	cache_chunk *c = NULL;
+	for(cache_chunk &i : cache)
+		if(i.data && !i.filling && (!c || i.last_used < c->last_used))
+			c = &i;
+	if(!c)
+		return false;
+
+	c->first = first;
+	c->blocks = blocks;
+	c->filling = true;
+	lock.unlock();
+
+	int read_blocks = 0;
+	if(ahead) {
+		while(read_blocks < blocks && io_waiting == 0) {
+			int n = std::min(blocks - read_blocks, (int)READ_AHEAD_BLOCKS);
+			std::lock_guard<std::mutex> io(io_lock);
+			int got = DVDReadBlocks(dvd_track, first + read_blocks, n, c->data + read_blocks * 2048);
+			if(got > 0)
+				read_blocks += got;
+			if(got < n)
+				break;
+		}
 	} else {
-		read_blocks = DVDReadBlocks(dvd_track, titles[current_track].first_sector + cpos, blocks_to_read, lpBuf);
+		std::lock_guard<std::mutex> io(io_lock);
+		read_blocks = DVDReadBlocks(dvd_track, first, blocks, c->data);
+	}
+
+	lock.lock();
+	c->filling = false;
+	c->last_used = ++cache_clock;
+	if(read_blocks > 0) {
+		c->blocks = read_blocks;
+		cache_stats.bytes_read += (int64_t)read_blocks * 2048;
+	} else {
+		c->first = -1;
+		c->blocks = 0;
+	}
+	cache_cond.notify_all();
+
+	return ahead ? read_blocks == blocks : read_blocks > 0;
+}
+
+void OMXDvdPlayer::start_read_ahead()
+{
+	// aligned for drives opened with O_DIRECT
+	for(cache_chunk &c : cache) {
+		if(!c.data && posix_memalign((void **)&c.data, 2048, CHUNK_BLOCKS * 2048) != 0)
+			c.data = NULL;
+		c.first = -1;
+		c.blocks = 0;
+		c.filling = false;
+	}
+
+	read_ahead_from = -1;
+	read_ahead_mailbox.clear();
+	read_ahead_thread.Create();
+}
+
+void OMXDvdPlayer::stop_read_ahead()
+{
+	if(read_ahead_thread.Running()) {
+		read_ahead_mailbox.send(ReadAheadMessage::Stop{});
+		read_ahead_thread.StopThread();
 	}
 
-	if(!pos_locked) pos = cpos + read_blocks;
-	return read_blocks * 2048;
+	std::lock_guard<std::mutex> lock(cache_lock);
+	for(cache_chunk &c : cache) {
+		c.first = -1;
+		c.blocks = 0;
+	}
+}
+
+void OMXDvdPlayer::read_ahead_loop()
+{
+	// only use the drive when playback isn't waiting on it. The drive is
+	// read a piece at a time, so at this priority io_lock is never held
+	// for long while playback waits for it.
+	struct sched_param param = {0};
+	pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+
+	bool exit = false;
+	int next = 0;
+	int remaining = 0;
+
+	auto on_read_ahead = [&](ReadAheadMessage::ReadAhead&& args)
+	{
+		next = args.sector;
+		remaining = READ_AHEAD_CHUNKS;
+	};
+	auto on_stop = [&](ReadAheadMessage::Stop&&)
+	{
+		exit = true;
+	};
+
+	while(!exit) {
+		if(remaining > 0)
+			read_ahead_mailbox.receive(on_read_ahead, on_stop);
+		else
+			read_ahead_mailbox.receive_wait(std::chrono::milliseconds(1000), on_read_ahead, on_stop);
+
+		if(exit || remaining == 0)
+			continue;
+
+		std::unique_lock<std::mutex> lock(cache_lock);
+		if(find_chunk(next) || fill_chunk(next, lock, true)) {
+			next += CHUNK_BLOCKS;
+			remaining--;
+		} else {
+			remaining = 0;
+		}
+	}
+}
+
+OMXDvdPlayer::CacheStats OMXDvdPlayer::GetCacheStats()
+{
+	std::lock_guard<std::mutex> lock(cache_lock);
+	return cache_stats;
+}
+
+// Logs the current track's cache stats and starts them again for the next
+void OMXDvdPlayer::log_cache_stats()
+{
+	CacheStats stats;
+	{
+		std::lock_guard<std::mutex> lock(cache_lock);
+		stats = cache_stats;
+		cache_stats = CacheStats{0, 0, 0.0, 0};
+	}
+
+	unsigned int reads = stats.hits + stats.misses;
+	CLog::Log(LOGDEBUG, "OMXDvdPlayer: title %d sector cache %u hits %u misses (%.0f%%), "
+		"%.0f ms stalled on the drive, %lld kB read", current_track + 1, stats.hits, stats.misses,
+		reads ? stats.hits * 100.0 / reads : 0.0, stats.stall_ms,
+		(long long)(stats.bytes_read >> 10));
 }
 
 int OMXDvdPlayer::getCurrentTrackLength()
@@ -279,6 +618,30 @@ int64_t OMXDvdPlayer::Seek(int64_t iFilePosition, int iWhence)
 	return 0;
 }
 
+// Finds the VOBU which starts at or before ms in the current title's time
+// map, setting ms to its time and pos to its byte position in the title
+bool OMXDvdPlayer::TimeToPosition(int &ms, int64_t &pos)
+{
+	if(!m_open)
+		return false;
+
+	title_info &t = titles[current_track];
+	title_info::time_entry *end = t.time_map + t.time_map_count;
+	title_info::time_entry *e = std::upper_bound(t.time_map, end, ms,
+		[](int ms, const title_info::time_entry &e) { return ms < e.ms; });
+
+	if(e == t.time_map)
+		return false;
+
+	--e;
+	if(e->sector < t.first_sector || e->sector > t.last_sector)
+		return false;
+
+	ms = e->ms;
+	pos = (int64_t)(e->sector - t.first_sector) * 2048;
+	return true;
+}
+
 int64_t OMXDvdPlayer::GetSizeInBytes()
 {
 	return (int64_t)total_blocks * 2048;
@@ -304,6 +667,9 @@ float OMXDvdPlayer::GetChapterStartTime(int i)
 
 void OMXDvdPlayer::CloseTrack()
 {
+	stop_read_ahead();
+	log_cache_stats();
+
 	DVDCloseFile(dvd_track);
 	m_open = false;
 }
@@ -321,7 +687,8 @@ void OMXDvdPlayer::GetStreamInfo(OMXStream *stream)
 	int len = titles[current_track].audiostream_count + titles[current_track].subtitle_count;
 
 	for (int i=0; i < len; i++) {
-		if(titles[current_track].streams[i].id == stream->stream->id) {
+		// MPEG audio is 0x1c0 and up in the stream, 0xc0 and up here
+		if(titles[current_track].streams[i].id == (stream->stream->id & 0xff)) {
 			stream->index = titles[current_track].streams[i].index;
 			strcpy(stream->language, convertLangCode(titles[current_track].streams[i].lang));
 			return;
@@ -332,21 +699,40 @@ void OMXDvdPlayer::GetStreamInfo(OMXStream *stream)
 	stream->index = -1;
 }
 
+std::vector<int> OMXDvdPlayer::GetStreamIds()
+{
+	title_info &t = titles[current_track];
+	std::vector<int> ids;
+	for (int i=0; i < t.audiostream_count + t.subtitle_count; i++)
+		ids.push_back(t.streams[i].id);
+	return ids;
+}
+
 OMXDvdPlayer::~OMXDvdPlayer()
 {
 	if(m_open)
 		CloseTrack();
 
+	free_titles();
+
+	if(dvd_device)
+		DVDClose(dvd_device);
+
+	for(cache_chunk &c : cache)
+		free(c.data);
+}
+
+void OMXDvdPlayer::free_titles()
+{
 	if(m_allocated) {
 		for (int i=0; i < title_count; i++) {
-			delete titles[i].chapters;
-			delete titles[i].streams;
+			delete[] titles[i].chapters;
+			delete[] titles[i].streams;
+			delete[] titles[i].time_map;
 		}
-		delete titles;
+		delete[] titles;
 	}
-
-	if(dvd_device)
-		DVDClose(dvd_device);
+	m_allocated = false;
 }
 
 int OMXDvdPlayer::dvdtime2msec(dvd_time_t *dt)
@@ -412,9 +798,253 @@ void OMXDvdPlayer::read_disc_checksum()
 	disc_checksum = hex;
 }
 
+// A cheap identity for the disc which doesn't need its IFO files read:
+// a hash of the ISO 9660 primary volume descriptor of a disc or image,
+// which holds its names, dates and size. A VIDEO_TS directory uses the
+// size and modification time of VIDEO_TS.IFO instead.
+void OMXDvdPlayer::read_disc_identity()
+{
+	uint64_t hash = 14695981039346656037ULL;
+	auto add = [&](const void *data, size_t len) {
+		for (size_t i = 0; i < len; i++) {
+			hash ^= ((const unsigned char *)data)[i];
+			hash *= 1099511628211ULL;
+		}
+	};
+
+	disc_identity.clear();
+
+	unsigned char pvd[2048];
+	bool have_pvd = false;
+	FILE *filehandle = fopen(device_path.c_str(), "r");
+	if (filehandle) {
+		have_pvd = fseek(filehandle, 16 * 2048, SEEK_SET) == 0 &&
+			fread(pvd, 1, sizeof(pvd), filehandle) == sizeof(pvd) &&
+			pvd[0] == 1 && memcmp(pvd + 1, "CD001", 5) == 0;
+		fclose(filehandle);
+	}
+
+	if (have_pvd) {
+		add(pvd, sizeof(pvd));
+	} else {
+		static const char *ifo_paths[] = {
+			"/VIDEO_TS/VIDEO_TS.IFO", "/video_ts/video_ts.ifo", "/VIDEO_TS.IFO"
+		};
+
+		struct stat st;
+		const char **path = ifo_paths;
+		while (path != ifo_paths + 3 && stat((device_path + *path).c_str(), &st) != 0)
+			path++;
+
+		if (path == ifo_paths + 3)
+			return;
+
+		add(device_path.data(), device_path.size());
+		add(&st.st_size, sizeof(st.st_size));
+		add(&st.st_mtime, sizeof(st.st_mtime));
+	}
+
+	char hex[17];
+	sprintf(hex, "%016llx", (unsigned long long)hash);
+	disc_identity = hex;
+}
+
+// The cache was wrong about this disc, so read it properly
+bool OMXDvdPlayer::reload_meta_data()
+{
+	meta_cached = false;
+	free_titles();
+
+	disc_checksum.clear();
+	read_disc_checksum();
+	if(!read_meta_data())
+		return false;
+
+	save_meta_cache();
+
+	if(heuristic_selection)
+		enableHeuristicTrackSelection();
+	return true;
+}
+
+std::string OMXDvdPlayer::meta_cache_file()
+{
+	const char *home = getenv("HOME");
+	return home ? std::string(home) + "/.omxplayer_dvd_cache" : "";
+}
+
+/*
+ * The meta data cache holds the title tables of the most recently opened
+ * discs, newest first. Each disc is a line
+ *   D <identity> <checksum> <title count>
+ * followed by a line for each title
+ *   T <enabled> <vts> <length> <first sector> <last sector>
+ *     <chapter count> <chapters...> <audio count> <subtitle count>
+ *     <index id lang of each stream...> <time map count>
+ *     <ms sector of each time map entry...>
+ */
+bool OMXDvdPlayer::load_meta_cache()
+{
+	// what a DVD can hold, anything else isn't from save_meta_cache
+	static const int MAX_TITLES = 99;
+	static const int MAX_VTS = 99;
+	static const int MAX_CHAPTERS = 255;
+	static const int MAX_AUDIO = 8;
+	static const int MAX_SUBTITLES = 32;
+	// a time map entry for each cell and each time map unit
+	static const int MAX_TIME_MAP = 255 + 65535;
+
+	std::string filename = meta_cache_file();
+	if(disc_identity.empty() || filename.empty())
+		return false;
+
+	std::ifstream s(filename);
+	std::string line;
+	int count = 0;
+	while(getline(s, line)) {
+		std::istringstream is(line);
+		std::string tag, identity;
+		if(is >> tag >> identity && tag == "D" && identity == disc_identity) {
+			if(!(is >> disc_checksum >> count))
+				return false;
+			break;
+		}
+	}
+
+	if(count < 1 || count > MAX_TITLES) {
+		disc_checksum.clear();
+		return false;
+	}
+
+	if(disc_checksum == "-")
+		disc_checksum.clear();
+
+	titles = new title_info[count];
+	title_count = 0;
+	m_allocated = true;
+
+	for(; title_count < count && getline(s, line); title_count++) {
+		title_info &t = titles[title_count];
+		std::istringstream is(line);
+		std::string tag;
+		int enabled;
+
+		if(!(is >> tag >> enabled >> t.vts >> t.length >> t.first_sector >> t.last_sector
+				>> t.chapter_count) || tag != "T" || t.vts < 1 || t.vts > MAX_VTS ||
+				t.length < 0 || t.first_sector < 0 || t.last_sector < t.first_sector ||
+				t.chapter_count < 0 || t.chapter_count > MAX_CHAPTERS)
+			break;
+
+		std::vector<int> chapters(t.chapter_count);
+		for(int &c : chapters)
+			is >> c;
+
+		is >> t.audiostream_count >> t.subtitle_count;
+		if(!is || t.audiostream_count < 0 || t.audiostream_count > MAX_AUDIO ||
+				t.subtitle_count < 0 || t.subtitle_count > MAX_SUBTITLES)
+			break;
+
+		std::vector<title_info::stream_info> streams(t.audiostream_count + t.subtitle_count);
+		for(title_info::stream_info &st : streams)
+			is >> st.index >> st.id >> st.lang;
+
+		is >> t.time_map_count;
+		if(!is || t.time_map_count < 0 || t.time_map_count > MAX_TIME_MAP)
+			break;
+
+		// in time order and inside the title, as seeking relies on it
+		std::vector<title_info::time_entry> time_map(t.time_map_count);
+		int last_ms = 0;
+		for(title_info::time_entry &e : time_map) {
+			if(!(is >> e.ms >> e.sector) || e.ms < last_ms ||
+					e.sector < 0 || e.sector > t.last_sector)
+				is.setstate(std::ios::failbit);
+			last_ms = e.ms;
+		}
+
+		if(!is)
+			break;
+
+		t.enabled = enabled;
+		t.chapters = new int[chapters.size()];
+		std::copy(chapters.begin(), chapters.end(), t.chapters);
+		t.streams = new title_info::stream_info[streams.size()];
+		std::copy(streams.begin(), streams.end(), t.streams);
+		t.time_map = new title_info::time_entry[time_map.size()];
+		std::copy(time_map.begin(), time_map.end(), t.time_map);
+	}
+
+	if(title_count != count) {
+		// only the complete titles are freed
+		free_titles();
+		disc_checksum.clear();
+		return false;
+	}
+
+	meta_cached = true;
+	return true;
+}
+
+void OMXDvdPlayer::save_meta_cache()
+{
+	static const int MAX_DISCS = 20;
+
+	std::string filename = meta_cache_file();
+	if(disc_identity.empty() || filename.empty())
+		return;
+
+	std::ostringstream out;
+	out << "D " << disc_identity << ' '
+		<< (disc_checksum.empty() ? "-" : disc_checksum) << ' ' << title_count << '\n';
+
+	for(int i = 0; i < title_count; i++) {
+		title_info &t = titles[i];
+		out << "T " << t.enabled << ' ' << t.vts << ' ' << t.length << ' '
+			<< t.first_sector << ' ' << t.last_sector << ' ' << t.chapter_count;
+		for(int j = 0; j < t.chapter_count; j++)
+			out << ' ' << t.chapters[j];
+
+		out << ' ' << t.audiostream_count << ' ' << t.subtitle_count;
+		for(int j = 0; j < t.audiostream_count + t.subtitle_count; j++)
+			out << ' ' << t.streams[j].index << ' ' << t.streams[j].id << ' ' << t.streams[j].lang;
+
+		out << ' ' << t.time_map_count;
+		for(int j = 0; j < t.time_map_count; j++)
+			out << ' ' << t.time_map[j].ms << ' ' << t.time_map[j].sector;
+		out << '\n';
+	}
+
+	// then the other discs, dropping the oldest
+	std::ifstream in(filename);
+	std::string line;
+	int discs = 1;
+	bool keep = false;
+	while(getline(in, line)) {
+		if(line.compare(0, 2, "D ") == 0) {
+			keep = line.compare(2, disc_identity.size(), disc_identity) != 0 && discs < MAX_DISCS;
+			if(keep) discs++;
+		}
+		if(keep)
+			out << line << '\n';
+	}
+	in.close();
+
+	// replace the file in one go so it's never seen half written
+	std::string tmp = filename + ".tmp";
+	std::ofstream s(tmp);
+	s << out.str();
+	s.close();
+	if(s)
+		rename(tmp.c_str(), filename.c_str());
+	else
+		remove(tmp.c_str());
+}
+
 //enable heuristic track skip
 void OMXDvdPlayer::enableHeuristicTrackSelection()
 {
+	heuristic_selection = true;
+
 	// Disable tracks which are shorter than two minutes
 	for(int i = 0; i < title_count; i++) {
 		if(titles[i].length < 120000) {
@@ -2,7 +2,14 @@
 
 #include <dvdread/dvd_reader.h>
 #include <dvdread/ifo_read.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <string>
+#include <vector>
+
+#include "OMXThread.h"
+#include "utils/Mailbox.h"
 
 struct OMXStream;
 
@@ -18,6 +25,7 @@ class OMXDvdPlayer
 
 	int Read(unsigned char *lpBuf, int64_t uiBufSize);
 	int64_t Seek(int64_t iFilePosition, int iWhence);
+	bool TimeToPosition(int &ms, int64_t &pos);
 	bool IsEOF();
 	int64_t GetSizeInBytes();
 	int getCurrentTrackLength();
@@ -25,6 +33,8 @@ class OMXDvdPlayer
 	float GetChapterStartTime(int i);
 	int GetCurrentTrack() const { return current_track; }
 	void GetStreamInfo(OMXStream *stream);
+	// MPEG-PS ids of the current track's audio streams, then its subtitles
+	std::vector<int> GetStreamIds();
 	bool MetaDataCheck(int audiostream_count, int subtitle_count);
 	std::string GetID() const { return disc_checksum; }
 	std::string GetTitle() const { return disc_title; }
@@ -32,11 +42,84 @@ class OMXDvdPlayer
 	int findNextEnabledTrack(int i);
 	int findPrevEnabledTrack(int i);
 
+	struct CacheStats {
+		unsigned int hits;
+		unsigned int misses;
+		// time reads spent waiting on the drive
+		double stall_ms;
+		int64_t bytes_read;
+	};
+	CacheStats GetCacheStats();
+
   private:
+	// Sectors are read from the disc in large aligned chunks, and the
+	// chunks after the one being played are read ahead on this thread
+	class ReadAheadThread : public OMXThread
+	{
+	  public:
+		explicit ReadAheadThread(OMXDvdPlayer *owner) : m_owner(owner) {}
+		void Process() override { m_owner->read_ahead_loop(); }
+	  private:
+		OMXDvdPlayer *m_owner;
+	};
+
+	// Opens title set IFOs alongside the main thread
+	class IfoThread : public OMXThread
+	{
+	  public:
+		IfoThread(OMXDvdPlayer *owner, dvd_reader_t *reader) : m_owner(owner), m_reader(reader) {}
+		void Process() override { m_owner->open_title_sets(m_reader); }
+	  private:
+		OMXDvdPlayer *m_owner;
+		dvd_reader_t *m_reader;
+	};
+
+	static const int IFO_THREADS = 4;
+
+	struct ReadAheadMessage {
+		struct ReadAhead
+		{
+			int sector;
+		};
+		struct Stop {};
+	};
+
+	struct cache_chunk {
+		// first sector in the title set, -1 if empty
+		int first = -1;
+		int blocks = 0;
+		bool filling = false;
+		unsigned int last_used = 0;
+		unsigned char *data = NULL;
+	};
+
+	static const int CHUNK_BLOCKS = 512;
+	static const int CACHE_CHUNKS = 4;
+	static const int READ_AHEAD_CHUNKS = 2;
+	// chunks are read ahead this many blocks at a time, so playback never
+	// waits on io_lock for longer than one of these
+	static const int READ_AHEAD_BLOCKS = 32;
+
+	void start_read_ahead();
+	void stop_read_ahead();
+	void read_ahead_loop();
+	cache_chunk *find_chunk(int sector);
+	cache_chunk *get_chunk(int sector, std::unique_lock<std::mutex> &lock);
+	bool fill_chunk(int sector, std::unique_lock<std::mutex> &lock, bool ahead);
+	void log_cache_stats();
+
 	int dvdtime2msec(dvd_time_t *dt);
 	const char* convertLangCode(uint16_t lang);
 	void read_title_name();
 	void read_disc_checksum();
+	void read_disc_identity();
+	bool read_meta_data();
+	void open_title_sets(dvd_reader_t *reader);
+	bool reload_meta_data();
+	void free_titles();
+	std::string meta_cache_file();
+	bool load_meta_cache();
+	void save_meta_cache();
 
 	bool m_open = false;
 	bool m_allocated = false;
@@ -46,6 +129,28 @@ class OMXDvdPlayer
 
 	dvd_reader_t *dvd_device = NULL;
 	dvd_file_t *dvd_track = NULL;
+	int file_blocks = 0;
+
+	// IFOs being opened by open_title_sets
+	ifo_handle_t **ifo_handles = NULL;
+	int ifo_count = 0;
+	std::atomic<int> ifo_next{0};
+
+	// Chunks are only changed with cache_lock held, except for the data of
+	// one being filled. Reads from the disc are serialised by io_lock, and
+	// read ahead stops while io_waiting says playback is waiting to read.
+	cache_chunk cache[CACHE_CHUNKS];
+	unsigned int cache_clock = 0;
+	// for the current track
+	CacheStats cache_stats = {0, 0, 0.0, 0};
+	std::mutex cache_lock;
+	std::condition_variable cache_cond;
+	std::mutex io_lock;
+	std::atomic<int> io_waiting{0};
+	int read_ahead_from = -1;
+	ReadAheadThread read_ahead_thread{this};
+	Mailbox<ReadAheadMessage::ReadAhead,
+			ReadAheadMessage::Stop> read_ahead_mailbox;
 
 	int current_track;
 	int total_blocks;
@@ -53,6 +158,11 @@ class OMXDvdPlayer
 	std::string device_path;
 	std::string disc_title;
 	std::string disc_checksum;
+	std::string disc_identity;
+	// titles came from the meta data cache and haven't been checked yet
+	bool meta_cached = false;
+	// enableHeuristicTrackSelection was used, so it's used again on reload
+	bool heuristic_selection = false;
 	int title_count;
 	struct title_info {
 		bool enabled;
@@ -69,6 +179,12 @@ class OMXDvdPlayer
 		} *streams;
 		int first_sector;
 		int last_sector;
+		// VOBU start sectors by time, in time order
+		int time_map_count;
+		struct time_entry {
+			int ms;
+			int sector;
+		} *time_map;
 	} *titles;
 
 	float frames_per_s[4] = {-1.0, 25.00, -1.0, 29.97};
@@ -18,6 +18,7 @@
 
 #include "OMXPlayerSubtitles.h"
 #include "SubtitleRenderer.h"
+#include "DispmanxLayer.h"
 #include "Subtitle.h"
 #include "DllAvCodec.h"
 #include "utils/Enforce.h"
@@ -34,15 +35,25 @@ using namespace std;
 using namespace boost;
 
 OMXPlayerSubtitles::OMXPlayerSubtitles() BOOST_NOEXCEPT
-: m_visible(),
+: m_dvd_codec_context(),
+  m_decoder_state(),
+  m_decoder_thread(this),
+  m_decoder_stopped(),
+  m_decoder_generation(),
+  m_memory_usage(),
+  m_loader_thread(this),
+  m_external_start(),
+  m_visible(),
   m_use_external_subtitles(),
   m_active_index(),
+  m_stream_count(),
   m_delay(),
   m_thread_stopped(),
   m_font_size(),
   m_centered(),
   m_ghost_box(),
   m_lines(),
+  m_retention(),
   m_av_clock()
 {}
 
@@ -57,6 +68,7 @@ bool OMXPlayerSubtitles::Init(int display,
                               bool centered,
                               bool ghost_box,
                               unsigned int lines,
+                              int retention,
                               OMXClock* clock) BOOST_NOEXCEPT
 {
   m_visible = true;
@@ -65,10 +77,17 @@ bool OMXPlayerSubtitles::Init(int display,
   m_delay = 0;
   m_thread_stopped.store(false, memory_order_relaxed);
 
+  m_decoder_state.visible = true;
+  m_decoder_state.use_external_subtitles = false;
+  m_decoder_state.active_index = 0;
+  m_decoder_stopped.store(false, memory_order_relaxed);
+  m_memory_usage.store(0, memory_order_relaxed);
+
   m_font_size = font_size;
   m_centered = centered;
   m_ghost_box = ghost_box;
   m_lines = lines;
+  m_retention = retention;
   m_av_clock = clock;
   m_display = display;
   m_layer = layer;
@@ -76,45 +95,140 @@ bool OMXPlayerSubtitles::Init(int display,
   if(!Create())
     return false;
 
+  if(!m_decoder_thread.Create())
+    return false;
+
   return true;
 }
 
 
 bool OMXPlayerSubtitles::Open(size_t stream_count,
-                              vector<Subtitle>&& external_subtitles) BOOST_NOEXCEPT
+                              const std::string& external_subtitles_path,
+                              int start_time) BOOST_NOEXCEPT
 {
-  m_subtitle_buffers.resize(stream_count, circular_buffer<Subtitle>(32));
+  m_stream_count = stream_count;
+  SendToDecoder(DecoderMessage::Open{stream_count});
 
-  if(external_subtitles.size() > 0)
+  if(!external_subtitles_path.empty())
   {
-    SendToRenderer(Message::SendExternalSubs{std::move(external_subtitles)});
+    StopLoader();
+
+    if(!m_external_file.Open(external_subtitles_path))
+      return false;
+
+    // Enable an empty track now, the loader fills it in
+    SendToRenderer(Message::SendExternalSubs{});
     m_use_external_subtitles = true;
+
+    m_external_start = start_time;
+    if(!m_loader_thread.Create())
+      return false;
   }
 
   return true;
 }
 
+void OMXPlayerSubtitles::StopLoader()
+{
+  if(m_loader_thread.Running())
+    m_loader_thread.StopThread();
+  m_external_file.Close();
+}
+
+// Called on the loader thread
+void OMXPlayerSubtitles::LoadProcess()
+{
+  static const size_t BATCH_SIZE = 256;
+  // how far before the start position to look for subtitles which may
+  // still be showing at it
+  static const int LOOK_BEHIND = 10000;
+
+  // External subtitles are kept for the whole file
+  SubtitleTrack tail;
+  Subtitle sub(false);
+
+  auto Append = [&](SubtitleTrack& track, const Subtitle& s)
+  {
+    if(!track.empty() && track.start(track.size() - 1) > s.start)
+      return;
+    track.push_back(s);
+  };
+
+  // Those nearest the start position first, in batches the renderer can
+  // use while the rest are parsed
+  size_t offset = m_external_file.Find(m_external_start - LOOK_BEHIND);
+  size_t pos = offset;
+  size_t sent = 0;
+  while(!m_loader_thread.Stopping() &&
+        m_external_file.Read(pos, m_external_file.Size(), sub))
+  {
+    Append(tail, sub);
+    if(tail.size() - sent >= BATCH_SIZE)
+    {
+      SendToRenderer(Message::UpdateExternalSubs{tail});
+      sent = tail.size();
+    }
+  }
+
+  if(m_loader_thread.Stopping())
+    return;
+
+  if(offset == 0)
+  {
+    if(tail.size() != sent)
+      SendToRenderer(Message::UpdateExternalSubs{std::move(tail)});
+    return;
+  }
+
+  SendToRenderer(Message::UpdateExternalSubs{tail});
+
+  // Then everything before them
+  SubtitleTrack all;
+  pos = 0;
+  while(!m_loader_thread.Stopping() &&
+        m_external_file.Read(pos, offset, sub))
+  {
+    Append(all, sub);
+  }
+
+  for(size_t i = 0; i < tail.size() && !m_loader_thread.Stopping(); i++)
+    Append(all, tail.at(i));
+
+  if(!m_loader_thread.Stopping())
+    SendToRenderer(Message::UpdateExternalSubs{std::move(all)});
+}
+
 bool OMXPlayerSubtitles::initDVDSubs(Dimension video,
                               float video_aspect,
                               int aspect_mode) BOOST_NOEXCEPT
 {
   SendToRenderer(Message::DVDSubs{video, video_aspect, aspect_mode});
-
-  AVCodec *dvd_codec = m_dllAvCodec.avcodec_find_decoder(AV_CODEC_ID_DVD_SUBTITLE);
-  m_dvd_codec_context = m_dllAvCodec.avcodec_alloc_context3(dvd_codec);
-  m_dllAvCodec.avcodec_open2(m_dvd_codec_context, dvd_codec, NULL);
+  SendToDecoder(DecoderMessage::InitDVDSubs{});
 
   return true;
 }
 
 void OMXPlayerSubtitles::Close() BOOST_NOEXCEPT
 {
+  StopLoader();
+  // Packets still queued for the decoder belong to the stream being closed
+  m_decoder_generation.fetch_add(1, memory_order_relaxed);
   m_mailbox.clear();
-  m_subtitle_buffers.clear();
+  m_stream_count = 0;
+  if(!m_decoder_stopped.load(memory_order_relaxed))
+    SendToDecoder(DecoderMessage::Close{});
 }
 
 void OMXPlayerSubtitles::DeInit() BOOST_NOEXCEPT
 {
+  StopLoader();
+
+  if(m_decoder_thread.Running())
+  {
+    SendToDecoder(DecoderMessage::Stop{});
+    m_decoder_thread.StopThread();
+  }
+
   if(Running())
   {
     SendToRenderer(Message::Stop{});
@@ -125,6 +239,112 @@ void OMXPlayerSubtitles::DeInit() BOOST_NOEXCEPT
     avcodec_free_context(&m_dvd_codec_context);
 }
 
+void OMXPlayerSubtitles::DecodeProcess()
+{
+  try
+  {
+    DecodeLoop();
+  }
+  catch(std::exception& e)
+  {
+    CLog::Log(LOGERROR, "OMXPlayerSubtitles::DecodeLoop threw %s (%s)",
+              typeid(e).name(), e.what());
+  }
+  m_decoder_stopped.store(true, memory_order_relaxed);
+}
+
+void OMXPlayerSubtitles::DecodeLoop()
+{
+  bool exit{};
+
+  while(!exit)
+  {
+    m_decoder_mailbox.receive_wait(chrono::milliseconds(1000),
+      [&](DecoderMessage::Open&& args)
+      {
+        m_subtitle_buffers.clear();
+        m_subtitle_buffers.resize(args.stream_count, SubtitleTrack(m_retention));
+        UpdateMemoryUsage();
+      },
+      [&](DecoderMessage::InitDVDSubs&&)
+      {
+        if(m_dvd_codec_context)
+          avcodec_free_context(&m_dvd_codec_context);
+
+        AVCodec *dvd_codec = m_dllAvCodec.avcodec_find_decoder(AV_CODEC_ID_DVD_SUBTITLE);
+        m_dvd_codec_context = m_dllAvCodec.avcodec_alloc_context3(dvd_codec);
+        m_dllAvCodec.avcodec_open2(m_dvd_codec_context, dvd_codec, NULL);
+      },
+      [&](DecoderMessage::Packet&& args)
+      {
+        if(args.generation == m_decoder_generation.load(memory_order_relaxed))
+          DecodePacket(args.pkt, args.stream_index);
+        else
+          delete args.pkt;
+      },
+      [&](DecoderMessage::Flush&&)
+      {
+        for(auto& q : m_subtitle_buffers)
+          q.clear();
+        UpdateMemoryUsage();
+
+        if(m_decoder_state.visible)
+        {
+          if(m_decoder_state.use_external_subtitles)
+            SendToRenderer(Message::Touch{});
+          else
+            SendToRenderer(Message::Flush{SubtitleTrack(m_retention)});
+        }
+      },
+      [&](DecoderMessage::Close&&)
+      {
+        m_subtitle_buffers.clear();
+        UpdateMemoryUsage();
+      },
+      [&](DecoderMessage::SetVisible&& args)
+      {
+        m_decoder_state.visible = args.value;
+
+        if(args.value)
+          FlushRenderer();
+        else if(m_decoder_state.use_external_subtitles)
+          SendToRenderer(Message::ToggleExternalSubs{false});
+        else
+          SendToRenderer(Message::Flush{SubtitleTrack(m_retention)});
+      },
+      [&](DecoderMessage::SetActiveStream&& args)
+      {
+        m_decoder_state.active_index = args.index;
+
+        if(!m_decoder_state.use_external_subtitles && m_decoder_state.visible)
+          FlushRenderer();
+      },
+      [&](DecoderMessage::SetUseExternalSubtitles&& args)
+      {
+        m_decoder_state.use_external_subtitles = args.value;
+
+        if(m_decoder_state.visible)
+          FlushRenderer();
+      },
+      [&](DecoderMessage::Stop&&)
+      {
+        exit = true;
+      });
+  }
+
+  // Packets still queued belong to us
+  m_decoder_mailbox.receive(
+    [&](DecoderMessage::Packet&& args) { delete args.pkt; },
+    [&](DecoderMessage::Open&&) {},
+    [&](DecoderMessage::InitDVDSubs&&) {},
+    [&](DecoderMessage::Flush&&) {},
+    [&](DecoderMessage::Close&&) {},
+    [&](DecoderMessage::SetVisible&&) {},
+    [&](DecoderMessage::SetActiveStream&&) {},
+    [&](DecoderMessage::SetUseExternalSubtitles&&) {},
+    [&](DecoderMessage::Stop&&) {});
+}
+
 void OMXPlayerSubtitles::Process()
 {
   try
@@ -148,13 +368,6 @@ void OMXPlayerSubtitles::Process()
   m_thread_stopped.store(true, memory_order_relaxed);
 }
 
-template <typename Iterator>
-Iterator FindSubtitle(Iterator begin, Iterator end, int time)
-{
-  return upper_bound(begin, end, time,
-    [](int a, const Subtitle& b) { return a < b.stop; });
-}
-
 void OMXPlayerSubtitles::
 RenderLoop(float font_size,
            bool centered,
@@ -162,84 +375,100 @@ RenderLoop(float font_size,
            unsigned int lines,
            OMXClock* clock)
 {
-  SubtitleRenderer renderer(m_display, m_layer,
+  SubtitleRenderer renderer(new DispmanxDisplay(m_display, m_layer),
                             font_size,
                             centered,
                             ghost_box,
                             lines);
 
-  vector<Subtitle> external_subtitles;
-  vector<Subtitle> subtitles;
+  SubtitleTrack external_subtitles;
+  SubtitleTrack subtitles(m_retention);
 
   bool external_subtitles_enabled = false;
 
   int prev_now{};
-  size_t next_index{};
   bool exit{};
   bool paused{};
-  bool have_next{};
-  int current_stop = INT_MIN;
   bool showing{};
   bool osd{};
   chrono::time_point<std::chrono::steady_clock> osd_stop;
   int delay{};
 
+  // What should be on screen from prepared_at until prepared_until, waiting
+  // to be shown if pending
+  bool pending{};
+  bool prepared_empty{};
+  int prepared_at = INT_MAX;
+  int prepared_until = INT_MAX;
+
+  // earliest start of the subtitles pushed since the last loop which
+  // change what is prepared
+  int pushed_start = INT_MAX;
+
+  vector<size_t> indices;
+
   auto GetCurrentTime = [&]
   {
     return static_cast<int>(clock->OMXMediaTime()/1000) - delay;
   };
 
-  auto TryPrepare = [&](int time)
+  // The subtitles showing at time combined into one, false if there are none
+  auto GetShowing = [&](int time, Subtitle& sub)
   {
-    for(; next_index != subtitles.size(); ++next_index)
+    subtitles.active(time, indices);
+    if(indices.empty())
+      return false;
+
+    vector<Subtitle> subs;
+    for(size_t i : indices)
+      subs.push_back(subtitles.at(i));
+    sub = renderer.composite(subs);
+    return true;
+  };
+
+  // Only the times are worked out here, the render ahead thread looks up
+  // and combines what shows at them
+  auto RenderAhead = [&](int time)
+  {
+    vector<int> times;
+    for(int i = 0; i < SubtitleRenderer::RENDER_AHEAD && time != INT_MAX; i++)
     {
-      if(subtitles[next_index].stop > time)
-      {
-        renderer.prepare(subtitles[next_index]);
-        have_next = true;
-        break;
-      }
+      times.push_back(time);
+      time = subtitles.next_change(time);
     }
+    renderer.render_ahead(subtitles, std::move(times));
   };
 
-  auto Reset = [&](int time)
+  auto PrepareAt = [&](int time)
   {
-    renderer.unprepare();
-    current_stop = INT_MIN;
+    Subtitle sub(false);
+    prepared_empty = !GetShowing(time, sub);
+    if(prepared_empty)
+      renderer.unprepare();
+    else
+      renderer.prepare(sub);
 
-    auto it = FindSubtitle(subtitles.begin(),
-                           subtitles.end(),
-                           time);
-    next_index = it - subtitles.begin();
+    prepared_at = time;
+    prepared_until = subtitles.next_change(time);
+    pending = true;
 
-    if(next_index != subtitles.size())
-    {
-      renderer.prepare(subtitles[next_index]);
-      have_next = true;
-    }
-    else
-    {
-      have_next = false;
-    }
+    if(prepared_until != INT_MAX)
+      RenderAhead(prepared_until);
   };
 
   for(;;)
   {
     int timeout = INT_MAX;
 
-    if(!paused)
+    if(!paused && !osd)
     {
       auto now = GetCurrentTime();
 
-      int till_stop =
-        showing ? current_stop - now
+      int till_next =
+        pending ? max(prepared_at - now, 0)
                 : INT_MAX;
 
-      int till_next_start =
-        have_next ? subtitles[next_index].start - now
-                  : INT_MAX;
-
-      timeout = min(min(till_stop, till_next_start), 1000);
+      timeout = min(till_next, 1000);
     }
 
     if(osd)
@@ -259,7 +488,9 @@ RenderLoop(float font_size,
       },
       [&](Message::Push&& args) // Add internal subs from muxer
       {
-        subtitles.push_back(std::move(args.subtitle));
+        subtitles.push_back(args.subtitle);
+        if(!pending || args.subtitle.start < prepared_until)
+          pushed_start = min(pushed_start, args.subtitle.start);
       },
       [&](Message::SendExternalSubs&& args)
       {
@@ -268,6 +499,18 @@ RenderLoop(float font_size,
         external_subtitles_enabled = true;
         prev_now = INT_MAX;
       },
+      [&](Message::UpdateExternalSubs&& args)
+      {
+        if(external_subtitles_enabled)
+        {
+          subtitles = std::move(args.subtitles);
+          prev_now = INT_MAX;
+        }
+        else
+        {
+          external_subtitles = std::move(args.subtitles);
+        }
+      },
       [&](Message::ToggleExternalSubs&& args)
       {
         if(external_subtitles_enabled != args.enable_subs)
@@ -280,6 +523,7 @@ RenderLoop(float font_size,
       [&](Message::Flush&& args) // Sets or clears internal subs
       {
         subtitles = std::move(args.subtitles);
+        subtitles.set_retention(m_retention);
         prev_now = INT_MAX;
       },
       [&](Message::Touch&&) // External subs
@@ -317,73 +561,72 @@ RenderLoop(float font_size,
 
     auto now = GetCurrentTime();
 
-    if(now < prev_now || (have_next && subtitles[next_index].stop <= now))
+    if(now < prev_now || (pending && prepared_until <= now))
     {
-      Reset(now);
+      PrepareAt(now);
     }
-    else if(!have_next)
+    else if(pushed_start != INT_MAX)
     {
-      TryPrepare(now);
+      // what's on screen, or due on it, has changed
+      if(pushed_start <= now || (pending && prepared_at <= now))
+        PrepareAt(now);
+      else
+        PrepareAt(subtitles.next_change(now));
     }
 
+    pushed_start = INT_MAX;
     prev_now = now;
 
     if(osd && chrono::steady_clock::now() >= osd_stop)
       osd = false;
 
-    if(!osd && current_stop <= now)
+    if(!osd && pending && prepared_at <= now)
     {
-      if(have_next && subtitles[next_index].start <= now)
+      if(!prepared_empty)
       {
         renderer.show_next();
-        // printf("show error: %i ms\n", now - subtitles[next_index].start);
+        // printf("show error: %i ms\n", now - prepared_at);
         showing = true;
-        current_stop = subtitles[next_index].stop;
-
-        ++next_index;
-        have_next = false;
-        TryPrepare(now);
       }
       else if(showing)
       {
         renderer.hide();
-        // printf("hide error: %i ms\n", now - current_stop);
+        // printf("hide error: %i ms\n", now - prepared_at);
         showing = false;
       }
+
+      if(prepared_until != INT_MAX)
+        PrepareAt(prepared_until);
+      else
+        pending = false;
     }
   }
 }
 
+// Called on the decoder thread
 void OMXPlayerSubtitles::FlushRenderer()
 {
-  assert(GetVisible());
+  assert(m_decoder_state.visible);
 
-  if(GetUseExternalSubtitles())
+  if(m_decoder_state.use_external_subtitles)
   {
     SendToRenderer(Message::ToggleExternalSubs{true});
   }
   else
   {
-    Message::Flush flush;
-    assert(!m_subtitle_buffers.empty());
-    for(auto& s : m_subtitle_buffers[m_active_index])
-      flush.subtitles.push_back(s);
-    SendToRenderer(std::move(flush));
+    SendToRenderer(Message::ToggleExternalSubs{false});
+
+    // Copying a track only shares its segments with the renderer
+    if(m_decoder_state.active_index < m_subtitle_buffers.size())
+      SendToRenderer(Message::Flush{m_subtitle_buffers[m_decoder_state.active_index]});
+    else
+      SendToRenderer(Message::Flush{SubtitleTrack(m_retention)});
   }
 }
 
 void OMXPlayerSubtitles::Flush() BOOST_NOEXCEPT
 {
-  for(auto& q : m_subtitle_buffers)
-    q.clear();
-
-  if(GetVisible())
-  {
-    if(GetUseExternalSubtitles())
-      SendToRenderer(Message::Touch{});
-    else
-      SendToRenderer(Message::Flush{});
-  }
+  SendToDecoder(DecoderMessage::Flush{});
 }
 
 void OMXPlayerSubtitles::Resume() BOOST_NOEXCEPT
@@ -398,11 +641,10 @@ void OMXPlayerSubtitles::Pause() BOOST_NOEXCEPT
 
 void OMXPlayerSubtitles::SetUseExternalSubtitles(bool use) BOOST_NOEXCEPT
 {
-  assert(use || !m_subtitle_buffers.empty());
+  assert(use || m_stream_count > 0);
 
   m_use_external_subtitles = use;
-  if(GetVisible())
-    FlushRenderer();
+  SendToDecoder(DecoderMessage::SetUseExternalSubtitles{use});
 }
 
 void OMXPlayerSubtitles::SetDelay(int value) BOOST_NOEXCEPT
@@ -418,35 +660,19 @@ void OMXPlayerSubtitles::Clear() BOOST_NOEXCEPT
 
 void OMXPlayerSubtitles::SetVisible(bool visible) BOOST_NOEXCEPT
 {
-  if(visible)
-  {
-    if (!m_visible)
-    {
-      m_visible = true;
-      FlushRenderer();
-    }
-  }
-  else
-  {
-    if(m_visible)
-    {
-      m_visible = false;
+  if(visible == m_visible)
+    return;
 
-      if(m_use_external_subtitles)
-        SendToRenderer(Message::ToggleExternalSubs{false});
-      else
-        SendToRenderer(Message::Flush{});
-    }
-  }
+  m_visible = visible;
+  SendToDecoder(DecoderMessage::SetVisible{visible});
 }
 
 void OMXPlayerSubtitles::SetActiveStream(size_t index) BOOST_NOEXCEPT
 {
-  assert(index < m_subtitle_buffers.size());
+  assert(index < m_stream_count);
 
   m_active_index = index;
-  if(!GetUseExternalSubtitles() && GetVisible())
-    FlushRenderer();
+  SendToDecoder(DecoderMessage::SetActiveStream{index});
 }
 
 bool OMXPlayerSubtitles::GetTextLines(OMXPacket *pkt, Subtitle &sub)
@@ -530,31 +756,43 @@ bool OMXPlayerSubtitles::GetImageData(OMXPacket *pkt, Subtitle &sub)
 
 void OMXPlayerSubtitles::AddPacket(OMXPacket *pkt, size_t stream_index) BOOST_NOEXCEPT
 {
-  assert(stream_index < m_subtitle_buffers.size());
+  assert(stream_index < m_stream_count);
 
+  if((pkt->hints.codec != AV_CODEC_ID_SUBRIP &&
+      pkt->hints.codec != AV_CODEC_ID_SSA &&
+      pkt->hints.codec != AV_CODEC_ID_ASS &&
+      pkt->hints.codec != AV_CODEC_ID_DVD_SUBTITLE) ||
+     m_decoder_stopped.load(memory_order_relaxed))
+  {
+    delete pkt;
+    return;
+  }
+
+  // The decoder thread takes ownership of the packet
+  SendToDecoder(DecoderMessage::Packet{pkt, stream_index,
+                                       m_decoder_generation.load(memory_order_relaxed)});
+}
+
+// Called on the decoder thread
+void OMXPlayerSubtitles::DecodePacket(OMXPacket *pkt, size_t stream_index)
+{
   SCOPE_EXIT
   {
     delete pkt;
   };
 
-  if(pkt->hints.codec != AV_CODEC_ID_SUBRIP && 
-     pkt->hints.codec != AV_CODEC_ID_SSA &&
-     pkt->hints.codec != AV_CODEC_ID_ASS &&
-     pkt->hints.codec != AV_CODEC_ID_DVD_SUBTITLE)
-  {
+  if(stream_index >= m_subtitle_buffers.size())
+    return;
+
+  if(pkt->hints.codec == AV_CODEC_ID_DVD_SUBTITLE && !m_dvd_codec_context)
     return;
-  }
 
   Subtitle sub(pkt->hints.codec == AV_CODEC_ID_DVD_SUBTITLE);
 
   sub.start = static_cast<int>(pkt->pts/1000);
   sub.stop = sub.start + static_cast<int>(pkt->duration/1000);
 
-  if (!m_subtitle_buffers[stream_index].empty() &&
-    sub.stop < m_subtitle_buffers[stream_index].back().stop)
-  {
-    sub.stop = m_subtitle_buffers[stream_index].back().stop;
-  }
+  SubtitleTrack& buffer = m_subtitle_buffers[stream_index];
 
   bool success;
   if(pkt->hints.codec == AV_CODEC_ID_DVD_SUBTITLE)
@@ -563,16 +801,36 @@ void OMXPlayerSubtitles::AddPacket(OMXPacket *pkt, size_t stream_index) BOOST_NO
     success = GetTextLines(pkt, sub);
   if(!success) return;
 
-  m_subtitle_buffers[stream_index].push_back(sub);
+  // Subtitles may overlap, but the track is kept in start order. One
+  // which starts out of order is shown from the previous start, unless it
+  // has stopped by then.
+  if (!buffer.empty() &&
+    sub.start < buffer.start(buffer.size() - 1))
+  {
+    sub.start = buffer.start(buffer.size() - 1);
+    if (sub.stop <= sub.start) return;
+  }
+
+  buffer.push_back(sub);
+  UpdateMemoryUsage();
 
-  if(!GetUseExternalSubtitles() &&
-     GetVisible() &&
-     stream_index == GetActiveStream())
+  if(!m_decoder_state.use_external_subtitles &&
+     m_decoder_state.visible &&
+     stream_index == m_decoder_state.active_index)
   {
     SendToRenderer(Message::Push{std::move(sub)});
   }
 }
 
+// Called on the decoder thread
+void OMXPlayerSubtitles::UpdateMemoryUsage()
+{
+  size_t total = 0;
+  for(auto& q : m_subtitle_buffers)
+    total += q.memory_usage();
+  m_memory_usage.store(total, memory_order_relaxed);
+}
+
 void OMXPlayerSubtitles::DisplayText(const std::string& text, int duration) BOOST_NOEXCEPT
 {
   vector<string> text_lines;
@@ -22,11 +22,12 @@
 #include "OMXReader.h"
 #include "OMXClock.h"
 #include "Subtitle.h"
+#include "SubtitleTrack.h"
+#include "Srt.h"
 #include "utils/Mailbox.h"
 #include "DllAvCodec.h"
 
 #include <boost/config.hpp>
-#include <boost/circular_buffer.hpp>
 #include <atomic>
 #include <string>
 #include <vector>
@@ -46,10 +47,14 @@ public:
             bool centered,
             bool ghost_box,
             unsigned int lines,
+            int retention,
             OMXClock* clock) BOOST_NOEXCEPT;
 
+  // External subtitles are loaded in the background, starting with those
+  // around start_time (ms)
   bool Open(size_t stream_count,
-            vector<Subtitle>&& external_subtitles) BOOST_NOEXCEPT;
+            const std::string& external_subtitles_path,
+            int start_time) BOOST_NOEXCEPT;
 
   bool initDVDSubs(Dimension video,
             float video_aspect,
@@ -73,7 +78,7 @@ public:
 
   size_t GetActiveStream() BOOST_NOEXCEPT
   {
-    assert(!m_subtitle_buffers.empty());
+    assert(m_stream_count > 0);
     return m_active_index;
   }
 
@@ -95,11 +100,69 @@ public:
 
   void AddPacket(OMXPacket *pkt, size_t stream_index) BOOST_NOEXCEPT;
 
+  // Bytes used to store the buffered internal subtitle streams
+  size_t GetMemoryUsage() BOOST_NOEXCEPT
+  {
+    return m_memory_usage.load(std::memory_order_relaxed);
+  }
+
 protected:
   DllAvCodec                m_dllAvCodec;
   AVCodecContext           *m_dvd_codec_context;
 
 private:
+  // Subtitle packets are decoded and buffered on their own thread so
+  // none of that work is done on the demux thread
+  class DecoderThread : public OMXThread
+  {
+  public:
+    explicit DecoderThread(OMXPlayerSubtitles *owner) : m_owner(owner) {}
+    void Process() override { m_owner->DecodeProcess(); }
+  private:
+    OMXPlayerSubtitles *m_owner;
+  };
+
+  // External subtitle files are parsed on their own thread so playback
+  // can start before the whole file has been read
+  class LoaderThread : public OMXThread
+  {
+  public:
+    explicit LoaderThread(OMXPlayerSubtitles *owner) : m_owner(owner) {}
+    void Process() override { m_owner->LoadProcess(); }
+    bool Stopping() { return m_bStop; }
+  private:
+    OMXPlayerSubtitles *m_owner;
+  };
+
+  struct DecoderMessage {
+    struct Open
+    {
+      size_t stream_count;
+    };
+    struct InitDVDSubs {};
+    struct Packet
+    {
+      OMXPacket *pkt;
+      size_t stream_index;
+      unsigned int generation;
+    };
+    struct Flush {};
+    struct Close {};
+    struct SetVisible
+    {
+      bool value;
+    };
+    struct SetActiveStream
+    {
+      size_t index;
+    };
+    struct SetUseExternalSubtitles
+    {
+      bool value;
+    };
+    struct Stop {};
+  };
+
   struct Message {
     struct DVDSubs
     {
@@ -110,11 +173,15 @@ private:
     struct Stop {};
     struct Flush
     {
-      std::vector<Subtitle> subtitles;
+      SubtitleTrack subtitles;
     };
     struct SendExternalSubs
     {
-      std::vector<Subtitle> subtitles;
+      SubtitleTrack subtitles;
+    };
+    struct UpdateExternalSubs
+    {
+      SubtitleTrack subtitles;
     };
     struct ToggleExternalSubs
     {
@@ -141,6 +208,17 @@ private:
     struct Clear {};
   };
 
+  template <typename T>
+  void SendToDecoder(T&& msg)
+  {
+    if(m_decoder_stopped.load(std::memory_order_relaxed))
+    {
+      CLog::Log(LOGERROR, "Subtitle decoding thread not running, message discarded");
+      return;
+    }
+    m_decoder_mailbox.send(std::forward<T>(msg));
+  }
+
   template <typename T>
   void SendToRenderer(T&& msg)
   {
@@ -158,14 +236,44 @@ private:
                   bool ghost_box,
                   unsigned int lines,
                   OMXClock* clock);
+  void LoadProcess();
+  void StopLoader();
+  void DecodeProcess();
+  void DecodeLoop();
+  void DecodePacket(OMXPacket *pkt, size_t stream_index);
   bool GetTextLines(OMXPacket *pkt, Subtitle &sub);
   bool GetImageData(OMXPacket *pkt, Subtitle &sub);
   void FlushRenderer();
+  void UpdateMemoryUsage();
+
+  // Owned by the decoder thread
+  std::vector<SubtitleTrack>                    m_subtitle_buffers;
+  struct {
+    bool visible;
+    bool use_external_subtitles;
+    size_t active_index;
+  }                                             m_decoder_state;
 
-  std::vector<boost::circular_buffer<Subtitle>> m_subtitle_buffers;
+  DecoderThread                                 m_decoder_thread;
+  Mailbox<DecoderMessage::Open,
+          DecoderMessage::InitDVDSubs,
+          DecoderMessage::Packet,
+          DecoderMessage::Flush,
+          DecoderMessage::Close,
+          DecoderMessage::SetVisible,
+          DecoderMessage::SetActiveStream,
+          DecoderMessage::SetUseExternalSubtitles,
+          DecoderMessage::Stop>                 m_decoder_mailbox;
+  std::atomic<bool>                             m_decoder_stopped;
+  std::atomic<unsigned int>                     m_decoder_generation;
+  std::atomic<size_t>                           m_memory_usage;
+  LoaderThread                                  m_loader_thread;
+  SrtFile                                       m_external_file;
+  int                                           m_external_start;
   Mailbox<Message::DVDSubs,
           Message::Stop,
           Message::SendExternalSubs,
+          Message::UpdateExternalSubs,
           Message::ToggleExternalSubs,
           Message::Flush,
           Message::Push,
@@ -177,12 +285,14 @@ private:
   bool                                          m_visible;
   bool                                          m_use_external_subtitles;
   size_t                                        m_active_index;
+  size_t                                        m_stream_count;
   int                                           m_delay;
   std::atomic<bool>                             m_thread_stopped;
   float                                         m_font_size;
   bool                                          m_centered;
   bool                                          m_ghost_box;
   unsigned int                                  m_lines;
+  int                                           m_retention;
   OMXClock*                                     m_av_clock;
   int                                           m_display;
   int                                           m_layer;
@@ -31,6 +31,14 @@
 #define MAX_DATA_SIZE_AUDIO    2 * 1024 * 1024
 #define MAX_DATA_SIZE          10 * 1024 * 1024
 
+// The streams of a DVD are known from its IFO, so the probe only has to
+// find their parameters, which the first VOBUs have. A title whose streams
+// don't all turn up that soon is probed as far as it always was.
+#define DVD_PROBE_SIZE         4 * 1024 * 1024
+#define DVD_ANALYZE_DURATION   2000000
+#define DVD_MAX_PROBE_SIZE     100000000
+#define DVD_MAX_ANALYZE_DURATION 100000000
+
 static bool g_abort = false;
 
 static int64_t timeout_start;
@@ -68,6 +76,13 @@ OMXReader::OMXReader()
   m_pFile       = NULL;
   m_ioContext   = NULL;
   m_pFormatContext = NULL;
+  m_netCache      = NULL;
+  m_netCacheSize  = 0;
+  m_prefetcher    = NULL;
+  m_segmentPrefetch = 0;
+  m_timeshift     = NULL;
+  m_timeshiftSize = 0;
+  m_pipeBufferSize = 0;
   m_eof           = false;
   m_chapter_count = 0;
   m_iCurrentPts   = AV_NOPTS_VALUE;
@@ -160,6 +175,59 @@ static offset_t media_file_seek(void *h, offset_t pos, int whence)
     return pFile->Seek(pos, whence & ~AVSEEK_FORCE);
 }
 
+static int net_read(void *h, uint8_t* buf, int size)
+{
+  RESET_TIMEOUT(1);
+  if(interrupt_cb(NULL))
+    return -1;
+
+  NetworkCache *cache = (NetworkCache *)h;
+  int ret = cache->Read(buf, size);
+
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58,12,100)
+  if (ret == 0)
+    ret = AVERROR_EOF;
+#endif
+
+  return ret;
+}
+
+static offset_t net_seek(void *h, offset_t pos, int whence)
+{
+  RESET_TIMEOUT(1);
+  if(interrupt_cb(NULL))
+    return -1;
+
+  NetworkCache *cache = (NetworkCache *)h;
+  return cache->Seek(pos, whence);
+}
+
+// The HLS and DASH demuxers read the segments their playlist names
+static bool is_playlist_format(AVInputFormat *iformat)
+{
+  return strncmp(iformat->name, "hls", 3) == 0 || strcmp(iformat->name, "dash") == 0;
+}
+
+static int ts_read(void *h, uint8_t* buf, int size)
+{
+  RESET_TIMEOUT(1);
+  if(interrupt_cb(NULL))
+    return -1;
+
+  TimeshiftBuffer *timeshift = (TimeshiftBuffer *)h;
+  return timeshift->Read(buf, size);
+}
+
+static offset_t ts_seek(void *h, offset_t pos, int whence)
+{
+  RESET_TIMEOUT(1);
+  if(interrupt_cb(NULL))
+    return -1;
+
+  TimeshiftBuffer *timeshift = (TimeshiftBuffer *)h;
+  return timeshift->Seek(pos, whence);
+}
+
 static offset_t dvd_seek(void *h, offset_t pos, int whence)
 {
   RESET_TIMEOUT(1);
@@ -173,6 +241,27 @@ static offset_t dvd_seek(void *h, offset_t pos, int whence)
     return reader->Seek(pos, whence);
 }
 
+void OMXReader::SetNetworkCache(size_t size, const std::string &spill_file)
+{
+  m_netCacheSize = size;
+  m_netCacheFile = spill_file;
+}
+
+void OMXReader::SetTimeshift(const std::string &path, size_t size)
+{
+  m_timeshiftFile = path;
+  m_timeshiftSize = size;
+}
+
+bool OMXReader::GetTimeshiftStats(TimeshiftBuffer::TimeshiftStats &stats)
+{
+  if(!m_timeshift)
+    return false;
+
+  stats = m_timeshift->GetTimeshiftStats();
+  return true;
+}
+
 bool OMXReader::Open(
 	std::string &filename,
 	bool is_url,
@@ -210,11 +299,10 @@ bool OMXReader::Open(
 
   m_pFormatContext     = m_dllAvFormat.avformat_alloc_context();
 
-  // the default size doesn't appear to be big enough for DVDs
   if(m_DvdPlayer)
   {
-    m_pFormatContext->probesize = 100000000;
-    m_pFormatContext->max_analyze_duration = 100000000;
+    m_pFormatContext->probesize = DVD_PROBE_SIZE;
+    m_pFormatContext->max_analyze_duration = DVD_ANALYZE_DURATION;
   }
 
   result = m_dllAvFormat.av_set_options_string(m_pFormatContext, lavfdopts.c_str(), ":", ",");
@@ -294,9 +382,117 @@ bool OMXReader::Open(
           av_dict_set(&d, "user_agent", user_agent.c_str(), 0);
        }
     }
-    CLog::Log(LOGDEBUG, "COMXPlayer::OpenFile - avformat_open_input %s ", m_filename.c_str());
-    result = m_dllAvFormat.avformat_open_input(&m_pFormatContext, m_filename.c_str(), iformat, &d);
-    if(av_dict_count(d) == 0)
+    // HLS and DASH playlists name the urls the demuxer actually reads.
+    // Those that don't end in .m3u8 or .mpd are found by probing them.
+    bool http = m_filename.substr(0,7) == "http://" || m_filename.substr(0,8) == "https://";
+    bool playlist = m_filename.find(".m3u8") != string::npos || m_filename.find(".mpd") != string::npos;
+    bool timeshifted = live && !m_timeshiftFile.empty() && !playlist;
+    bool cached = !timeshifted && m_netCacheSize && (http || m_filename.substr(0,6) == "ftp://") && !playlist;
+    bool prefetched = m_netCacheSize && m_segmentPrefetch && http && playlist;
+    if(timeshifted)
+    {
+      CLog::Log(LOGDEBUG, "COMXPlayer::OpenFile - open %s with timeshift", m_filename.c_str());
+
+      // recording carries on while paused, and reconnects when it drops
+      m_timeshift = new TimeshiftBuffer();
+      if(!m_timeshift->Open(m_filename, d, m_timeshiftFile, m_timeshiftSize, timeout / 2, int_cb))
+      {
+        av_dict_free(&d);
+        Close();
+        return false;
+      }
+
+      buffer = (unsigned char*)m_dllAvUtil.av_malloc(FFMPEG_FILE_BUFFER_SIZE);
+      m_ioContext = m_dllAvFormat.avio_alloc_context(buffer, FFMPEG_FILE_BUFFER_SIZE, 0, m_timeshift, ts_read, NULL, ts_seek);
+      m_ioContext->seekable = AVIO_SEEKABLE_NORMAL;
+
+      m_dllAvFormat.av_probe_input_buffer(m_ioContext, &iformat, m_filename.c_str(), NULL, 0, 0);
+
+      if(!iformat)
+      {
+        CLog::Log(LOGERROR, "COMXPlayer::OpenFile - av_probe_input_buffer %s ", m_filename.c_str());
+        av_dict_free(&d);
+        Close();
+        return false;
+      }
+
+      m_pFormatContext->pb = m_ioContext;
+      result = m_dllAvFormat.avformat_open_input(&m_pFormatContext, m_filename.c_str(), iformat, &d);
+    }
+    else if(cached)
+    {
+      CLog::Log(LOGDEBUG, "COMXPlayer::OpenFile - open %s through network cache", m_filename.c_str());
+
+      // a stalled connection is retried before the reader gives up on it
+      m_netCache = new NetworkCache();
+      if(!m_netCache->Open(m_filename, d, live, m_netCacheSize, m_netCacheFile, timeout / 2, int_cb))
+      {
+        av_dict_free(&d);
+        Close();
+        return false;
+      }
+
+      buffer = (unsigned char*)m_dllAvUtil.av_malloc(FFMPEG_FILE_BUFFER_SIZE);
+      m_ioContext = m_dllAvFormat.avio_alloc_context(buffer, FFMPEG_FILE_BUFFER_SIZE, 0, m_netCache, net_read, NULL, net_seek);
+      m_ioContext->seekable = m_netCache->IsSeekable() ? AVIO_SEEKABLE_NORMAL : 0;
+
+      m_dllAvFormat.av_probe_input_buffer(m_ioContext, &iformat, m_filename.c_str(), NULL, 0, 0);
+
+      if(!iformat)
+      {
+        CLog::Log(LOGERROR, "COMXPlayer::OpenFile - av_probe_input_buffer %s ", m_filename.c_str());
+        av_dict_free(&d);
+        Close();
+        return false;
+      }
+
+      if(is_playlist_format(iformat))
+      {
+        CLog::Log(LOGDEBUG, "COMXPlayer::OpenFile - %s is a %s playlist, not caching it", m_filename.c_str(), iformat->name);
+
+        m_dllAvUtil.av_free(m_ioContext->buffer);
+        m_dllAvUtil.av_free(m_ioContext);
+        m_ioContext = NULL;
+        m_netCache->Close();
+        delete m_netCache;
+        m_netCache = NULL;
+
+        iformat = NULL;
+        cached = false;
+        prefetched = m_segmentPrefetch && http;
+      }
+      else
+      {
+        m_pFormatContext->pb = m_ioContext;
+        result = m_dllAvFormat.avformat_open_input(&m_pFormatContext, m_filename.c_str(), iformat, &d);
+      }
+    }
+
+    if(prefetched)
+    {
+      CLog::Log(LOGDEBUG, "COMXPlayer::OpenFile - open %s with segment prefetch", m_filename.c_str());
+
+      m_prefetcher = new SegmentPrefetcher();
+      m_ioContext = m_prefetcher->Open(m_filename, d, m_segmentPrefetch, m_netCacheSize, timeout / 2, int_cb);
+      if(!m_ioContext)
+      {
+        av_dict_free(&d);
+        Close();
+        return false;
+      }
+      m_prefetcher->Attach(m_pFormatContext);
+      // a kept-alive connection would be reused behind the prefetcher's back
+      av_dict_set(&d, "http_persistent", "0", 0);
+
+      m_pFormatContext->pb = m_ioContext;
+      result = m_dllAvFormat.avformat_open_input(&m_pFormatContext, m_filename.c_str(), iformat, &d);
+    }
+    else if(!timeshifted && !cached)
+    {
+      CLog::Log(LOGDEBUG, "COMXPlayer::OpenFile - avformat_open_input %s ", m_filename.c_str());
+      result = m_dllAvFormat.avformat_open_input(&m_pFormatContext, m_filename.c_str(), iformat, &d);
+    }
+    if(!timeshifted && !cached && !prefetched && av_dict_count(d) == 0)
     {
        CLog::Log(LOGDEBUG, "COMXPlayer::OpenFile - avformat_open_input enabled SEEKING ");
        if(m_filename.substr(0,7) == "http://")
@@ -313,6 +509,7 @@ bool OMXReader::Open(
   else
   {
     m_pFile = new CFile();
+    m_pFile->SetPipeBuffer(m_pipeBufferSize);
 
     if (!m_pFile->Open(m_filename, flags))
     {
@@ -363,12 +560,24 @@ bool OMXReader::Open(
     m_pFormatContext->flags |= AVFMT_FLAG_NOBUFFER;
 
   result = m_dllAvFormat.avformat_find_stream_info(m_pFormatContext, NULL);
+
+  if(result >= 0 && m_DvdPlayer && !DvdStreamsFound())
+  {
+    CLog::Log(LOGWARNING, "COMXPlayer::OpenFile - DVD streams missing from the first %d MB, probing further", DVD_PROBE_SIZE / (1024 * 1024));
+    m_pFormatContext->probesize = DVD_MAX_PROBE_SIZE;
+    m_pFormatContext->max_analyze_duration = DVD_MAX_ANALYZE_DURATION;
+    result = m_dllAvFormat.avformat_find_stream_info(m_pFormatContext, NULL);
+  }
+
   if(result < 0)
   {
     Close();
     return false;
   }
 
+  if(m_DvdPlayer)
+    AddDvdSubtitleStreams();
+
   if(!GetStreams(dump_format))
   {
     Close();
@@ -458,6 +667,27 @@ bool OMXReader::Close()
     m_pFile = NULL;
   }
 
+  if(m_prefetcher)
+  {
+    m_prefetcher->Close();
+    delete m_prefetcher;
+    m_prefetcher = NULL;
+  }
+
+  if(m_netCache)
+  {
+    m_netCache->Close();
+    delete m_netCache;
+    m_netCache = NULL;
+  }
+
+  if(m_timeshift)
+  {
+    m_timeshift->Close();
+    delete m_timeshift;
+    m_timeshift = NULL;
+  }
+
   m_dllAvFormat.avformat_network_deinit();
 
   m_dllAvUtil.Unload();
@@ -515,12 +745,40 @@ bool OMXReader::SeekTime(double time, bool backwords, int64_t *startpts)
   if(m_ioContext)
     m_ioContext->buf_ptr = m_ioContext->buf_end;
 
-  int64_t seek_pts = (int64_t)time * AV_TIME_BASE;
-  if (m_pFormatContext->start_time != (int64_t)AV_NOPTS_VALUE)
-    seek_pts += m_pFormatContext->start_time;
+  int ret;
+  int ms = (int)(time * 1000);
+  int64_t pos;
 
-  RESET_TIMEOUT(1);
-  int ret = m_dllAvFormat.av_seek_frame(m_pFormatContext, -1, seek_pts, backwords ? AVSEEK_FLAG_BACKWARD : 0);
+  if(m_DvdPlayer && m_DvdPlayer->TimeToPosition(ms, pos))
+  {
+    // A DVD's time map gives the sector of the VOBU to start at, so seek
+    // straight to it instead of searching the title for the time
+    RESET_TIMEOUT(1);
+    ret = m_dllAvFormat.av_seek_frame(m_pFormatContext, -1, pos, AVSEEK_FLAG_BYTE);
+    if(ret >= 0)
+      time = ms / 1000.0;
+  }
+  else
+  {
+    int64_t start_pts = 0;
+    if (m_pFormatContext->start_time != (int64_t)AV_NOPTS_VALUE)
+      start_pts = m_pFormatContext->start_time;
+    int64_t seek_pts = (int64_t)time * AV_TIME_BASE + start_pts;
+
+    RESET_TIMEOUT(1);
+    if(m_timeshift && m_timeshift->TimeToPosition(seek_pts, pos))
+    {
+      // Only what's still in the timeshift ring can be played, and its
+      // index knows where that is, so the demuxer doesn't search for it
+      ret = m_dllAvFormat.av_seek_frame(m_pFormatContext, -1, pos, AVSEEK_FLAG_BYTE);
+      if(ret >= 0 && seek_pts > start_pts)
+        time = (double)(seek_pts - start_pts) / AV_TIME_BASE;
+      else if(ret >= 0)
+        time = 0;
+    }
+    else
+      ret = m_dllAvFormat.av_seek_frame(m_pFormatContext, -1, seek_pts, backwords ? AVSEEK_FLAG_BACKWARD : 0);
+  }
 
   if(ret >= 0)
     UpdateCurrentPTS();
@@ -744,6 +1002,75 @@ bool OMXReader::GetStreams(bool dump_format)
   return true;
 }
 
+// The stream with the MPEG-PS id given, or NULL
+static AVStream *find_stream_by_id(AVFormatContext *s, int id)
+{
+  for(unsigned int i = 0; i < s->nb_streams; i++)
+    if(s->streams[i]->id == id)
+      return s->streams[i];
+  return NULL;
+}
+
+// Whether the probe found the video and every audio stream the title's IFO
+// lists, with what's needed to play them. Subtitles often first appear
+// minutes in, so they're left to AddDvdSubtitleStreams.
+bool OMXReader::DvdStreamsFound()
+{
+  bool video = false;
+  for(unsigned int i = 0; i < m_pFormatContext->nb_streams; i++)
+  {
+    AVCodecContext *codec = m_pFormatContext->streams[i]->codec;
+    if(codec->codec_type == AVMEDIA_TYPE_VIDEO && codec->width > 0)
+      video = true;
+  }
+  if(!video)
+    return false;
+
+  for(int id : m_DvdPlayer->GetStreamIds())
+  {
+    if(id >= 0x20 && id <= 0x3f)
+      continue;
+
+    // the IFO numbers MPEG audio by its substream
+    if(id >= 0xc0 && id <= 0xc7)
+      id += 0x100;
+
+    AVStream *st = find_stream_by_id(m_pFormatContext, id);
+    if(!st)
+      return false;
+    if(st->codec->codec_type == AVMEDIA_TYPE_AUDIO &&
+        (st->codec->sample_rate == 0 || st->codec->channels == 0))
+      return false;
+  }
+  return true;
+}
+
+// Creates the subpicture streams the title's IFO lists that the probe
+// didn't come across, as the MPEG-PS demuxer would when it reads their
+// first packet. DVD subtitles are decoded without probed parameters.
+void OMXReader::AddDvdSubtitleStreams()
+{
+  for(int id : m_DvdPlayer->GetStreamIds())
+  {
+    if(id < 0x20 || id > 0x3f || find_stream_by_id(m_pFormatContext, id))
+      continue;
+
+    AVStream *st = m_dllAvFormat.avformat_new_stream(m_pFormatContext, NULL);
+    if(!st)
+      return;
+
+    st->id = id;
+    // the demuxer reads codecpar, the player the codec context
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57,33,100)
+    st->codecpar->codec_type = AVMEDIA_TYPE_SUBTITLE;
+    st->codecpar->codec_id   = AV_CODEC_ID_DVD_SUBTITLE;
+#endif
+    st->codec->codec_type    = AVMEDIA_TYPE_SUBTITLE;
+    st->codec->codec_id      = AV_CODEC_ID_DVD_SUBTITLE;
+    st->need_parsing = AVSTREAM_PARSE_FULL;
+  }
+}
+
 void OMXReader::AddStream(int id)
 {
   if(id > MAX_STREAMS || !m_pFormatContext)
@@ -31,6 +31,9 @@
 
 #include "OMXStreamInfo.h"
 #include "OMXDvdPlayer.h"
+#include "NetworkCache.h"
+#include "SegmentPrefetcher.h"
+#include "TimeshiftBuffer.h"
 
 #include "File.h"
 #include "utils/simple_geometry.h"
@@ -121,6 +124,15 @@ protected:
   bool SetActiveStreamInternal(OMXStreamType type, unsigned int index);
   bool                      m_seek;
   OMXDvdPlayer              *m_DvdPlayer;
+  NetworkCache              *m_netCache;
+  size_t                    m_netCacheSize;
+  std::string               m_netCacheFile;
+  SegmentPrefetcher         *m_prefetcher;
+  int                       m_segmentPrefetch;
+  TimeshiftBuffer           *m_timeshift;
+  std::string               m_timeshiftFile;
+  size_t                    m_timeshiftSize;
+  size_t                    m_pipeBufferSize;
 
 private:
 public:
@@ -129,6 +141,20 @@ public:
   bool Open(std::string &filename, bool is_url, bool dump_format, bool live, float timeout,
     std::string &cookie, std::string &user_agent, std::string &lavfdopts, std::string &avdict,
     OMXDvdPlayer *dvd);
+  // Reads http(s) and ftp urls opened after this through a NetworkCache
+  // of size bytes, which is off for 0
+  void SetNetworkCache(size_t size, const std::string &spill_file);
+  // Downloads this many segments of HLS and DASH urls ahead of the
+  // demuxer, keeping as much as the network cache holds
+  void SetSegmentPrefetch(int ahead) { m_segmentPrefetch = ahead; }
+  // Records live urls opened after this into a ring file of size bytes
+  // at path, and plays from there. Off for an empty path.
+  void SetTimeshift(const std::string &path, size_t size);
+  bool IsBehindLive() { return m_timeshift && m_timeshift->IsBehindLive(); }
+  bool GetTimeshiftStats(TimeshiftBuffer::TimeshiftStats &stats);
+  // Reads pipe: through a ring of size bytes, or straight from stdin for 0
+  void SetPipeBuffer(size_t size) { m_pipeBufferSize = size; }
+  bool GetPipeStats(PipeReader::PipeStats &stats) { return m_pFile && m_pFile->GetPipeStats(stats); }
   void ClearStreams();
   bool Close();
   //void FlushRead();
@@ -136,6 +162,8 @@ public:
   OMXPacket *Read();
   bool GetStreams(bool dump_format = false);
   void AddStream(int id);
+  bool DvdStreamsFound();
+  void AddDvdSubtitleStreams();
   bool IsActive(int stream_index);
   bool IsActive(OMXStreamType type, int stream_index);
   double SelectAspect(AVStream* st, bool& forced);
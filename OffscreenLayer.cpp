@@ -0,0 +1,131 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <cairo.h>
+
+#include "OffscreenLayer.h"
+#include "utils/log.h"
+
+OffscreenLayer::OffscreenLayer(int bytesperpixel, Rectangle dest_rect,
+	Dimension src_image, const std::string &png_prefix)
+: m_bytesperpixel(bytesperpixel),
+  m_png_prefix(png_prefix)
+{
+	assert(bytesperpixel == 4 || bytesperpixel == 1);
+
+	m_width = src_image.width == -1 ? dest_rect.width : src_image.width;
+	m_height = src_image.height == -1 ? dest_rect.height : src_image.height;
+	m_image.resize(m_width * m_height * m_bytesperpixel, 0);
+}
+
+void OffscreenLayer::hideElement()
+{
+}
+
+void OffscreenLayer::clearImage()
+{
+	setImageData(NULL, 0, 0, false);
+}
+
+void OffscreenLayer::setImageData(void *image_data, bool show)
+{
+	setImageData(image_data, 0, m_height, show);
+}
+
+// Like DispmanxLayer, only rows y to y + height are given
+void OffscreenLayer::setImageData(void *image_data, int y, int height, bool show)
+{
+	int pitch = m_width * m_bytesperpixel;
+
+	if(m_dirty_height > 0 && (m_dirty_y < y || m_dirty_y + m_dirty_height > y + height))
+		memset(m_image.data() + m_dirty_y * pitch, 0, m_dirty_height * pitch);
+
+	if(height > 0)
+		memcpy(m_image.data() + y * pitch, image_data, height * pitch);
+
+	m_dirty_y = y;
+	m_dirty_height = height;
+
+	if(show) {
+		m_frames++;
+		if(!m_png_prefix.empty())
+			writePng();
+	}
+}
+
+void OffscreenLayer::writePng()
+{
+	int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, m_width);
+	std::vector<unsigned char> argb(stride * m_height);
+
+	if(m_bytesperpixel == 4) {
+		for(int y = 0; y < m_height; y++)
+			memcpy(&argb[y * stride], &m_image[y * m_width * 4], m_width * 4);
+	} else {
+		// the palette DispmanxLayer uses for 8bpp layers
+		static const uint32_t palette[4] = { 0x00000000, 0xFF000000, 0xFFFFFFFF, 0xFF7F7F7F };
+		for(int y = 0; y < m_height; y++) {
+			uint32_t *row = (uint32_t *)&argb[y * stride];
+			for(int x = 0; x < m_width; x++)
+				row[x] = palette[m_image[y * m_width + x] & 3];
+		}
+	}
+
+	cairo_surface_t *surface = cairo_image_surface_create_for_data(argb.data(),
+		CAIRO_FORMAT_ARGB32, m_width, m_height, stride);
+
+	std::string filename = m_png_prefix + "-" + std::to_string(m_frames) + ".png";
+	if(cairo_surface_write_to_png(surface, filename.c_str()) != CAIRO_STATUS_SUCCESS)
+		CLog::Log(LOGERROR, "OffscreenLayer: unable to write %s", filename.c_str());
+
+	cairo_surface_destroy(surface);
+}
+
+const int& OffscreenLayer::getSourceWidth()
+{
+	return m_width;
+}
+
+const int& OffscreenLayer::getSourceHeight()
+{
+	return m_height;
+}
+
+OffscreenDisplay::OffscreenDisplay(Dimension screen, const std::string &png_prefix)
+: m_screen(screen),
+  m_png_prefix(png_prefix)
+{
+}
+
+Dimension OffscreenDisplay::getScreenDimensions()
+{
+	return m_screen;
+}
+
+SubtitleLayer *OffscreenDisplay::createLayer(int bytesperpixel, Rectangle dest_rect,
+	Dimension src_image)
+{
+	std::string prefix;
+	if(!m_png_prefix.empty())
+		prefix = m_png_prefix + "-layer" + std::to_string(m_layers);
+	m_layers++;
+
+	return new OffscreenLayer(bytesperpixel, dest_rect, src_image, prefix);
+}
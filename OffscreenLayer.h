@@ -0,0 +1,69 @@
+#pragma once
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <string>
+#include <vector>
+
+#include "SubtitleLayer.h"
+
+// A layer kept in memory, for rendering without a display. Every image
+// shown is either discarded or, if png_prefix isn't empty, written to
+// png_prefix-<n>.png
+class OffscreenLayer : public SubtitleLayer
+{
+public:
+	OffscreenLayer(int bytesperpixel, Rectangle dest_rect, Dimension src_image,
+		const std::string &png_prefix);
+
+	void hideElement() override;
+	void clearImage() override;
+	void setImageData(void *image_data, bool show = true) override;
+	void setImageData(void *image_data, int y, int height, bool show = true) override;
+
+	const int& getSourceWidth() override;
+	const int& getSourceHeight() override;
+
+	int getFramesShown() { return m_frames; }
+
+private:
+	void writePng();
+
+	int m_width;
+	int m_height;
+	int m_bytesperpixel;
+	std::vector<unsigned char> m_image;
+	int m_dirty_y = 0;
+	int m_dirty_height = 0;
+	std::string m_png_prefix;
+	int m_frames = 0;
+};
+
+class OffscreenDisplay : public SubtitleDisplay
+{
+public:
+	OffscreenDisplay(Dimension screen, const std::string &png_prefix = "");
+
+	Dimension getScreenDimensions() override;
+	SubtitleLayer *createLayer(int bytesperpixel, Rectangle dest_rect,
+		Dimension src_image = {-1, -1}) override;
+
+private:
+	Dimension m_screen;
+	std::string m_png_prefix;
+	int m_layers = 0;
+};
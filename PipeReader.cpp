@@ -0,0 +1,249 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+#include "PipeReader.h"
+#include "utils/log.h"
+
+// Size asked for the pipe. Without privileges it's limited to
+// /proc/sys/fs/pipe-max-size, which is tried next.
+#define PIPE_SIZE            (1024 * 1024)
+// Bytes read from the pipe at a time
+#define READ_SIZE            (1024 * 1024)
+// The part of the ring kept behind the read position is 1/KEEP_BEHIND
+#define KEEP_BEHIND          4
+// How often the reading thread checks whether it's stopped
+#define WAIT_MS              100
+
+PipeReader::PipeReader()
+: m_fd(-1), m_size(0), m_keep(0), m_low(0), m_end(0), m_pos(0), m_eof(false)
+{
+  memset(&m_stats, 0, sizeof(m_stats));
+}
+
+PipeReader::~PipeReader()
+{
+  Close();
+}
+
+bool PipeReader::Open(int fd, size_t size)
+{
+  Close();
+
+  m_fd   = fd;
+  m_size = std::max(size, (size_t)READ_SIZE * 2);
+  m_keep = m_size / KEEP_BEHIND;
+  m_ring.reset(new uint8_t[m_size]);
+  m_low  = 0;
+  m_end  = 0;
+  m_pos  = 0;
+  m_eof  = false;
+  memset(&m_stats, 0, sizeof(m_stats));
+
+  // a bigger pipe takes up more of the writer's bursts while this thread
+  // isn't scheduled
+  struct stat st;
+  if (fstat(m_fd, &st) == 0 && S_ISFIFO(st.st_mode))
+  {
+#ifdef F_SETPIPE_SZ
+    int pipe_size = fcntl(m_fd, F_SETPIPE_SZ, PIPE_SIZE);
+    if (pipe_size < 0)
+    {
+      FILE *fp = fopen("/proc/sys/fs/pipe-max-size", "r");
+      int max_size;
+      if (fp && fscanf(fp, "%d", &max_size) == 1 && max_size < PIPE_SIZE)
+        pipe_size = fcntl(m_fd, F_SETPIPE_SZ, max_size);
+      if (fp)
+        fclose(fp);
+    }
+    if (pipe_size < 0)
+      pipe_size = fcntl(m_fd, F_GETPIPE_SZ);
+    m_stats.pipe_size = std::max(pipe_size, 0);
+#endif
+  }
+
+  CLog::Log(LOGDEBUG, "PipeReader: %lld MB ring, %d kB pipe", (long long)(m_size >> 20), m_stats.pipe_size >> 10);
+
+  Create();
+  return true;
+}
+
+void PipeReader::Close()
+{
+  if (Running())
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_bStop = true;
+    }
+    m_cond.notify_all();
+    StopThread();
+
+    PipeStats stats = GetPipeStats();
+    CLog::Log(LOGDEBUG, "PipeReader: %lld MB at %.1f MB/s, pipe full %u times, ring full %u times with "
+              "%lld kB at most, %u stalls for %.0f ms", (long long)(stats.received >> 20),
+              stats.receive_ms > 0 ? stats.received * 1000.0 / stats.receive_ms / (1 << 20) : 0.0,
+              stats.pipe_full, stats.ring_full, (long long)(stats.peak >> 10), stats.stalls, stats.stall_ms);
+  }
+  m_ring.reset();
+  m_fd = -1;
+}
+
+PipeReader::PipeStats PipeReader::GetPipeStats()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+void PipeReader::Process()
+{
+  bool full = false;
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_bStop && !m_eof)
+  {
+    // what's ahead of the reader, and what it may seek back to
+    int64_t keep = std::max(std::min(m_pos, m_end) - m_keep, m_low);
+    if (keep + m_size - m_end <= 0)
+    {
+      if (!full)
+        m_stats.ring_full++;
+      full = true;
+      m_cond.wait(lock);
+      continue;
+    }
+    full = false;
+    lock.unlock();
+
+    pollfd pfd = { m_fd, POLLIN, 0 };
+    int ret = poll(&pfd, 1, WAIT_MS);
+
+    lock.lock();
+    if (ret == 0 || (ret < 0 && errno == EINTR))
+      continue;
+
+    keep = std::max(std::min(m_pos, m_end) - m_keep, m_low);
+    int64_t at = m_end % m_size;
+    int n = (int)std::min(std::min(keep + m_size - m_end, m_size - at), (int64_t)READ_SIZE);
+    // given up from here on, as it's about to be written over
+    m_low = std::max(m_low, m_end + n - m_size);
+    lock.unlock();
+
+    // how close the writer came to waiting on the pipe
+    int queued = 0;
+    if (ioctl(m_fd, FIONREAD, &queued) != 0)
+      queued = 0;
+    ssize_t got = read(m_fd, m_ring.get() + at, n);
+    int err = errno;
+
+    lock.lock();
+    if (got < 0)
+    {
+      if (err == EINTR || err == EAGAIN)
+        continue;
+      CLog::Log(LOGERROR, "PipeReader: read failed: %s", strerror(err));
+      got = 0;
+    }
+    if (got == 0)
+    {
+      m_eof = true;
+      m_cond.notify_all();
+      break;
+    }
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (m_stats.received == 0)
+      m_first = now;
+    m_end += got;
+    m_stats.received += got;
+    m_stats.receive_ms = std::chrono::duration<double, std::milli>(now - m_first).count();
+    if (m_stats.pipe_size && queued >= m_stats.pipe_size)
+      m_stats.pipe_full++;
+    m_stats.peak = std::max(m_stats.peak, m_end - m_pos);
+    m_cond.notify_all();
+  }
+}
+
+int PipeReader::Read(uint8_t *buf, int size)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  if (m_pos >= m_end && !m_eof && !m_bStop)
+  {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while (m_pos >= m_end && !m_eof && !m_bStop)
+      m_cond.wait_for(lock, std::chrono::milliseconds(WAIT_MS));
+    m_stats.stalls++;
+    m_stats.stall_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+  if (m_pos >= m_end)
+    return 0;
+
+  // nothing from here to m_end is written over while it's copied
+  int64_t pos = m_pos;
+  int n = (int)std::min(std::min((int64_t)size, m_end - pos), m_size - pos % m_size);
+  lock.unlock();
+  memcpy(buf, m_ring.get() + pos % m_size, n);
+  lock.lock();
+
+  m_pos = pos + n;
+  m_cond.notify_all();
+  return n;
+}
+
+int64_t PipeReader::Seek(int64_t offset, int whence)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  int64_t pos;
+  if (whence == SEEK_SET)
+    pos = offset;
+  else if (whence == SEEK_CUR)
+    pos = m_pos + offset;
+  else
+    return -1;
+
+  // forward past m_end is fine, what's in between is skipped
+  if (pos < m_low)
+    return -1;
+
+  m_pos = pos;
+  m_cond.notify_all();
+  return m_pos;
+}
+
+int64_t PipeReader::GetPosition()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_pos;
+}
+
+bool PipeReader::IsEOF()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_eof && m_pos >= m_end;
+}
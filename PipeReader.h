@@ -0,0 +1,85 @@
+#pragma once
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+#include "OMXThread.h"
+
+// Drains a pipe into a ring in memory as fast as the writer fills it, so
+// a capture tool piping a high bitrate stream isn't held up whenever the
+// demuxer or decoders are. The pipe itself is enlarged as far as the
+// system allows.
+//
+// Reads see a stream that can't be seeked in general, but can go back by
+// up to a quarter of the ring, which is what probing the format needs,
+// and forward by skipping what's in between.
+class PipeReader : public OMXThread
+{
+public:
+  struct PipeStats
+  {
+    int64_t      received;     // bytes
+    double       receive_ms;   // from the first byte to the last
+    int          pipe_size;    // bytes, after enlarging it
+    unsigned int pipe_full;    // times the pipe was found full, so the writer was waiting
+    unsigned int ring_full;    // times the ring was full, so the pipe wasn't drained
+    int64_t      peak;         // most bytes waiting in the ring
+    unsigned int stalls;       // reads that had to wait for the pipe
+    double       stall_ms;
+  };
+
+  PipeReader();
+  ~PipeReader();
+
+  // Reads fd, which is left open, through a ring of size bytes
+  bool Open(int fd, size_t size);
+  void Close();
+
+  // Returns 0 only at the end of the stream
+  int Read(uint8_t *buf, int size);
+  // -1 for positions that are no longer in the ring
+  int64_t Seek(int64_t offset, int whence);
+  int64_t GetPosition();
+  bool IsEOF();
+  PipeStats GetPipeStats();
+
+  void Process() override;
+
+private:
+  int             m_fd;
+  std::unique_ptr<uint8_t[]> m_ring;
+
+  // The ring holds [m_low, m_end) of the stream, byte n at n % m_size.
+  // m_keep bytes before m_pos aren't overwritten. The pipe is read into
+  // the ring after m_end with the lock released.
+  int64_t         m_size;
+  int64_t         m_keep;
+  int64_t         m_low;
+  int64_t         m_end;
+  int64_t         m_pos;
+  bool            m_eof;
+
+  std::chrono::steady_clock::time_point m_first;
+  PipeStats       m_stats;
+  std::mutex      m_mutex;
+  std::condition_variable m_cond;
+};
@@ -29,6 +29,7 @@
 using namespace std;
 
 RecentDVDStore::RecentDVDStore()
+: journal(string(getenv("HOME")) + "/.omxplayer_dvd_journal")
 {
 	// recent DVD file store
 	recent_dvd_file = getenv("HOME");
@@ -39,6 +40,21 @@ void RecentDVDStore::readStore()
 {
 	m_init = true;
 
+	vector<ResumeJournal::Record> records;
+	if(journal.load(records)) {
+		// most recent first
+		int pos = 0;
+		for(auto it = records.rbegin(); it != records.rend(); ++it)
+			store[it->key] = {it->time, it->track, pos++};
+	} else {
+		// carry over the store of older versions
+		readOldStore();
+		saveStore();
+	}
+}
+
+void RecentDVDStore::readOldStore()
+{
 	ifstream s(recent_dvd_file);
 
 	if(!s.is_open()) return;
@@ -81,7 +97,23 @@ int RecentDVDStore::setCurrentDVD(const string &key, int &track)
 
 void RecentDVDStore::remember(int track, int time)
 {
-	store[current_dvd] = {time, track, -1};
+	// newer than everything read from the store
+	store[current_dvd] = {time, track, --m_newest};
+}
+
+void RecentDVDStore::forget()
+{
+	store.erase(current_dvd);
+	if(m_init)
+		journal.forget(current_dvd);
+}
+
+void RecentDVDStore::checkpoint(int track, int time)
+{
+	if(!m_init) return;
+
+	remember(track, time);
+	journal.append({current_dvd, track, time});
 }
 
 bool RecentDVDStore::DVDInfoCmp(pair<string, DVDInfo> const &a, pair<string, DVDInfo> const &b)
@@ -100,14 +132,10 @@ void RecentDVDStore::saveStore()
 
 	int size = vector_store.size();
 	if(size > 20) size = 20; // to to twenty files
-	
-	ofstream s(recent_dvd_file);
-	
-	for(int i = 0; i < size; i++) {
-		s << vector_store[i].first << '\t';
-		s << vector_store[i].second.track << '\t';
-		s << vector_store[i].second.time << "\n";
-	}
-	
-	s.close();
+
+	// the journal is least recent first
+	vector<ResumeJournal::Record> records;
+	for(int i = size - 1; i >= 0; i--)
+		records.push_back({vector_store[i].first, vector_store[i].second.track, vector_store[i].second.time});
+	journal.compact(records);
 }
@@ -21,6 +21,8 @@
 #include <string>
 #include <map>
 
+#include "ResumeJournal.h"
+
 using namespace std;
 
 class RecentDVDStore
@@ -30,6 +32,9 @@ public:
 	void readStore();
 	int setCurrentDVD(const string &key, int &track);
 	void remember(int track, int time);
+	void forget();
+	// remember, and append to the journal straight away
+	void checkpoint(int track, int time);
 	void saveStore();
 
 private:
@@ -41,8 +46,12 @@ private:
 
 	static bool DVDInfoCmp(pair<string, DVDInfo> const &a, pair<string, DVDInfo> const &b);
 
+	void readOldStore();
+
 	map<string, DVDInfo> store;
 	string recent_dvd_file;
 	string current_dvd;
+	ResumeJournal journal;
+	int m_newest = 0;
 	bool m_init = false;
 };
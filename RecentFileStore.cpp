@@ -20,18 +20,21 @@
 #include <fstream>
 #include <string>
 #include <algorithm>
+#include <iterator>
 #include <vector>
 #include <map>
 #include <iostream>
+#include <ctype.h>
+#include <string.h>
 #include <dirent.h>
 #include <sys/stat.h>
 
-#include "utils/RegExp.h"
 #include "RecentFileStore.h"
 
 using namespace std;
 
 RecentFileStore::RecentFileStore()
+: journal(string(getenv("HOME")) + "/.omxplayer_recent_journal")
 {
 	// recent dir
 	recent_dir = getenv("HOME");
@@ -45,13 +48,30 @@ RecentFileStore::RecentFileStore()
 }
 
 void RecentFileStore::readStore()
+{
+	vector<ResumeJournal::Record> records;
+	if(journal.load(records)) {
+		// most recent first
+		int count = 0;
+		for(auto it = records.rbegin(); it != records.rend(); ++it)
+			store[it->key] = {it->time, it->track, ++count};
+	} else {
+		// carry over the link files of older versions
+		readRecentFiles();
+		compactJournal();
+	}
+
+	m_init = true;
+}
+
+void RecentFileStore::readRecentFiles()
 {
 	string uri;
 	int time;
 	int track;
 
 	vector<string> recents = getRecentFileList();
-	sort(recents.begin(), recents.end());
+	sort(recents.begin(), recents.end(), linkCmp);
 
 	int count = 0;
 	for(uint i=0; i < recents.size(); i++) {
@@ -66,8 +86,6 @@ void RecentFileStore::readStore()
 		}
 		s.close();
 	}
-
-	m_init = true;
 }
 
 bool RecentFileStore::checkIfRecentFile(string &filename)
@@ -92,6 +110,8 @@ bool RecentFileStore::checkIfRecentFile(string &filename)
 	}
 }
 
+// The link files in the recent dir, which are those that start with a
+// uri and a time
 vector<string> RecentFileStore::getRecentFileList()
 {
 	vector<string> recents;
@@ -101,22 +121,44 @@ vector<string> RecentFileStore::getRecentFileList()
 	if ((dir = opendir(recent_dir.c_str())) == NULL)
 		return recents;
 
-	// re for filename match
-	CRegExp link_file = CRegExp(true);
-	link_file.RegComp("^[0-9]{2} - ");
-
 	while ((ent = readdir (dir)) != NULL) {
-		if(link_file.RegFind(ent->d_name, 0) > -1) {
-			recents.push_back(recent_dir + ent->d_name);
-		}
+		if(ent->d_name[0] == '.') continue;
+
+		string path = recent_dir + ent->d_name;
+		ifstream s(path);
+		string uri;
+		int time;
+		if(getline(s, uri) && !uri.empty() && s >> time)
+			recents.push_back(path);
 	}
 
+	closedir(dir);
 	return recents;
 }
 
+// Older versions named the links "NN - " by rank; those come first, then
+// the newest
+bool RecentFileStore::linkCmp(const string &a, const string &b)
+{
+	auto rank = [](const string &path) {
+		const char *name = path.c_str() + path.rfind('/') + 1;
+		if(isdigit(name[0]) && isdigit(name[1]) && strncmp(name + 2, " - ", 3) == 0)
+			return (name[0] - '0') * 10 + name[1] - '0';
+		return 100;
+	};
+	int rank_a = rank(a), rank_b = rank(b);
+	if(rank_a != rank_b || rank_a < 100) return rank_a < rank_b;
+
+	struct stat stat_a, stat_b;
+	if(stat(a.c_str(), &stat_a) || stat(b.c_str(), &stat_b)) return a < b;
+	return stat_a.st_mtime > stat_b.st_mtime;
+}
+
 void RecentFileStore::forget(string &key)
 {
 	store.erase(key);
+	if(m_init)
+		journal.forget(key);
 }
 
 int RecentFileStore::getTime(string &key, int &track)
@@ -139,15 +181,16 @@ int RecentFileStore::getTime(string &key, int &track)
 
 void RecentFileStore::remember(string key, int track, int time)
 {
-	store[key] = {time, track, -1};
+	// newer than everything read from the store
+	store[key] = {time, track, --m_newest};
 }
 
-void RecentFileStore::clearRecents()
+void RecentFileStore::checkpoint(string key, int track, int time)
 {
-	vector<string> old_recents = getRecentFileList();
+	if(!m_init) return;
 
-	for(uint i=0; i < old_recents.size(); i++)
-		std::remove(old_recents[i].c_str());
+	remember(key, track, time);
+	journal.append({key, track, time});
 }
 
 bool RecentFileStore::fileinfoCmp(pair<string, fileInfo> const &a, pair<string, fileInfo> const &b)
@@ -155,46 +198,92 @@ bool RecentFileStore::fileinfoCmp(pair<string, fileInfo> const &a, pair<string,
 	return a.second.pos < b.second.pos;
 }
 
-void RecentFileStore::saveStore()
+// The file name, or the host of a stream. The names don't change as files
+// move down the list, so a link is only written when what it says does.
+string RecentFileStore::linkName(const string &uri)
 {
-	if(!m_init) return;
+	string link;
 
-	// delete all existing link files
-	clearRecents();
+	size_t slash = uri.rfind('/');
+	size_t scheme = uri.find("://");
+	size_t host_end = scheme == string::npos ? string::npos : uri.find('/', scheme + 3);
 
-	// set up some regexes
-	CRegExp link_file = CRegExp(true);
-	link_file.RegComp("/([^/]+)$");
+	if(slash != string::npos && slash + 1 < uri.length()) {
+		link += uri.substr(slash + 1);
+	} else if(host_end != string::npos && host_end > scheme + 3) {
+		link += uri.substr(scheme + 3, host_end - scheme - 3) + ".ts";
+	} else {
+		link += "stream.ts";
+	}
 
-	CRegExp link_stream = CRegExp(true);
-	link_stream.RegComp("://([^/]+)/");
+	return link;
+}
 
-	// create a sorted vector
+// The link files are made from the store, and only those which have
+// changed are written, so the most recently played are also the most
+// recently modified
+void RecentFileStore::updateRecentFiles(vector<pair<string, fileInfo> > &recents)
+{
+	map<string, string> links;
+	for(uint i = 0; i < recents.size(); i++) {
+		string content = recents[i].first + '\n' + to_string(recents[i].second.time) + "\n";
+		if(recents[i].second.track > 0) content += to_string(recents[i].second.track) + "\n";
+
+		// files of the same name from different places are numbered
+		string name = linkName(recents[i].first);
+		size_t dot = name.rfind('.');
+		if(dot == string::npos || dot == 0) dot = name.length();
+		string link = recent_dir + name;
+		for(int n = 2; links.count(link); n++)
+			link = recent_dir + name.substr(0, dot) + " (" + to_string(n) + ")" + name.substr(dot);
+
+		links[link] = content;
+	}
+
+	vector<string> old_recents = getRecentFileList();
+	for(uint i=0; i < old_recents.size(); i++)
+		if(links.find(old_recents[i]) == links.end())
+			std::remove(old_recents[i].c_str());
+
+	for(auto &link : links) {
+		ifstream in(link.first);
+		string old((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+		in.close();
+		if(old == link.second) continue;
+
+		ofstream s(link.first);
+		s << link.second;
+		s.close();
+	}
+}
+
+// Replaces the journal with the twenty most recent files
+void RecentFileStore::compactJournal()
+{
 	vector<pair<string, fileInfo> > vector_store;
 	vector_store.assign(store.begin(), store.end());
 	sort(vector_store.begin(), vector_store.end(), fileinfoCmp);
 
-	int size = vector_store.size();
-	if(size > 20) size = 20; // to to twenty files
-	for(int i = 0; i < size; i++) {
-		// make link name
-		string link;
+	if(vector_store.size() > 20) vector_store.resize(20);
 
-		if(i < 9) link += '0';
-		link += to_string(i+1) + " - ";
+	// the journal is least recent first
+	vector<ResumeJournal::Record> records;
+	for(auto it = vector_store.rbegin(); it != vector_store.rend(); ++it)
+		records.push_back({it->first, it->second.track, it->second.time});
+	journal.compact(records);
+}
 
-		if(link_file.RegFind(vector_store[i].first, 0) > -1) {
-			link += link_file.GetMatch(1);
-		} else if(link_stream.RegFind(vector_store[i].first, 0) > -1) {
-			link += link_stream.GetMatch(1) + ".ts";
-		} else {
-			link += "stream.ts";
-		}
+void RecentFileStore::saveStore()
+{
+	if(!m_init) return;
 
-		// write link file
-		ofstream s(recent_dir + link);
-		s << vector_store[i].first << '\n' << vector_store[i].second.time << "\n";
-		if(vector_store[i].second.track > 0) s << vector_store[i].second.track << "\n";
-		s.close();
-	}
+	// create a sorted vector
+	vector<pair<string, fileInfo> > vector_store;
+	vector_store.assign(store.begin(), store.end());
+	sort(vector_store.begin(), vector_store.end(), fileinfoCmp);
+
+	if(vector_store.size() > 20) vector_store.resize(20); // to to twenty files
+
+	compactJournal();
+	updateRecentFiles(vector_store);
 }
@@ -20,6 +20,9 @@
 
 #include <string>
 #include <vector>
+#include <map>
+
+#include "ResumeJournal.h"
 
 using namespace std;
 
@@ -31,6 +34,8 @@ public:
 	void forget(string &key);
 	int getTime(string &key, int &track);
 	void remember(string key, int track, int time);
+	// remember, and append to the journal straight away
+	void checkpoint(string key, int track, int time);
 	void saveStore();
 	bool checkIfRecentFile(string &filename);
 
@@ -42,10 +47,16 @@ private:
 	};
 
 	vector<string> getRecentFileList();
-	void clearRecents();
+	void readRecentFiles();
+	void compactJournal();
+	void updateRecentFiles(vector<pair<string, fileInfo> > &recents);
+	static string linkName(const string &uri);
+	static bool linkCmp(const string &a, const string &b);
 	static bool fileinfoCmp(pair<string, fileInfo> const &a, pair<string, fileInfo> const &b);
 
 	map<string, fileInfo> store;
 	string recent_dir;
+	ResumeJournal journal;
+	int m_newest = 0;
 	bool m_init = false;
 };
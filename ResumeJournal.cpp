@@ -0,0 +1,219 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "ResumeJournal.h"
+
+using namespace std;
+
+ResumeJournal::ResumeJournal(const string &filename)
+: m_filename(filename)
+{
+}
+
+ResumeJournal::~ResumeJournal()
+{
+	// the last records are synced before the thread finishes
+	if(m_sync_thread.Running()) {
+		{
+			lock_guard<mutex> lock(m_sync_lock);
+			m_sync_stop = true;
+		}
+		m_sync_cond.notify_all();
+		m_sync_thread.StopThread();
+	}
+
+	if(m_sync_fd != -1)
+		close(m_sync_fd);
+	if(m_fd != -1)
+		close(m_fd);
+}
+
+bool ResumeJournal::load(vector<Record> &records)
+{
+	records.clear();
+
+	ifstream s(m_filename);
+	if(!s.is_open()) return false;
+
+	// key -> index of its latest record, older ones are blanked
+	map<string, size_t> latest;
+	vector<Record> log;
+
+	// the length of the complete lines
+	off_t length = 0;
+	bool torn = false;
+
+	string line;
+	while(getline(s, line)) {
+		// a torn write has no newline
+		if(s.eof()) {
+			torn = true;
+			break;
+		}
+		length += line.size() + 1;
+
+		if(line.compare(0, 2, "- ") == 0) {
+			auto it = latest.find(line.substr(2));
+			if(it != latest.end()) {
+				log[it->second].key.clear();
+				latest.erase(it);
+			}
+			continue;
+		}
+
+		Record r;
+		istringstream is(line);
+		if(!(is >> r.time >> r.track) || is.get() != ' ' || !getline(is, r.key) || r.key.empty())
+			continue;
+
+		auto it = latest.find(r.key);
+		if(it != latest.end()) {
+			log[it->second].key.clear();
+			it->second = log.size();
+		} else {
+			latest[r.key] = log.size();
+		}
+		log.push_back(move(r));
+	}
+
+	for(Record &r : log)
+		if(!r.key.empty())
+			records.push_back(move(r));
+
+	// otherwise the next record would be glued onto the torn one
+	s.close();
+	if(torn)
+		truncate(m_filename.c_str(), length);
+
+	return true;
+}
+
+string ResumeJournal::format(const Record &record)
+{
+	return to_string(record.time) + ' ' + to_string(record.track) + ' ' + record.key + '\n';
+}
+
+bool ResumeJournal::append(const Record &record)
+{
+	if(record.key.empty() || record.key.find('\n') != string::npos)
+		return false;
+
+	return append_line(format(record));
+}
+
+bool ResumeJournal::forget(const string &key)
+{
+	if(key.empty() || key.find('\n') != string::npos)
+		return false;
+
+	return append_line("- " + key + '\n');
+}
+
+bool ResumeJournal::append_line(const string &line)
+{
+	if(m_fd == -1) {
+		m_fd = open(m_filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		if(m_fd == -1) return false;
+	}
+
+	if(write(m_fd, line.data(), line.size()) != (ssize_t)line.size())
+		return false;
+
+	// synced on the sync thread, through a descriptor of its own as
+	// compact() may close m_fd meanwhile
+	{
+		lock_guard<mutex> lock(m_sync_lock);
+		if(m_sync_fd == -1)
+			m_sync_fd = dup(m_fd);
+	}
+	m_sync_cond.notify_all();
+
+	if(!m_sync_thread.Running())
+		m_sync_thread.Create();
+	return true;
+}
+
+void ResumeJournal::sync_loop()
+{
+	unique_lock<mutex> lock(m_sync_lock);
+	for(;;) {
+		while(m_sync_fd == -1 && !m_sync_stop)
+			m_sync_cond.wait(lock);
+		if(m_sync_fd == -1)
+			break;
+
+		int fd = m_sync_fd;
+		m_sync_fd = -1;
+		lock.unlock();
+
+		fdatasync(fd);
+		close(fd);
+
+		lock.lock();
+	}
+}
+
+bool ResumeJournal::compact(const vector<Record> &records)
+{
+	string data;
+	for(const Record &r : records)
+		if(!r.key.empty() && r.key.find('\n') == string::npos)
+			data += format(r);
+
+	string tmp = m_filename + ".tmp";
+	int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(fd == -1) return false;
+
+	bool ok = write(fd, data.data(), data.size()) == (ssize_t)data.size() && fsync(fd) == 0;
+	close(fd);
+
+	if(!ok || rename(tmp.c_str(), m_filename.c_str()) != 0) {
+		remove(tmp.c_str());
+		return false;
+	}
+
+	// the rename itself is only durable once the directory is synced
+	size_t slash = m_filename.rfind('/');
+	string dir = slash == string::npos ? "." : m_filename.substr(0, slash + 1);
+	int dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(dir_fd != -1) {
+		fsync(dir_fd);
+		close(dir_fd);
+	}
+
+	// appends go to the new file from now on, and what was waiting to be
+	// synced is in it already
+	if(m_fd != -1) {
+		close(m_fd);
+		m_fd = -1;
+	}
+	lock_guard<mutex> lock(m_sync_lock);
+	if(m_sync_fd != -1) {
+		close(m_sync_fd);
+		m_sync_fd = -1;
+	}
+	return true;
+}
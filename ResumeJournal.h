@@ -0,0 +1,81 @@
+#pragma once
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+#include "OMXThread.h"
+
+using namespace std;
+
+// An append-only log of resume positions, one line per record:
+//   <time> <track> <key>
+// or, for a key which has been forgotten:
+//   - <key>
+// Each record is added with a single write() and synced on a thread of
+// its own, so a crash or power cut loses at most the records since the
+// last sync, and playback never waits for the card. A torn last line is
+// cut off when the log is loaded. Later records of a key replace earlier
+// ones. compact() replaces the log with a snapshot through a rename, so
+// it's never seen half written.
+class ResumeJournal
+{
+public:
+	struct Record {
+		string key;
+		int track;
+		int time;
+	};
+
+	explicit ResumeJournal(const string &filename);
+	~ResumeJournal();
+
+	// The latest record of each key, least recently written first. Returns
+	// false if there's no journal yet.
+	bool load(vector<Record> &records);
+
+	bool append(const Record &record);
+	bool forget(const string &key);
+	bool compact(const vector<Record> &records);
+
+private:
+	class SyncThread : public OMXThread
+	{
+		public:
+			explicit SyncThread(ResumeJournal *owner) : m_owner(owner) {}
+			void Process() override { m_owner->sync_loop(); }
+		private:
+			ResumeJournal *m_owner;
+	};
+
+	static string format(const Record &record);
+	bool append_line(const string &line);
+	void sync_loop();
+
+	string m_filename;
+	int m_fd = -1;
+
+	// A duplicate of m_fd waiting to be synced, taken by the sync thread
+	int m_sync_fd = -1;
+	bool m_sync_stop = false;
+	mutex m_sync_lock;
+	condition_variable m_sync_cond;
+	SyncThread m_sync_thread{this};
+};
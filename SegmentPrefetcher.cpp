@@ -0,0 +1,670 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "SegmentPrefetcher.h"
+#include "utils/log.h"
+
+// Bytes asked of the protocol at a time
+#define FETCH_SIZE           (64 * 1024)
+#define READ_BUFFER_SIZE     32768
+// How often a waiting read checks the interrupt callback
+#define WAIT_MS              100
+// A download that fails is resumed this many times
+#define FETCH_ATTEMPTS       3
+// Segments not wanted by the last few opens are no longer in any stream's
+// window. Audio and video can be separate streams taking turns.
+#define STALE_OPENS          4
+
+static bool IsPlaylist(const std::string &url)
+{
+  std::string path = url.substr(0, url.find('?'));
+  return path.find(".m3u8") != std::string::npos || path.find(".mpd") != std::string::npos;
+}
+
+// The start of an HLS playlist, after any byte order mark and white space
+static bool IsHlsData(const uint8_t *data, size_t size)
+{
+  size_t i = 0;
+  if (size >= 3 && data[0] == 0xef && data[1] == 0xbb && data[2] == 0xbf)
+    i = 3;
+  while (i < size && isspace(data[i]))
+    i++;
+  return size - i >= 7 && memcmp(data + i, "#EXTM3U", 7) == 0;
+}
+
+// The root element of a DASH manifest, which may follow an XML declaration
+// and comments
+static bool IsDashData(const uint8_t *data, size_t size)
+{
+  std::string head(data, data + std::min(size, (size_t)4096));
+  return head.find("<MPD") != std::string::npos;
+}
+
+// The url of a playlist entry, which may be relative to the playlist
+static std::string Resolve(const std::string &base, const std::string &ref)
+{
+  if (ref.find("://") != std::string::npos)
+    return ref;
+
+  size_t scheme = base.find("://");
+  if (scheme == std::string::npos)
+    return ref;
+  if (ref.compare(0, 2, "//") == 0)
+    return base.substr(0, scheme + 1) + ref;
+  if (ref[0] == '/')
+    return base.substr(0, base.find('/', scheme + 3)) + ref;
+
+  std::string path = base.substr(0, base.find('?'));
+  return path.substr(0, path.rfind('/') + 1) + ref;
+}
+
+// Counts up the last number in the file name of url, before its extension,
+// by n. Without n the number is taken out, to tell the segments of one
+// stream from another's.
+static std::string Guess(const std::string &url, int n)
+{
+  size_t query = std::min(url.find('?'), url.size());
+  size_t name = url.rfind('/', query);
+  name = name == std::string::npos ? 0 : name + 1;
+  size_t ext = url.rfind('.', query);
+  if (ext == std::string::npos || ext < name)
+    ext = query;
+  if (ext == name)
+    return "";
+
+  size_t end = url.find_last_of("0123456789", ext - 1);
+  if (end == std::string::npos || end < name)
+    return "";
+  size_t start = url.find_last_not_of("0123456789", end) + 1;
+
+  if (!n)
+    return url.substr(0, start) + "#" + url.substr(end + 1);
+
+  std::string digits = url.substr(start, end + 1 - start);
+  char number[32];
+  // a zero padded number stays that wide
+  snprintf(number, sizeof(number), "%0*llu", digits[0] == '0' ? (int)digits.size() : 1,
+           strtoull(digits.c_str(), NULL, 10) + n);
+  return url.substr(0, start) + number + url.substr(end + 1);
+}
+
+SegmentPrefetcher::SegmentPrefetcher()
+: m_options(NULL), m_ahead(0), m_size(0), m_io_open(NULL), m_io_close(NULL),
+  m_cached(0), m_opens(0), m_stop(false), m_dash(false)
+{
+  m_interrupt.callback = NULL;
+  m_interrupt.opaque = NULL;
+  memset(&m_stats, 0, sizeof(m_stats));
+}
+
+SegmentPrefetcher::~SegmentPrefetcher()
+{
+  Close();
+}
+
+AVIOContext *SegmentPrefetcher::Open(const std::string &url, AVDictionary *options, int ahead, size_t size,
+                                     float timeout, const AVIOInterruptCB &int_cb)
+{
+  Close();
+
+  m_url       = url;
+  m_ahead     = ahead;
+  m_size      = size;
+  m_interrupt = int_cb;
+  m_dash      = url.substr(0, url.find('?')).find(".mpd") != std::string::npos;
+  m_stop      = false;
+  m_cached    = 0;
+  m_opens     = 0;
+  memset(&m_stats, 0, sizeof(m_stats));
+  av_dict_copy(&m_options, options, 0);
+  if (timeout > 0)
+    av_dict_set_int(&m_options, "rw_timeout", (int64_t)(timeout * 1e6), AV_DICT_DONT_OVERWRITE);
+
+  SegmentPtr playlist = std::make_shared<Segment>();
+  playlist->url      = url;
+  playlist->length   = -1;
+  playlist->done     = false;
+  playlist->error    = 0;
+  playlist->playlist = true;
+  playlist->guessed  = false;
+  playlist->started  = true;
+  playlist->used     = true;
+  playlist->wanted   = 0;
+  Fetch(playlist);
+  if (playlist->error && playlist->data.empty())
+  {
+    CLog::Log(LOGERROR, "SegmentPrefetcher: unable to open %s (%d)", url.c_str(), playlist->error);
+    av_dict_free(&m_options);
+    return NULL;
+  }
+  // a manifest at a url without the extension
+  m_dash = m_dash || IsDashData(playlist->data.data(), playlist->data.size());
+  if (!m_dash)
+    ParsePlaylist(url, playlist->data);
+
+  // one more than are fetched ahead, so a segment that's needed now
+  // doesn't wait for those
+  for (int i = 0; i <= ahead; i++)
+  {
+    m_fetchers.emplace_back(new Fetcher(this));
+    m_fetchers.back()->Create();
+  }
+
+  CLog::Log(LOGDEBUG, "SegmentPrefetcher: %s, %d segments ahead, %lld kB cache", url.c_str(), ahead,
+            (long long)(m_size >> 10));
+
+  return OpenReader(playlist);
+}
+
+void SegmentPrefetcher::Attach(AVFormatContext *s)
+{
+  m_io_open  = s->io_open;
+  m_io_close = s->io_close;
+  s->opaque   = this;
+  s->io_open  = IoOpen;
+  s->io_close = IoClose;
+}
+
+void SegmentPrefetcher::Close()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+    m_queue.clear();
+  }
+  m_cond.notify_all();
+  for (auto &fetcher : m_fetchers)
+    fetcher->StopThread();
+
+  if (!m_fetchers.empty())
+  {
+    PrefetchStats stats = GetPrefetchStats();
+    CLog::Log(LOGDEBUG, "SegmentPrefetcher: %u segments opened, %u already fetched, %u waits for %.0f ms, "
+              "%lld kB fetched, %u failed, %u evicted unused", stats.opened, stats.ready, stats.waits,
+              stats.wait_ms, (long long)(stats.fetched >> 10), stats.failed, stats.evicted);
+  }
+  m_fetchers.clear();
+
+  // contexts the demuxer didn't close, and the playlist's
+  for (Reader *reader : m_readers)
+    delete reader;
+  m_readers.clear();
+  m_segments.clear();
+  m_playlists.clear();
+  m_next.clear();
+  m_no_guess.clear();
+  m_playlist_urls.clear();
+  m_cached = 0;
+  av_dict_free(&m_options);
+}
+
+SegmentPrefetcher::PrefetchStats SegmentPrefetcher::GetPrefetchStats()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+int SegmentPrefetcher::Interrupted(void *opaque)
+{
+  SegmentPrefetcher *prefetcher = (SegmentPrefetcher *)opaque;
+  return prefetcher->m_stop;
+}
+
+AVIOContext *SegmentPrefetcher::OpenReader(const SegmentPtr &segment)
+{
+  Reader *reader = new Reader;
+  reader->owner   = this;
+  reader->segment = segment;
+  reader->pos     = 0;
+
+  unsigned char *buffer = (unsigned char *)av_malloc(READ_BUFFER_SIZE);
+  AVIOContext *pb = avio_alloc_context(buffer, READ_BUFFER_SIZE, 0, reader, ReadPacket, NULL, SeekPacket);
+  if (!pb)
+  {
+    av_free(buffer);
+    delete reader;
+    return NULL;
+  }
+  pb->seekable = AVIO_SEEKABLE_NORMAL;
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_readers.insert(reader);
+  return pb;
+}
+
+int SegmentPrefetcher::IoOpen(AVFormatContext *s, AVIOContext **pb, const char *url, int flags,
+                              AVDictionary **options)
+{
+  SegmentPrefetcher *prefetcher = (SegmentPrefetcher *)s->opaque;
+  std::string name = url;
+
+  // byte ranges of one file and anything not over http go the usual way
+  bool http = name.compare(0, 7, "http://") == 0 || name.compare(0, 8, "https://") == 0;
+  if ((flags & AVIO_FLAG_WRITE) || !http || (options && av_dict_get(*options, "offset", NULL, 0)))
+    return prefetcher->m_io_open(s, pb, url, flags, options);
+
+  SegmentPtr segment;
+  bool playlist;
+  {
+    std::lock_guard<std::mutex> lock(prefetcher->m_mutex);
+    playlist = IsPlaylist(name) || name == prefetcher->m_url || prefetcher->m_playlist_urls.count(name);
+  }
+  if (playlist)
+  {
+    // playlists change, so they're always fetched when asked for
+    segment = std::make_shared<Segment>();
+    segment->url      = name;
+    segment->length   = -1;
+    segment->done     = false;
+    segment->error    = 0;
+    segment->playlist = true;
+    segment->guessed  = false;
+    segment->started  = true;
+    segment->used     = true;
+    segment->wanted   = 0;
+    prefetcher->Fetch(segment);
+    if (segment->error && segment->data.empty())
+      return segment->error;
+    if (!prefetcher->m_dash)
+      prefetcher->ParsePlaylist(name, segment->data);
+  }
+  else
+  {
+    std::lock_guard<std::mutex> lock(prefetcher->m_mutex);
+    prefetcher->m_opens++;
+    segment = prefetcher->Want(name, false);
+    segment->used = true;
+
+    // needed now, so ahead of anything prefetched
+    if (!segment->started)
+    {
+      std::deque<SegmentPtr> &queue = prefetcher->m_queue;
+      queue.erase(std::remove(queue.begin(), queue.end(), segment), queue.end());
+      queue.push_front(segment);
+      prefetcher->m_cond.notify_all();
+    }
+
+    prefetcher->Schedule(name);
+
+    prefetcher->m_stats.opened++;
+    if (segment->done && !segment->error)
+      prefetcher->m_stats.ready++;
+  }
+
+  *pb = prefetcher->OpenReader(segment);
+  return *pb ? 0 : AVERROR(ENOMEM);
+}
+
+void SegmentPrefetcher::IoClose(AVFormatContext *s, AVIOContext *pb)
+{
+  SegmentPrefetcher *prefetcher = (SegmentPrefetcher *)s->opaque;
+  if (!pb)
+    return;
+
+  if (pb->read_packet != ReadPacket)
+  {
+    prefetcher->m_io_close(s, pb);
+    return;
+  }
+
+  Reader *reader = (Reader *)pb->opaque;
+  {
+    std::lock_guard<std::mutex> lock(prefetcher->m_mutex);
+    prefetcher->m_readers.erase(reader);
+    delete reader;
+    // what it held may be evicted now
+    prefetcher->Evict();
+  }
+  prefetcher->m_cond.notify_all();
+  av_freep(&pb->buffer);
+  avio_context_free(&pb);
+}
+
+int SegmentPrefetcher::ReadPacket(void *opaque, uint8_t *buf, int size)
+{
+  Reader *reader = (Reader *)opaque;
+  SegmentPrefetcher *prefetcher = reader->owner;
+  Segment &segment = *reader->segment;
+  std::unique_lock<std::mutex> lock(prefetcher->m_mutex);
+  std::chrono::steady_clock::time_point wait_start;
+  bool waited = false;
+  int ret = 0;
+
+  while (reader->pos >= (int64_t)segment.data.size() && !segment.done)
+  {
+    const AVIOInterruptCB &int_cb = prefetcher->m_interrupt;
+    if (prefetcher->m_stop || (int_cb.callback && int_cb.callback(int_cb.opaque)))
+    {
+      ret = AVERROR_EXIT;
+      break;
+    }
+    if (!waited)
+    {
+      waited = true;
+      wait_start = std::chrono::steady_clock::now();
+      prefetcher->m_stats.waits++;
+    }
+    prefetcher->m_cond.wait_for(lock, std::chrono::milliseconds(WAIT_MS));
+  }
+
+  if (waited)
+    prefetcher->m_stats.wait_ms += std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - wait_start).count();
+
+  if (ret)
+    return ret;
+
+  if (reader->pos < (int64_t)segment.data.size())
+  {
+    int n = (int)std::min((int64_t)size, (int64_t)segment.data.size() - reader->pos);
+    memcpy(buf, segment.data.data() + reader->pos, n);
+    reader->pos += n;
+    return n;
+  }
+  return segment.error ? segment.error : AVERROR_EOF;
+}
+
+int64_t SegmentPrefetcher::SeekPacket(void *opaque, int64_t offset, int whence)
+{
+  Reader *reader = (Reader *)opaque;
+  Segment &segment = *reader->segment;
+  std::lock_guard<std::mutex> lock(reader->owner->m_mutex);
+
+  int64_t length = segment.done ? (int64_t)segment.data.size() : segment.length;
+  if (whence == AVSEEK_SIZE)
+    return length;
+
+  int64_t pos;
+  switch (whence & ~AVSEEK_FORCE)
+  {
+    case SEEK_SET: pos = offset; break;
+    case SEEK_CUR: pos = reader->pos + offset; break;
+    case SEEK_END: pos = length < 0 ? -1 : length + offset; break;
+    default:       pos = -1; break;
+  }
+  if (pos < 0)
+    return -1;
+
+  // reads past what's downloaded wait for it
+  reader->pos = pos;
+  return pos;
+}
+
+// Downloads a segment, resuming it where a connection drops.
+void SegmentPrefetcher::Fetch(const SegmentPtr &segment)
+{
+  const AVIOInterruptCB int_cb = { Interrupted, this };
+  bool http = segment->url.compare(0, 7, "http://") == 0 || segment->url.compare(0, 8, "https://") == 0;
+  uint8_t buf[FETCH_SIZE];
+  bool found_playlist = false;
+  int ret = 0;
+
+  for (int attempt = 0; attempt < FETCH_ATTEMPTS && !m_stop; attempt++)
+  {
+    // only this thread adds to it
+    int64_t offset = segment->data.size();
+
+    AVDictionary *options = NULL;
+    av_dict_copy(&options, m_options, 0);
+    if (offset && http)
+      av_dict_set_int(&options, "offset", offset, 0);
+
+    AVIOContext *io = NULL;
+    ret = avio_open2(&io, segment->url.c_str(), AVIO_FLAG_READ, &int_cb, &options);
+    av_dict_free(&options);
+    if (ret < 0)
+      continue;
+
+    if (offset && !http && avio_seek(io, offset, SEEK_SET) != offset)
+    {
+      avio_closep(&io);
+      ret = AVERROR(EIO);
+      break;
+    }
+
+    if (!offset)
+    {
+      int64_t length = avio_size(io);
+      std::lock_guard<std::mutex> lock(m_mutex);
+      segment->length = length > 0 ? length : -1;
+      if (length > 0)
+        segment->data.reserve(length);
+    }
+
+    while ((ret = avio_read(io, buf, sizeof(buf))) > 0)
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      // a playlist at a url that doesn't say so isn't cached either
+      if (segment->data.empty() && !segment->playlist && !segment->guessed &&
+          (IsHlsData(buf, ret) || IsDashData(buf, ret)))
+      {
+        segment->playlist = true;
+        found_playlist = true;
+      }
+      segment->data.insert(segment->data.end(), buf, buf + ret);
+      m_stats.fetched += ret;
+      if (!segment->playlist)
+        m_cached += ret;
+      m_cond.notify_all();
+    }
+    avio_closep(&io);
+
+    if ((ret == 0 || ret == AVERROR_EOF) &&
+        (segment->length < 0 || (int64_t)segment->data.size() >= segment->length))
+    {
+      ret = 0;
+      break;
+    }
+    if (ret == 0 || ret == AVERROR_EOF)
+      ret = AVERROR(EIO);
+  }
+
+  // before it's done, so the segments it lists are known by the time the
+  // demuxer opens them
+  if (found_playlist && !ret && !m_dash)
+    ParsePlaylist(segment->url, segment->data);
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  segment->done  = true;
+  segment->error = m_stop ? AVERROR_EXIT : ret;
+  if (found_playlist)
+  {
+    // fetched afresh as a playlist from now on
+    m_playlist_urls.insert(segment->url);
+    auto it = m_segments.find(segment->url);
+    if (it != m_segments.end() && it->second == segment)
+      m_segments.erase(it);
+  }
+  if (segment->error && !m_stop)
+  {
+    // a guess that isn't there says the stream isn't numbered that way
+    if (segment->guessed && segment->data.empty())
+      m_no_guess.insert(Guess(segment->url, 0));
+    else
+      CLog::Log(LOGWARNING, "SegmentPrefetcher: unable to fetch %s (%d)", segment->url.c_str(), segment->error);
+    m_stats.failed++;
+  }
+  m_cond.notify_all();
+}
+
+void SegmentPrefetcher::FetchLoop()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_stop)
+  {
+    // what's no longer in a window isn't worth fetching
+    while (!m_queue.empty() && !m_queue.front()->used && m_queue.front()->wanted + STALE_OPENS < m_opens)
+    {
+      m_segments.erase(m_queue.front()->url);
+      m_queue.pop_front();
+    }
+
+    if (m_queue.empty())
+    {
+      m_cond.wait(lock);
+      continue;
+    }
+
+    // with the cache full only a segment that's being read is started
+    SegmentPtr segment = m_queue.front();
+    if (!segment->used && m_cached >= m_size)
+    {
+      Evict();
+      if (m_cached >= m_size)
+      {
+        m_cond.wait(lock);
+        continue;
+      }
+    }
+
+    m_queue.pop_front();
+    segment->started = true;
+    lock.unlock();
+    Fetch(segment);
+    lock.lock();
+  }
+}
+
+// Notes which segments follow which in an HLS media playlist
+void SegmentPrefetcher::ParsePlaylist(const std::string &url, const std::vector<uint8_t> &data)
+{
+  std::string text(data.begin(), data.end());
+  // a master playlist lists other playlists
+  if (text.find("#EXT-X-STREAM-INF") != std::string::npos)
+    return;
+
+  std::shared_ptr<std::vector<std::string> > list = std::make_shared<std::vector<std::string> >();
+  size_t start = 0;
+  while (start < text.size())
+  {
+    size_t end = text.find('\n', start);
+    if (end == std::string::npos)
+      end = text.size();
+    std::string line = text.substr(start, end - start);
+    start = end + 1;
+
+    size_t first = line.find_first_not_of(" \t\r");
+    if (first == std::string::npos || line[first] == '#')
+      continue;
+    line = line.substr(first, line.find_last_not_of(" \t\r") + 1 - first);
+    list->push_back(Resolve(url, line));
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  // a live playlist that's reloaded replaces what it said before
+  std::shared_ptr<std::vector<std::string> > &old = m_playlists[url];
+  if (old)
+  {
+    for (const std::string &segment : *old)
+    {
+      auto it = m_next.find(segment);
+      if (it != m_next.end() && it->second.first == old)
+        m_next.erase(it);
+    }
+  }
+  old = list;
+  for (size_t i = 0; i < list->size(); i++)
+    m_next[(*list)[i]] = std::make_pair(list, i);
+}
+
+// Returns the segment at url, queueing it if it's new. Called with m_mutex held.
+SegmentPrefetcher::SegmentPtr SegmentPrefetcher::Want(const std::string &url, bool guessed)
+{
+  SegmentPtr &segment = m_segments[url];
+  // one that failed is tried again
+  if (segment && segment->done && segment->error)
+  {
+    m_cached -= segment->data.size();
+    segment.reset();
+  }
+  if (!segment)
+  {
+    segment = std::make_shared<Segment>();
+    segment->url      = url;
+    segment->length   = -1;
+    segment->done     = false;
+    segment->error    = 0;
+    segment->playlist = false;
+    segment->guessed  = guessed;
+    segment->started  = false;
+    segment->used     = false;
+    m_queue.push_back(segment);
+    m_cond.notify_all();
+  }
+  segment->wanted = m_opens;
+  return segment;
+}
+
+// Queues the segments after the one at url. Called with m_mutex held.
+void SegmentPrefetcher::Schedule(const std::string &url)
+{
+  auto it = m_next.find(url);
+  if (it != m_next.end())
+  {
+    const std::vector<std::string> &list = *it->second.first;
+    for (size_t i = it->second.second + 1; i < list.size() && i <= it->second.second + m_ahead; i++)
+      Want(list[i], false);
+  }
+  else if (m_dash && !m_no_guess.count(Guess(url, 0)))
+  {
+    for (int i = 1; i <= m_ahead; i++)
+    {
+      std::string next = Guess(url, i);
+      if (next.empty())
+        break;
+      Want(next, true);
+    }
+  }
+}
+
+// Drops segments that have been read, then ones no longer in a window,
+// oldest first, until the cache fits. Called with m_mutex held.
+void SegmentPrefetcher::Evict()
+{
+  while (m_cached > m_size)
+  {
+    auto victim = m_segments.end();
+    for (auto it = m_segments.begin(); it != m_segments.end(); ++it)
+    {
+      const Segment &segment = *it->second;
+      // still being fetched or read
+      if (!segment.done || it->second.use_count() > 1)
+        continue;
+      if (!segment.used && segment.wanted + STALE_OPENS >= m_opens)
+        continue;
+      if (victim == m_segments.end() || (segment.used && !victim->second->used) ||
+          (segment.used == victim->second->used && segment.wanted < victim->second->wanted))
+        victim = it;
+    }
+    if (victim == m_segments.end())
+      break;
+
+    if (!victim->second->used)
+      m_stats.evicted++;
+    m_cached -= victim->second->data.size();
+    m_segments.erase(victim);
+  }
+}
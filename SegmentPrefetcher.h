@@ -0,0 +1,153 @@
+#pragma once
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+};
+
+#include "OMXThread.h"
+
+// Downloads the segments of HLS and DASH streams ahead of the demuxer.
+// It stands in for the format context's io_open, so ffmpeg's own hls and
+// dash demuxers still pick variants, reload live playlists and seek, but
+// a segment they open has usually been downloaded already, and the next
+// few are downloading while it plays.
+//
+// Playlists are known by their extension, or by what they start with, and
+// are never cached. HLS playlists are parsed as they pass through to know
+// which segments come next. DASH segments are guessed by counting up the
+// last number in the file name before its extension, which is what
+// $Number$ templates give; once a guess doesn't exist no more are made for
+// that stream.
+class SegmentPrefetcher
+{
+public:
+  struct PrefetchStats
+  {
+    unsigned int opened;    // segments the demuxer opened
+    unsigned int ready;     // of those, already downloaded
+    unsigned int waits;     // reads that had to wait for the download
+    double       wait_ms;
+    int64_t      fetched;   // bytes
+    unsigned int failed;
+    unsigned int evicted;   // downloaded but dropped before use
+  };
+
+  SegmentPrefetcher();
+  ~SegmentPrefetcher();
+
+  // Fetches the playlist or manifest at url, returning a context to read
+  // it from that belongs to the prefetcher. options go to the protocol on
+  // every request. ahead segments are kept downloading, and no new ones
+  // are started while size bytes are cached. A connection that stalls for
+  // timeout is opened again. Reads give up waiting when int_cb says so.
+  AVIOContext *Open(const std::string &url, AVDictionary *options, int ahead, size_t size,
+                    float timeout, const AVIOInterruptCB &int_cb);
+  // Has s open its segments through the prefetcher
+  void Attach(AVFormatContext *s);
+  void Close();
+  PrefetchStats GetPrefetchStats();
+
+private:
+  struct Segment
+  {
+    std::string          url;
+    std::vector<uint8_t> data;
+    int64_t              length;   // -1 until the server says
+    bool                 done;
+    int                  error;
+    bool                 playlist; // not cached, so not counted
+    bool                 guessed;
+    bool                 started;
+    bool                 used;
+    uint64_t             wanted;   // when it was last in the window
+  };
+  typedef std::shared_ptr<Segment> SegmentPtr;
+
+  struct Reader
+  {
+    SegmentPrefetcher *owner;
+    SegmentPtr         segment;
+    int64_t            pos;
+  };
+
+  class Fetcher : public OMXThread
+  {
+  public:
+    Fetcher(SegmentPrefetcher *owner) : m_owner(owner) {}
+    void Process() override { m_owner->FetchLoop(); }
+  private:
+    SegmentPrefetcher *m_owner;
+  };
+
+  static int IoOpen(AVFormatContext *s, AVIOContext **pb, const char *url, int flags, AVDictionary **options);
+  static void IoClose(AVFormatContext *s, AVIOContext *pb);
+  static int ReadPacket(void *opaque, uint8_t *buf, int size);
+  static int64_t SeekPacket(void *opaque, int64_t offset, int whence);
+  static int Interrupted(void *opaque);
+
+  AVIOContext *OpenReader(const SegmentPtr &segment);
+  void Fetch(const SegmentPtr &segment);
+  void FetchLoop();
+  void ParsePlaylist(const std::string &url, const std::vector<uint8_t> &data);
+  SegmentPtr Want(const std::string &url, bool guessed);
+  void Schedule(const std::string &url);
+  void Evict();
+
+  std::string     m_url;
+  AVDictionary   *m_options;
+  AVIOInterruptCB m_interrupt;
+  int             m_ahead;
+  int64_t         m_size;
+
+  int  (*m_io_open)(AVFormatContext *, AVIOContext **, const char *, int, AVDictionary **);
+  void (*m_io_close)(AVFormatContext *, AVIOContext *);
+
+  // segments downloaded or downloading, and the ones waiting for a fetcher,
+  // with the bytes they hold
+  std::map<std::string, SegmentPtr> m_segments;
+  std::deque<SegmentPtr> m_queue;
+  int64_t         m_cached;
+  uint64_t        m_opens;
+  // each segment of the last HLS playlists read, and the ones after it
+  std::map<std::string, std::shared_ptr<std::vector<std::string> > > m_playlists;
+  std::map<std::string, std::pair<std::shared_ptr<std::vector<std::string> >, size_t> > m_next;
+  // DASH segment urls with their number taken out that aren't guessed
+  std::set<std::string> m_no_guess;
+  // urls without a playlist's extension that turned out to be playlists
+  std::set<std::string> m_playlist_urls;
+
+  std::vector<std::unique_ptr<Fetcher> > m_fetchers;
+  std::set<Reader *> m_readers;
+  volatile bool   m_stop;
+  bool            m_dash;
+
+  PrefetchStats   m_stats;
+  std::mutex      m_mutex;
+  std::condition_variable m_cond;
+};
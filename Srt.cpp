@@ -26,7 +26,12 @@
 
 #include "Srt.h"
 
-#include <fstream>
+#include <algorithm>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <utility>
 
 namespace {
@@ -40,44 +45,178 @@ namespace {
            s*1000 +
            f;
   }
-}
 
-template <typename T, typename U>
-T& getline(T&& input, U&& str) {
-  std::getline(std::forward<T>(input), std::forward<U>(str));
-  if (!str.empty() && str.back() == '\r') {
-    str.resize(str.size()-1);
+  void skip_spaces(const char*& p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t'))
+      ++p;
   }
-  return input;
-}
 
-bool ReadSrt(const std::string& filename, std::vector<Subtitle>& subtitles) {
-  std::ifstream srt(filename);
-  if (!srt) return false;
+  bool parse_number(const char*& p, const char* end, unsigned int& n) {
+    skip_spaces(p, end);
+    if (p == end || *p < '0' || *p > '9')
+      return false;
 
-  for (std::string line; getline(srt, line);) {
-    unsigned int h, m, s, f, h2, m2, s2, f2;
+    n = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+      n = n*10 + (*p++ - '0');
+    return true;
+  }
+
+  bool parse_char(const char*& p, const char* end, char c) {
+    if (p == end || *p != c)
+      return false;
+    ++p;
+    return true;
+  }
 
-    if (sscanf(line.c_str(), "%u:%u:%u,%u --> %u:%u:%u,%u",
-               &h, &m, &s, &f, &h2, &m2, &s2, &f2)
-        != 8)
+  // h:m:s,f
+  bool parse_timecode(const char*& p, const char* end, int& ms) {
+    unsigned int h, m, s, f;
+    if (!parse_number(p, end, h) || !parse_char(p, end, ':') ||
+        !parse_number(p, end, m) || !parse_char(p, end, ':') ||
+        !parse_number(p, end, s) || !parse_char(p, end, ',') ||
+        !parse_number(p, end, f))
     {
-      continue;
+      return false;
+    }
+    ms = (int) timecode_to_milliseconds(h, m, s, f);
+    return true;
+  }
+
+  // h:m:s,f --> h:m:s,f
+  bool parse_timecode_line(const char* p, const char* end, int& start, int& stop) {
+    if (!parse_timecode(p, end, start))
+      return false;
+    skip_spaces(p, end);
+    if (!parse_char(p, end, '-') || !parse_char(p, end, '-') || !parse_char(p, end, '>'))
+      return false;
+    return parse_timecode(p, end, stop);
+  }
+
+  const char* line_end(const char* p, const char* end) {
+    auto nl = (const char*) memchr(p, '\n', end - p);
+    return nl ? nl : end;
+  }
+}
+
+SrtFile::SrtFile()
+: m_data(nullptr), m_size(0), m_open(false)
+{}
+
+SrtFile::~SrtFile() {
+  Close();
+}
+
+bool SrtFile::Open(const std::string& filename) {
+  Close();
+
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return false;
+  }
+
+  if (st.st_size > 0) {
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      close(fd);
+      return false;
     }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    m_data = (const char*) data;
+    m_size = st.st_size;
+  }
+
+  close(fd);
+  m_open = true;
+  return true;
+}
 
-    auto start = (int) timecode_to_milliseconds(h, m, s, f);
-    auto stop = (int) timecode_to_milliseconds(h2, m2, s2 ,f2);
+void SrtFile::Close() {
+  if (m_data)
+    munmap((void*) m_data, m_size);
+  m_data = nullptr;
+  m_size = 0;
+  m_open = false;
+}
 
-    std::vector<std::string> text_lines;
-    while (getline(srt, line)) {
-      if (line.empty()) break;
-      text_lines.push_back(std::move(line));
+bool SrtFile::NextTimecode(size_t pos, size_t& line, int& start, int& stop) const {
+  const char* end = m_data + m_size;
+  const char* p = m_data + pos;
+
+  // start from a whole line
+  if (pos > 0 && p[-1] != '\n')
+    p = line_end(p, end) + 1;
+
+  while (p < end) {
+    const char* eol = line_end(p, end);
+    if (parse_timecode_line(p, eol, start, stop)) {
+      line = p - m_data;
+      return true;
     }
+    p = eol + 1;
+  }
+  return false;
+}
+
+size_t SrtFile::Find(int time) const {
+  size_t lo = 0, hi = m_size;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    size_t line;
+    int start, stop;
+    if (!NextTimecode(mid, line, start, stop) || start >= time)
+      hi = mid;
+    else
+      lo = line + 1;
+  }
+
+  size_t line;
+  int start, stop;
+  return NextTimecode(lo, line, start, stop) ? line : m_size;
+}
+
+bool SrtFile::Read(size_t& pos, size_t end, Subtitle& sub) const {
+  size_t line;
+  int start, stop;
+  if (pos >= end || !NextTimecode(pos, line, start, stop) || line >= end)
+    return false;
+
+  const char* file_end = m_data + m_size;
+  const char* p = line_end(m_data + line, file_end) + 1;
+
+  std::vector<std::string> text_lines;
+  while (p < file_end) {
+    const char* eol = line_end(p, file_end);
+    const char* text_end = eol;
+    if (text_end > p && text_end[-1] == '\r')
+      --text_end;
+
+    const char* text = p;
+    p = eol + 1;
+    if (text == text_end) break;
+    text_lines.emplace_back(text, text_end);
+  }
+
+  pos = std::min<size_t>(p - m_data, m_size);
+  sub = Subtitle(start, stop, text_lines);
+  return true;
+}
+
+bool ReadSrt(const std::string& filename, std::vector<Subtitle>& subtitles) {
+  SrtFile srt;
+  if (!srt.Open(filename)) return false;
 
-    if (!subtitles.empty() && subtitles.back().stop > stop)
+  size_t pos = 0;
+  Subtitle sub(false);
+  while (srt.Read(pos, srt.Size(), sub)) {
+    if (!subtitles.empty() && subtitles.back().start > sub.start)
       continue;
 
-    subtitles.emplace_back(start, stop, text_lines);
+    subtitles.push_back(std::move(sub));
   }
 
   return true;
@@ -31,4 +31,33 @@
 
 #include "Subtitle.h"
 
+// A memory mapped srt file, parsed on demand
+class SrtFile {
+public:
+  SrtFile();
+  ~SrtFile();
+  SrtFile(const SrtFile&) = delete;
+  SrtFile& operator=(const SrtFile&) = delete;
+
+  bool Open(const std::string& filename);
+  void Close();
+  bool IsOpen() const { return m_open; }
+  size_t Size() const { return m_size; }
+
+  // Offset of the first subtitle which starts at or after time. Start
+  // times are expected to be in order, so this is a bisection of the file.
+  size_t Find(int time) const;
+
+  // Reads the next subtitle with a timecode line starting at or after pos
+  // and before end, leaving pos after its text
+  bool Read(size_t& pos, size_t end, Subtitle& sub) const;
+
+private:
+  bool NextTimecode(size_t pos, size_t& line, int& start, int& stop) const;
+
+  const char* m_data;
+  size_t m_size;
+  bool m_open;
+};
+
 bool ReadSrt(const std::string& filename, std::vector<Subtitle>& subtitles);
@@ -0,0 +1,265 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+// Checks the mapped srt reader against the ifstream and sscanf one it
+// replaced, then times both.
+//
+//   srt-bench.bin [options] [file.srt...]
+//
+// Without files a large srt file is generated, with a mix of line endings,
+// overlapping subtitles, stray lines and ones out of order. The exit
+// status is 1 if the readers disagree on any file.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Srt.h"
+#include "Subtitle.h"
+
+using namespace std;
+
+namespace {
+  unsigned int TimecodeToMilliseconds(unsigned int h, unsigned int m, unsigned int s, unsigned int f) {
+    return h*3600000 + m*60000 + s*1000 + f;
+  }
+
+  template <typename T, typename U>
+  T& GetLine(T&& input, U&& str) {
+    std::getline(std::forward<T>(input), std::forward<U>(str));
+    if (!str.empty() && str.back() == '\r') {
+      str.resize(str.size()-1);
+    }
+    return input;
+  }
+
+  // The reader as it was. A subtitle starting before the last one is
+  // dropped as ReadSrt does now; it used to go by the stop time, before
+  // overlapping subtitles were shown together.
+  bool OldReadSrt(const string& filename, vector<Subtitle>& subtitles) {
+    ifstream srt(filename);
+    if (!srt) return false;
+
+    for (string line; GetLine(srt, line);) {
+      unsigned int h, m, s, f, h2, m2, s2, f2;
+
+      if (sscanf(line.c_str(), "%u:%u:%u,%u --> %u:%u:%u,%u",
+                 &h, &m, &s, &f, &h2, &m2, &s2, &f2)
+          != 8)
+      {
+        continue;
+      }
+
+      auto start = (int) TimecodeToMilliseconds(h, m, s, f);
+      auto stop = (int) TimecodeToMilliseconds(h2, m2, s2 ,f2);
+
+      vector<string> text_lines;
+      while (GetLine(srt, line)) {
+        if (line.empty()) break;
+        text_lines.push_back(std::move(line));
+      }
+
+      if (!subtitles.empty() && subtitles.back().start > start)
+        continue;
+
+      subtitles.emplace_back(start, stop, text_lines);
+    }
+
+    return true;
+  }
+
+  string Timecode(int ms) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%02d:%02d:%02d,%03d", ms / 3600000, ms / 60000 % 60, ms / 1000 % 60, ms % 1000);
+    return buf;
+  }
+
+  const char *words[] = {
+    "Hello", "world", "<i>quietly</i>", "{\\b1}now{\\b0}", "<font color=\"#ffcc00\">look</font>",
+    "the", "readings", "are", "off", "the", "scale", "-", "...", "\xc3\xa9t\xc3\xa9", "42",
+  };
+
+  // An srt file of count subtitles
+  string GenerateSrt(int count, mt19937& rng) {
+    const size_t word_count = sizeof(words) / sizeof(words[0]);
+    string srt;
+    int start = 1000;
+    for (int i = 0; i < count; i++) {
+      const char *eol = rng() % 4 == 0 ? "\r\n" : "\n";
+
+      if (rng() % 50 == 0)
+        srt += string("a stray line") + eol;
+      if (rng() % 10 != 0)
+        srt += to_string(i + 1) + eol;
+
+      // now and then one overlaps the next, or starts before the last
+      int begin = start;
+      if (rng() % 200 == 0)
+        begin = max(start - 5000, 0);
+      int stop = begin + 500 + rng() % (rng() % 20 == 0 ? 8000 : 3000);
+      const char *arrow = rng() % 20 == 0 ? "  -->  " : " --> ";
+      srt += Timecode(begin) + arrow + Timecode(stop) + eol;
+
+      int lines = 1 + rng() % 3;
+      for (int l = 0; l < lines; l++) {
+        int n = 1 + rng() % 8;
+        for (int w = 0; w < n; w++)
+          srt += string(w ? " " : "") + words[rng() % word_count];
+        srt += eol;
+      }
+      srt += eol;
+      start += 500 + rng() % 4000;
+    }
+    return srt;
+  }
+
+  bool Same(const Subtitle& a, const Subtitle& b) {
+    return a.start == b.start && a.stop == b.stop && a.text_lines == b.text_lines;
+  }
+
+  void PrintSubtitle(const char* name, const vector<Subtitle>& subs, size_t i) {
+    if (i >= subs.size()) {
+      printf("  %s: none\n", name);
+      return;
+    }
+    printf("  %s: %d --> %d\n", name, subs[i].start, subs[i].stop);
+    for (const string& line : subs[i].text_lines)
+      printf("    \"%s\"\n", line.c_str());
+  }
+
+  // Compares what the readers give for filename, returning the number of
+  // subtitles they differ on
+  size_t Compare(const string& filename) {
+    vector<Subtitle> expected, parsed;
+    if (!OldReadSrt(filename, expected) || !ReadSrt(filename, parsed)) {
+      fprintf(stderr, "Unable to read %s\n", filename.c_str());
+      return 1;
+    }
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < max(expected.size(), parsed.size()); i++) {
+      if (i < expected.size() && i < parsed.size() && Same(expected[i], parsed[i]))
+        continue;
+      if (mismatches++ < 5) {
+        printf("Mismatch on subtitle %zu of %s:\n", i, filename.c_str());
+        PrintSubtitle("ifstream", expected, i);
+        PrintSubtitle("mapped", parsed, i);
+      }
+    }
+    printf("%s: %zu subtitles, %zu mismatches\n", filename.c_str(), parsed.size(), mismatches);
+    return mismatches;
+  }
+
+  template <typename F>
+  double TimeRead(const string& filename, int repeat, F read) {
+    size_t subtitles = 0;
+    auto start = chrono::steady_clock::now();
+    for (int r = 0; r < repeat; r++) {
+      vector<Subtitle> subs;
+      read(filename, subs);
+      subtitles += subs.size();
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    if (subtitles == 0) printf("  no subtitles read\n");
+    return ms / repeat;
+  }
+
+  void PrintUsage() {
+    printf("Usage: srt-bench.bin [options] [file.srt...]\n"
+           "    --subtitles n     Subtitles in the generated file (default: 200000)\n"
+           "    --seed n          Seed for the generated file (default: 1)\n"
+           "    --repeat n        Times to read each file when timing (default: 5)\n");
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int count = 200000;
+  unsigned int seed = 1;
+  int repeat = 5;
+
+  const int subtitles_opt = 0x100;
+  const int seed_opt      = 0x101;
+  const int repeat_opt    = 0x102;
+
+  struct option longopts[] = {
+    { "subtitles",    required_argument,  NULL,          subtitles_opt },
+    { "seed",         required_argument,  NULL,          seed_opt },
+    { "repeat",       required_argument,  NULL,          repeat_opt },
+    { "help",         no_argument,        NULL,          'h' },
+    { 0, 0, 0, 0 }
+  };
+
+  int c;
+  while ((c = getopt_long(argc, argv, "h", longopts, NULL)) != -1) {
+    switch (c) {
+      case subtitles_opt:
+        count = max(atoi(optarg), 1);
+        break;
+      case seed_opt:
+        seed = strtoul(optarg, NULL, 10);
+        break;
+      case repeat_opt:
+        repeat = max(atoi(optarg), 1);
+        break;
+      default:
+        PrintUsage();
+        return c == 'h' ? 0 : 1;
+    }
+  }
+
+  vector<string> files(argv + optind, argv + argc);
+  string generated;
+  if (files.empty()) {
+    char path[] = "/tmp/srt-bench-XXXXXX";
+    int fd = mkstemp(path);
+    mt19937 rng(seed);
+    string srt = GenerateSrt(count, rng);
+    if (fd < 0 || write(fd, srt.data(), srt.size()) != (ssize_t)srt.size()) {
+      fprintf(stderr, "Unable to write %s\n", path);
+      return 1;
+    }
+    close(fd);
+    generated = path;
+    files.push_back(generated);
+  }
+
+  size_t mismatches = 0;
+  for (const string& file : files) {
+    mismatches += Compare(file);
+
+    ifstream in(file, ios::binary | ios::ate);
+    double mb = in.tellg() / 1048576.0;
+    double old_ms = TimeRead(file, repeat, OldReadSrt);
+    double new_ms = TimeRead(file, repeat, ReadSrt);
+    printf("  %.1f MB, per read: ifstream %.1f ms (%.0f MB/s), mapped %.1f ms (%.0f MB/s)\n",
+           mb, old_ms, mb / old_ms * 1000, new_ms, mb / new_ms * 1000);
+  }
+
+  if (!generated.empty())
+    unlink(generated.c_str());
+
+  return mismatches ? 1 : 0;
+}
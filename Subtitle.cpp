@@ -63,6 +63,11 @@ Subtitle::Subtitle(const Subtitle &old) //copy
 
 Subtitle& Subtitle::operator=(const Subtitle &old) // copy assign
 {
+  if(this == &old)
+    return *this;
+
+  destroy_content();
+
   start = old.start;
   stop = old.stop;
   isImage = old.isImage;
@@ -96,6 +101,11 @@ Subtitle::Subtitle(Subtitle &&old) noexcept //move
 
 Subtitle& Subtitle::operator=(Subtitle &&old) noexcept // move assign
 {
+  if(this == &old)
+    return *this;
+
+  destroy_content();
+
   start = old.start;
   stop = old.stop;
   isImage = old.isImage;
@@ -112,6 +122,11 @@ Subtitle& Subtitle::operator=(Subtitle &&old) noexcept // move assign
 }
 
 Subtitle::~Subtitle()
+{
+  destroy_content();
+}
+
+void Subtitle::destroy_content()
 {
   if(isImage) {
     image.data.~basic_string<unsigned char>();
@@ -48,4 +48,8 @@ class Subtitle {
       Rectangle rect;
     } image;
   };
+
+  private:
+  // Ends the lifetime of whichever union member is live
+  void destroy_content();
 };
@@ -0,0 +1,185 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+// Renders subtitle files offscreen and reports how long each subtitle
+// took to prepare and to upload to its layer.
+//
+//   subtitle-bench.bin [options] file.srt...
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "OffscreenLayer.h"
+#include "SubtitleRenderer.h"
+#include "Subtitle.h"
+#include "SubtitleTrack.h"
+#include "Srt.h"
+
+using namespace std;
+
+namespace {
+  void PrintUsage() {
+    printf("Usage: subtitle-bench.bin [options] file.srt...\n"
+           "    --width n         Screen width (default: 1920)\n"
+           "    --height n        Screen height (default: 1080)\n"
+           "    --font-size size  Font size in 1/1000 screen height (default: 55)\n"
+           "    --lines n         Number of lines in the subtitle buffer (default: 3)\n"
+           "    --align center    Center subtitles\n"
+           "    --png prefix      Write every frame to prefix-layer<n>-<frame>.png\n"
+           "    --render-ahead ms Queue the next subtitles to be rendered ahead after each one\n"
+           "                      is shown and wait ms before the next, as the player does\n");
+  }
+
+  void PrintTimes(const char* name, vector<double>& us) {
+    if (us.empty()) return;
+
+    sort(us.begin(), us.end());
+    double total = 0;
+    for (double t : us) total += t;
+
+    printf("  %-8s mean %8.1f us  median %8.1f us  95%% %8.1f us  max %8.1f us\n",
+           name,
+           total / us.size(),
+           us[us.size() / 2],
+           us[us.size() * 95 / 100],
+           us.back());
+  }
+
+  double Elapsed(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+  }
+}
+
+int main(int argc, char *argv[]) {
+  Dimension screen = {1920, 1080};
+  float font_size = 0.055f;
+  unsigned int lines = 3;
+  bool centered = false;
+  string png_prefix;
+  int render_ahead_ms = -1;
+
+  const int width_opt        = 0x100;
+  const int height_opt       = 0x101;
+  const int font_size_opt    = 0x102;
+  const int lines_opt        = 0x103;
+  const int align_opt        = 0x104;
+  const int png_opt          = 0x105;
+  const int render_ahead_opt = 0x106;
+
+  struct option longopts[] = {
+    { "width",        required_argument,  NULL,          width_opt },
+    { "height",       required_argument,  NULL,          height_opt },
+    { "font-size",    required_argument,  NULL,          font_size_opt },
+    { "lines",        required_argument,  NULL,          lines_opt },
+    { "align",        required_argument,  NULL,          align_opt },
+    { "png",          required_argument,  NULL,          png_opt },
+    { "render-ahead", required_argument,  NULL,          render_ahead_opt },
+    { "help",         no_argument,        NULL,          'h' },
+    { 0, 0, 0, 0 }
+  };
+
+  int c;
+  while ((c = getopt_long(argc, argv, "h", longopts, NULL)) != -1) {
+    switch (c) {
+      case width_opt:
+        screen.width = atoi(optarg);
+        break;
+      case height_opt:
+        screen.height = atoi(optarg);
+        break;
+      case font_size_opt:
+        font_size = atoi(optarg) / 1000.0f;
+        break;
+      case lines_opt:
+        lines = max(atoi(optarg), 1);
+        break;
+      case align_opt:
+        centered = !strcmp(optarg, "center");
+        break;
+      case png_opt:
+        png_prefix = optarg;
+        break;
+      case render_ahead_opt:
+        render_ahead_ms = max(atoi(optarg), 0);
+        break;
+      default:
+        PrintUsage();
+        return c == 'h' ? 0 : 1;
+    }
+  }
+
+  if (optind >= argc) {
+    PrintUsage();
+    return 1;
+  }
+
+  SubtitleRenderer renderer(new OffscreenDisplay(screen, png_prefix),
+                            font_size, centered, true, lines);
+
+  for (int i = optind; i < argc; i++) {
+    vector<Subtitle> subtitles;
+    if (!ReadSrt(argv[i], subtitles)) {
+      fprintf(stderr, "Unable to read %s\n", argv[i]);
+      return 1;
+    }
+
+    vector<double> prepare_us, upload_us;
+    prepare_us.reserve(subtitles.size());
+    upload_us.reserve(subtitles.size());
+
+    SubtitleTrack track;
+    for (auto& sub : subtitles)
+      track.push_back(sub);
+
+    double wait_ms = 0;
+    auto file_start = chrono::steady_clock::now();
+    for (size_t j = 0; j < subtitles.size(); j++) {
+      auto start = chrono::steady_clock::now();
+      renderer.prepare(subtitles[j]);
+      prepare_us.push_back(Elapsed(start));
+
+      start = chrono::steady_clock::now();
+      renderer.show_next();
+      upload_us.push_back(Elapsed(start));
+
+      if (render_ahead_ms >= 0) {
+        vector<int> ahead;
+        for (size_t k = j + 1; k < subtitles.size() && ahead.size() < SubtitleRenderer::RENDER_AHEAD; k++)
+          ahead.push_back(subtitles[k].start);
+        renderer.render_ahead(track, std::move(ahead));
+
+        this_thread::sleep_for(chrono::milliseconds(render_ahead_ms));
+        wait_ms += render_ahead_ms;
+      }
+    }
+    double total_ms = Elapsed(file_start) / 1000 - wait_ms;
+
+    printf("%s: %zu subtitles in %.1f ms\n", argv[i], subtitles.size(), total_ms);
+    PrintTimes("prepare", prepare_us);
+    PrintTimes("upload", upload_us);
+  }
+
+  return 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "utils/simple_geometry.h"
+
+// A surface subtitles are drawn on. Images are 32bpp ARGB or 8bpp
+// palette indices (0 transparent, 1 black, 2 white, 3 grey).
+class SubtitleLayer
+{
+public:
+	virtual ~SubtitleLayer() {}
+
+	virtual void hideElement() = 0;
+	virtual void clearImage() = 0;
+	virtual void setImageData(void *image_data, bool show = true) = 0;
+	virtual void setImageData(void *image_data, int y, int height, bool show = true) = 0;
+
+	virtual const int& getSourceWidth() = 0;
+	virtual const int& getSourceHeight() = 0;
+};
+
+// Creates the layers subtitles are shown on
+class SubtitleDisplay
+{
+public:
+	virtual ~SubtitleDisplay() {}
+
+	virtual Dimension getScreenDimensions() = 0;
+	virtual SubtitleLayer *createLayer(int bytesperpixel, Rectangle dest_rect,
+		Dimension src_image = {-1, -1}) = 0;
+};
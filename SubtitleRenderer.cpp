@@ -20,38 +20,40 @@
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <mutex>
+#include <climits>
+#include <cstring>
 
 #include <boost/algorithm/string.hpp>
 #include <cairo.h>
+#include <pthread.h>
+#include <sched.h>
 
-#include "utils/RegExp.h"
+#include "utils/log.h"
 #include "SubtitleRenderer.h"
-#include "DispmanxLayer.h"
+#include "SubtitleTags.h"
+#include "SubtitleLayer.h"
 #include "Subtitle.h"
 
 using namespace std;
 
-SubtitleRenderer::SubtitleRenderer(int display_num, int layer_num, float r_font_size,
+SubtitleRenderer::SubtitleRenderer(SubtitleDisplay *display, float r_font_size,
 	bool centered, bool box_opacity, unsigned int lines)
-: m_centered(centered),
+: m_display(display),
+  dvdSubLayer(NULL),
+  m_cache(CACHE_SIZE),
+  m_dvd_layer_size{0, 0},
+  m_cache_generation(0),
+  m_render_ahead_thread(this),
+  m_draw(GLYPH_CACHE_BYTES),
+  m_ahead_draw(GLYPH_CACHE_BYTES),
+  m_centered(centered),
   m_ghost_box(box_opacity),
   m_max_lines(lines)
 {
-	// Subtitle tag parser regexes
-	m_tags = new CRegExp(true);
-	m_tags->RegComp("(<[^>]*>|\\{\\\\[^\\}]*\\})");
-
-	m_font_color_html = new CRegExp(true);
-	m_font_color_html->RegComp("color[ \\t]*=[ \\t\"']*#?([a-f0-9]{6})");
-
-	m_font_color_curly = new CRegExp(true);
-	m_font_color_curly->RegComp("^\\{\\\\c&h([a-f0-9]{2})([a-f0-9]{2})([a-f0-9]{2})&\\}$");
-
-	// Open display
-	DispmanxLayer::openDisplay(display_num, layer_num);
-
 	// Determine screen size
-	Dimension screen = DispmanxLayer::getScreenDimensions();
+	Dimension screen = m_display->getScreenDimensions();
 
 	/*    *    *    *     *    *    *    *    *    *    *    *
 	 * Set up layer for text subtitles and on screen display *
@@ -92,7 +94,7 @@ SubtitleRenderer::SubtitleRenderer(int display_num, int layer_num, float r_font_
 	}
 
 	// Create layer
-	subtitleLayer = new DispmanxLayer(4, text_subtitle_rect);
+	subtitleLayer = m_display->createLayer(4, text_subtitle_rect);
 
 	// font faces
 	cairo_font_face_t *normal_font = cairo_toy_font_face_create("FreeSans", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
@@ -119,6 +121,8 @@ SubtitleRenderer::SubtitleRenderer(int display_num, int layer_num, float r_font_
 	cairo_font_face_destroy(normal_font);
 	cairo_font_face_destroy(italic_font);
 	cairo_font_face_destroy(bold_font);
+
+	m_render_ahead_thread.Create();
 }
 	/*    *    *    *    *    *    *    *    *    *    *    *
 	 *            Set up layer for DVD subtitles            *
@@ -127,11 +131,18 @@ SubtitleRenderer::SubtitleRenderer(int display_num, int layer_num, float r_font_
 void SubtitleRenderer::initDVDSubs(Dimension video, float video_aspect_ratio,
 		int aspect_mode)
 {
+	std::lock_guard<std::mutex> lock(m_render_lock);
+
 	if(dvdSubLayer)
 		delete dvdSubLayer;
 
+	// cached dvd subtitles were rendered for the old layer, as may be
+	// those being rendered ahead
+	m_cache.clear();
+	m_cache_generation++;
+
 	// Determine screen size
-	Dimension screen = DispmanxLayer::getScreenDimensions();
+	Dimension screen = m_display->getScreenDimensions();
 
 	// Calculate position of view port
 	Rectangle view_port {.width = screen.width, .height = screen.height};
@@ -161,84 +172,302 @@ void SubtitleRenderer::initDVDSubs(Dimension video, float video_aspect_ratio,
 	view_port.y = (screen.height - view_port.height) / 2;
 
 	// create layer
-	dvdSubLayer = new DispmanxLayer(1, view_port, video);
+	dvdSubLayer = m_display->createLayer(1, view_port, video);
+	m_dvd_layer_size = {dvdSubLayer->getSourceWidth(), dvdSubLayer->getSourceHeight()};
 }
 
-void SubtitleRenderer::set_font(int new_font_type)
+cairo_scaled_font_t *SubtitleRenderer::get_scaled_font(int font_type)
 {
-	if(new_font_type == m_current_font) return;
-
-	switch(new_font_type) {
-		case NORMAL_FONT:
-			cairo_set_scaled_font(m_cr, m_normal_font_scaled);
-			break;
+	switch(font_type) {
 		case BOLD_FONT:
-			cairo_set_scaled_font(m_cr, m_bold_font_scaled);
-			break;
+			return m_bold_font_scaled;
 		case ITALIC_FONT:
-			cairo_set_scaled_font(m_cr, m_italic_font_scaled);
-			break;
+			return m_italic_font_scaled;
+		default:
+			return m_normal_font_scaled;
 	}
+}
+
+void SubtitleRenderer::set_font(DrawState &state, int new_font_type)
+{
+	if(new_font_type == state.current_font) return;
+
+	cairo_set_scaled_font(state.cr, get_scaled_font(new_font_type));
+
+	state.current_font = new_font_type;
+}
 
-	m_current_font = new_font_type;
+// Returns the shaped glyphs for a text fragment. Subtitles and OSD messages
+// repeat a lot, so glyph runs are cached. The pointer is only valid until
+// the next call.
+const SubtitleRenderer::GlyphRun *SubtitleRenderer::get_glyph_run(DrawState &state, const string &text, int font)
+{
+	GlyphKey key{text, font, m_font_size};
+
+	GlyphRun *run = state.glyph_cache.get(key);
+	if(run) return run;
+
+	cairo_scaled_font_t *scaled_font = get_scaled_font(font);
+	cairo_glyph_t *glyphs = NULL;
+	int num_glyphs = 0;
+
+	cairo_status_t status = cairo_scaled_font_text_to_glyphs(scaled_font,
+			0, 0, text.c_str(), text.length(), &glyphs, &num_glyphs,
+			NULL, NULL, NULL);
+
+	if(status != CAIRO_STATUS_SUCCESS)
+		return NULL;
+
+	GlyphRun new_run;
+	new_run.glyphs.assign(glyphs, glyphs + num_glyphs);
+	cairo_glyph_free(glyphs);
+
+	cairo_scaled_font_glyph_extents(scaled_font, new_run.glyphs.data(),
+			num_glyphs, &new_run.extents);
+
+	size_t cost = sizeof(GlyphRun) + text.length() + num_glyphs * sizeof(cairo_glyph_t);
+	return state.glyph_cache.put(key, std::move(new_run), cost);
 }
 
-void SubtitleRenderer::set_color(int new_color)
+void SubtitleRenderer::set_color(DrawState &state, int new_color)
 {
-	if(new_color == m_color) return;
+	if(new_color == state.color) return;
 
 	if(new_color == -1)
-		cairo_set_source(m_cr, m_default_font_color);
+		cairo_set_source(state.cr, m_default_font_color);
 	else if(new_color == -2)
-		cairo_set_source(m_cr, m_ghost_box_transparency);
+		cairo_set_source(state.cr, m_ghost_box_transparency);
 	else if(new_color == 0)
-		cairo_set_source(m_cr, m_black_font_outline);
+		cairo_set_source(state.cr, m_black_font_outline);
 	else {
 		float r = ((new_color >> 16) & 0xFF) / 255.0f;
 		float g = ((new_color >>  8) & 0xFF) / 255.0f;
 		float b = ((new_color >>  0) & 0xFF) / 255.0f;
 
-		cairo_set_source_rgba(m_cr, r, g, b, 1);
+		cairo_set_source_rgba(state.cr, r, g, b, 1);
+	}
+
+	state.color = new_color;
+}
+
+
+SubtitleRenderer::PreparedImage::PreparedImage(cairo_surface_t *surface, int y)
+: m_surface(surface),
+  m_data(NULL),
+  m_y(y),
+  m_height(cairo_image_surface_get_height(surface))
+{
+}
+
+SubtitleRenderer::PreparedImage::PreparedImage(unsigned char *data, int y, int height)
+: m_surface(NULL),
+  m_data(data),
+  m_y(y),
+  m_height(height)
+{
+}
+
+SubtitleRenderer::PreparedImage::~PreparedImage()
+{
+	if(m_surface)
+		cairo_surface_destroy(m_surface);
+	else
+		free(m_data);
+}
+
+unsigned char *SubtitleRenderer::PreparedImage::get_data()
+{
+	if(m_surface)
+		return cairo_image_surface_get_data(m_surface);
+	else
+		return m_data;
+}
+
+// Subtitles are cached by their timing and a hash of their content
+SubtitleRenderer::CacheKey SubtitleRenderer::make_key(const Subtitle &sub)
+{
+	// FNV-1a
+	size_t hash = 2166136261u;
+	auto add = [&hash](const unsigned char *p, size_t len)
+	{
+		for(size_t i = 0; i < len; i++)
+			hash = (hash ^ p[i]) * 16777619u;
+	};
+
+	if(sub.isImage) {
+		add(sub.image.data.data(), sub.image.data.size());
+		add((const unsigned char *)&sub.image.rect, sizeof(sub.image.rect));
+	} else {
+		for(const string &line : sub.text_lines) {
+			add((const unsigned char *)line.data(), line.size());
+			add((const unsigned char *)"\n", 1);
+		}
 	}
 
-	m_color = new_color;
+	return {sub.start, sub.stop, hash};
 }
 
+// DVD subtitles are laid out on a layer of the size given
+shared_ptr<SubtitleRenderer::PreparedImage> SubtitleRenderer::render(DrawState &state, Subtitle &sub,
+	Dimension dvd_layer)
+{
+	if(sub.isImage)
+		return make_subtitle_image(sub, dvd_layer);
+
+	// parse_lines trims the lines it is given
+	vector<string> lines(sub.text_lines);
+	return parse_lines(state, lines);
+}
 
 void SubtitleRenderer::prepare(Subtitle &sub)
 {
 	unprepare();
 
-	if(sub.isImage)
-		make_subtitle_image(sub);
-	else
-		parse_lines(sub.text_lines);
+	CacheKey key = make_key(sub);
+
+	// The render-ahead thread holds the lock only to use the cache, but at
+	// idle priority it may not get to run again while it does, so rather
+	// than wait the cache is skipped
+	std::unique_lock<std::mutex> lock(m_render_lock, std::try_to_lock);
+	if(lock.owns_lock()) {
+		shared_ptr<PreparedImage> *cached = m_cache.get(key);
+		if(cached) {
+			m_prepared = *cached;
+			return;
+		}
+		lock.unlock();
+	}
+
+	// the DVD layer only changes on this thread
+	m_prepared = render(m_draw, sub, m_dvd_layer_size);
+	if(m_prepared && lock.try_lock())
+		m_cache.put(key, m_prepared);
 }
 
 void SubtitleRenderer::prepare(vector<string> &lines)
 {
-    unprepare();
+	unprepare();
 
-    parse_lines(lines);
+	m_prepared = parse_lines(m_draw, lines);
 }
 
-void SubtitleRenderer::make_subtitle_image(vector<vector<SubtitleText> > &parsed_lines)
+void SubtitleRenderer::render_ahead(const SubtitleTrack &track, vector<int> times)
 {
-	// create surface
-	m_surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, subtitleLayer->getSourceWidth(), subtitleLayer->getSourceHeight());
-	m_cr = cairo_create(m_surface);
+	if(times.empty() || !m_render_ahead_thread.Running())
+		return;
 
-	// Reset font control vars as no font or drawing dolour has been set
-	m_current_font = -500;
-	m_color = -500;
+	if(times.size() > RENDER_AHEAD)
+		times.resize(RENDER_AHEAD);
 
-	// cursor y position
-	int cursor_y_position = subtitleLayer->getSourceHeight() - m_padding;
+	// anything queued earlier is out of date
+	m_render_ahead_mailbox.clear();
+	m_render_ahead_mailbox.send(RenderAheadMessage::Render{track, std::move(times)});
+}
+
+// Text is stacked in start order, so only the newest m_max_lines lines are
+// kept. Images can't be combined and the newest one wins.
+Subtitle SubtitleRenderer::composite(vector<Subtitle> &subs)
+{
+	if(subs.size() == 1)
+		return subs[0];
+
+	for(auto it = subs.rbegin(); it != subs.rend(); ++it)
+		if(it->isImage)
+			return *it;
+
+	vector<string> lines;
+	int start = INT_MIN, stop = INT_MAX;
+	for(Subtitle &sub : subs) {
+		lines.insert(lines.end(), sub.text_lines.begin(), sub.text_lines.end());
+		start = max(start, sub.start);
+		stop = min(stop, sub.stop);
+	}
+
+	if(lines.size() > (size_t)m_max_lines)
+		lines.erase(lines.begin(), lines.end() - m_max_lines);
+
+	return Subtitle(start, stop, lines);
+}
+
+void SubtitleRenderer::render_ahead_loop()
+{
+	// only use cpu time nobody else wants
+	struct sched_param param = {0};
+	pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+
+	bool exit = false;
+	while(!exit) {
+		m_render_ahead_mailbox.receive_wait(std::chrono::milliseconds(1000),
+			[&](RenderAheadMessage::Render&& args)
+			{
+				vector<size_t> indices;
+				for(int time : args.times) {
+					args.track.active(time, indices);
+					if(indices.empty())
+						continue;
+
+					vector<Subtitle> subs;
+					for(size_t i : indices)
+						subs.push_back(args.track.at(i));
+					Subtitle sub = composite(subs);
+					CacheKey key = make_key(sub);
+
+					Dimension dvd_layer;
+					unsigned int generation;
+					{
+						std::lock_guard<std::mutex> lock(m_render_lock);
+						if(m_cache.contains(key))
+							continue;
+						dvd_layer = m_dvd_layer_size;
+						generation = m_cache_generation;
+					}
+
+					shared_ptr<PreparedImage> image = render(m_ahead_draw, sub, dvd_layer);
+					if(!image)
+						continue;
+
+					// not if the cache was cleared for a new DVD layer meanwhile
+					std::lock_guard<std::mutex> lock(m_render_lock);
+					if(generation == m_cache_generation && !m_cache.contains(key))
+						m_cache.put(key, image);
+				}
+			},
+			[&](RenderAheadMessage::Stop&&)
+			{
+				exit = true;
+			});
+	}
+}
 
+shared_ptr<SubtitleRenderer::PreparedImage> SubtitleRenderer::make_subtitle_image(DrawState &state,
+	vector<vector<SubtitleText> > &parsed_lines)
+{
 	// Limit the number of line
 	int no_of_lines = parsed_lines.size();
 	if(no_of_lines > m_max_lines) no_of_lines = m_max_lines;
 
+	// Only allocate the rows we draw on: the lines themselves, plus room
+	// above the top line for accents and the outline
+	int layer_height = subtitleLayer->getSourceHeight();
+	int band_y = layer_height - no_of_lines * (m_font_size + m_padding) - 2 * m_padding;
+	if(band_y < 0) band_y = 0;
+
+	// create surface
+	cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+		subtitleLayer->getSourceWidth(), layer_height - band_y);
+	shared_ptr<PreparedImage> image = make_shared<PreparedImage>(surface, band_y);
+	state.cr = cairo_create(surface);
+
+	// draw using layer coordinates
+	cairo_translate(state.cr, 0, -band_y);
+
+	// Reset font control vars as no font or drawing dolour has been set
+	state.current_font = -500;
+	state.color = -500;
+
+	// cursor y position
+	int cursor_y_position = layer_height - m_padding;
+
 	for(int i = no_of_lines - 1; i > -1; i--) {
 		int box_width = (m_padding * 2);
 		int text_parts = parsed_lines[i].size();
@@ -247,30 +476,27 @@ void SubtitleRenderer::make_subtitle_image(vector<vector<SubtitleText> > &parsed
 		int cursor_x_position = 0;
 
 		for(int j = 0; j < text_parts; j++) {
-			set_font(parsed_lines[i][j].font);
-
 			// prepare font glyphs
-			cairo_status_t status = cairo_scaled_font_text_to_glyphs(
-					cairo_get_scaled_font(m_cr),
-					cursor_x_position + m_padding,
-					cursor_y_position - (m_padding / 4),
-					parsed_lines[i][j].text.c_str(), -1,
-					&parsed_lines[i][j].glyphs,
-					&parsed_lines[i][j].num_glyphs,
-					NULL, NULL, NULL);
-
-			if (status != CAIRO_STATUS_SUCCESS)
-				return;
-
-			// calculate font extents
-			cairo_text_extents_t extents;
-			cairo_glyph_extents (m_cr,
-				parsed_lines[i][j].glyphs,
-				parsed_lines[i][j].num_glyphs,
-				&extents);
-
-			cursor_x_position += extents.x_advance;
-			box_width += extents.x_advance;
+			const GlyphRun *run = get_glyph_run(state, parsed_lines[i][j].text, parsed_lines[i][j].font);
+
+			if (!run) {
+				cairo_destroy(state.cr);
+				return NULL;
+			}
+
+			// position glyphs
+			double x = cursor_x_position + m_padding;
+			double y = cursor_y_position - (m_padding / 4);
+
+			vector<cairo_glyph_t> &glyphs = parsed_lines[i][j].glyphs;
+			glyphs = run->glyphs;
+			for(cairo_glyph_t &g : glyphs) {
+				g.x += x;
+				g.y += y;
+			}
+
+			cursor_x_position += run->extents.x_advance;
+			box_width += run->extents.x_advance;
 		}
 
 		// aligned text
@@ -278,9 +504,8 @@ void SubtitleRenderer::make_subtitle_image(vector<vector<SubtitleText> > &parsed
 			cursor_x_position = (subtitleLayer->getSourceWidth() / 2) - (box_width / 2);
 
 			for(int j = 0; j < text_parts; j++) {
-				cairo_glyph_t *p = parsed_lines[i][j].glyphs;
-				for(int h = 0; h < parsed_lines[i][j].num_glyphs; h++, p++) {
-					p->x +=cursor_x_position;
+				for(cairo_glyph_t &g : parsed_lines[i][j].glyphs) {
+					g.x += cursor_x_position;
 				}
 			}
 		} else {
@@ -289,47 +514,50 @@ void SubtitleRenderer::make_subtitle_image(vector<vector<SubtitleText> > &parsed
 
 		// draw ghost box
 		if(m_ghost_box) {
-			set_color(-2);
-			cairo_rectangle(m_cr, cursor_x_position, cursor_y_position - m_font_size, box_width,
+			set_color(state, -2);
+			cairo_rectangle(state.cr, cursor_x_position, cursor_y_position - m_font_size, box_width,
 				m_font_size + m_padding);
-			cairo_fill(m_cr);
+			cairo_fill(state.cr);
 		}
 
 		for(int j = 0; j < text_parts; j++) {
-			set_font(parsed_lines[i][j].font);
-			set_color(parsed_lines[i][j].color);
+			set_font(state, parsed_lines[i][j].font);
+			set_color(state, parsed_lines[i][j].color);
 
 			// draw text
-			cairo_glyph_path(m_cr, parsed_lines[i][j].glyphs, parsed_lines[i][j].num_glyphs);
-
-			// free glyph array
-			cairo_glyph_free(parsed_lines[i][j].glyphs);
+			cairo_glyph_path(state.cr, parsed_lines[i][j].glyphs.data(), parsed_lines[i][j].glyphs.size());
 		}
 
 		// draw black text outline
-		cairo_fill_preserve(m_cr);
-		set_color(0);
-		cairo_set_line_width(m_cr, 2);
-		cairo_stroke(m_cr);
+		cairo_fill_preserve(state.cr);
+		set_color(state, 0);
+		cairo_set_line_width(state.cr, 2);
+		cairo_stroke(state.cr);
 
 		// next line
 		cursor_y_position -= m_font_size + m_padding;
 	}
 
-	cairo_image_data = cairo_image_surface_get_data(m_surface);
-	m_prepared_from_text = true;
+	cairo_destroy(state.cr);
+	state.cr = NULL;
+	cairo_surface_flush(surface);
+
+	return image;
 }
 
 
-void SubtitleRenderer::make_subtitle_image(Subtitle &sub)
+shared_ptr<SubtitleRenderer::PreparedImage> SubtitleRenderer::make_subtitle_image(Subtitle &sub, Dimension dvd_layer)
 {
 	unsigned char *p;
 
-	// Subtitles which exceed dimensions are ignored
-	if(sub.image.rect.x + sub.image.rect.width  > dvdSubLayer->getSourceWidth() || sub.image.rect.y + sub.image.rect.height  > dvdSubLayer->getSourceHeight())
-	  return;
+	// Subtitles which exceed dimensions are ignored, as are all of them
+	// without a layer
+	if(sub.image.rect.x + sub.image.rect.width  > dvd_layer.width || sub.image.rect.y + sub.image.rect.height  > dvd_layer.height)
+	  return NULL;
 
-	p = other_image_data = (unsigned char *)malloc(dvdSubLayer->getSourceWidth() * dvdSubLayer->getSourceHeight());
+	// Only the rows covered by the subtitle are stored
+	unsigned char *data = (unsigned char *)malloc(dvd_layer.width * sub.image.rect.height);
+	p = data;
 
 	auto mem_set = [&p](int num_pixels)
 	{
@@ -343,11 +571,7 @@ void SubtitleRenderer::make_subtitle_image(Subtitle &sub)
 		p += len;
 	};
 
-	int right_padding  = dvdSubLayer->getSourceWidth()  - sub.image.rect.width  - sub.image.rect.x;
-	int bottom_padding = dvdSubLayer->getSourceHeight() - sub.image.rect.height - sub.image.rect.y;
-
-	// blanks char at top
-	mem_set(sub.image.rect.y * dvdSubLayer->getSourceWidth());
+	int right_padding  = dvd_layer.width  - sub.image.rect.width  - sub.image.rect.x;
 
 	for(int j = 0; j < sub.image.rect.height; j++) {
 		mem_set(sub.image.rect.x);
@@ -355,23 +579,23 @@ void SubtitleRenderer::make_subtitle_image(Subtitle &sub)
 		mem_set(right_padding);
 	}
 
-	// blanks char at bottom
-	mem_set(bottom_padding * dvdSubLayer->getSourceWidth());
-
-	m_prepared_from_image = true;
+	return make_shared<PreparedImage>(data, sub.image.rect.y, sub.image.rect.height);
 }
 
 void SubtitleRenderer::show_next()
 {
-	if(m_prepared_from_image) {
+	if(!m_prepared) return;
+
+	if(m_prepared->is_image()) {
 		subtitleLayer->hideElement();
-		dvdSubLayer->setImageData(other_image_data);
-		unprepare();
-	} else if(m_prepared_from_text) {
+		dvdSubLayer->setImageData(m_prepared->get_data(),
+			m_prepared->get_y(), m_prepared->get_height());
+	} else {
 		if(dvdSubLayer) dvdSubLayer->hideElement();
-		subtitleLayer->setImageData(cairo_image_data);
-		unprepare();
+		subtitleLayer->setImageData(m_prepared->get_data(),
+			m_prepared->get_y(), m_prepared->get_height());
 	}
+	unprepare();
 }
 
 void SubtitleRenderer::hide()
@@ -388,106 +612,56 @@ void SubtitleRenderer::clear()
 
 void SubtitleRenderer::unprepare()
 {
-	if(m_prepared_from_image) {
-		free(other_image_data);
-		m_prepared_from_image = false;
-	}
-
-	if(m_prepared_from_text) {
-		cairo_destroy(m_cr);
-		cairo_surface_destroy(m_surface);
-		m_prepared_from_text = false;
-	}
+	// the image itself is freed once it drops out of the cache
+	m_prepared.reset();
 }
 
-// Tag parser functions
-void SubtitleRenderer::parse_lines(vector<string> &text_lines)
+shared_ptr<SubtitleRenderer::PreparedImage> SubtitleRenderer::parse_lines(DrawState &state, vector<string> &text_lines)
 {
 	vector<vector<SubtitleText> > formatted_lines(text_lines.size());
 
-	bool bold = false, italic = false;
-	int color = -1;
+	SubtitleTags tags;
 
 	for(uint i=0; i < text_lines.size(); i++) {
 		boost::algorithm::trim(text_lines[i]);
 
-		int pos = 0, old_pos = 0;
+		const char *line = text_lines[i].data();
+		tags.start(line, line + text_lines[i].length());
 
-		int line_length = text_lines[i].length();
-		while (pos < line_length) {
-			pos = m_tags->RegFind(text_lines[i].c_str(), pos);
-
-			//parse text
-			if(pos != old_pos) {
-				string t = text_lines[i].substr(old_pos, pos - old_pos);
-				int font = italic ? ITALIC_FONT : (bold ? BOLD_FONT : NORMAL_FONT);
-				formatted_lines[i].emplace_back(move(t), font, color);
-			}
-
-			// No more tags found
-			if(pos < 0) break;
-
-			// Parse Tag
-			string fullTag = m_tags->GetMatch(0);
-			boost::algorithm::to_lower(fullTag);
-			pos += fullTag.length();
-			old_pos = pos;
-
-			if (fullTag == "<b>" || fullTag == "{\\b1}") {
-				bold = true;
-			} else if ((fullTag == "</b>" || fullTag == "{\\b0}") && bold) {
-				bold = false;
-			} else if (fullTag == "<i>" || fullTag == "{\\i1}") {
-				italic = true;
-			} else if ((fullTag == "</i>" || fullTag == "{\\i0}") && italic) {
-				italic = false;
-			} else if ((fullTag == "</font>" || fullTag == "{\\c}") && color != -1) {
-				color = -1;
-			} else if (fullTag.substr(0,5) == "<font") {
-				if(m_font_color_html->RegFind(fullTag.c_str(), 5) >= 0) {
-					color = hex2int(m_font_color_html->GetMatch(1).c_str());
-				}
-			} else if(m_font_color_curly->RegFind(fullTag.c_str(), 0) >= 0) {
-				string t = m_font_color_curly->GetMatch(3) + m_font_color_curly->GetMatch(2)
-					+ m_font_color_curly->GetMatch(1);
-				color = hex2int(t.c_str());
-			}
+		const char *text, *text_end;
+		while(tags.next(text, text_end)) {
+			int font = tags.italic ? ITALIC_FONT : (tags.bold ? BOLD_FONT : NORMAL_FONT);
+			formatted_lines[i].emplace_back(string(text, text_end), font, tags.color);
 		}
 	}
 
-	make_subtitle_image(formatted_lines);
-}
-
-// expects 6 lowercase, digit hex string
-int SubtitleRenderer::hex2int(const char *hex)
-{
-	int r = 0;
-	for(int i = 0, f = 20; i < 6; i++, f -= 4)
-		if(hex[i] >= 'a')
-			r += (hex[i] - 87) << f;
-		else
-			r += (hex[i] - 48) << f;
-
-	return r;
+	return make_subtitle_image(state, formatted_lines);
 }
 
 SubtitleRenderer::~SubtitleRenderer()
 {
-	//destroy cairo surface, if defined
+	if(m_render_ahead_thread.Running()) {
+		m_render_ahead_mailbox.send(RenderAheadMessage::Stop{});
+		m_render_ahead_thread.StopThread();
+	}
+
+	CLog::Log(LOGDEBUG, "SubtitleRenderer: image cache %u hits %u misses, "
+		"glyph cache %u hits %u misses (%.0f%%), %u bytes",
+		(unsigned)m_cache.hits(), (unsigned)m_cache.misses(),
+		(unsigned)m_draw.glyph_cache.hits(), (unsigned)m_draw.glyph_cache.misses(),
+		m_draw.glyph_cache.hit_rate() * 100, (unsigned)m_draw.glyph_cache.cost());
+
+	// free rendered images
 	unprepare();
+	m_cache.clear();
 
 	// remove DispmanX layer
 	delete subtitleLayer;
 	if(dvdSubLayer) delete dvdSubLayer;
-	DispmanxLayer::closeDisplay();
+	delete m_display;
 
 	// destroy cairo fonts
 	cairo_scaled_font_destroy(m_normal_font_scaled);
 	cairo_scaled_font_destroy(m_italic_font_scaled);
 	cairo_scaled_font_destroy(m_bold_font_scaled);
-
-	//delete regexes
-	delete m_tags;
-	delete m_font_color_html;
-	delete m_font_color_curly;
 }
@@ -20,21 +20,28 @@
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <mutex>
 
 #include <cairo.h>
 
+#include "OMXThread.h"
 #include "utils/simple_geometry.h"
+#include "utils/LruCache.h"
+#include "utils/Mailbox.h"
 #include "Subtitle.h"
+#include "SubtitleTrack.h"
 
-class CRegExp;
-class DispmanxLayer;
+class SubtitleLayer;
+class SubtitleDisplay;
 using namespace std;
 
 class SubtitleRenderer {
 	public:
 		SubtitleRenderer(const SubtitleRenderer&) = delete;
 		SubtitleRenderer& operator=(const SubtitleRenderer&) = delete;
-		SubtitleRenderer(int display, int layer,
+		// Takes ownership of display
+		SubtitleRenderer(SubtitleDisplay *display,
 						float r_font_size,
 						bool centered,
 						bool box_opacity,
@@ -52,9 +59,98 @@ class SubtitleRenderer {
 		void unprepare();
 		void clear();
 
+		// Queue what shows at upcoming times to be rendered ahead of time
+		// by a low priority thread, only the first RENDER_AHEAD times are
+		// used. The subtitles are looked up and combined on that thread,
+		// in a copy of track which shares its segments.
+		void render_ahead(const SubtitleTrack &track, vector<int> times);
+		static const int RENDER_AHEAD = 4;
+
+		// Combines subtitles showing at the same time into one
+		Subtitle composite(vector<Subtitle> &subs);
+
 	private:
-		DispmanxLayer *subtitleLayer;
-		DispmanxLayer *dvdSubLayer;
+		SubtitleDisplay *m_display;
+		SubtitleLayer *subtitleLayer;
+		SubtitleLayer *dvdSubLayer;
+
+		// A rendered subtitle ready to be copied to a layer. Only the band
+		// of rows starting at y which has been drawn on is stored.
+		class PreparedImage
+		{
+			public:
+				PreparedImage(cairo_surface_t *surface, int y);
+				PreparedImage(unsigned char *data, int y, int height);
+				~PreparedImage();
+
+				PreparedImage(const PreparedImage&) = delete;
+				PreparedImage& operator=(const PreparedImage&) = delete;
+
+				unsigned char *get_data();
+				int get_y() { return m_y; }
+				int get_height() { return m_height; }
+				bool is_image() { return m_surface == NULL; }
+
+			private:
+				cairo_surface_t *m_surface;
+				unsigned char *m_data;
+				int m_y;
+				int m_height;
+		};
+
+		struct CacheKey
+		{
+			int start;
+			int stop;
+			size_t hash;
+
+			bool operator<(const CacheKey &other) const
+			{
+				if(start != other.start) return start < other.start;
+				if(stop != other.stop) return stop < other.stop;
+				return hash < other.hash;
+			}
+		};
+
+		static CacheKey make_key(const Subtitle &sub);
+
+		// total number of subtitles cached (upcoming and recently shown)
+		static const int CACHE_SIZE = 8;
+
+		LruCache<CacheKey, shared_ptr<PreparedImage> > m_cache;
+		shared_ptr<PreparedImage> m_prepared;
+
+		// held while accessing the cache and the DVD layer's size, never
+		// while rendering
+		std::mutex m_render_lock;
+		// the size of the DVD layer, and a count of the times the cache was
+		// cleared for a new one
+		Dimension m_dvd_layer_size;
+		unsigned int m_cache_generation;
+
+		class RenderAheadThread : public OMXThread
+		{
+			public:
+				explicit RenderAheadThread(SubtitleRenderer *owner) : m_owner(owner) {}
+				void Process() override { m_owner->render_ahead_loop(); }
+			private:
+				SubtitleRenderer *m_owner;
+		};
+
+		struct RenderAheadMessage {
+			struct Render
+			{
+				SubtitleTrack track;
+				vector<int> times;
+			};
+			struct Stop {};
+		};
+
+		void render_ahead_loop();
+
+		RenderAheadThread m_render_ahead_thread;
+		Mailbox<RenderAheadMessage::Render,
+				RenderAheadMessage::Stop> m_render_ahead_mailbox;
 
 		class SubtitleText
 		{
@@ -63,8 +159,7 @@ class SubtitleRenderer {
 				int font;
 				int color;
 
-				cairo_glyph_t *glyphs = NULL;
-				int num_glyphs = -1;
+				vector<cairo_glyph_t> glyphs;
 
 				SubtitleText(string t, int f, int c)
 				: text(t), font(f), color(c)
@@ -72,17 +167,57 @@ class SubtitleRenderer {
 				};
 		};
 
-		void parse_lines(vector<string> &text_lines);
-		void make_subtitle_image(vector<vector<SubtitleText> > &parsed_lines);
-		void make_subtitle_image(Subtitle &sub);
-		int hex2int(const char *hex);
+		// Shaped text, positioned relative to the origin
+		struct GlyphRun
+		{
+			vector<cairo_glyph_t> glyphs;
+			cairo_text_extents_t extents;
+		};
 
-		CRegExp *m_tags;
-		CRegExp *m_font_color_html;
-		CRegExp *m_font_color_curly;
+		struct GlyphKey
+		{
+			string text;
+			int font;
+			int size;
+
+			bool operator<(const GlyphKey &other) const
+			{
+				if(font != other.font) return font < other.font;
+				if(size != other.size) return size < other.size;
+				return text < other.text;
+			}
+		};
 
-		void set_font(int new_font_type);
-		void set_color(int new_color);
+		// memory cap for each glyph run cache
+		static const size_t GLYPH_CACHE_BYTES = 256 * 1024;
+
+		// What a thread draws text with. The prepare() caller and the
+		// render-ahead thread each have their own, so they render at the
+		// same time; the fonts and colour patterns they use are shared.
+		struct DrawState
+		{
+			explicit DrawState(size_t glyph_cache_bytes)
+			: cr(NULL), current_font(-500), color(-500), glyph_cache(glyph_cache_bytes) {}
+
+			cairo_t *cr;
+			int current_font;
+			int color;
+			LruCache<GlyphKey, GlyphRun> glyph_cache;
+		};
+
+		DrawState m_draw;
+		DrawState m_ahead_draw;
+
+		shared_ptr<PreparedImage> render(DrawState &state, Subtitle &sub, Dimension dvd_layer);
+		shared_ptr<PreparedImage> parse_lines(DrawState &state, vector<string> &text_lines);
+		shared_ptr<PreparedImage> make_subtitle_image(DrawState &state, vector<vector<SubtitleText> > &parsed_lines);
+		shared_ptr<PreparedImage> make_subtitle_image(Subtitle &sub, Dimension dvd_layer);
+
+		const GlyphRun *get_glyph_run(DrawState &state, const string &text, int font);
+
+		cairo_scaled_font_t *get_scaled_font(int font_type);
+		void set_font(DrawState &state, int new_font_type);
+		void set_color(DrawState &state, int new_color);
 
 		enum {
 			NORMAL_FONT,
@@ -90,15 +225,6 @@ class SubtitleRenderer {
 			BOLD_FONT,
 		};
 
-		bool m_prepared_from_image = false;
-		bool m_prepared_from_text = false;
-		unsigned char *cairo_image_data;
-		unsigned char *other_image_data;
-
-		// cairo stuff
-		cairo_surface_t *m_surface;
-		cairo_t *m_cr;
-
 		// fonts
 		cairo_scaled_font_t *m_normal_font_scaled;
 		cairo_scaled_font_t *m_italic_font_scaled;
@@ -116,6 +242,4 @@ class SubtitleRenderer {
 		// font properties
 		int m_padding;
 		int m_font_size;
-		int m_current_font;
-		int m_color;
 };
@@ -0,0 +1,175 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <cctype>
+#include <cstring>
+
+#include "SubtitleTags.h"
+
+namespace {
+
+// Case insensitive comparison with a lowercase literal
+bool starts_with(const char *p, const char *end, const char *lit)
+{
+	for(; *lit; p++, lit++)
+		if(p == end || tolower((unsigned char)*p) != *lit)
+			return false;
+	return true;
+}
+
+bool equals(const char *p, const char *end, const char *lit)
+{
+	return (size_t)(end - p) == strlen(lit) && starts_with(p, end, lit);
+}
+
+bool parse_hex(const char *p, const char *end, int digits, int &value)
+{
+	if(end - p < digits)
+		return false;
+
+	int v = 0;
+	for(int i = 0; i < digits; i++) {
+		char c = tolower((unsigned char)p[i]);
+		if(c >= '0' && c <= '9')
+			v = (v << 4) | (c - '0');
+		else if(c >= 'a' && c <= 'f')
+			v = (v << 4) | (c - 'a' + 10);
+		else
+			return false;
+	}
+	value = v;
+	return true;
+}
+
+// color[ \t]*=[ \t"']*#?rrggbb anywhere in the tag
+bool parse_html_color(const char *p, const char *end, int &color)
+{
+	for(; p < end; p++) {
+		if(!starts_with(p, end, "color"))
+			continue;
+
+		const char *q = p + 5;
+		while(q < end && (*q == ' ' || *q == '\t'))
+			q++;
+		if(q == end || *q != '=')
+			continue;
+		q++;
+		while(q < end && (*q == ' ' || *q == '\t' || *q == '"' || *q == '\''))
+			q++;
+		if(q < end && *q == '#')
+			q++;
+
+		if(parse_hex(q, end, 6, color))
+			return true;
+	}
+	return false;
+}
+
+// the whole tag is {\c&hbbggrr&}
+bool parse_curly_color(const char *p, const char *end, int &color)
+{
+	int b, g, r;
+	if(end - p != 13 || !starts_with(p, end, "{\\c&h") ||
+		!parse_hex(p + 5, end, 2, b) ||
+		!parse_hex(p + 7, end, 2, g) ||
+		!parse_hex(p + 9, end, 2, r) ||
+		!equals(p + 11, end, "&}"))
+		return false;
+
+	color = (r << 16) | (g << 8) | b;
+	return true;
+}
+
+}
+
+void SubtitleTags::start(const char *line, const char *end)
+{
+	m_pos = line;
+	m_end = end;
+	m_tag = NULL;
+	m_tag_end = NULL;
+	m_no_html = false;
+	m_no_curly = false;
+}
+
+bool SubtitleTags::next(const char *&text, const char *&text_end)
+{
+	while(m_pos < m_end) {
+		const char *tag = m_tag, *tag_end = m_tag_end;
+		if(tag != m_pos) {
+			tag_end = m_end;
+			tag = find_tag(m_pos, tag_end);
+		}
+		m_tag = NULL;
+
+		if(tag != m_pos) {
+			text = m_pos;
+			text_end = tag;
+			m_pos = tag;
+			m_tag = tag;
+			m_tag_end = tag_end;
+			return true;
+		}
+
+		apply_tag(tag, tag_end);
+		m_pos = tag_end;
+	}
+	return false;
+}
+
+// Tags are <...> or {\...}. Returns the start of the first tag at or after
+// p, or m_end if there isn't one.
+const char *SubtitleTags::find_tag(const char *p, const char *&tag_end)
+{
+	for(; p < m_end; p++) {
+		if(*p == '<' && !m_no_html) {
+			const char *close = (const char *)memchr(p + 1, '>', m_end - p - 1);
+			if(close) {
+				tag_end = close + 1;
+				return p;
+			}
+			m_no_html = true;
+		} else if(*p == '{' && !m_no_curly && p + 1 < m_end && p[1] == '\\') {
+			const char *close = (const char *)memchr(p + 2, '}', m_end - p - 2);
+			if(close) {
+				tag_end = close + 1;
+				return p;
+			}
+			m_no_curly = true;
+		}
+	}
+	return m_end;
+}
+
+void SubtitleTags::apply_tag(const char *tag, const char *tag_end)
+{
+	if(equals(tag, tag_end, "<b>") || equals(tag, tag_end, "{\\b1}")) {
+		bold = true;
+	} else if((equals(tag, tag_end, "</b>") || equals(tag, tag_end, "{\\b0}")) && bold) {
+		bold = false;
+	} else if(equals(tag, tag_end, "<i>") || equals(tag, tag_end, "{\\i1}")) {
+		italic = true;
+	} else if((equals(tag, tag_end, "</i>") || equals(tag, tag_end, "{\\i0}")) && italic) {
+		italic = false;
+	} else if((equals(tag, tag_end, "</font>") || equals(tag, tag_end, "{\\c}")) && color != -1) {
+		color = -1;
+	} else if(starts_with(tag, tag_end, "<font")) {
+		parse_html_color(tag + 5, tag_end, color);
+	} else {
+		parse_curly_color(tag, tag_end, color);
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <cstddef>
+
+// Splits subtitle lines into runs of text between formatting tags. The html
+// tags <b>, <i> and <font color=...> and the ASS tags {\b1}, {\i1} and
+// {\c&Hbbggrr&} are understood, any other tag is dropped. Tags are matched
+// case-insensitively and a line is scanned in a single pass, without
+// allocating.
+class SubtitleTags
+{
+	public:
+		SubtitleTags()
+		: bold(false), italic(false), color(-1),
+		  m_pos(NULL), m_end(NULL), m_tag(NULL), m_tag_end(NULL),
+		  m_no_html(false), m_no_curly(false)
+		{
+		}
+
+		// Starts on the next line, the formatting carries on from the last
+		void start(const char *line, const char *end);
+
+		// Finds the next run of text and applies the tags before it.
+		// Returns false at the end of the line.
+		bool next(const char *&text, const char *&text_end);
+
+		// formatting of the last run returned
+		bool bold;
+		bool italic;
+		int color; // 0xrrggbb, -1 for the default
+
+	private:
+		const char *m_pos;
+		const char *m_end;
+		// the tag ending the last run, applied before the next one
+		const char *m_tag;
+		const char *m_tag_end;
+		// Once a kind of tag can't be closed any more on the line it stops
+		// being looked for
+		bool m_no_html;
+		bool m_no_curly;
+
+		const char *find_tag(const char *p, const char *&tag_end);
+		void apply_tag(const char *tag, const char *tag_end);
+};
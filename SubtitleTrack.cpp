@@ -0,0 +1,318 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "SubtitleTrack.h"
+#include "Subtitle.h"
+
+using namespace std;
+
+SubtitleTrack::SubtitleTrack()
+: SubtitleTrack(-1)
+{
+}
+
+SubtitleTrack::SubtitleTrack(int retention)
+: m_leaves(0),
+  m_first(0),
+  m_size(0),
+  m_memory(0),
+  m_retention(retention)
+{
+}
+
+size_t SubtitleTrack::push_back(const Subtitle &sub)
+{
+  size_t evicted = 0;
+  if(m_retention >= 0)
+  {
+    while(m_size > 0 && stop(0) < sub.start - m_retention)
+    {
+      pop_front();
+      evicted++;
+    }
+  }
+
+  if(m_segments.empty() || m_segments.back()->entries.size() == SEGMENT_SIZE)
+  {
+    m_segments.push_back(make_shared<Segment>());
+    m_segments.back()->entries.reserve(SEGMENT_SIZE);
+    m_memory += m_segments.back()->memory_usage();
+  }
+
+  Segment &seg = writable_back();
+  size_t old_memory = seg.memory_usage();
+
+  Entry e;
+  e.start = sub.start;
+  e.stop = sub.stop;
+  e.offset = seg.data.size();
+  e.is_image = sub.isImage;
+  e.rle = false;
+
+  if(sub.isImage)
+  {
+    e.rect = sub.image.rect;
+    e.rle = rle_encode(sub.image.data, seg.data);
+    if(!e.rle)
+      seg.data.append((const char *)sub.image.data.data(), sub.image.data.size());
+  }
+  else
+  {
+    e.rect = {0, 0, 0, 0};
+    for(size_t i = 0; i < sub.text_lines.size(); i++)
+    {
+      if(i > 0) seg.data.push_back('\n');
+      seg.data.append(sub.text_lines[i]);
+    }
+  }
+
+  e.length = seg.data.size() - e.offset;
+  seg.entries.push_back(e);
+  m_size++;
+
+  if(e.stop > seg.max_stop)
+  {
+    seg.max_stop = e.stop;
+    update_tree(m_segments.size() - 1);
+  }
+
+  m_memory += seg.memory_usage() - old_memory;
+
+  return evicted;
+}
+
+Subtitle SubtitleTrack::at(size_t i) const
+{
+  size_t n = i + m_first;
+  const Segment &seg = *m_segments[n / SEGMENT_SIZE];
+  const Entry &e = seg.entries[n % SEGMENT_SIZE];
+  const char *p = seg.data.data() + e.offset;
+
+  Subtitle sub(e.is_image);
+  sub.start = e.start;
+  sub.stop = e.stop;
+
+  if(e.is_image)
+  {
+    sub.image.rect = e.rect;
+    if(e.rle)
+      rle_decode(p, e.length, sub.image.data);
+    else
+      sub.image.data.assign((const unsigned char *)p, e.length);
+  }
+  else
+  {
+    const char *end = p + e.length;
+    while(p < end)
+    {
+      const char *nl = std::find(p, end, '\n');
+      sub.text_lines.emplace_back(p, nl);
+      p = nl + 1;
+    }
+  }
+
+  return sub;
+}
+
+size_t SubtitleTrack::upper_bound(int time) const
+{
+  size_t lo = 0, hi = m_size;
+  while(lo < hi)
+  {
+    size_t mid = lo + (hi - lo) / 2;
+    if(start(mid) > time)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return lo;
+}
+
+void SubtitleTrack::active(int time, vector<size_t> &indices) const
+{
+  indices.clear();
+
+  // only those which have started can be showing
+  size_t end = upper_bound(time);
+  if(end == 0)
+    return;
+
+  size_t last = (end - 1 + m_first) / SEGMENT_SIZE;
+  vector<size_t> segments;
+  find_segments(1, 0, m_leaves, last, time, segments);
+
+  for(size_t s : segments)
+  {
+    const Segment &seg = *m_segments[s];
+    size_t from = s == 0 ? m_first : 0;
+    for(size_t j = from; j < seg.entries.size(); j++)
+    {
+      size_t i = s * SEGMENT_SIZE + j - m_first;
+      if(i >= end)
+        break;
+      if(seg.entries[j].stop > time)
+        indices.push_back(i);
+    }
+  }
+}
+
+int SubtitleTrack::next_change(int time) const
+{
+  size_t next = upper_bound(time);
+  int change = next < m_size ? start(next) : INT_MAX;
+
+  vector<size_t> indices;
+  active(time, indices);
+  for(size_t i : indices)
+    change = min(change, stop(i));
+
+  return change;
+}
+
+// Segments up to last with a subtitle stopping after time, in order
+void SubtitleTrack::find_segments(size_t node, size_t lo, size_t hi, size_t last,
+                                  int time, vector<size_t> &segments) const
+{
+  if(lo > last || m_tree[node] <= time)
+    return;
+
+  if(hi - lo == 1)
+  {
+    segments.push_back(lo);
+    return;
+  }
+
+  size_t mid = lo + (hi - lo) / 2;
+  find_segments(2 * node, lo, mid, last, time, segments);
+  find_segments(2 * node + 1, mid, hi, last, time, segments);
+}
+
+void SubtitleTrack::update_tree(size_t segment)
+{
+  if(segment >= m_leaves)
+  {
+    rebuild_tree();
+    return;
+  }
+
+  size_t n = m_leaves + segment;
+  m_tree[n] = m_segments[segment]->max_stop;
+  for(n /= 2; n > 0; n /= 2)
+    m_tree[n] = max(m_tree[2 * n], m_tree[2 * n + 1]);
+}
+
+void SubtitleTrack::rebuild_tree()
+{
+  m_leaves = 1;
+  while(m_leaves < m_segments.size())
+    m_leaves *= 2;
+
+  m_tree.assign(2 * m_leaves, INT_MIN);
+  for(size_t i = 0; i < m_segments.size(); i++)
+    m_tree[m_leaves + i] = m_segments[i]->max_stop;
+  for(size_t n = m_leaves - 1; n > 0; n--)
+    m_tree[n] = max(m_tree[2 * n], m_tree[2 * n + 1]);
+}
+
+void SubtitleTrack::clear()
+{
+  m_segments.clear();
+  m_tree.clear();
+  m_leaves = 0;
+  m_first = 0;
+  m_size = 0;
+  m_memory = 0;
+}
+
+void SubtitleTrack::swap(SubtitleTrack &other)
+{
+  m_segments.swap(other.m_segments);
+  m_tree.swap(other.m_tree);
+  std::swap(m_leaves, other.m_leaves);
+  std::swap(m_first, other.m_first);
+  std::swap(m_size, other.m_size);
+  std::swap(m_memory, other.m_memory);
+  std::swap(m_retention, other.m_retention);
+}
+
+// Segments shared with another copy are immutable, so the last segment is
+// cloned before it's appended to. Only the owner of a track copies it, so
+// a use count of one can't go up behind our back.
+SubtitleTrack::Segment &SubtitleTrack::writable_back()
+{
+  shared_ptr<Segment> &seg = m_segments.back();
+  if(seg.use_count() > 1)
+  {
+    m_memory -= seg->memory_usage();
+    seg = make_shared<Segment>(*seg);
+    seg->entries.reserve(SEGMENT_SIZE);
+    m_memory += seg->memory_usage();
+  }
+  return *seg;
+}
+
+void SubtitleTrack::pop_front()
+{
+  m_first++;
+  m_size--;
+
+  // drop the segment once all its entries have gone
+  if(m_first == SEGMENT_SIZE || m_size == 0)
+  {
+    m_memory -= m_segments.front()->memory_usage();
+    m_segments.pop_front();
+    m_first = 0;
+
+    // segment indices have moved
+    rebuild_tree();
+  }
+}
+
+// DVD subtitles use 4 colours so each byte is stored as a run:
+// two bits of colour and six bits of (length - 1). Returns false
+// leaving out untouched if the bitmap uses other colours.
+bool SubtitleTrack::rle_encode(const basic_string<unsigned char> &in, string &out)
+{
+  for(unsigned char c : in)
+    if(c > 3) return false;
+
+  size_t i = 0;
+  while(i < in.size())
+  {
+    unsigned char c = in[i];
+    size_t run = 1;
+    while(run < 64 && i + run < in.size() && in[i + run] == c)
+      run++;
+
+    out.push_back((char)((c << 6) | (run - 1)));
+    i += run;
+  }
+  return true;
+}
+
+void SubtitleTrack::rle_decode(const char *in, size_t len, basic_string<unsigned char> &out)
+{
+  for(size_t i = 0; i < len; i++)
+  {
+    unsigned char b = in[i];
+    out.append((b & 63) + 1, b >> 6);
+  }
+}
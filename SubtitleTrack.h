@@ -0,0 +1,134 @@
+#pragma once
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <limits.h>
+
+#include "Subtitle.h"
+#include "utils/simple_geometry.h"
+
+// Compact storage for a timeline of subtitles. Subtitles are stored in
+// segments of up to SEGMENT_SIZE entries, each with its own arena holding
+// the text (lines joined with '\n') or the run length encoded bitmaps of
+// its entries. Subtitles are expanded back into Subtitle objects by at().
+//
+// Subtitles are expected to be added in order of start time, and may
+// overlap. Those which stopped more than retention ms before the start of
+// the newest one are evicted, a negative retention keeps everything.
+//
+// The largest stop time of each segment is kept in a max tree over the
+// segments, so the subtitles showing at a given time are found without
+// looking at every segment which started before it.
+//
+// Segments are reference counted and shared between copies, so copying a
+// track only copies the segment pointers. A copy never changes a segment
+// another copy can see: appending to a shared segment clones it first.
+class SubtitleTrack
+{
+public:
+  SubtitleTrack();
+  explicit SubtitleTrack(int retention);
+
+  // Returns the number of subtitles evicted from the front of the track
+  size_t push_back(const Subtitle &sub);
+
+  size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+
+  int start(size_t i) const { return entry(i).start; }
+  int stop(size_t i) const { return entry(i).stop; }
+
+  Subtitle at(size_t i) const;
+
+  // Index of the first subtitle which starts after time
+  size_t upper_bound(int time) const;
+
+  // Indices of the subtitles showing at time, in order
+  void active(int time, std::vector<size_t> &indices) const;
+
+  // The first time after time at which a subtitle starts or stops, or
+  // INT_MAX if there isn't one
+  int next_change(int time) const;
+
+  void clear();
+  void swap(SubtitleTrack &other);
+
+  int get_retention() const { return m_retention; }
+  void set_retention(int retention) { m_retention = retention; }
+
+  // bytes used by entries and arenas, including segments shared with
+  // other copies
+  size_t memory_usage() const { return m_memory; }
+
+  static const size_t SEGMENT_SIZE = 64;
+
+private:
+  struct Entry
+  {
+    int start;
+    int stop;
+    uint32_t offset;
+    uint32_t length;
+    Rectangle rect;
+    bool is_image;
+    bool rle;
+  };
+
+  struct Segment
+  {
+    std::vector<Entry> entries;
+    std::string data;
+    int max_stop = INT_MIN;
+
+    size_t memory_usage() const
+    {
+      return sizeof(Segment) + entries.capacity() * sizeof(Entry) + data.capacity();
+    }
+  };
+
+  const Entry &entry(size_t i) const
+  {
+    i += m_first;
+    return m_segments[i / SEGMENT_SIZE]->entries[i % SEGMENT_SIZE];
+  }
+
+  void pop_front();
+  Segment &writable_back();
+
+  void update_tree(size_t segment);
+  void rebuild_tree();
+  void find_segments(size_t node, size_t lo, size_t hi, size_t last, int time,
+                     std::vector<size_t> &segments) const;
+
+  static bool rle_encode(const std::basic_string<unsigned char> &in, std::string &out);
+  static void rle_decode(const char *in, size_t len, std::basic_string<unsigned char> &out);
+
+  std::deque<std::shared_ptr<Segment> > m_segments;
+  // max stop of m_segments[i] at m_tree[m_leaves + i], node n holds the
+  // max of nodes 2n and 2n + 1
+  std::vector<int> m_tree;
+  size_t m_leaves;
+  size_t m_first;
+  size_t m_size;
+  size_t m_memory;
+  int m_retention;
+};
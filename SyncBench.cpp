@@ -0,0 +1,329 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+// Runs a leader and followers of ClockSync as separate processes with
+// simulated clocks. The followers start off the leader and their clocks
+// drift, the leader pauses part way through and a seek takes a while to
+// land, as the player's do. Keys pressed on the followers take the place
+// of some of the actions the sync asks for. Each follower knows the
+// leader's schedule, so it measures how far off it really is, and the
+// exit status is 1 if any follower is further off than --max-offset at
+// the end of the run.
+//
+//   sync-bench.bin [options]
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "ClockSync.h"
+#include "KeyConfig.h"
+
+using namespace std;
+
+namespace {
+  int64_t Now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+  }
+
+  // A player's clock, which drifts and waits for data after a seek
+  class SimClock : public ClockSync::Clock {
+  public:
+    SimClock(int64_t media_time, double drift_ppm)
+    : m_media_time(media_time), m_drift(drift_ppm * 1e-6), m_speed(1000),
+      m_paused(false), m_waiting_until(0), m_last(Now()) {}
+
+    int64_t MediaTime() override { Advance(); return m_media_time; }
+    int Speed() override { return m_speed; }
+    bool Waiting() override { Advance(); return Now() < m_waiting_until; }
+    void SetSpeed(int speed) override { Advance(); m_speed = speed; }
+
+    void Pause(bool paused) { Advance(); m_paused = paused; }
+    void Seek(int64_t media_time, int64_t lag) {
+      Advance();
+      m_media_time = media_time;
+      m_waiting_until = Now() + lag;
+    }
+
+  private:
+    void Advance() {
+      int64_t now = Now();
+      int64_t from = max(m_last, m_waiting_until);
+      if (!m_paused && now > from)
+        m_media_time += (int64_t)((now - from) * (m_speed / 1000.0) * (1 + m_drift));
+      m_last = now;
+    }
+
+    int64_t m_media_time;
+    double m_drift;
+    int m_speed;
+    bool m_paused;
+    int64_t m_waiting_until;
+    int64_t m_last;
+  };
+
+  struct Follower {
+    double start_offset; // seconds
+    double drift_ppm;
+  };
+
+  struct Options {
+    string address = "239.255.42.99:4243";
+    double duration = 40;
+    double pause_at = 10;
+    double pause = 2;
+    double seek_lag = 0.3;
+    double settle = 10;
+    double max_offset = 5;
+    int keys = 2;
+    vector<Follower> followers;
+  };
+
+  // The leader's media time, which starts at 0 at start and stands still
+  // while it's paused
+  int64_t LeaderTime(const Options& o, int64_t start, int64_t now) {
+    int64_t elapsed = now - start;
+    int64_t pause_start = (int64_t)(o.pause_at * 1e6), pause_end = pause_start + (int64_t)(o.pause * 1e6);
+    if (elapsed > pause_end)
+      return elapsed - (pause_end - pause_start);
+    return min(elapsed, pause_start);
+  }
+
+  bool LeaderPaused(const Options& o, int64_t start, int64_t now) {
+    int64_t elapsed = now - start;
+    return elapsed >= o.pause_at * 1e6 && elapsed < (o.pause_at + o.pause) * 1e6;
+  }
+
+  // The leader's clock follows its schedule exactly
+  class LeaderClock : public ClockSync::Clock {
+  public:
+    LeaderClock(const Options& o, int64_t start) : m_o(o), m_start(start) {}
+
+    int64_t MediaTime() override { return LeaderTime(m_o, m_start, Now()); }
+    int Speed() override { return 1000; }
+    bool Waiting() override { return false; }
+    void SetSpeed(int speed) override {}
+
+  private:
+    const Options& m_o;
+    int64_t m_start;
+  };
+
+  // the main loop checks for keys every 20 ms
+  const int64_t PASS = 20000;
+
+  int RunLeader(const Options& o, int64_t start) {
+    ClockSync sync;
+    if (!sync.Lead(o.address)) {
+      fprintf(stderr, "Unable to lead on %s\n", o.address.c_str());
+      return 1;
+    }
+
+    LeaderClock clock(o, start);
+    int64_t end = start + (int64_t)(o.duration * 1e6);
+    for (int64_t now = Now(); now < end; now = Now()) {
+      bool paused = LeaderPaused(o, start, now);
+      int64_t arg;
+      sync.Update(&clock, paused, arg);
+      usleep(PASS);
+    }
+    return 0;
+  }
+
+  int RunFollower(const Options& o, int64_t start, int index) {
+    const Follower& f = o.followers[index];
+    ClockSync sync;
+    if (!sync.Follow(o.address)) {
+      fprintf(stderr, "Unable to follow on %s\n", o.address.c_str());
+      return 1;
+    }
+
+    SimClock clock((int64_t)(f.start_offset * 1e6), f.drift_ppm);
+    bool paused = false;
+    int64_t seeks = 0, dropped = 0, measured = 0;
+    int64_t worst = 0;
+    int64_t end = start + (int64_t)(o.duration * 1e6);
+    int64_t settled = end - (int64_t)(o.settle * 1e6);
+
+    for (int actions = 0; ; ) {
+      int64_t now = Now();
+      if (now >= end)
+        break;
+
+      int64_t arg = 0;
+      int action = sync.Update(&clock, paused, arg);
+      if (action != KeyConfig::ACTION_BLANK) {
+        if (o.keys && actions++ % o.keys == 0) {
+          dropped++;
+        } else {
+          if (action == KeyConfig::ACTION_PAUSE || action == KeyConfig::ACTION_PLAY) {
+            paused = action == KeyConfig::ACTION_PAUSE;
+            clock.Pause(paused);
+          } else if (action == KeyConfig::ACTION_SEEK_ABSOLUTE) {
+            clock.Seek(arg, (int64_t)(o.seek_lag * 1e6));
+            seeks++;
+          }
+          sync.Taken(&clock);
+        }
+      }
+
+      // how far off it really is once it's had time to settle, apart from
+      // around the leader's pause
+      now = Now();
+      int64_t pause_start = start + (int64_t)(o.pause_at * 1e6);
+      int64_t pause_end = pause_start + (int64_t)((o.pause + 1) * 1e6);
+      if (now >= settled && !paused && !clock.Waiting() && (now < pause_start || now >= pause_end)) {
+        int64_t offset = clock.MediaTime() - LeaderTime(o, start, now);
+        worst = max(worst, (int64_t)llabs(offset));
+        measured++;
+      }
+
+      usleep(PASS);
+    }
+
+    bool ok = measured > 0 && worst <= o.max_offset * 1000;
+    printf("Follower %d (%+.2f s, %+.0f ppm): %s; %lld seeks, %lld actions dropped, "
+           "%s %.2f ms off over the last %.0f s\n",
+           index, f.start_offset, f.drift_ppm, sync.Stats().c_str(),
+           (long long)seeks, (long long)dropped,
+           ok ? "at most" : "FAILED,", worst * 1e-3, o.settle);
+    return ok ? 0 : 1;
+  }
+
+  void PrintUsage() {
+    printf("Usage: sync-bench.bin [options]\n"
+           "    --address a:p     Address the leader sends to (default: 239.255.42.99:4243)\n"
+           "    --follower s,ppm  Add a follower starting s seconds off the leader whose clock\n"
+           "                      drifts by ppm (default: 0.15,300 -0.4,-200 2.8,0)\n"
+           "    --duration s      Length of the run (default: 40)\n"
+           "    --pause-at s      Time the leader pauses at (default: 10)\n"
+           "    --pause s         Length of the leader's pause (default: 2)\n"
+           "    --seek-lag s      Time a seek waits for data (default: 0.3)\n"
+           "    --keys n          A key takes the place of every nth action of a follower, 0 for never (default: 2)\n"
+           "    --settle s        Length of the end of the run the offsets are checked over (default: 10)\n"
+           "    --max-offset ms   Furthest a follower may be off (default: 5)\n");
+  }
+}
+
+int main(int argc, char *argv[]) {
+  Options o;
+
+  const int address_opt    = 0x100;
+  const int follower_opt   = 0x101;
+  const int duration_opt   = 0x102;
+  const int pause_at_opt   = 0x103;
+  const int pause_opt      = 0x104;
+  const int seek_lag_opt   = 0x105;
+  const int keys_opt       = 0x106;
+  const int settle_opt     = 0x107;
+  const int max_offset_opt = 0x108;
+
+  struct option longopts[] = {
+    { "address",      required_argument,  NULL,          address_opt },
+    { "follower",     required_argument,  NULL,          follower_opt },
+    { "duration",     required_argument,  NULL,          duration_opt },
+    { "pause-at",     required_argument,  NULL,          pause_at_opt },
+    { "pause",        required_argument,  NULL,          pause_opt },
+    { "seek-lag",     required_argument,  NULL,          seek_lag_opt },
+    { "keys",         required_argument,  NULL,          keys_opt },
+    { "settle",       required_argument,  NULL,          settle_opt },
+    { "max-offset",   required_argument,  NULL,          max_offset_opt },
+    { "help",         no_argument,        NULL,          'h' },
+    { 0, 0, 0, 0 }
+  };
+
+  int c;
+  while ((c = getopt_long(argc, argv, "h", longopts, NULL)) != -1) {
+    switch (c) {
+      case address_opt:
+        o.address = optarg;
+        break;
+      case follower_opt: {
+        Follower f = { 0, 0 };
+        if (sscanf(optarg, "%lf,%lf", &f.start_offset, &f.drift_ppm) < 1) {
+          PrintUsage();
+          return 1;
+        }
+        o.followers.push_back(f);
+        break;
+      }
+      case duration_opt:
+        o.duration = max(atof(optarg), 1.0);
+        break;
+      case pause_at_opt:
+        o.pause_at = atof(optarg);
+        break;
+      case pause_opt:
+        o.pause = max(atof(optarg), 0.0);
+        break;
+      case seek_lag_opt:
+        o.seek_lag = max(atof(optarg), 0.0);
+        break;
+      case keys_opt:
+        o.keys = max(atoi(optarg), 0);
+        break;
+      case settle_opt:
+        o.settle = max(atof(optarg), 0.1);
+        break;
+      case max_offset_opt:
+        o.max_offset = atof(optarg);
+        break;
+      default:
+        PrintUsage();
+        return c == 'h' ? 0 : 1;
+    }
+  }
+
+  if (o.followers.empty())
+    o.followers = { { 0.15, 300 }, { -0.4, -200 }, { 2.8, 0 } };
+
+  // the leader starts sending once the followers have joined the group
+  int64_t start = Now() + 200000;
+  vector<pid_t> children;
+  for (int i = -1; i < (int)o.followers.size(); i++) {
+    pid_t pid = fork();
+    if (pid == -1) {
+      perror("fork");
+      return 1;
+    }
+    if (pid == 0) {
+      usleep(max(start - Now(), (int64_t)0));
+      int status = i == -1 ? RunLeader(o, start) : RunFollower(o, start, i);
+      fflush(stdout);
+      _exit(status);
+    }
+    children.push_back(pid);
+  }
+
+  int failed = 0;
+  for (pid_t pid : children) {
+    int status;
+    if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      failed++;
+  }
+  return failed ? 1 : 0;
+}
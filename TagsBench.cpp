@@ -0,0 +1,300 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+// Checks the subtitle tag parser against the regular expressions it
+// replaced, on randomly assembled lines of tags, then times both.
+//
+//   tags-bench.bin [options] [file.srt...]
+//
+// Without files the timing uses a tag-heavy ASS subtitle. The exit status
+// is 1 if the parsers disagree on any line.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "utils/RegExp.h"
+#include "SubtitleTags.h"
+#include "Subtitle.h"
+#include "Srt.h"
+
+using namespace std;
+
+namespace {
+  struct Run {
+    string text;
+    int font;   // 0 normal, 1 italic, 2 bold, as the renderer picks them
+    int color;
+
+    bool operator==(const Run& other) const {
+      return text == other.text && font == other.font && color == other.color;
+    }
+  };
+
+  typedef vector<vector<Run> > Parsed;
+
+  int Font(bool bold, bool italic) {
+    return italic ? 1 : (bold ? 2 : 0);
+  }
+
+  // The parser as it was, running the three expressions through PCRE
+  class RegexParser {
+  public:
+    RegexParser() : m_tags(true), m_font_color_html(true), m_font_color_curly(true) {
+      m_tags.RegComp("(<[^>]*>|\\{\\\\[^\\}]*\\})");
+      m_font_color_html.RegComp("color[ \\t]*=[ \\t\"']*#?([a-f0-9]{6})");
+      m_font_color_curly.RegComp("^\\{\\\\c&h([a-f0-9]{2})([a-f0-9]{2})([a-f0-9]{2})&\\}$");
+    }
+
+    Parsed Parse(const vector<string>& lines) {
+      Parsed parsed(lines.size());
+
+      bool bold = false, italic = false;
+      int color = -1;
+
+      for (size_t i = 0; i < lines.size(); i++) {
+        int pos = 0, old_pos = 0;
+
+        int line_length = lines[i].length();
+        while (pos < line_length) {
+          pos = m_tags.RegFind(lines[i].c_str(), pos);
+
+          if (pos != old_pos) {
+            Run run = { lines[i].substr(old_pos, pos - old_pos), Font(bold, italic), color };
+            parsed[i].push_back(run);
+          }
+
+          if (pos < 0) break;
+
+          string fullTag = m_tags.GetMatch(0);
+          transform(fullTag.begin(), fullTag.end(), fullTag.begin(), ::tolower);
+          pos += fullTag.length();
+          old_pos = pos;
+
+          if (fullTag == "<b>" || fullTag == "{\\b1}") {
+            bold = true;
+          } else if ((fullTag == "</b>" || fullTag == "{\\b0}") && bold) {
+            bold = false;
+          } else if (fullTag == "<i>" || fullTag == "{\\i1}") {
+            italic = true;
+          } else if ((fullTag == "</i>" || fullTag == "{\\i0}") && italic) {
+            italic = false;
+          } else if ((fullTag == "</font>" || fullTag == "{\\c}") && color != -1) {
+            color = -1;
+          } else if (fullTag.substr(0,5) == "<font") {
+            if (m_font_color_html.RegFind(fullTag.c_str(), 5) >= 0)
+              color = Hex2Int(m_font_color_html.GetMatch(1).c_str());
+          } else if (m_font_color_curly.RegFind(fullTag.c_str(), 0) >= 0) {
+            string t = m_font_color_curly.GetMatch(3) + m_font_color_curly.GetMatch(2)
+              + m_font_color_curly.GetMatch(1);
+            color = Hex2Int(t.c_str());
+          }
+        }
+      }
+
+      return parsed;
+    }
+
+  private:
+    static int Hex2Int(const char *hex) {
+      int r = 0;
+      for (int i = 0, f = 20; i < 6; i++, f -= 4)
+        if (hex[i] >= 'a')
+          r += (hex[i] - 87) << f;
+        else
+          r += (hex[i] - 48) << f;
+      return r;
+    }
+
+    CRegExp m_tags;
+    CRegExp m_font_color_html;
+    CRegExp m_font_color_curly;
+  };
+
+  Parsed ParseTags(const vector<string>& lines) {
+    Parsed parsed(lines.size());
+    SubtitleTags tags;
+
+    for (size_t i = 0; i < lines.size(); i++) {
+      const char *line = lines[i].data();
+      tags.start(line, line + lines[i].length());
+
+      const char *text, *text_end;
+      while (tags.next(text, text_end)) {
+        Run run = { string(text, text_end), Font(tags.bold, tags.italic), tags.color };
+        parsed[i].push_back(run);
+      }
+    }
+
+    return parsed;
+  }
+
+  // Tags, near misses and text that lines are assembled from
+  const char *pieces[] = {
+    "<b>", "</b>", "<i>", "</i>", "</font>", "<u>", "</u>", "<br/>",
+    "{\\b1}", "{\\b0}", "{\\i1}", "{\\i0}", "{\\c}", "{\\an8}", "{\\pos(320,50)}",
+    "{\\b1\\i1}", "{\\fad(200,200)}", "{\\c&H00FFFF&}", "{\\c&h1a2B3c&}",
+    "{\\c&H00FFFF}", "{\\c&H00FFF&}", "{\\c&H00FFFFF&}", "{\\1c&H00FFFF&}",
+    "<font color=\"#ff8000\">", "<font color='00ff00'>", "<font color=#abcdef>",
+    "<font  color = \t\"#123456\">", "<font face=\"Arial\" color=\"#fedcba\">",
+    "<font color=\"red\">", "<font color=\"#12345\">", "<font color=\"#1234567\">",
+    "<font size=20>", "<fontcolor=#010203>", "<font color=#zz0000>",
+    "<font color color=#445566>", "<b color=#778899>",
+    "<", ">", "{", "}", "{\\", "\\", "<>", "{\\}", "&", "#",
+    "color=#102030", "Hello", " world", ", ", "...", "\t", "-", "\xc3\xa9t\xc3\xa9",
+  };
+
+  string RandomLine(mt19937& rng) {
+    const size_t count = sizeof(pieces) / sizeof(pieces[0]);
+    string line;
+    int n = rng() % 12;
+    for (int i = 0; i < n; i++) {
+      string piece = pieces[rng() % count];
+      if (rng() % 3 == 0)
+        for (char& c : piece)
+          c = rng() % 2 ? toupper((unsigned char)c) : tolower((unsigned char)c);
+      line += piece;
+    }
+    return line;
+  }
+
+  void PrintRuns(const char* name, const Parsed& parsed) {
+    printf("  %s:\n", name);
+    for (size_t i = 0; i < parsed.size(); i++)
+      for (const Run& run : parsed[i])
+        printf("    line %zu font %d color %6x \"%s\"\n", i, run.font, run.color, run.text.c_str());
+  }
+
+  void PrintUsage() {
+    printf("Usage: tags-bench.bin [options] [file.srt...]\n"
+           "    --subtitles n     Random subtitles to compare the parsers on (default: 200000)\n"
+           "    --seed n          Seed for the random subtitles (default: 1)\n"
+           "    --repeat n        Times to parse each subtitle when timing (default: 1000)\n");
+  }
+
+  double Elapsed(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+  }
+
+  template <typename F>
+  double TimeParse(const vector<vector<string> >& subtitles, int repeat, F parse) {
+    size_t runs = 0;
+    auto start = chrono::steady_clock::now();
+    for (int r = 0; r < repeat; r++)
+      for (const auto& lines : subtitles)
+        runs += parse(lines).size();
+    double us = Elapsed(start);
+    if (runs == 0) printf("  no lines parsed\n");
+    return us / repeat / subtitles.size();
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int count = 200000;
+  unsigned int seed = 1;
+  int repeat = 1000;
+
+  const int subtitles_opt = 0x100;
+  const int seed_opt      = 0x101;
+  const int repeat_opt    = 0x102;
+
+  struct option longopts[] = {
+    { "subtitles",    required_argument,  NULL,          subtitles_opt },
+    { "seed",         required_argument,  NULL,          seed_opt },
+    { "repeat",       required_argument,  NULL,          repeat_opt },
+    { "help",         no_argument,        NULL,          'h' },
+    { 0, 0, 0, 0 }
+  };
+
+  int c;
+  while ((c = getopt_long(argc, argv, "h", longopts, NULL)) != -1) {
+    switch (c) {
+      case subtitles_opt:
+        count = max(atoi(optarg), 0);
+        break;
+      case seed_opt:
+        seed = strtoul(optarg, NULL, 10);
+        break;
+      case repeat_opt:
+        repeat = max(atoi(optarg), 1);
+        break;
+      default:
+        PrintUsage();
+        return c == 'h' ? 0 : 1;
+    }
+  }
+
+  RegexParser regex_parser;
+
+  // the tag state carries over between the lines of a subtitle, so they
+  // are compared a few lines at a time
+  mt19937 rng(seed);
+  int mismatches = 0;
+  for (int i = 0; i < count; i++) {
+    vector<string> lines(1 + rng() % 3);
+    for (string& line : lines)
+      line = RandomLine(rng);
+
+    Parsed expected = regex_parser.Parse(lines);
+    Parsed parsed = ParseTags(lines);
+    if (parsed != expected) {
+      if (mismatches++ < 5) {
+        printf("Mismatch on subtitle %d:\n", i);
+        for (const string& line : lines)
+          printf("  \"%s\"\n", line.c_str());
+        PrintRuns("expressions", expected);
+        PrintRuns("parser", parsed);
+      }
+    }
+  }
+  printf("%d random subtitles compared, %d mismatches\n", count, mismatches);
+
+  vector<vector<string> > subtitles;
+  for (int i = optind; i < argc; i++) {
+    vector<Subtitle> file;
+    if (!ReadSrt(argv[i], file)) {
+      fprintf(stderr, "Unable to read %s\n", argv[i]);
+      return 1;
+    }
+    for (const Subtitle& sub : file)
+      if (!sub.isImage)
+        subtitles.push_back(sub.text_lines);
+  }
+  if (optind >= argc) {
+    subtitles.push_back({
+      "{\\an8}{\\fad(150,150)}{\\c&H00FFFF&}{\\b1}Captain{\\b0}{\\c}, {\\i1}the readings{\\i0} are {\\c&H0000FF&}off the scale{\\c}!",
+      "<font color=\"#ffcc00\"><b>WARNING</b></font> <i>hull breach on deck <b>7</b></i>",
+      "{\\pos(320,50)}{\\c&HFFFFFF&}{\\i1}Evacuate{\\i0} {\\b1}now{\\b0}{\\c}",
+    });
+  }
+
+  if (!subtitles.empty()) {
+    double regex_us = TimeParse(subtitles, repeat, [&](const vector<string>& lines) { return regex_parser.Parse(lines); });
+    double parser_us = TimeParse(subtitles, repeat, ParseTags);
+    printf("%zu subtitles, per subtitle: expressions %.2f us, parser %.2f us\n",
+           subtitles.size(), regex_us, parser_us);
+  }
+
+  return mismatches ? 1 : 0;
+}
@@ -0,0 +1,504 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "TimeshiftBuffer.h"
+#include "utils/log.h"
+
+// Each write to the ring file is a whole block
+#define BLOCK_SIZE           (1024 * 1024)
+// Blocks in memory, for what's not written yet
+#define BLOCKS               4
+// Bytes asked of the protocol at a time
+#define READ_SIZE            (64 * 1024)
+// How often a waiting read checks the interrupt callback
+#define WAIT_MS              100
+#define RECONNECT_MIN_MS     100
+#define RECONNECT_MAX_MS     2000
+// Time between index entries, and how far behind the live edge playback
+// has to be to count as timeshifted, in 90 kHz units
+#define INDEX_INTERVAL       45000
+#define BEHIND_LIVE          (3 * 90000)
+
+#define TS_PACKET_SIZE       188
+#define PCR_WRAP             (1LL << 33)
+// PCRs further apart than this are a discontinuity
+#define PCR_JUMP             (10 * 90000)
+
+TimeshiftBuffer::TimeshiftBuffer()
+: m_options(NULL), m_io(NULL), m_fd(-1), m_size(0), m_start(0), m_flushed(0), m_end(0), m_pos(0),
+  m_carry_size(0), m_pcr_pid(-1), m_last_pcr(-1), m_pcr_wrap(0), m_pcr_offset(0)
+{
+  m_interrupt.callback = NULL;
+  m_interrupt.opaque = NULL;
+  memset(&m_stats, 0, sizeof(m_stats));
+}
+
+TimeshiftBuffer::~TimeshiftBuffer()
+{
+  Close();
+}
+
+bool TimeshiftBuffer::Open(const std::string &url, AVDictionary *options, const std::string &path, size_t size,
+                           float timeout, const AVIOInterruptCB &int_cb)
+{
+  Close();
+
+  m_url       = url;
+  m_interrupt = int_cb;
+  av_dict_copy(&m_options, options, 0);
+  if (timeout > 0)
+    av_dict_set_int(&m_options, "rw_timeout", (int64_t)(timeout * 1e6), AV_DICT_DONT_OVERWRITE);
+
+  // whole blocks, and more of them than are kept in memory
+  m_size = std::max((int64_t)size / BLOCK_SIZE, (int64_t)BLOCKS * 2) * BLOCK_SIZE;
+
+  m_fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (m_fd == -1)
+  {
+    CLog::Log(LOGERROR, "TimeshiftBuffer: unable to open %s: %s", path.c_str(), strerror(errno));
+    av_dict_free(&m_options);
+    return false;
+  }
+  unlink(path.c_str());
+  // allocated up front, so writing never has to wait for the file system
+  // to find space
+  int ret = posix_fallocate(m_fd, 0, m_size);
+  if (ret == EOPNOTSUPP || ret == EINVAL)
+    ret = ftruncate(m_fd, m_size) == 0 ? 0 : errno;
+  if (ret != 0)
+  {
+    CLog::Log(LOGERROR, "TimeshiftBuffer: unable to allocate %lld MB for %s: %s", (long long)(m_size >> 20),
+              path.c_str(), strerror(ret));
+    close(m_fd);
+    m_fd = -1;
+    av_dict_free(&m_options);
+    return false;
+  }
+
+  if (!Connect())
+  {
+    close(m_fd);
+    m_fd = -1;
+    av_dict_free(&m_options);
+    return false;
+  }
+
+  m_blocks.clear();
+  for (int i = 0; i < BLOCKS; i++)
+    m_blocks.emplace_back(new uint8_t[BLOCK_SIZE]);
+  m_start      = 0;
+  m_flushed    = 0;
+  m_end        = 0;
+  m_pos        = 0;
+  m_carry_size = 0;
+  m_pcr_pid    = -1;
+  m_last_pcr   = -1;
+  m_pcr_wrap   = 0;
+  m_pcr_offset = 0;
+  m_index.clear();
+  memset(&m_stats, 0, sizeof(m_stats));
+  m_stats.size = m_size;
+
+  CLog::Log(LOGDEBUG, "TimeshiftBuffer: %s into %s, %lld MB", m_url.c_str(), path.c_str(), (long long)(m_size >> 20));
+
+  m_writer.reset(new Writer(this));
+  m_writer->Create();
+  Create();
+  return true;
+}
+
+void TimeshiftBuffer::Close()
+{
+  if (Running())
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_bStop = true;
+    }
+    m_cond.notify_all();
+    StopThread();
+    m_writer->StopThread();
+
+    TimeshiftStats stats = GetTimeshiftStats();
+    CLog::Log(LOGDEBUG, "TimeshiftBuffer: %lld MB received, %lld MB written at %.1f MB/s, %u overruns, "
+              "%u times lapped, %u reconnects", (long long)(stats.received >> 20), (long long)(stats.written >> 20),
+              stats.write_ms > 0 ? stats.written * 1000.0 / stats.write_ms / (1 << 20) : 0.0,
+              stats.overruns, stats.lapped, stats.reconnects);
+  }
+  m_writer.reset();
+
+  if (m_io)
+    avio_closep(&m_io);
+
+  if (m_fd != -1)
+  {
+    close(m_fd);
+    m_fd = -1;
+  }
+  m_blocks.clear();
+  m_index.clear();
+  av_dict_free(&m_options);
+}
+
+TimeshiftBuffer::TimeshiftStats TimeshiftBuffer::GetTimeshiftStats()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  TimeshiftStats stats = m_stats;
+  stats.used   = m_end - m_start;
+  stats.behind = m_end - m_pos;
+  return stats;
+}
+
+int TimeshiftBuffer::Interrupted(void *opaque)
+{
+  TimeshiftBuffer *buffer = (TimeshiftBuffer *)opaque;
+  return buffer->m_bStop;
+}
+
+bool TimeshiftBuffer::Connect()
+{
+  const AVIOInterruptCB int_cb = { Interrupted, this };
+  AVDictionary *options = NULL;
+  av_dict_copy(&options, m_options, 0);
+
+  int ret = avio_open2(&m_io, m_url.c_str(), AVIO_FLAG_READ, &int_cb, &options);
+  av_dict_free(&options);
+  if (ret < 0)
+  {
+    if (ret != AVERROR_EXIT)
+      CLog::Log(LOGERROR, "TimeshiftBuffer: unable to open %s (%d)", m_url.c_str(), ret);
+    m_io = NULL;
+    return false;
+  }
+  return true;
+}
+
+// Records the stream into the blocks
+void TimeshiftBuffer::Process()
+{
+  int backoff_ms = 0;
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_bStop)
+  {
+    if (!m_io)
+    {
+      if (backoff_ms)
+        m_cond.wait_for(lock, std::chrono::milliseconds(backoff_ms));
+      if (m_bStop)
+        break;
+      lock.unlock();
+      bool ok = Connect();
+      lock.lock();
+      backoff_ms = ok ? 0 : backoff_ms ? std::min(backoff_ms * 2, RECONNECT_MAX_MS) : RECONNECT_MIN_MS;
+      continue;
+    }
+
+    // every block is waiting to be written
+    if (m_end / BLOCK_SIZE - m_flushed / BLOCK_SIZE >= BLOCKS)
+    {
+      m_stats.overruns++;
+      while (!m_bStop && m_end / BLOCK_SIZE - m_flushed / BLOCK_SIZE >= BLOCKS)
+        m_cond.wait(lock);
+      continue;
+    }
+
+    int64_t pos = m_end;
+    int at = (int)(pos % BLOCK_SIZE);
+    uint8_t *block = m_blocks[pos / BLOCK_SIZE % BLOCKS].get();
+    lock.unlock();
+
+    // whatever has arrived, rather than waiting for all of it
+    int n = avio_read_partial(m_io, block + at, std::min(BLOCK_SIZE - at, READ_SIZE));
+    if (n > 0)
+      Scan(block + at, n, pos);
+
+    lock.lock();
+    if (n > 0)
+    {
+      m_end += n;
+      m_stats.received += n;
+      m_cond.notify_all();
+      continue;
+    }
+
+    if (m_bStop)
+      break;
+
+    // a live stream that ends has dropped
+    CLog::Log(LOGWARNING, "TimeshiftBuffer: %s at %lld, reconnecting",
+              n == 0 || n == AVERROR_EOF ? "connection closed" : "read failed", (long long)m_end);
+    m_stats.reconnects++;
+    lock.unlock();
+    avio_closep(&m_io);
+    lock.lock();
+  }
+}
+
+// Writes each block to the ring file once it's full
+void TimeshiftBuffer::WriteLoop()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_bStop)
+  {
+    if (m_end - m_flushed < BLOCK_SIZE)
+    {
+      m_cond.wait(lock);
+      continue;
+    }
+
+    int64_t pos = m_flushed;
+    // what's about to be overwritten is no longer in the ring
+    m_start = std::max(m_start, pos + BLOCK_SIZE - m_size);
+    Trim();
+    const uint8_t *block = m_blocks[pos / BLOCK_SIZE % BLOCKS].get();
+    lock.unlock();
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ssize_t written = 0;
+    while (written < BLOCK_SIZE)
+    {
+      ssize_t n = pwrite(m_fd, block + written, BLOCK_SIZE - written, pos % m_size + written);
+      if (n <= 0)
+      {
+        if (n < 0 && errno == EINTR)
+          continue;
+        break;
+      }
+      written += n;
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    lock.lock();
+    if (written < BLOCK_SIZE)
+    {
+      // the stream goes on from the blocks, with a gap where this one was
+      CLog::Log(LOGERROR, "TimeshiftBuffer: unable to write at %lld: %s", (long long)pos, strerror(errno));
+      m_start = std::max(m_start, pos + BLOCK_SIZE);
+      Trim();
+    }
+    else
+    {
+      m_stats.written += BLOCK_SIZE;
+      m_stats.write_ms += ms;
+    }
+    m_flushed = pos + BLOCK_SIZE;
+    m_cond.notify_all();
+  }
+}
+
+// Drops index entries no longer in the ring. Called with m_mutex held.
+void TimeshiftBuffer::Trim()
+{
+  while (!m_index.empty() && m_index.front().pos < m_start)
+    m_index.pop_front();
+}
+
+// Goes through the transport stream packets in data, the stream from pos,
+// for the index
+void TimeshiftBuffer::Scan(const uint8_t *data, int size, int64_t pos)
+{
+  const uint8_t *end = data + size;
+
+  if (m_carry_size)
+  {
+    int n = std::min(TS_PACKET_SIZE - m_carry_size, size);
+    memcpy(m_carry + m_carry_size, data, n);
+    m_carry_size += n;
+    data += n;
+    if (m_carry_size < TS_PACKET_SIZE)
+      return;
+    ScanPacket(m_carry, pos - (m_carry_size - n));
+    m_carry_size = 0;
+  }
+
+  while (data < end)
+  {
+    // find the sync byte again after garbage
+    if (*data != 0x47)
+    {
+      data++;
+      continue;
+    }
+    if (end - data < TS_PACKET_SIZE)
+    {
+      m_carry_size = end - data;
+      memcpy(m_carry, data, m_carry_size);
+      return;
+    }
+    ScanPacket(data, pos + (data - (end - size)));
+    data += TS_PACKET_SIZE;
+  }
+}
+
+void TimeshiftBuffer::ScanPacket(const uint8_t *packet, int64_t pos)
+{
+  if (packet[0] != 0x47)
+    return;
+
+  // an adaptation field long enough for a PCR, with one
+  int pid = ((packet[1] & 0x1f) << 8) | packet[2];
+  if (!(packet[3] & 0x20) || packet[4] < 7 || !(packet[5] & 0x10))
+    return;
+  // the first pid seen with PCRs is the clock
+  if (m_pcr_pid == -1)
+    m_pcr_pid = pid;
+  if (pid != m_pcr_pid)
+    return;
+
+  int64_t pcr = ((int64_t)packet[6] << 25) | (packet[7] << 17) | (packet[8] << 9) | (packet[9] << 1) | (packet[10] >> 7);
+  pcr += m_pcr_wrap;
+  bool discontinuity = false;
+  if (m_last_pcr != -1)
+  {
+    if (pcr < m_last_pcr - PCR_WRAP / 2)
+    {
+      m_pcr_wrap += PCR_WRAP;
+      pcr += PCR_WRAP;
+    }
+    // the recording time carries on from the last PCR over a
+    // discontinuity, to keep the index in order
+    discontinuity = pcr < m_last_pcr || pcr > m_last_pcr + PCR_JUMP;
+    if (discontinuity)
+      m_pcr_offset += m_last_pcr - pcr;
+  }
+  m_last_pcr = pcr;
+  int64_t time = pcr + m_pcr_offset;
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  // each discontinuity starts an entry, so every entry is on one clock
+  if (m_index.empty() || time - m_index.back().time >= INDEX_INTERVAL || discontinuity)
+  {
+    IndexEntry entry = { pos, pcr, time };
+    m_index.push_back(entry);
+  }
+}
+
+int TimeshiftBuffer::Read(uint8_t *buf, int size)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  for (;;)
+  {
+    // overwritten while paused: carry on from the oldest there is, at a
+    // packet if there's one
+    if (m_pos < m_start)
+    {
+      Trim();
+      m_pos = m_index.empty() ? m_start : m_index.front().pos;
+      m_stats.lapped++;
+    }
+
+    int64_t pos = m_pos;
+    if (pos < m_flushed)
+    {
+      int n = (int)std::min(std::min((int64_t)size, m_flushed - pos), m_size - pos % m_size);
+      lock.unlock();
+      ssize_t ret = pread(m_fd, buf, n, pos % m_size);
+      int err = errno;
+      lock.lock();
+      // unless it was overwritten meanwhile
+      if (pos < m_start || m_pos != pos)
+        continue;
+      if (ret <= 0)
+        return ret < 0 ? AVERROR(err) : AVERROR(EIO);
+      m_pos += ret;
+      return ret;
+    }
+
+    if (pos < m_end)
+    {
+      int n = (int)std::min(std::min((int64_t)size, m_end - pos), (int64_t)(BLOCK_SIZE - pos % BLOCK_SIZE));
+      memcpy(buf, m_blocks[pos / BLOCK_SIZE % BLOCKS].get() + pos % BLOCK_SIZE, n);
+      m_pos += n;
+      return n;
+    }
+
+    if (m_interrupt.callback && m_interrupt.callback(m_interrupt.opaque))
+      return AVERROR_EXIT;
+    m_cond.wait_for(lock, std::chrono::milliseconds(WAIT_MS));
+  }
+}
+
+int64_t TimeshiftBuffer::Seek(int64_t offset, int whence)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  // the stream so far, for byte seeks to be clamped to
+  if (whence == AVSEEK_SIZE)
+    return m_end;
+
+  int64_t pos;
+  switch (whence & ~AVSEEK_FORCE)
+  {
+    case SEEK_SET: pos = offset; break;
+    case SEEK_CUR: pos = m_pos + offset; break;
+    case SEEK_END: pos = m_end + offset; break;
+    default:       return -1;
+  }
+
+  m_pos = std::min(std::max(pos, m_start), m_end);
+  return m_pos;
+}
+
+bool TimeshiftBuffer::TimeToPosition(int64_t &pts, int64_t &pos)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Trim();
+  if (m_index.empty())
+    return false;
+
+  // pts is on the clock of the entry being read, which places it in
+  // recording time
+  std::deque<IndexEntry>::iterator it = std::upper_bound(m_index.begin(), m_index.end(), m_pos,
+    [](int64_t pos, const IndexEntry &entry) { return pos < entry.pos; });
+  if (it != m_index.begin())
+    --it;
+  int64_t target = pts * 9 / 100 + it->time - it->pcr;
+
+  // the last entry at or before it, or the nearest end of the ring
+  it = std::upper_bound(m_index.begin(), m_index.end(), target,
+    [](int64_t time, const IndexEntry &entry) { return time < entry.time; });
+  if (it != m_index.begin())
+    --it;
+
+  pos = it->pos;
+  pts = it->pcr * 100 / 9;
+  return true;
+}
+
+bool TimeshiftBuffer::IsBehindLive()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_index.empty())
+    return m_end - m_pos > BLOCK_SIZE;
+
+  std::deque<IndexEntry>::iterator it = std::upper_bound(m_index.begin(), m_index.end(), m_pos,
+    [](int64_t pos, const IndexEntry &entry) { return pos < entry.pos; });
+  if (it != m_index.begin())
+    --it;
+  return m_index.back().time - it->time > BEHIND_LIVE;
+}
@@ -0,0 +1,140 @@
+#pragma once
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avio.h>
+#include <libavutil/dict.h>
+};
+
+#include "OMXThread.h"
+
+// Records a live transport stream into a ring file of fixed size on disk
+// and plays from there, so a paused or rewound stream keeps recording
+// without the memory use growing. The recording thread reads the stream
+// into a few blocks in memory, and a writer thread writes each one to the
+// ring file once it's full, in one write. The file is allocated up front.
+// What isn't written yet is read from the blocks.
+//
+// The PCRs seen while recording index the ring by time, so seeks are made
+// by byte position and can't go past either end of the ring: seeking
+// forward past the live edge catches up with it. The index keeps each
+// PCR as the demuxer sees it, so pts can be compared with it, and a
+// recording time that carries on across discontinuities to order it.
+class TimeshiftBuffer : public OMXThread
+{
+public:
+  struct TimeshiftStats
+  {
+    int64_t      received;     // bytes
+    int64_t      written;      // bytes
+    double       write_ms;     // time spent writing them
+    int64_t      size;         // of the ring
+    int64_t      used;         // bytes of the stream in the ring
+    int64_t      behind;       // bytes between the read position and the live edge
+    unsigned int overruns;     // times recording waited for the disk
+    unsigned int lapped;       // times the reader fell out of the ring
+    unsigned int reconnects;
+  };
+
+  TimeshiftBuffer();
+  ~TimeshiftBuffer();
+
+  // options go to the protocol on each connect. size is the size of the
+  // ring file at path in bytes. A connection that drops, or stalls for
+  // timeout, is opened again. Reads give up waiting when int_cb says so.
+  bool Open(const std::string &url, AVDictionary *options, const std::string &path, size_t size,
+            float timeout, const AVIOInterruptCB &int_cb);
+  void Close();
+
+  int Read(uint8_t *buf, int size);
+  int64_t Seek(int64_t offset, int whence);
+  // Finds where in the ring to read from for pts, in AV_TIME_BASE units,
+  // and the pts found there. pts is taken to be on the clock of what's
+  // being read, and the distance from there is kept across
+  // discontinuities.
+  bool TimeToPosition(int64_t &pts, int64_t &pos);
+  // Whether playback is more than a few seconds behind the live edge
+  bool IsBehindLive();
+  TimeshiftStats GetTimeshiftStats();
+
+  void Process() override;
+
+private:
+  class Writer : public OMXThread
+  {
+  public:
+    Writer(TimeshiftBuffer *owner) : m_owner(owner) {}
+    void Process() override { m_owner->WriteLoop(); }
+  private:
+    TimeshiftBuffer *m_owner;
+  };
+
+  struct IndexEntry
+  {
+    int64_t pos;
+    int64_t pcr;   // 90 kHz, unwrapped
+    int64_t time;  // 90 kHz, pcr carried on across discontinuities
+  };
+
+  static int Interrupted(void *opaque);
+  bool Connect();
+  void WriteLoop();
+  void Scan(const uint8_t *data, int size, int64_t pos);
+  void ScanPacket(const uint8_t *packet, int64_t pos);
+  void Trim();
+
+  std::string     m_url;
+  AVDictionary   *m_options;
+  AVIOInterruptCB m_interrupt;
+  AVIOContext    *m_io;
+  int             m_fd;
+
+  // The ring file holds [m_start, m_flushed) of the stream, byte n at
+  // n % m_size, and the blocks [m_flushed, m_end), byte n in block
+  // n / BLOCK_SIZE % BLOCKS. Recording writes after m_end with the lock
+  // released.
+  std::vector<std::unique_ptr<uint8_t[]> > m_blocks;
+  int64_t         m_size;
+  int64_t         m_start;
+  int64_t         m_flushed;
+  int64_t         m_end;
+  int64_t         m_pos;
+
+  // only used by the recording thread
+  uint8_t         m_carry[188];
+  int             m_carry_size;
+  int             m_pcr_pid;
+  int64_t         m_last_pcr;
+  int64_t         m_pcr_wrap;   // added to each PCR for wraps
+  int64_t         m_pcr_offset; // added to the unwrapped PCR for the recording time
+
+  std::deque<IndexEntry> m_index;
+  std::unique_ptr<Writer> m_writer;
+
+  TimeshiftStats  m_stats;
+  std::mutex      m_mutex;
+  std::condition_variable m_cond;
+};
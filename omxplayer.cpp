@@ -54,7 +54,6 @@ extern "C" {
 #include "OMXPlayerSubtitles.h"
 #include "OMXControl.h"
 #include "DllOMX.h"
-#include "Srt.h"
 #include "KeyConfig.h"
 #include "utils/Strprintf.h"
 #include "Keyboard.h"
@@ -62,7 +61,9 @@ extern "C" {
 #include "AutoPlaylist.h"
 #include "RecentFileStore.h"
 #include "RecentDVDStore.h"
+#include "ClockSync.h"
 
+#include <chrono>
 #include <string>
 #include <utility>
 
@@ -85,13 +86,17 @@ bool              m_NativeDeinterlace   = false;
 bool              m_HWDecode            = false;
 bool              m_osd                 = true;
 bool              m_no_keys             = false;
+bool              m_prefetch            = true;
 std::string       m_external_subtitles_path;
 bool              m_has_external_subtitles = false;
 std::string       m_dbus_name           = "org.mpris.MediaPlayer2.omxplayer";
+std::string       m_control_socket;
+ClockSync         m_sync;
 float             m_font_size           = 0.055f;
 bool              m_centered            = false;
 bool              m_ghost_box           = true;
 unsigned int      m_subtitle_lines      = 3;
+int               m_subtitle_retention  = 300;
 bool              m_Pause               = false;
 OMXReader         m_omx_reader;
 int               m_audio_index     = -1;
@@ -212,6 +217,22 @@ static void SetSpeed(int iSpeed)
   m_av_clock->OMXSetSpeed(iSpeed, true, true);
 }
 
+// The player's clock as ClockSync sees it
+class SyncClock : public ClockSync::Clock
+{
+public:
+  int64_t MediaTime() override { return m_av_clock->OMXMediaTime(); }
+  int Speed() override { return m_av_clock->OMXPlaySpeed(); }
+  bool Waiting() override { return m_av_clock->OMXIsPaused(); }
+  void SetSpeed(int speed) override
+  {
+    m_av_clock->OMXSetSpeed(speed);
+    // a clock waiting for data picks the speed up when it resumes
+    if (!m_av_clock->OMXIsPaused())
+      m_av_clock->OMXSetSpeed(speed, true, true);
+  }
+};
+
 static float get_display_aspect_ratio(HDMI_ASPECT_T aspect)
 {
   float display_aspect;
@@ -460,6 +481,14 @@ bool IsPipe(const std::string& str)
   return false;
 }
 
+// An option's argument that is a number from min to max and nothing else
+static bool parse_number(const char *arg, double min, double max, double &value)
+{
+  char *end;
+  value = strtod(arg, &end);
+  return end != arg && *end == '\0' && value >= min && value <= max;
+}
+
 static int get_mem_gpu(void)
 {
    char response[80] = "";
@@ -537,6 +566,9 @@ int main(int argc, char *argv[])
   bool                  m_is_dvd              = false;
   bool                  m_is_dvd_device       = false;
   OMXDvdPlayer          *m_DvdPlayer          = NULL;
+  // when the DVD or its track started opening, until the first frame
+  std::chrono::steady_clock::time_point m_dvd_open_time;
+  bool                  m_dvd_first_frame     = false;
   int                   m_incr                = 0;
   int                   m_loop_from           = 0;
   CRBP                  g_RBP;
@@ -551,6 +583,13 @@ int main(int argc, char *argv[])
   bool sentStarted = false;
   float m_threshold      = -1.0f; // amount of audio/video required to come out of buffering
   float m_timeout        = 10.0f; // amount of time file/network operation can stall for before timing out
+  float m_net_cache      = 8.0f; // MB read ahead of http(s)/ftp streams
+  std::string            m_net_cache_file;
+  int m_segment_prefetch = 3; // HLS/DASH segments downloaded ahead
+  std::string            m_timeshift_file;
+  float m_timeshift_size = 1024.0f; // MB of live stream kept on disk
+  bool m_behind_live     = false;
+  float m_pipe_buffer    = 16.0f; // MB read ahead of a pipe
   int m_orientation      = -1; // unset
   float m_fps            = 0.0f; // unset
   TV_DISPLAY_STATE_T   tv_state;
@@ -603,6 +642,17 @@ int main(int argc, char *argv[])
   const int avdict_opt      = 0x401;
   const int track_opt       = 0x402;
   const int start_paused_opt = 0x403;
+  const int subtitle_retention_opt = 0x404;
+  const int no_prefetch_opt = 0x405;
+  const int control_socket_opt = 0x406;
+  const int sync_leader_opt = 0x407;
+  const int sync_follow_opt = 0x408;
+  const int net_cache_opt = 0x409;
+  const int net_cache_file_opt = 0x40a;
+  const int segment_prefetch_opt = 0x40b;
+  const int timeshift_opt = 0x40c;
+  const int timeshift_size_opt = 0x40d;
+  const int pipe_buffer_opt = 0x40e;
 
   struct option longopts[] = {
     { "info",         no_argument,        NULL,          'i' },
@@ -636,6 +686,7 @@ int main(int argc, char *argv[])
     { "no-ghost-box", no_argument,        NULL,          no_ghost_box_opt },
     { "subtitles",    required_argument,  NULL,          subtitles_opt },
     { "lines",        required_argument,  NULL,          lines_opt },
+    { "subtitle-retention", required_argument, NULL,     subtitle_retention_opt },
     { "aspect-mode",  required_argument,  NULL,          aspect_mode_opt },
     { "audio_fifo",   required_argument,  NULL,          audio_fifo_opt },
     { "video_fifo",   required_argument,  NULL,          video_fifo_opt },
@@ -643,16 +694,26 @@ int main(int argc, char *argv[])
     { "video_queue",  required_argument,  NULL,          video_queue_opt },
     { "threshold",    required_argument,  NULL,          threshold_opt },
     { "timeout",      required_argument,  NULL,          timeout_opt },
+    { "net-cache",    required_argument,  NULL,          net_cache_opt },
+    { "net-cache-file", required_argument, NULL,         net_cache_file_opt },
+    { "segment-prefetch", required_argument, NULL,       segment_prefetch_opt },
+    { "timeshift",    required_argument,  NULL,          timeshift_opt },
+    { "timeshift-size", required_argument, NULL,         timeshift_size_opt },
+    { "pipe-buffer",  required_argument,  NULL,          pipe_buffer_opt },
     { "boost-on-downmix", no_argument,    NULL,          boost_on_downmix_opt },
     { "no-boost-on-downmix", no_argument, NULL,          no_boost_on_downmix_opt },
     { "key-config",   required_argument,  NULL,          key_config_opt },
     { "no-osd",       no_argument,        NULL,          no_osd_opt },
     { "no-keys",      no_argument,        NULL,          no_keys_opt },
+    { "no-prefetch",  no_argument,        NULL,          no_prefetch_opt },
     { "orientation",  required_argument,  NULL,          orientation_opt },
     { "fps",          required_argument,  NULL,          fps_opt },
     { "live",         no_argument,        NULL,          live_opt },
     { "layout",       required_argument,  NULL,          layout_opt },
     { "dbus_name",    required_argument,  NULL,          dbus_name_opt },
+    { "control-socket", required_argument, NULL,         control_socket_opt },
+    { "sync-leader",  required_argument,  NULL,          sync_leader_opt },
+    { "sync-follow",  required_argument,  NULL,          sync_follow_opt },
     { "loop",         no_argument,        NULL,          loop_opt },
     { "layer",        required_argument,  NULL,          layer_opt },
     { "alpha",        required_argument,  NULL,          alpha_opt },
@@ -671,6 +732,7 @@ int main(int argc, char *argv[])
   const int playspeed_slow_min = 0, playspeed_slow_max = 7, playspeed_rew_max = 8, playspeed_rew_min = 13, playspeed_normal = 14, playspeed_ff_min = 15, playspeed_ff_max = 19;
   int playspeed_current = playspeed_normal;
   int64_t m_last_check_time = 0;
+  int64_t m_last_checkpoint_time = 0;
   float m_latency = 0.0f;
   int c;
   std::string mode;
@@ -823,6 +885,9 @@ int main(int argc, char *argv[])
       case no_keys_opt:
         m_no_keys = true;
         break;
+      case no_prefetch_opt:
+        m_prefetch = false;
+        break;
       case font_size_opt:
         {
           const int thousands = atoi(optarg);
@@ -844,6 +909,9 @@ int main(int argc, char *argv[])
       case lines_opt:
         m_subtitle_lines = std::max(atoi(optarg), 1);
         break;
+      case subtitle_retention_opt:
+        m_subtitle_retention = atoi(optarg);
+        break;
       case aspect_mode_opt:
         if (optarg) {
           if (!strcasecmp(optarg, "letterbox"))
@@ -886,6 +954,60 @@ int main(int argc, char *argv[])
       case timeout_opt:
         m_timeout = atof(optarg);
         break;
+      case net_cache_opt:
+      {
+        double mb;
+        // it's held in memory, and the size is passed on as a size_t
+        if(!parse_number(optarg, 0, 4095, mb))
+        {
+          printf("Bad argument for --net-cache: %s is not from 0 to 4095 MB\n", optarg);
+          return EXIT_FAILURE;
+        }
+        m_net_cache = mb;
+        break;
+      }
+      case net_cache_file_opt:
+        m_net_cache_file = optarg;
+        break;
+      case segment_prefetch_opt:
+      {
+        double segments;
+        // each one ahead has a thread fetching it
+        if(!parse_number(optarg, 0, 16, segments) || segments != (int)segments)
+        {
+          printf("Bad argument for --segment-prefetch: %s is not from 0 to 16 segments\n", optarg);
+          return EXIT_FAILURE;
+        }
+        m_segment_prefetch = (int)segments;
+        break;
+      }
+      case timeshift_opt:
+        m_timeshift_file = optarg;
+        break;
+      case timeshift_size_opt:
+      {
+        double mb;
+        // the size is passed on as a size_t
+        if(!parse_number(optarg, 1, 4095, mb))
+        {
+          printf("Bad argument for --timeshift-size: %s is not from 1 to 4095 MB\n", optarg);
+          return EXIT_FAILURE;
+        }
+        m_timeshift_size = mb;
+        break;
+      }
+      case pipe_buffer_opt:
+      {
+        double mb;
+        // it's held in memory, and the size is passed on as a size_t
+        if(!parse_number(optarg, 0, 4095, mb))
+        {
+          printf("Bad argument for --pipe-buffer: %s is not from 0 to 4095 MB\n", optarg);
+          return EXIT_FAILURE;
+        }
+        m_pipe_buffer = mb;
+        break;
+      }
       case orientation_opt:
         m_orientation = atoi(optarg);
         break;
@@ -916,6 +1038,23 @@ int main(int argc, char *argv[])
       case dbus_name_opt:
         m_dbus_name = optarg;
         break;
+      case control_socket_opt:
+        m_control_socket = optarg;
+        break;
+      case sync_leader_opt:
+        if(!m_sync.Lead(optarg))
+        {
+          printf("Unable to send the clock to %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case sync_follow_opt:
+        if(!m_sync.Follow(optarg))
+        {
+          printf("Unable to follow the clock at %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
       case loop_opt:
         if(m_incr != 0)
             m_loop_from = m_incr;
@@ -1013,6 +1152,7 @@ int main(int argc, char *argv[])
                                 m_centered,
                                 m_ghost_box,
                                 m_subtitle_lines,
+                                m_subtitle_retention < 0 ? -1 : m_subtitle_retention * 1000,
                                 m_av_clock))
   {
     m_av_clock->OMXStop();
@@ -1123,6 +1263,8 @@ int main(int argc, char *argv[])
     &m_omx_reader,
     m_dbus_name
   );
+  if (!m_control_socket.empty() && !m_omxcontrol.openSocket(m_control_socket))
+    printf("Unable to open control socket %s\n", m_control_socket.c_str());
   if (false == m_no_keys)
   {
     m_keyboard = new Keyboard();
@@ -1143,6 +1285,8 @@ int main(int argc, char *argv[])
   {
     m_has_external_subtitles = false;
     m_audio_extension = false;
+    m_dvd_open_time = std::chrono::steady_clock::now();
+    m_dvd_first_frame = true;
     m_DvdPlayer = new OMXDvdPlayer();
     if(!m_DvdPlayer->Open(m_filename))
       ExitGentlyOnError();
@@ -1159,6 +1303,8 @@ int main(int argc, char *argv[])
 
     if(!m_DvdPlayer->OpenTrack(m_track))
       ExitGentlyOnError();
+    // reading the meta data again can renumber the titles
+    m_track = m_DvdPlayer->GetCurrentTrack();
   }
   else
   {
@@ -1191,6 +1337,10 @@ int main(int argc, char *argv[])
 
   change_track:
 
+  m_omx_reader.SetNetworkCache((size_t)(m_net_cache * 1024 * 1024), m_net_cache_file);
+  m_omx_reader.SetSegmentPrefetch(m_segment_prefetch);
+  m_omx_reader.SetTimeshift(m_timeshift_file, (size_t)(m_timeshift_size * 1024 * 1024));
+  m_omx_reader.SetPipeBuffer((size_t)(m_pipe_buffer * 1024 * 1024));
   if(!m_omx_reader.Open(m_filename, IsURL(m_filename), m_dump_format, m_config_audio.is_live, m_timeout, m_cookie, m_user_agent, m_lavfdopts, m_avdict, m_DvdPlayer))
     ExitGentlyWithMessage("File read error or format not supported");
 
@@ -1310,13 +1460,14 @@ int main(int argc, char *argv[])
 
   if(m_has_subtitle || m_osd)
   {
-    std::vector<Subtitle> external_subtitles;
-    if(m_has_external_subtitles && !ReadSrt(m_external_subtitles_path, external_subtitles))
-       ExitGentlyWithMessage("Unable to read the subtitle file");
-
     if(!m_player_subtitles.Open(m_omx_reader.SubtitleStreamCount(),
-                                std::move(external_subtitles)))
+                                m_has_external_subtitles ? m_external_subtitles_path : "",
+                                m_incr * 1000))
+    {
+      if(m_has_external_subtitles)
+        ExitGentlyWithMessage("Unable to read the subtitle file");
       ExitGentlyOnError();
+    }
 
 	// sub_dim and sub_aspect asre passed through FindDVDSubs in case
 	// the subtitles have a different size
@@ -1384,8 +1535,9 @@ int main(int argc, char *argv[])
   m_av_clock->OMXStateExecute();
   sentStarted = true;
 
-  // forget seek time fo all files being played
-  if(!m_is_dvd_device) m_file_store.forget(m_filename);
+  // warm the cache for the file which plays next
+  if(m_prefetch && !m_is_dvd_device)
+    m_playlist.prefetchNext();
 
   while(!m_stop)
   {
@@ -1395,16 +1547,28 @@ int main(int argc, char *argv[])
     int64_t now = OMXClock::GetAbsoluteClock();
     bool update = false;
     m_chapter_seek = false;
-    if (m_last_check_time == 0 || m_last_check_time + 20000 <= now)
+    // commands from the control socket don't wait for the next check
+    if (m_last_check_time == 0 || m_last_check_time + 20000 <= now || m_omxcontrol.pending())
     {
       update = true;
       m_last_check_time = now;
     }
 
      if (update) {
-       OMXControlResult result = control_err
-                               ? (OMXControlResult)(m_keyboard ? m_keyboard->getEvent() : KeyConfig::ACTION_BLANK)
-                               : m_omxcontrol.getEvent();
+       // without D-Bus the keys aren't sent through it
+       OMXControlResult result = m_omxcontrol.getEvent();
+       if (control_err && result.getKey() == KeyConfig::ACTION_BLANK && m_keyboard)
+         result = m_keyboard->getEvent();
+
+       // followers pause, resume and seek with the leader like this
+       SyncClock sync_clock;
+       int64_t sync_arg = 0;
+       int sync_action = m_sync.Update(m_av_clock ? &sync_clock : NULL, m_Pause, sync_arg);
+       if (result.getKey() == KeyConfig::ACTION_BLANK && sync_action != KeyConfig::ACTION_BLANK)
+       {
+         result = OMXControlResult(sync_action, sync_arg);
+         m_sync.Taken(&sync_clock);
+       }
        double oldPos, newPos;
 
     switch(result.getKey())
@@ -1852,14 +2016,45 @@ int main(int argc, char *argv[])
       float threshold = std::min(0.1f, (float)m_player_audio.GetCacheTotal() * 0.1f);
       bool audio_fifo_low = false, video_fifo_low = false, audio_fifo_high = false, video_fifo_high = false;
 
+      // save the position every 10 seconds, so it survives a crash
+      if(!m_dump_format_exit && m_last_checkpoint_time + 10000000 <= now)
+      {
+        m_last_checkpoint_time = now;
+
+        int t = (int)(stamp*1e-6);
+        if(t > 5)
+        {
+          if(m_is_dvd_device)
+            m_dvd_store.checkpoint(m_track, t);
+          else
+            m_file_store.checkpoint(m_filename, m_track, t);
+        }
+      }
+
       if(m_stats)
       {
         static int count;
         if ((count++ & 7) == 0)
-           printf("M:%lld V:%6.2fs %6dk/%6dk A:%6.2f %6.02fs/%6.02fs Cv:%6uk Ca:%6uk                            \r", stamp,
+        {
+          // timeshift write rate, how full the ring is and how far behind live,
+          // or the pipe's rate, its full and stalled counts
+          char input[48] = "";
+          TimeshiftBuffer::TimeshiftStats ts;
+          PipeReader::PipeStats ps;
+          if (m_omx_reader.GetTimeshiftStats(ts))
+            snprintf(input, sizeof input, " T:%5.1fMB/s %3d%% B:%6lldk",
+               ts.write_ms > 0 ? ts.written * 1000.0 / ts.write_ms / (1 << 20) : 0.0,
+               (int)(100 * ts.used / ts.size), (long long)(ts.behind >> 10));
+          else if (m_omx_reader.GetPipeStats(ps))
+            snprintf(input, sizeof input, " P:%5.1fMB/s F:%u/%u S:%u",
+               ps.receive_ms > 0 ? ps.received * 1000.0 / ps.receive_ms / (1 << 20) : 0.0,
+               ps.pipe_full, ps.ring_full, ps.stalls);
+          printf("M:%lld V:%6.2fs %6dk/%6dk A:%6.2f %6.02fs/%6.02fs Cv:%6uk Ca:%6uk Cs:%5uk%s                    \r", stamp,
                video_fifo, (m_player_video.GetDecoderBufferSize()-m_player_video.GetDecoderFreeSpace())>>10, m_player_video.GetDecoderBufferSize()>>10,
                audio_fifo, m_player_audio.GetDelay(), m_player_audio.GetCacheTotal(),
-               m_player_video.GetCached()>>10, m_player_audio.GetCached()>>10);
+               m_player_video.GetCached()>>10, m_player_audio.GetCached()>>10,
+               (unsigned)(m_player_subtitles.GetMemoryUsage()>>10), input);
+        }
       }
 
       if(m_tv_show_info)
@@ -1899,8 +2094,21 @@ int main(int argc, char *argv[])
         audio_pts == AV_NOPTS_VALUE ? 0.0:audio_fifo, video_pts == AV_NOPTS_VALUE ? 0.0:video_fifo, m_threshold, audio_fifo_low, video_fifo_low, audio_fifo_high, video_fifo_high,
         m_player_audio.GetLevel(), m_player_video.GetLevel(), m_player_audio.GetDelay(), (float)m_player_audio.GetCacheTotal());
 
+      // a timeshifted stream plays at its own pace until it catches up
+      bool behind_live = m_config_audio.is_live && m_omx_reader.IsBehindLive();
+      if (behind_live != m_behind_live)
+      {
+        CLog::Log(LOGDEBUG, "Live: %s live edge\n", behind_live ? "behind" : "back at");
+        if (behind_live && !m_av_clock->OMXIsPaused())
+        {
+          m_av_clock->OMXSetSpeed(S(1.0f));
+          m_av_clock->OMXSetSpeed(S(1.0f), true, true);
+        }
+        m_behind_live = behind_live;
+      }
+
       // keep latency under control by adjusting clock (and so resampling audio)
-      if (m_config_audio.is_live)
+      if (m_config_audio.is_live && !behind_live)
       {
         float latency = AV_NOPTS_VALUE;
         if (m_has_audio && audio_pts != AV_NOPTS_VALUE)
@@ -1943,6 +2151,14 @@ int main(int argc, char *argv[])
         {
           CLog::Log(LOGDEBUG, "Resume %.2f,%.2f (%d,%d,%d,%d) EOF:%d PKT:%p\n", audio_fifo, video_fifo, audio_fifo_low, video_fifo_low, audio_fifo_high, video_fifo_high, m_omx_reader.IsEof(), m_omx_pkt);
           m_av_clock->OMXResume();
+
+          if(m_dvd_first_frame)
+          {
+            m_dvd_first_frame = false;
+            CLog::Log(LOGINFO, "DVD track %d: %lld ms to first frame\n", m_track + 1,
+                (long long)std::chrono::duration_cast<std::chrono::milliseconds>(
+                  std::chrono::steady_clock::now() - m_dvd_open_time).count());
+          }
         }
       }
       else if (m_Pause || audio_fifo_low || video_fifo_low)
@@ -2064,11 +2280,19 @@ do_exit:
   m_incr = 0;
 
   if(!m_stop && !g_abort && m_send_eos) {
+    // finished, so don't resume from the last checkpoint
+    if(m_is_dvd_device)
+      m_dvd_store.forget();
+    else
+      m_file_store.forget(m_filename);
+
     // default to playing next track file
     if(m_next_prev_file == 0) m_next_prev_file = 1;
 
     // if this is a DVD look for next track
     if(m_is_dvd) {
+      m_dvd_open_time = std::chrono::steady_clock::now();
+      m_dvd_first_frame = true;
       if(m_DvdPlayer->ChangeTrack(m_next_prev_file, m_track))
       {
         m_firstfile = false;
@@ -2095,6 +2319,10 @@ do_exit:
       m_dvd_store.remember(m_track, (int)t);
     else
 	  m_file_store.remember(m_filename, m_track, (int)t);
+  } else if(!m_is_dvd_device) {
+    // quit straight away, so don't resume it next time either. This isn't
+    // done as playback starts, so a crash keeps the last checkpoint.
+    m_file_store.forget(m_filename);
   }
 
   if (m_NativeDeinterlace)
@@ -2107,6 +2335,13 @@ do_exit:
     m_BcmHost.vc_tv_hdmi_power_on_explicit_new(HDMI_MODE_HDMI, (HDMI_RES_GROUP_T)tv_state.display.hdmi.group, tv_state.display.hdmi.mode);
   }
 
+  // the socket's thread reads the clock
+  m_omxcontrol.closeSocket();
+
+  if (m_sync.IsFollower())
+    printf("Sync: %s\n", m_sync.Stats().c_str());
+  m_sync.Close();
+
   m_player_subtitles.DeInit();
   m_av_clock->OMXStop();
   m_av_clock->OMXStateIdle();
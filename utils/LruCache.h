@@ -0,0 +1,119 @@
+#pragma once
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+// A least recently used cache. Every entry has a cost (1 by default, or
+// e.g. its size in bytes) and the least recently used entries are evicted
+// once the total cost exceeds max_cost. Not thread safe.
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <utility>
+
+template <typename Key, typename Value>
+class LruCache {
+public:
+  explicit LruCache(size_t max_cost)
+  : max_cost_(max_cost), cost_(0), hits_(0), misses_(0)
+  {}
+
+  LruCache(const LruCache&) = delete;
+  LruCache& operator=(const LruCache&) = delete;
+
+  // Returns a pointer to the cached value, or NULL. A hit makes the entry
+  // the most recently used one.
+  Value *get(const Key& key) {
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      ++misses_;
+      return NULL;
+    }
+    ++hits_;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return &it->second->value;
+  }
+
+  // Like get, but doesn't count as a use
+  bool contains(const Key& key) const {
+    return index_.find(key) != index_.end();
+  }
+
+  Value *put(const Key& key, Value value, size_t cost = 1) {
+    erase(key);
+
+    entries_.push_front(Entry{key, std::move(value), cost});
+    index_[key] = entries_.begin();
+    cost_ += cost;
+
+    // never evict the entry we've just added
+    while (cost_ > max_cost_ && entries_.size() > 1)
+      evict_oldest();
+
+    return &entries_.front().value;
+  }
+
+  void erase(const Key& key) {
+    auto it = index_.find(key);
+    if (it == index_.end()) return;
+    cost_ -= it->second->cost;
+    entries_.erase(it->second);
+    index_.erase(it);
+  }
+
+  void clear() {
+    entries_.clear();
+    index_.clear();
+    cost_ = 0;
+  }
+
+  void set_max_cost(size_t max_cost) {
+    max_cost_ = max_cost;
+    while (cost_ > max_cost_ && !entries_.empty())
+      evict_oldest();
+  }
+
+  size_t size() const { return entries_.size(); }
+  size_t cost() const { return cost_; }
+  size_t max_cost() const { return max_cost_; }
+  size_t hits() const { return hits_; }
+  size_t misses() const { return misses_; }
+
+  float hit_rate() const {
+    return hits_ + misses_ ? (float)hits_ / (hits_ + misses_) : 0.0f;
+  }
+
+private:
+  struct Entry {
+    Key key;
+    Value value;
+    size_t cost;
+  };
+
+  void evict_oldest() {
+    cost_ -= entries_.back().cost;
+    index_.erase(entries_.back().key);
+    entries_.pop_back();
+  }
+
+  std::list<Entry> entries_;
+  std::map<Key, typename std::list<Entry>::iterator> index_;
+  size_t max_cost_;
+  size_t cost_;
+  size_t hits_;
+  size_t misses_;
+};